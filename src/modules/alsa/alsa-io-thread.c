@@ -0,0 +1,424 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/msgobject.h>
+#include <pulsecore/refcnt.h>
+#include <pulsecore/shared.h>
+#include <pulsecore/thread.h>
+
+#include "alsa-util.h"
+#include "alsa-io-thread.h"
+
+struct pa_alsa_io_device {
+    const pa_alsa_io_device_cb *cb;
+    void *userdata;
+
+    pa_usec_t wakeup; /* 0 if the device has no timer */
+    bool pending, on_timeout, failed;
+
+    PA_LLIST_FIELDS(pa_alsa_io_device);
+};
+
+typedef struct io_thread_msg {
+    pa_msgobject parent;
+    pa_alsa_io_thread *thread;
+} io_thread_msg;
+
+PA_DEFINE_PRIVATE_CLASS(io_thread_msg, pa_msgobject);
+#define IO_THREAD_MSG(o) (io_thread_msg_cast(o))
+
+enum {
+    IO_THREAD_MESSAGE_ADD_DEVICE,
+    IO_THREAD_MESSAGE_REMOVE_DEVICE
+};
+
+struct pa_alsa_io_thread {
+    PA_REFCNT_DECLARE;
+
+    pa_core *core;
+    char *name;
+
+    pa_thread *thread;
+    pa_thread_mq thread_mq;
+    pa_rtpoll *rtpoll;
+    io_thread_msg *msg;
+
+    bool realtime;
+    int priority;
+
+    PA_LLIST_HEAD(pa_alsa_io_device, devices);
+
+    /* Duplex mode, only accessed from the IO thread */
+    struct {
+        pa_alsa_io_device *device;
+        snd_pcm_t *pcm;
+    } duplex[2];
+    bool linked;
+};
+
+/* Called from IO context */
+static int io_thread_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    pa_alsa_io_thread *t = IO_THREAD_MSG(o)->thread;
+    pa_alsa_io_device *d = data;
+
+    switch (code) {
+        case IO_THREAD_MESSAGE_ADD_DEVICE:
+            if (d->cb->attach && d->cb->attach(d->userdata, d) < 0)
+                return -1;
+
+            d->pending = true;
+            PA_LLIST_PREPEND(pa_alsa_io_device, t->devices, d);
+            return 0;
+
+        case IO_THREAD_MESSAGE_REMOVE_DEVICE:
+            PA_LLIST_REMOVE(pa_alsa_io_device, t->devices, d);
+
+            if (d->cb->detach)
+                d->cb->detach(d->userdata);
+            return 0;
+    }
+
+    return 0;
+}
+
+/* Called from IO context */
+static void thread_func(void *userdata) {
+    pa_alsa_io_thread *t = userdata;
+
+    pa_assert(t);
+
+    pa_log_debug("Thread starting up");
+
+    if (t->realtime)
+        pa_thread_make_realtime(t->priority);
+
+    pa_thread_mq_install(&t->thread_mq);
+
+    for (;;) {
+        pa_alsa_io_device *d;
+        pa_usec_t now, next = 0;
+        int ret;
+
+        PA_LLIST_FOREACH(d, t->devices) {
+            pa_usec_t sleep_usec = 0;
+
+            if (d->failed)
+                continue;
+
+            if (d->pending) {
+                if (d->cb->process(d->userdata, d->on_timeout, &sleep_usec) < 0) {
+                    d->failed = true;
+                    continue;
+                }
+
+                d->wakeup = sleep_usec > 0 ? pa_rtclock_now() + sleep_usec : 0;
+                d->pending = d->on_timeout = false;
+            }
+
+            if (d->wakeup > 0 && (next == 0 || d->wakeup < next))
+                next = d->wakeup;
+        }
+
+        if (next > 0)
+            pa_rtpoll_set_timer_absolute(t->rtpoll, next);
+        else
+            pa_rtpoll_set_timer_disabled(t->rtpoll);
+
+        if ((ret = pa_rtpoll_run(t->rtpoll)) < 0)
+            goto fail;
+
+        if (ret == 0)
+            goto finish;
+
+        now = pa_rtclock_now();
+
+        PA_LLIST_FOREACH(d, t->devices) {
+            bool on_timeout;
+            int r;
+
+            if (d->failed)
+                continue;
+
+            on_timeout = d->wakeup > 0 && d->wakeup <= now;
+
+            if ((r = d->cb->after_poll(d->userdata, on_timeout)) < 0) {
+                d->failed = true;
+                continue;
+            }
+
+            if (r > 0 || on_timeout) {
+                d->pending = true;
+                d->on_timeout = d->on_timeout || on_timeout;
+            }
+        }
+    }
+
+fail:
+    /* The devices cannot be served anymore, but their owners still need us
+     * to process their messages until they are gone */
+    pa_log("pa_rtpoll_run() failed.");
+    pa_asyncmsgq_wait_for(t->thread_mq.inq, PA_MESSAGE_SHUTDOWN);
+
+finish:
+    pa_log_debug("Thread shutting down");
+}
+
+pa_alsa_io_thread *pa_alsa_io_thread_new(pa_mainloop_api *mainloop, const char *name, bool realtime, int priority) {
+    pa_alsa_io_thread *t;
+    char *thread_name;
+
+    pa_assert(mainloop);
+    pa_assert(name);
+
+    t = pa_xnew0(pa_alsa_io_thread, 1);
+    PA_REFCNT_INIT(t);
+    t->name = pa_xstrdup(name);
+    t->realtime = realtime;
+    t->priority = priority;
+    t->rtpoll = pa_rtpoll_new();
+
+    if (pa_thread_mq_init(&t->thread_mq, mainloop, t->rtpoll) < 0) {
+        pa_log("pa_thread_mq_init() failed.");
+        goto fail;
+    }
+
+    t->msg = pa_msgobject_new(io_thread_msg);
+    t->msg->parent.process_msg = io_thread_process_msg;
+    t->msg->thread = t;
+
+    thread_name = pa_sprintf_malloc("alsa-io-%s", name);
+    t->thread = pa_thread_new(thread_name, thread_func, t);
+    pa_xfree(thread_name);
+
+    if (!t->thread) {
+        pa_log("Failed to create thread.");
+        goto fail;
+    }
+
+    return t;
+
+fail:
+    if (t->msg)
+        pa_msgobject_unref(PA_MSGOBJECT(t->msg));
+
+    pa_thread_mq_done(&t->thread_mq);
+    pa_rtpoll_free(t->rtpoll);
+    pa_xfree(t->name);
+    pa_xfree(t);
+
+    return NULL;
+}
+
+static char *shared_name(const char *name) {
+    return pa_sprintf_malloc("alsa-io-thread-%s", name);
+}
+
+pa_alsa_io_thread *pa_alsa_io_thread_get(pa_core *c, const char *name) {
+    pa_alsa_io_thread *t;
+    char *key;
+
+    pa_assert(c);
+    pa_assert(name);
+
+    key = shared_name(name);
+
+    if ((t = pa_shared_get(c, key)))
+        pa_alsa_io_thread_ref(t);
+    else if ((t = pa_alsa_io_thread_new(c->mainloop, name, c->realtime_scheduling, c->realtime_priority))) {
+        t->core = c;
+        pa_assert_se(pa_shared_set(c, key, t) >= 0);
+    }
+
+    pa_xfree(key);
+
+    return t;
+}
+
+pa_alsa_io_thread *pa_alsa_io_thread_ref(pa_alsa_io_thread *t) {
+    pa_assert(t);
+    pa_assert(PA_REFCNT_VALUE(t) >= 1);
+
+    PA_REFCNT_INC(t);
+
+    return t;
+}
+
+void pa_alsa_io_thread_unref(pa_alsa_io_thread *t) {
+    pa_assert(t);
+    pa_assert(PA_REFCNT_VALUE(t) >= 1);
+
+    if (PA_REFCNT_DEC(t) > 0)
+        return;
+
+    pa_assert(!t->devices);
+
+    if (t->core) {
+        char *key = shared_name(t->name);
+        pa_assert_se(pa_shared_remove(t->core, key) >= 0);
+        pa_xfree(key);
+    }
+
+    pa_asyncmsgq_send(t->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+    pa_thread_free(t->thread);
+
+    pa_thread_mq_done(&t->thread_mq);
+    pa_msgobject_unref(PA_MSGOBJECT(t->msg));
+    pa_rtpoll_free(t->rtpoll);
+
+    pa_xfree(t->name);
+    pa_xfree(t);
+}
+
+pa_rtpoll *pa_alsa_io_thread_get_rtpoll(pa_alsa_io_thread *t) {
+    pa_assert(t);
+
+    return t->rtpoll;
+}
+
+pa_thread_mq *pa_alsa_io_thread_get_thread_mq(pa_alsa_io_thread *t) {
+    pa_assert(t);
+
+    return &t->thread_mq;
+}
+
+pa_alsa_io_device *pa_alsa_io_thread_add_device(pa_alsa_io_thread *t, const pa_alsa_io_device_cb *cb, void *userdata) {
+    pa_alsa_io_device *d;
+
+    pa_assert(t);
+    pa_assert(cb);
+    pa_assert(cb->process);
+    pa_assert(cb->after_poll);
+
+    d = pa_xnew0(pa_alsa_io_device, 1);
+    d->cb = cb;
+    d->userdata = userdata;
+
+    if (pa_asyncmsgq_send(t->thread_mq.inq, PA_MSGOBJECT(t->msg), IO_THREAD_MESSAGE_ADD_DEVICE, d, 0, NULL) < 0) {
+        pa_xfree(d);
+        return NULL;
+    }
+
+    return d;
+}
+
+void pa_alsa_io_thread_remove_device(pa_alsa_io_thread *t, pa_alsa_io_device *d) {
+    pa_assert(t);
+    pa_assert(d);
+
+    pa_asyncmsgq_send(t->thread_mq.inq, PA_MSGOBJECT(t->msg), IO_THREAD_MESSAGE_REMOVE_DEVICE, d, 0, NULL);
+    pa_xfree(d);
+}
+
+static unsigned duplex_index(pa_alsa_direction_t direction) {
+    pa_assert(direction == PA_ALSA_DIRECTION_OUTPUT || direction == PA_ALSA_DIRECTION_INPUT);
+
+    return direction == PA_ALSA_DIRECTION_OUTPUT ? 0 : 1;
+}
+
+/* Called from IO context */
+bool pa_alsa_io_thread_link_pcm(pa_alsa_io_thread *t, pa_alsa_io_device *d, pa_alsa_direction_t direction, snd_pcm_t *pcm) {
+    unsigned i;
+    pa_alsa_io_device *other;
+    snd_pcm_t *other_pcm;
+    int err;
+
+    pa_assert(t);
+    pa_assert(d);
+    pa_assert(pcm);
+
+    i = duplex_index(direction);
+
+    /* Only one device per direction can be linked, on cards with several
+     * the others run on their own */
+    if (t->duplex[i].device && t->duplex[i].device != d)
+        return false;
+
+    t->duplex[i].device = d;
+    t->duplex[i].pcm = pcm;
+
+    other = t->duplex[!i].device;
+    other_pcm = t->duplex[!i].pcm;
+
+    if (!other_pcm || t->linked)
+        return t->linked;
+
+    /* Linked PCMs can only be started together, so if the other one is
+     * already running it needs to start over */
+    if (snd_pcm_state(other_pcm) != SND_PCM_STATE_PREPARED) {
+        pa_log_debug("Restarting the other PCM to link it.");
+
+        snd_pcm_drop(other_pcm);
+
+        if ((err = snd_pcm_prepare(other_pcm)) < 0) {
+            pa_log_warn("snd_pcm_prepare() failed: %s", pa_alsa_strerror(err));
+            return false;
+        }
+
+        if (other->cb->restart)
+            other->cb->restart(other->userdata);
+    }
+
+    if ((err = snd_pcm_link(other_pcm, pcm)) < 0) {
+        pa_log_info("Failed to link playback and capture: %s", pa_alsa_strerror(err));
+        return false;
+    }
+
+    pa_log_info("Linked playback and capture PCM.");
+    t->linked = true;
+
+    if (other->cb->linked)
+        other->cb->linked(other->userdata, true);
+
+    return true;
+}
+
+/* Called from IO context */
+void pa_alsa_io_thread_unlink_pcm(pa_alsa_io_thread *t, pa_alsa_io_device *d) {
+    unsigned i;
+
+    pa_assert(t);
+    pa_assert(d);
+
+    for (i = 0; i < 2; i++) {
+        if (t->duplex[i].device != d)
+            continue;
+
+        if (t->linked) {
+            pa_alsa_io_device *other = t->duplex[!i].device;
+
+            snd_pcm_unlink(t->duplex[i].pcm);
+            t->linked = false;
+
+            if (other && other->cb->linked)
+                other->cb->linked(other->userdata, false);
+        }
+
+        t->duplex[i].device = NULL;
+        t->duplex[i].pcm = NULL;
+    }
+}
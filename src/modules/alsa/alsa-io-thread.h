@@ -0,0 +1,96 @@
+#ifndef fooalsaiothreadhfoo
+#define fooalsaiothreadhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <alsa/asoundlib.h>
+
+#include <pulse/mainloop-api.h>
+#include <pulse/sample.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/thread-mq.h>
+
+#include "alsa-mixer.h"
+
+/* An IO thread that serves several ALSA devices from one rtpoll. Each
+ * device keeps its own wakeup time, the thread sleeps until the earliest
+ * of them and only runs the devices that are due, have poll events or ask
+ * to be run. */
+
+typedef struct pa_alsa_io_thread pa_alsa_io_thread;
+typedef struct pa_alsa_io_device pa_alsa_io_device;
+
+typedef struct pa_alsa_io_device_cb {
+    /* Called from the IO thread when the device is added and removed, to
+     * create and free its rtpoll items. attach() may fail with a negative
+     * return value. */
+    int (*attach)(void *userdata, pa_alsa_io_device *d);
+    void (*detach)(void *userdata);
+
+    /* Called from the IO thread when the device is due. Returns the time
+     * after which it wants to run again in *sleep_usec, 0 for no timeout.
+     * A negative return value disables the device, it is the device's job
+     * to have itself unloaded. */
+    int (*process)(void *userdata, bool on_timeout, pa_usec_t *sleep_usec);
+
+    /* Called from the IO thread after every poll. Returns > 0 if the device
+     * needs to run although its timer did not elapse, and negative on
+     * failure like process(). */
+    int (*after_poll)(void *userdata, bool on_timeout);
+
+    /* Called from the IO thread if the device's PCM was stopped and
+     * prepared again to link it with the PCM of another device. The device
+     * has to forget its position as after an xrun. Only needed for devices
+     * that use pa_alsa_io_thread_link_pcm(). */
+    void (*restart)(void *userdata);
+
+    /* Called from the IO thread if the other device linked its PCM with
+     * ours or unlinked it again. Only needed for devices that use
+     * pa_alsa_io_thread_link_pcm(). */
+    void (*linked)(void *userdata, bool linked);
+} pa_alsa_io_device_cb;
+
+pa_alsa_io_thread *pa_alsa_io_thread_new(pa_mainloop_api *mainloop, const char *name, bool realtime, int priority);
+
+/* Returns a new reference to the IO thread of that name, creating it if
+ * necessary */
+pa_alsa_io_thread *pa_alsa_io_thread_get(pa_core *c, const char *name);
+
+pa_alsa_io_thread *pa_alsa_io_thread_ref(pa_alsa_io_thread *t);
+void pa_alsa_io_thread_unref(pa_alsa_io_thread *t);
+
+pa_rtpoll *pa_alsa_io_thread_get_rtpoll(pa_alsa_io_thread *t);
+pa_thread_mq *pa_alsa_io_thread_get_thread_mq(pa_alsa_io_thread *t);
+
+/* Called from main context, these wait for the IO thread */
+pa_alsa_io_device *pa_alsa_io_thread_add_device(pa_alsa_io_thread *t, const pa_alsa_io_device_cb *cb, void *userdata);
+void pa_alsa_io_thread_remove_device(pa_alsa_io_thread *t, pa_alsa_io_device *d);
+
+/* Duplex mode: the playback and the capture PCM of one card are linked
+ * with snd_pcm_link() while both are open, so that they start and stop
+ * together and their positions advance on the same clock. A device
+ * registers its PCM after opening it and unregisters it before closing it
+ * or recovering from an xrun. If the other PCM is already running it is
+ * stopped and restarted together with the new one. Returns true if the
+ * PCMs are linked now. Called from IO context. */
+bool pa_alsa_io_thread_link_pcm(pa_alsa_io_thread *t, pa_alsa_io_device *d, pa_alsa_direction_t direction, snd_pcm_t *pcm);
+void pa_alsa_io_thread_unlink_pcm(pa_alsa_io_thread *t, pa_alsa_io_device *d);
+
+#endif
@@ -51,6 +51,8 @@
 
 #include "alsa-mixer.h"
 #include "alsa-util.h"
+#include "alsa-path-cache.h"
+#include "alsa-probe-cache.h"
 
 #ifdef HAVE_VALGRIND_MEMCHECK_H
 /* These macros are workarounds for a bug in valgrind, which is not handling the
@@ -2981,7 +2983,7 @@ static char *get_data_path(const char *data_dir, const char *data_type, const ch
 }
 
 pa_alsa_path* pa_alsa_path_new(const char *paths_dir, const char *fname, pa_alsa_direction_t direction) {
-    pa_alsa_path *p;
+    pa_alsa_path *p, *cached;
     char *fn;
     int r;
     const char *n;
@@ -3046,16 +3048,29 @@ pa_alsa_path* pa_alsa_path_new(const char *paths_dir, const char *fname, pa_alsa
 
     fn = get_data_path(paths_dir, "paths", fname);
 
+    if ((cached = pa_alsa_path_cache_get(fn, direction))) {
+        pa_log_info("Using compiled path config: %s", fn);
+        pa_xfree(fn);
+        pa_alsa_path_free(p);
+        p = cached;
+        goto verify;
+    }
+
     pa_log_info("Loading path config: %s", fn);
 
     r = pa_config_parse(fn, NULL, items, p->proplist, false, p);
-    pa_xfree(fn);
 
-    if (r < 0)
+    if (r < 0) {
+        pa_xfree(fn);
         goto fail;
+    }
 
     p->mute_during_activation = mute_during_activation;
 
+    pa_alsa_path_cache_put(fn, direction, p);
+    pa_xfree(fn);
+
+verify:
     if (path_verify(p) < 0)
         goto fail;
 
@@ -4039,6 +4054,7 @@ void pa_alsa_profile_set_free(pa_alsa_profile_set *ps) {
     if (ps->decibel_fixes)
         pa_hashmap_free(ps->decibel_fixes);
 
+    pa_xfree(ps->fname);
     pa_xfree(ps);
 }
 
@@ -4603,7 +4619,7 @@ static void profile_set_set_availability_groups(pa_alsa_profile_set *ps) {
 
 static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
                                 pa_alsa_direction_t direction, pa_hashmap *used_paths,
-                                pa_hashmap *mixers) {
+                                pa_hashmap *mixers, int alsa_card_index) {
 
     pa_alsa_path *p;
     void *state;
@@ -4626,9 +4642,14 @@ static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
     if (!ps)
         return; /* No paths */
 
-    pa_assert(pcm_handle);
-
-    mixer_handle = pa_alsa_open_mixer_for_pcm(mixers, pcm_handle, true);
+    /* Without a PCM, when the probing results came from the cache, the
+     * mixer is opened by card index */
+    if (pcm_handle)
+        mixer_handle = pa_alsa_open_mixer_for_pcm(mixers, pcm_handle, true);
+    else {
+        pa_assert(alsa_card_index >= 0);
+        mixer_handle = pa_alsa_open_mixer(mixers, alsa_card_index, true);
+    }
     if (!mixer_handle) {
         /* Cannot open mixer, remove all entries */
         pa_hashmap_remove_all(ps->paths);
@@ -5072,7 +5093,7 @@ pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel
     pa_log_info("Loading profile set: %s", fn);
 
     r = pa_config_parse(fn, NULL, items, NULL, false, ps);
-    pa_xfree(fn);
+    ps->fname = fn;
 
     if (r < 0)
         goto fail;
@@ -5376,7 +5397,7 @@ void pa_alsa_profile_set_probe(
                     if (p->fallback_output && selected_fallback_output == NULL) {
                         selected_fallback_output = m;
                     }
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixers);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixers, -1);
                 }
 
         if (p->input_mappings)
@@ -5386,7 +5407,7 @@ void pa_alsa_profile_set_probe(
                     if (p->fallback_input && selected_fallback_input == NULL) {
                         selected_fallback_input = m;
                     }
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixers);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixers, -1);
                 }
     }
 
@@ -5405,6 +5426,95 @@ void pa_alsa_profile_set_probe(
     profile_set_set_availability_groups(ps);
 
     ps->probed = true;
+
+    pa_alsa_path_cache_flush();
+}
+
+static bool mapping_restore_from_cache(pa_alsa_mapping *m, pa_alsa_probe_cache_entry *e) {
+    if (m->hw_device_index >= 0)
+        return true;
+
+    return pa_alsa_probe_cache_entry_get_hw_device_index(e, m->name, &m->hw_device_index);
+}
+
+/* Like pa_alsa_profile_set_probe(), but takes the supported profiles from
+ * a cache entry instead of opening the PCMs. Only the mixer paths are
+ * probed. Returns false, leaving the set untouched, if the entry does not
+ * match the set. */
+bool pa_alsa_profile_set_probe_from_cache(
+        pa_alsa_profile_set *ps,
+        pa_hashmap *mixers,
+        int alsa_card_index,
+        pa_alsa_probe_cache_entry *e) {
+
+    pa_alsa_profile *p;
+    pa_alsa_mapping *m;
+    pa_hashmap *used_paths;
+    void *state;
+    uint32_t idx;
+
+    pa_assert(ps);
+    pa_assert(e);
+
+    if (ps->probed)
+        return true;
+
+    /* Check first that every mapping of a supported profile is known */
+    PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+        int hw_device_index;
+
+        if (!pa_alsa_probe_cache_entry_get_supported(e, p->name))
+            continue;
+
+        if (p->output_mappings)
+            PA_IDXSET_FOREACH(m, p->output_mappings, idx)
+                if (!pa_alsa_probe_cache_entry_get_hw_device_index(e, m->name, &hw_device_index))
+                    return false;
+
+        if (p->input_mappings)
+            PA_IDXSET_FOREACH(m, p->input_mappings, idx)
+                if (!pa_alsa_probe_cache_entry_get_hw_device_index(e, m->name, &hw_device_index))
+                    return false;
+    }
+
+    used_paths = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+    PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+        p->supported = pa_alsa_probe_cache_entry_get_supported(e, p->name);
+
+        if (!p->supported)
+            continue;
+
+        pa_log_debug("Profile %s supported (cached).", p->name);
+
+        if (p->output_mappings)
+            PA_IDXSET_FOREACH(m, p->output_mappings, idx) {
+                pa_assert_se(mapping_restore_from_cache(m, e));
+                m->supported++;
+                mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixers, alsa_card_index);
+            }
+
+        if (p->input_mappings)
+            PA_IDXSET_FOREACH(m, p->input_mappings, idx) {
+                pa_assert_se(mapping_restore_from_cache(m, e));
+                m->supported++;
+                mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixers, alsa_card_index);
+            }
+    }
+
+    pa_alsa_profile_set_drop_unsupported(ps);
+
+    paths_drop_unused(ps->input_paths, used_paths);
+    paths_drop_unused(ps->output_paths, used_paths);
+    pa_hashmap_free(used_paths);
+
+    profile_set_set_availability_groups(ps);
+
+    ps->probed = true;
+
+    pa_alsa_path_cache_flush();
+
+    return true;
 }
 
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *ps) {
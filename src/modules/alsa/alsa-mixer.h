@@ -46,6 +46,7 @@ typedef struct pa_alsa_profile pa_alsa_profile;
 typedef struct pa_alsa_decibel_fix pa_alsa_decibel_fix;
 typedef struct pa_alsa_profile_set pa_alsa_profile_set;
 typedef struct pa_alsa_port_data pa_alsa_port_data;
+typedef struct pa_alsa_probe_cache_entry pa_alsa_probe_cache_entry;
 
 #include "alsa-util.h"
 #include "alsa-ucm.h"
@@ -373,6 +374,9 @@ struct pa_alsa_profile_set {
     pa_hashmap *input_paths;
     pa_hashmap *output_paths;
 
+    /* The file the set was loaded from, NULL for UCM */
+    char *fname;
+
     bool auto_profiles;
     bool ignore_dB:1;
     bool probed:1;
@@ -385,6 +389,7 @@ pa_alsa_mapping *pa_alsa_mapping_get(pa_alsa_profile_set *ps, const char *name);
 
 pa_alsa_profile_set* pa_alsa_profile_set_new(const char *fname, const pa_channel_map *bonus);
 void pa_alsa_profile_set_probe(pa_alsa_profile_set *ps, pa_hashmap *mixers, const char *dev_id, const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec);
+bool pa_alsa_profile_set_probe_from_cache(pa_alsa_profile_set *ps, pa_hashmap *mixers, int alsa_card_index, pa_alsa_probe_cache_entry *e);
 void pa_alsa_profile_set_free(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_dump(pa_alsa_profile_set *s);
 void pa_alsa_profile_set_drop_unsupported(pa_alsa_profile_set *s);
@@ -0,0 +1,673 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/database.h>
+#include <pulsecore/dynarray.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/tagstruct.h>
+
+#include "alsa-path-cache.h"
+
+#define ENTRY_VERSION 2
+#define DATABASE_NAME "alsa-mixer-paths"
+
+/* Nesting limit when looking for included files */
+#define MAX_INCLUDE_DEPTH 8
+
+struct file_stamp {
+    char *fn;
+    uint64_t mtime; /* in nanoseconds where the platform has them */
+    uint64_t size;
+};
+
+struct entry {
+    char *key;
+    pa_dynarray *files;
+    uint8_t *data;
+    size_t length;
+    bool dirty;
+};
+
+static pa_static_mutex mutex = PA_STATIC_MUTEX_INIT;
+
+/* Protected by mutex */
+static pa_hashmap *entries = NULL;
+static bool loaded = false;
+
+static void file_stamp_free(struct file_stamp *f) {
+    pa_xfree(f->fn);
+    pa_xfree(f);
+}
+
+static void entry_free(struct entry *e) {
+    pa_xfree(e->key);
+    pa_dynarray_free(e->files);
+    pa_xfree(e->data);
+    pa_xfree(e);
+}
+
+static char *make_key(const char *fn, pa_alsa_direction_t direction) {
+    return pa_sprintf_malloc("%u:%s", (unsigned) direction, fn);
+}
+
+static bool stamp_file(const char *fn, struct file_stamp *f) {
+    struct stat st;
+
+    if (stat(fn, &st) < 0)
+        return false;
+
+    /* Two edits within the same second must not look alike */
+    f->mtime = (uint64_t) st.st_mtime * PA_NSEC_PER_SEC;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    f->mtime += (uint64_t) st.st_mtim.tv_nsec;
+#endif
+    f->size = (uint64_t) st.st_size;
+
+    return true;
+}
+
+/* Adds fn and, recursively, the files it includes, resolved the same way
+ * as pa_config_parse() does */
+static bool collect_files(const char *fn, pa_dynarray *files, unsigned depth) {
+    struct file_stamp *f;
+    FILE *file;
+    char line[4096];
+
+    if (depth > MAX_INCLUDE_DEPTH)
+        return false;
+
+    f = pa_xnew(struct file_stamp, 1);
+    f->fn = pa_xstrdup(fn);
+
+    if (!stamp_file(fn, f)) {
+        file_stamp_free(f);
+        return false;
+    }
+
+    pa_dynarray_append(files, f);
+
+    if (!(file = pa_fopen_cloexec(fn, "r")))
+        return false;
+
+    while (fgets(line, sizeof(line), file)) {
+        char *include, *path = NULL;
+        const char *k;
+        bool ok;
+
+        include = pa_strip(line);
+
+        if (!pa_startswith(include, ".include "))
+            continue;
+
+        include = pa_strip(include + 9);
+
+        if (!pa_is_path_absolute(include) && (k = strrchr(fn, '/'))) {
+            char *dir = pa_xstrndup(fn, k - fn);
+            include = path = pa_sprintf_malloc("%s" PA_PATH_SEP "%s", dir, include);
+            pa_xfree(dir);
+        }
+
+        ok = collect_files(include, files, depth + 1);
+        pa_xfree(path);
+
+        if (!ok) {
+            fclose(file);
+            return false;
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+static bool files_valid(pa_dynarray *files) {
+    struct file_stamp *f, now;
+    unsigned idx;
+
+    PA_DYNARRAY_FOREACH(f, files, idx)
+        if (!stamp_file(f->fn, &now) || now.mtime != f->mtime || now.size != f->size)
+            return false;
+
+    return true;
+}
+
+static void encode_path(pa_tagstruct *t, pa_alsa_path *p) {
+    pa_alsa_element *e;
+    pa_alsa_option *o;
+    pa_alsa_jack *j;
+    unsigned n;
+
+    pa_tagstruct_puts(t, p->name);
+    pa_tagstruct_puts(t, p->description_key);
+    pa_tagstruct_puts(t, p->description);
+    pa_tagstruct_putu32(t, p->priority);
+    pa_tagstruct_put_boolean(t, p->mute_during_activation);
+    pa_tagstruct_putu32(t, p->device_port_type);
+    pa_tagstruct_put_boolean(t, p->autodetect_eld_device);
+    pa_tagstruct_puts64(t, p->eld_device);
+    pa_tagstruct_put_boolean(t, p->has_req_any);
+    pa_tagstruct_put_proplist(t, p->proplist);
+
+    n = 0;
+    PA_LLIST_FOREACH(e, p->elements)
+        n++;
+    pa_tagstruct_putu32(t, n);
+
+    PA_LLIST_FOREACH(e, p->elements) {
+        pa_tagstruct_puts(t, e->alsa_id.name);
+        pa_tagstruct_puts64(t, e->alsa_id.index);
+        pa_tagstruct_putu8(t, e->direction);
+        pa_tagstruct_putu8(t, e->switch_use);
+        pa_tagstruct_putu8(t, e->volume_use);
+        pa_tagstruct_putu8(t, e->enumeration_use);
+        pa_tagstruct_putu8(t, e->required);
+        pa_tagstruct_putu8(t, e->required_any);
+        pa_tagstruct_putu8(t, e->required_absent);
+        pa_tagstruct_puts64(t, e->constant_volume);
+        pa_tagstruct_putu32(t, e->override_map);
+        pa_tagstruct_put_boolean(t, e->direction_try_other);
+        pa_tagstruct_puts64(t, e->volume_limit);
+
+        /* The masks are only set by override maps */
+        if (e->override_map)
+            pa_tagstruct_put_arbitrary(t, e->masks, sizeof(e->masks));
+
+        n = 0;
+        PA_LLIST_FOREACH(o, e->options)
+            n++;
+        pa_tagstruct_putu32(t, n);
+
+        PA_LLIST_FOREACH(o, e->options) {
+            pa_tagstruct_puts(t, o->alsa_name);
+            pa_tagstruct_puts(t, o->name);
+            pa_tagstruct_puts(t, o->description);
+            pa_tagstruct_putu32(t, o->priority);
+            pa_tagstruct_putu8(t, o->required);
+            pa_tagstruct_putu8(t, o->required_any);
+            pa_tagstruct_putu8(t, o->required_absent);
+        }
+    }
+
+    n = 0;
+    PA_LLIST_FOREACH(j, p->jacks)
+        n++;
+    pa_tagstruct_putu32(t, n);
+
+    PA_LLIST_FOREACH(j, p->jacks) {
+        pa_tagstruct_puts(t, j->name);
+        pa_tagstruct_puts64(t, j->alsa_id.index);
+        pa_tagstruct_putu8(t, j->state_unplugged);
+        pa_tagstruct_putu8(t, j->state_plugged);
+        pa_tagstruct_putu8(t, j->required);
+        pa_tagstruct_putu8(t, j->required_any);
+        pa_tagstruct_putu8(t, j->required_absent);
+        pa_tagstruct_put_boolean(t, j->append_pcm_to_name);
+    }
+}
+
+static int get_enum(pa_tagstruct *t, unsigned max, void *v, size_t size) {
+    uint8_t u;
+
+    if (pa_tagstruct_getu8(t, &u) < 0 || u > max)
+        return -1;
+
+    /* All enums here have the size of an int */
+    pa_assert(size == sizeof(int));
+    *(int *) v = u;
+
+    return 0;
+}
+
+#define GET_ENUM(t, max, v) get_enum((t), (max), &(v), sizeof(v))
+
+static int get_string(pa_tagstruct *t, char **s) {
+    const char *v;
+
+    if (pa_tagstruct_gets(t, &v) < 0)
+        return -1;
+
+    *s = pa_xstrdup(v);
+    return 0;
+}
+
+static int decode_element(pa_tagstruct *t, pa_alsa_path *p) {
+    pa_alsa_element *e;
+    pa_alsa_option *last = NULL;
+    int64_t index, constant_volume, volume_limit;
+    uint32_t n;
+    bool direction_try_other;
+
+    e = pa_xnew0(pa_alsa_element, 1);
+    e->path = p;
+
+    PA_LLIST_INSERT_AFTER(pa_alsa_element, p->elements, p->last_element, e);
+    p->last_element = e;
+
+    if (get_string(t, &e->alsa_id.name) < 0 || !e->alsa_id.name ||
+        pa_tagstruct_gets64(t, &index) < 0 ||
+        GET_ENUM(t, PA_ALSA_DIRECTION_INPUT, e->direction) < 0 ||
+        GET_ENUM(t, PA_ALSA_SWITCH_SELECT, e->switch_use) < 0 ||
+        GET_ENUM(t, PA_ALSA_VOLUME_CONSTANT, e->volume_use) < 0 ||
+        GET_ENUM(t, PA_ALSA_ENUMERATION_SELECT, e->enumeration_use) < 0 ||
+        GET_ENUM(t, PA_ALSA_REQUIRED_ANY, e->required) < 0 ||
+        GET_ENUM(t, PA_ALSA_REQUIRED_ANY, e->required_any) < 0 ||
+        GET_ENUM(t, PA_ALSA_REQUIRED_ANY, e->required_absent) < 0 ||
+        pa_tagstruct_gets64(t, &constant_volume) < 0 ||
+        pa_tagstruct_getu32(t, &e->override_map) < 0 ||
+        pa_tagstruct_get_boolean(t, &direction_try_other) < 0 ||
+        pa_tagstruct_gets64(t, &volume_limit) < 0)
+        return -1;
+
+    e->alsa_id.index = (int) index;
+    e->constant_volume = (long) constant_volume;
+    e->direction_try_other = direction_try_other;
+    e->volume_limit = (long) volume_limit;
+
+    if (e->override_map) {
+        const void *masks;
+
+        if (pa_tagstruct_get_arbitrary(t, &masks, sizeof(e->masks)) < 0)
+            return -1;
+
+        memcpy(e->masks, masks, sizeof(e->masks));
+    }
+
+    if (pa_tagstruct_getu32(t, &n) < 0)
+        return -1;
+
+    for (; n > 0; n--) {
+        pa_alsa_option *o;
+
+        o = pa_xnew0(pa_alsa_option, 1);
+        o->element = e;
+        o->alsa_idx = -1;
+
+        PA_LLIST_INSERT_AFTER(pa_alsa_option, e->options, last, o);
+        last = o;
+
+        if (get_string(t, &o->alsa_name) < 0 || !o->alsa_name ||
+            get_string(t, &o->name) < 0 ||
+            get_string(t, &o->description) < 0 ||
+            pa_tagstruct_getu32(t, &o->priority) < 0 ||
+            GET_ENUM(t, PA_ALSA_REQUIRED_ANY, o->required) < 0 ||
+            GET_ENUM(t, PA_ALSA_REQUIRED_ANY, o->required_any) < 0 ||
+            GET_ENUM(t, PA_ALSA_REQUIRED_ANY, o->required_absent) < 0)
+            return -1;
+
+        p->last_option = o;
+    }
+
+    return 0;
+}
+
+static int decode_jack(pa_tagstruct *t, pa_alsa_path *p) {
+    pa_alsa_jack *j;
+    const char *name;
+    int64_t index;
+    bool append_pcm_to_name;
+
+    if (pa_tagstruct_gets(t, &name) < 0 || !name ||
+        pa_tagstruct_gets64(t, &index) < 0)
+        return -1;
+
+    j = pa_alsa_jack_new(p, NULL, name, (int) index);
+
+    PA_LLIST_INSERT_AFTER(pa_alsa_jack, p->jacks, p->last_jack, j);
+    p->last_jack = j;
+
+    if (GET_ENUM(t, PA_AVAILABLE_YES, j->state_unplugged) < 0 ||
+        GET_ENUM(t, PA_AVAILABLE_YES, j->state_plugged) < 0 ||
+        GET_ENUM(t, PA_ALSA_REQUIRED_ANY, j->required) < 0 ||
+        GET_ENUM(t, PA_ALSA_REQUIRED_ANY, j->required_any) < 0 ||
+        GET_ENUM(t, PA_ALSA_REQUIRED_ANY, j->required_absent) < 0 ||
+        pa_tagstruct_get_boolean(t, &append_pcm_to_name) < 0)
+        return -1;
+
+    j->append_pcm_to_name = append_pcm_to_name;
+
+    return 0;
+}
+
+static pa_alsa_path *decode_path(const uint8_t *data, size_t length, pa_alsa_direction_t direction) {
+    pa_tagstruct *t;
+    pa_alsa_path *p;
+    uint32_t port_type, n;
+    int64_t eld_device;
+    bool mute_during_activation, autodetect_eld_device, has_req_any;
+
+    t = pa_tagstruct_new_fixed(data, length);
+
+    p = pa_xnew0(pa_alsa_path, 1);
+    p->proplist = pa_proplist_new();
+    p->direction = direction;
+
+    if (get_string(t, &p->name) < 0 || !p->name ||
+        get_string(t, &p->description_key) < 0 ||
+        get_string(t, &p->description) < 0 ||
+        pa_tagstruct_getu32(t, &p->priority) < 0 ||
+        pa_tagstruct_get_boolean(t, &mute_during_activation) < 0 ||
+        pa_tagstruct_getu32(t, &port_type) < 0 ||
+        pa_tagstruct_get_boolean(t, &autodetect_eld_device) < 0 ||
+        pa_tagstruct_gets64(t, &eld_device) < 0 ||
+        pa_tagstruct_get_boolean(t, &has_req_any) < 0 ||
+        pa_tagstruct_get_proplist(t, p->proplist) < 0)
+        goto fail;
+
+    p->mute_during_activation = mute_during_activation;
+    p->device_port_type = port_type;
+    p->autodetect_eld_device = autodetect_eld_device;
+    p->eld_device = (int) eld_device;
+    p->has_req_any = has_req_any;
+
+    if (pa_tagstruct_getu32(t, &n) < 0)
+        goto fail;
+
+    for (; n > 0; n--)
+        if (decode_element(t, p) < 0)
+            goto fail;
+
+    if (pa_tagstruct_getu32(t, &n) < 0)
+        goto fail;
+
+    for (; n > 0; n--)
+        if (decode_jack(t, p) < 0)
+            goto fail;
+
+    if (!pa_tagstruct_eof(t))
+        goto fail;
+
+    pa_tagstruct_free(t);
+    return p;
+
+fail:
+    pa_log_debug("Invalid cached data for path %s", pa_strnull(p->name));
+    pa_tagstruct_free(t);
+    pa_alsa_path_free(p);
+    return NULL;
+}
+
+static pa_database *open_database(bool for_write) {
+    pa_database *db;
+    char *state_path;
+
+    if (!(state_path = pa_state_path(NULL, true)))
+        return NULL;
+
+    db = pa_database_open(state_path, DATABASE_NAME, true, for_write);
+    pa_xfree(state_path);
+
+    return db;
+}
+
+static struct entry *entry_read(const char *key, const pa_datum *data) {
+    pa_tagstruct *t;
+    struct entry *e;
+    uint32_t n, length;
+    uint8_t version;
+    const void *blob;
+
+    t = pa_tagstruct_new_fixed(data->data, data->size);
+
+    e = pa_xnew0(struct entry, 1);
+    e->key = pa_xstrdup(key);
+    e->files = pa_dynarray_new((pa_free_cb_t) file_stamp_free);
+
+    if (pa_tagstruct_getu8(t, &version) < 0 || version != ENTRY_VERSION ||
+        pa_tagstruct_getu32(t, &n) < 0)
+        goto fail;
+
+    for (; n > 0; n--) {
+        struct file_stamp *f;
+        const char *fn;
+
+        if (pa_tagstruct_gets(t, &fn) < 0 || !fn)
+            goto fail;
+
+        f = pa_xnew(struct file_stamp, 1);
+        f->fn = pa_xstrdup(fn);
+        pa_dynarray_append(e->files, f);
+
+        if (pa_tagstruct_getu64(t, &f->mtime) < 0 ||
+            pa_tagstruct_getu64(t, &f->size) < 0)
+            goto fail;
+    }
+
+    if (pa_tagstruct_getu32(t, &length) < 0 ||
+        pa_tagstruct_get_arbitrary(t, &blob, length) < 0 ||
+        !pa_tagstruct_eof(t))
+        goto fail;
+
+    e->data = pa_xmemdup(blob, length);
+    e->length = length;
+
+    pa_tagstruct_free(t);
+    return e;
+
+fail:
+    pa_log_debug("Database contains invalid data for key: %s", key);
+    pa_tagstruct_free(t);
+    entry_free(e);
+    return NULL;
+}
+
+static void entry_write(pa_database *db, struct entry *e) {
+    pa_tagstruct *t;
+    pa_datum key, data;
+    struct file_stamp *f;
+    unsigned idx;
+
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu8(t, ENTRY_VERSION);
+
+    pa_tagstruct_putu32(t, pa_dynarray_size(e->files));
+    PA_DYNARRAY_FOREACH(f, e->files, idx) {
+        pa_tagstruct_puts(t, f->fn);
+        pa_tagstruct_putu64(t, f->mtime);
+        pa_tagstruct_putu64(t, f->size);
+    }
+
+    pa_tagstruct_putu32(t, e->length);
+    pa_tagstruct_put_arbitrary(t, e->data, e->length);
+
+    key.data = e->key;
+    key.size = strlen(e->key);
+
+    data.data = (void *) pa_tagstruct_data(t, &data.size);
+
+    if (pa_database_set(db, &key, &data, true) < 0)
+        pa_log_info("Failed to store compiled path %s.", e->key);
+
+    pa_tagstruct_free(t);
+}
+
+/* Called with the mutex held */
+static void ensure_loaded(void) {
+    pa_database *db;
+    pa_datum key;
+    bool done;
+
+    if (!entries)
+        entries = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, (pa_free_cb_t) entry_free);
+
+    if (loaded)
+        return;
+
+    loaded = true;
+
+    if (!(db = open_database(false)))
+        return;
+
+    done = !pa_database_first(db, &key, NULL);
+
+    while (!done) {
+        pa_datum next_key, data;
+        struct entry *e;
+        char *name;
+
+        done = !pa_database_next(db, &key, &next_key, NULL);
+
+        name = pa_xstrndup(key.data, key.size);
+
+        pa_zero(data);
+        if (pa_database_get(db, &key, &data)) {
+            if (!pa_hashmap_get(entries, name) && (e = entry_read(name, &data)))
+                pa_hashmap_put(entries, e->key, e);
+
+            pa_datum_free(&data);
+        }
+
+        pa_xfree(name);
+        pa_datum_free(&key);
+
+        key = next_key;
+    }
+
+    pa_database_close(db);
+
+    pa_log_debug("Loaded %u compiled mixer paths.", pa_hashmap_size(entries));
+}
+
+pa_alsa_path *pa_alsa_path_cache_get(const char *fn, pa_alsa_direction_t direction) {
+    pa_mutex *mx;
+    struct entry *e;
+    pa_alsa_path *p = NULL;
+    char *key;
+
+    pa_assert(fn);
+
+    key = make_key(fn, direction);
+
+    mx = pa_static_mutex_get(&mutex, false, false);
+    pa_mutex_lock(mx);
+
+    ensure_loaded();
+
+    if ((e = pa_hashmap_get(entries, key))) {
+        if (files_valid(e->files))
+            p = decode_path(e->data, e->length, direction);
+
+        if (!p)
+            pa_hashmap_remove_and_free(entries, key);
+    }
+
+    pa_mutex_unlock(mx);
+
+    pa_xfree(key);
+
+    return p;
+}
+
+void pa_alsa_path_cache_put(const char *fn, pa_alsa_direction_t direction, pa_alsa_path *p) {
+    pa_mutex *mx;
+    pa_tagstruct *t;
+    struct entry *e;
+    const uint8_t *data;
+
+    pa_assert(fn);
+    pa_assert(p);
+
+    e = pa_xnew0(struct entry, 1);
+    e->files = pa_dynarray_new((pa_free_cb_t) file_stamp_free);
+
+    if (!collect_files(fn, e->files, 0)) {
+        entry_free(e);
+        return;
+    }
+
+    t = pa_tagstruct_new();
+    encode_path(t, p);
+    data = pa_tagstruct_data(t, &e->length);
+    e->data = pa_xmemdup(data, e->length);
+    pa_tagstruct_free(t);
+
+    e->key = make_key(fn, direction);
+    e->dirty = true;
+
+    mx = pa_static_mutex_get(&mutex, false, false);
+    pa_mutex_lock(mx);
+
+    ensure_loaded();
+
+    pa_hashmap_remove_and_free(entries, e->key);
+    pa_hashmap_put(entries, e->key, e);
+
+    pa_mutex_unlock(mx);
+}
+
+void pa_alsa_path_cache_flush(void) {
+    pa_mutex *mx;
+    pa_database *db = NULL;
+    struct entry *e;
+    void *state;
+
+    mx = pa_static_mutex_get(&mutex, false, false);
+    pa_mutex_lock(mx);
+
+    if (!entries)
+        goto finish;
+
+    PA_HASHMAP_FOREACH(e, entries, state) {
+        if (!e->dirty)
+            continue;
+
+        if (!db && !(db = open_database(true))) {
+            pa_log_info("Failed to open compiled mixer path database.");
+            goto finish;
+        }
+
+        entry_write(db, e);
+        e->dirty = false;
+    }
+
+    if (db) {
+        pa_database_sync(db);
+        pa_database_close(db);
+    }
+
+finish:
+    pa_mutex_unlock(mx);
+}
+
+void pa_alsa_path_cache_clear(void) {
+    pa_mutex *mx;
+
+    mx = pa_static_mutex_get(&mutex, false, false);
+    pa_mutex_lock(mx);
+
+    if (entries) {
+        pa_hashmap_free(entries);
+        entries = NULL;
+    }
+
+    loaded = false;
+
+    pa_mutex_unlock(mx);
+}
@@ -0,0 +1,46 @@
+#ifndef fooalsapathcachehfoo
+#define fooalsapathcachehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "alsa-mixer.h"
+
+/* Every card parses the same mixer path files. The parsed form of each file
+ * is kept in a compact binary encoding, shared by all cards of the process
+ * and stored in the state directory, so that a path can be instantiated
+ * without parsing the file again. Entries are invalidated when the file or
+ * one of the files it includes changes its mtime or size.
+ *
+ * The cache holds paths as they come out of the parser, before
+ * verification, which depends on the locale. All functions may be called
+ * from any thread. */
+
+/* Returns a new path for the file fn, or NULL if there is no valid entry */
+pa_alsa_path *pa_alsa_path_cache_get(const char *fn, pa_alsa_direction_t direction);
+
+/* Adds a freshly parsed path for the file fn */
+void pa_alsa_path_cache_put(const char *fn, pa_alsa_direction_t direction, pa_alsa_path *p);
+
+/* Writes the entries added since the last call to the state directory */
+void pa_alsa_path_cache_flush(void);
+
+/* Drops all entries from memory. The next lookup loads the state directory
+ * again. */
+void pa_alsa_path_cache_clear(void);
+
+#endif
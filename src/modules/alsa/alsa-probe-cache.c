@@ -0,0 +1,612 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+#include <alsa/asoundlib.h>
+
+#ifdef HAVE_ALSA_UCM
+#include <alsa/use-case.h>
+#endif
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/database.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/strbuf.h>
+#include <pulsecore/tagstruct.h>
+#include <pulsecore/thread.h>
+
+#include "alsa-util.h"
+#include "alsa-probe-cache.h"
+
+#define ENTRY_VERSION 1
+#define DATABASE_NAME "alsa-probe-cache"
+
+struct profile_record {
+    char *name;
+    bool supported;
+};
+
+struct mapping_record {
+    char *name;
+    int hw_device_index;
+};
+
+struct pa_alsa_probe_cache_entry {
+    char *checksum;
+    pa_hashmap *profiles;
+    pa_hashmap *mappings;
+};
+
+static void profile_record_free(struct profile_record *r) {
+    pa_xfree(r->name);
+    pa_xfree(r);
+}
+
+static void mapping_record_free(struct mapping_record *r) {
+    pa_xfree(r->name);
+    pa_xfree(r);
+}
+
+static pa_alsa_probe_cache_entry *entry_new(const char *checksum) {
+    pa_alsa_probe_cache_entry *e;
+
+    e = pa_xnew0(pa_alsa_probe_cache_entry, 1);
+    e->checksum = pa_xstrdup(checksum);
+    e->profiles = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, (pa_free_cb_t) profile_record_free);
+    e->mappings = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, (pa_free_cb_t) mapping_record_free);
+
+    return e;
+}
+
+static void entry_add_profile(pa_alsa_probe_cache_entry *e, const char *name, bool supported) {
+    struct profile_record *r;
+
+    r = pa_xnew(struct profile_record, 1);
+    r->name = pa_xstrdup(name);
+    r->supported = supported;
+
+    if (pa_hashmap_put(e->profiles, r->name, r) < 0)
+        profile_record_free(r);
+}
+
+static void entry_add_mapping(pa_alsa_probe_cache_entry *e, const char *name, int hw_device_index) {
+    struct mapping_record *r;
+
+    r = pa_xnew(struct mapping_record, 1);
+    r->name = pa_xstrdup(name);
+    r->hw_device_index = hw_device_index;
+
+    if (pa_hashmap_put(e->mappings, r->name, r) < 0)
+        mapping_record_free(r);
+}
+
+void pa_alsa_probe_cache_entry_free(pa_alsa_probe_cache_entry *e) {
+    pa_assert(e);
+
+    pa_hashmap_free(e->profiles);
+    pa_hashmap_free(e->mappings);
+    pa_xfree(e->checksum);
+    pa_xfree(e);
+}
+
+pa_alsa_probe_cache_entry *pa_alsa_probe_cache_entry_new(pa_alsa_profile_set *ps, const char *checksum) {
+    pa_alsa_probe_cache_entry *e;
+    pa_alsa_profile *p;
+    pa_alsa_mapping *m;
+    void *state;
+    uint32_t idx;
+
+    pa_assert(ps);
+    pa_assert(ps->probed);
+    pa_assert(checksum);
+
+    e = entry_new(checksum);
+
+    /* Unsupported profiles have been dropped from the set by now */
+    PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+        entry_add_profile(e, p->name, p->supported);
+
+        if (p->output_mappings)
+            PA_IDXSET_FOREACH(m, p->output_mappings, idx)
+                entry_add_mapping(e, m->name, m->hw_device_index);
+
+        if (p->input_mappings)
+            PA_IDXSET_FOREACH(m, p->input_mappings, idx)
+                entry_add_mapping(e, m->name, m->hw_device_index);
+    }
+
+    return e;
+}
+
+const char *pa_alsa_probe_cache_entry_get_checksum(pa_alsa_probe_cache_entry *e) {
+    pa_assert(e);
+
+    return e->checksum;
+}
+
+bool pa_alsa_probe_cache_entry_get_supported(pa_alsa_probe_cache_entry *e, const char *profile) {
+    struct profile_record *r;
+
+    pa_assert(e);
+    pa_assert(profile);
+
+    if (!(r = pa_hashmap_get(e->profiles, profile)))
+        return false;
+
+    return r->supported;
+}
+
+bool pa_alsa_probe_cache_entry_get_hw_device_index(pa_alsa_probe_cache_entry *e, const char *mapping, int *hw_device_index) {
+    struct mapping_record *r;
+
+    pa_assert(e);
+    pa_assert(mapping);
+    pa_assert(hw_device_index);
+
+    if (!(r = pa_hashmap_get(e->mappings, mapping)))
+        return false;
+
+    *hw_device_index = r->hw_device_index;
+    return true;
+}
+
+char *pa_alsa_probe_cache_card_key(const char *dev_id) {
+    snd_ctl_t *ctl;
+    snd_ctl_card_info_t *info;
+    char *name, *key = NULL;
+    int err;
+
+    pa_assert(dev_id);
+
+    snd_ctl_card_info_alloca(&info);
+
+    name = pa_sprintf_malloc("hw:%s", dev_id);
+    err = snd_ctl_open(&ctl, name, 0);
+    pa_xfree(name);
+
+    if (err < 0)
+        return NULL;
+
+    if (snd_ctl_card_info(ctl, info) >= 0)
+        key = pa_sprintf_malloc("%s|%s|%s|%s|%s",
+                                pa_strnull(snd_ctl_card_info_get_driver(info)),
+                                pa_strnull(snd_ctl_card_info_get_id(info)),
+                                pa_strnull(snd_ctl_card_info_get_longname(info)),
+                                pa_strnull(snd_ctl_card_info_get_mixername(info)),
+                                pa_strnull(snd_ctl_card_info_get_components(info)));
+
+    snd_ctl_close(ctl);
+
+    return key;
+}
+
+static void checksum_add_file(pa_strbuf *buf, const char *fn) {
+    struct stat st;
+
+    if (stat(fn, &st) < 0)
+        pa_strbuf_printf(buf, "%s:-;", fn);
+    else
+        pa_strbuf_printf(buf, "%s:%llu:%llu;", fn, (unsigned long long) st.st_mtime, (unsigned long long) st.st_size);
+}
+
+/* 64 bit FNV-1a */
+static uint64_t hash_string(const char *s) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (; *s; s++) {
+        h ^= (uint8_t) *s;
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+char *pa_alsa_probe_cache_checksum(pa_alsa_profile_set *ps, const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec) {
+    static const char * const alsa_files[] = {
+        "/usr/share/alsa/alsa.conf",
+        "/usr/share/alsa/alsa.conf.d",
+        "/usr/share/alsa/cards",
+        "/etc/asound.conf",
+        "/etc/alsa/conf.d",
+    };
+    pa_strbuf *buf;
+    struct utsname u;
+    const char *e;
+    char *home, *s, *checksum;
+    unsigned i;
+
+    pa_assert(ps);
+    pa_assert(ss);
+
+    buf = pa_strbuf_new();
+
+    pa_strbuf_printf(buf, "%u:%s:%u:%u:%u:%u;", ENTRY_VERSION, pa_sample_format_to_string(ss->format), ss->rate, ss->channels,
+                     default_n_fragments, default_fragment_size_msec);
+
+    if (uname(&u) >= 0)
+        pa_strbuf_printf(buf, "%s;", u.release);
+
+    if (ps->fname)
+        checksum_add_file(buf, ps->fname);
+
+    if ((e = getenv("ALSA_CONFIG_PATH"))) {
+        const char *state = NULL;
+        char *fn;
+
+        while ((fn = pa_split(e, ":", &state))) {
+            checksum_add_file(buf, fn);
+            pa_xfree(fn);
+        }
+    } else
+        for (i = 0; i < PA_ELEMENTSOF(alsa_files); i++)
+            checksum_add_file(buf, alsa_files[i]);
+
+    if ((home = pa_get_home_dir_malloc())) {
+        char *fn;
+
+        fn = pa_sprintf_malloc("%s" PA_PATH_SEP ".asoundrc", home);
+        checksum_add_file(buf, fn);
+        pa_xfree(fn);
+
+        fn = pa_sprintf_malloc("%s" PA_PATH_SEP ".config" PA_PATH_SEP "alsa" PA_PATH_SEP "asoundrc", home);
+        checksum_add_file(buf, fn);
+        pa_xfree(fn);
+
+        pa_xfree(home);
+    }
+
+    s = pa_strbuf_to_string_free(buf);
+    checksum = pa_sprintf_malloc("%016llx", (unsigned long long) hash_string(s));
+    pa_xfree(s);
+
+    return checksum;
+}
+
+static pa_database *open_database(bool for_write) {
+    pa_database *db;
+    char *state_path;
+
+    if (!(state_path = pa_state_path(NULL, true)))
+        return NULL;
+
+    db = pa_database_open(state_path, DATABASE_NAME, true, for_write);
+    pa_xfree(state_path);
+
+    return db;
+}
+
+pa_alsa_probe_cache_entry *pa_alsa_probe_cache_load(const char *key) {
+    pa_database *db;
+    pa_datum k, data;
+    pa_tagstruct *t = NULL;
+    pa_alsa_probe_cache_entry *e = NULL;
+    const char *checksum;
+    uint32_t n_profiles, n_mappings, i;
+    uint8_t version;
+
+    pa_assert(key);
+
+    if (!(db = open_database(false)))
+        return NULL;
+
+    k.data = (char *) key;
+    k.size = strlen(key);
+
+    pa_zero(data);
+
+    if (!pa_database_get(db, &k, &data)) {
+        pa_database_close(db);
+        return NULL;
+    }
+
+    t = pa_tagstruct_new_fixed(data.data, data.size);
+
+    if (pa_tagstruct_getu8(t, &version) < 0 ||
+        version != ENTRY_VERSION ||
+        pa_tagstruct_gets(t, &checksum) < 0 ||
+        !checksum ||
+        pa_tagstruct_getu32(t, &n_profiles) < 0)
+        goto fail;
+
+    e = entry_new(checksum);
+
+    for (i = 0; i < n_profiles; i++) {
+        const char *name;
+        bool supported;
+
+        if (pa_tagstruct_gets(t, &name) < 0 || !name ||
+            pa_tagstruct_get_boolean(t, &supported) < 0)
+            goto fail;
+
+        entry_add_profile(e, name, supported);
+    }
+
+    if (pa_tagstruct_getu32(t, &n_mappings) < 0)
+        goto fail;
+
+    for (i = 0; i < n_mappings; i++) {
+        const char *name;
+        int64_t hw_device_index;
+
+        if (pa_tagstruct_gets(t, &name) < 0 || !name ||
+            pa_tagstruct_gets64(t, &hw_device_index) < 0)
+            goto fail;
+
+        entry_add_mapping(e, name, (int) hw_device_index);
+    }
+
+    if (!pa_tagstruct_eof(t))
+        goto fail;
+
+    pa_tagstruct_free(t);
+    pa_datum_free(&data);
+    pa_database_close(db);
+
+    return e;
+
+fail:
+    pa_log_debug("Database contains invalid data for key: %s", key);
+
+    if (e)
+        pa_alsa_probe_cache_entry_free(e);
+
+    pa_tagstruct_free(t);
+    pa_datum_free(&data);
+    pa_database_close(db);
+
+    return NULL;
+}
+
+void pa_alsa_probe_cache_save(const char *key, pa_alsa_probe_cache_entry *e) {
+    pa_database *db;
+    pa_tagstruct *t;
+    pa_datum k, data;
+    struct profile_record *p;
+    struct mapping_record *m;
+    void *state;
+
+    pa_assert(key);
+    pa_assert(e);
+
+    if (!(db = open_database(true))) {
+        pa_log_info("Failed to open probe cache database.");
+        return;
+    }
+
+    t = pa_tagstruct_new();
+    pa_tagstruct_putu8(t, ENTRY_VERSION);
+    pa_tagstruct_puts(t, e->checksum);
+
+    pa_tagstruct_putu32(t, pa_hashmap_size(e->profiles));
+    PA_HASHMAP_FOREACH(p, e->profiles, state) {
+        pa_tagstruct_puts(t, p->name);
+        pa_tagstruct_put_boolean(t, p->supported);
+    }
+
+    pa_tagstruct_putu32(t, pa_hashmap_size(e->mappings));
+    PA_HASHMAP_FOREACH(m, e->mappings, state) {
+        pa_tagstruct_puts(t, m->name);
+        pa_tagstruct_puts64(t, m->hw_device_index);
+    }
+
+    k.data = (char *) key;
+    k.size = strlen(key);
+
+    data.data = (void *) pa_tagstruct_data(t, &data.size);
+
+    if (pa_database_set(db, &k, &data, true) < 0)
+        pa_log_info("Failed to store probing results for %s.", key);
+
+    pa_tagstruct_free(t);
+
+    pa_database_sync(db);
+    pa_database_close(db);
+}
+
+void pa_alsa_profile_set_probe_cached(pa_alsa_profile_set *ps, pa_hashmap *mixers, const char *dev_id, int alsa_card_index,
+                                      const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec) {
+    pa_alsa_probe_cache_entry *e = NULL;
+    char *key, *checksum;
+
+    pa_assert(ps);
+    pa_assert(dev_id);
+    pa_assert(ss);
+
+    if (ps->probed)
+        return;
+
+    if (!(key = pa_alsa_probe_cache_card_key(dev_id))) {
+        pa_alsa_profile_set_probe(ps, mixers, dev_id, ss, default_n_fragments, default_fragment_size_msec);
+        return;
+    }
+
+    checksum = pa_alsa_probe_cache_checksum(ps, ss, default_n_fragments, default_fragment_size_msec);
+
+    if ((e = pa_alsa_probe_cache_load(key)) && pa_streq(e->checksum, checksum) &&
+        pa_alsa_profile_set_probe_from_cache(ps, mixers, alsa_card_index, e))
+        pa_log_info("Using cached probing results for card %s.", dev_id);
+    else {
+        if (e)
+            pa_alsa_probe_cache_entry_free(e);
+
+        pa_alsa_profile_set_probe(ps, mixers, dev_id, ss, default_n_fragments, default_fragment_size_msec);
+
+        /* Nothing usable most likely means the card was busy, which must
+         * not stick */
+        if (pa_hashmap_isempty(ps->profiles))
+            e = NULL;
+        else {
+            e = pa_alsa_probe_cache_entry_new(ps, checksum);
+            pa_alsa_probe_cache_save(key, e);
+        }
+    }
+
+    if (e)
+        pa_alsa_probe_cache_entry_free(e);
+    pa_xfree(checksum);
+    pa_xfree(key);
+}
+
+struct prefetch {
+    pa_core *core;
+    char *dev_id;
+    char *key;
+    bool use_ucm;
+
+    pa_thread *thread;
+    pa_alsa_probe_cache_entry *entry;
+};
+
+static bool has_ucm(const char *dev_id) {
+#ifdef HAVE_ALSA_UCM
+    snd_use_case_mgr_t *ucm;
+    char *card_name;
+    int card_index, err;
+
+    if ((card_index = snd_card_get_index(dev_id)) < 0)
+        return false;
+
+    card_name = pa_sprintf_malloc("hw:%i", card_index);
+    err = snd_use_case_mgr_open(&ucm, card_name);
+    pa_xfree(card_name);
+
+    if (err < 0) {
+        if (snd_card_get_name(card_index, &card_name) < 0)
+            return false;
+
+        err = snd_use_case_mgr_open(&ucm, card_name);
+        free(card_name);
+    }
+
+    if (err < 0)
+        return false;
+
+    snd_use_case_mgr_close(ucm);
+    return true;
+#else
+    return false;
+#endif
+}
+
+/* Called from the prefetch thread */
+static void prefetch_thread(void *userdata) {
+    struct prefetch *p = userdata;
+    pa_alsa_profile_set *ps;
+    pa_hashmap *mixers;
+    char *checksum;
+
+    if (p->use_ucm && has_ucm(p->dev_id)) {
+        pa_log_debug("Card %s uses UCM, not probing.", p->dev_id);
+        return;
+    }
+
+    if (!(ps = pa_alsa_profile_set_new(NULL, &p->core->default_channel_map)))
+        return;
+
+    mixers = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                 pa_xfree, (pa_free_cb_t) pa_alsa_mixer_free);
+
+    pa_alsa_profile_set_probe(ps, mixers, p->dev_id, &p->core->default_sample_spec,
+                              p->core->default_n_fragments, p->core->default_fragment_size_msec);
+
+    if (!pa_hashmap_isempty(ps->profiles)) {
+        checksum = pa_alsa_probe_cache_checksum(ps, &p->core->default_sample_spec,
+                                                p->core->default_n_fragments, p->core->default_fragment_size_msec);
+        p->entry = pa_alsa_probe_cache_entry_new(ps, checksum);
+        pa_xfree(checksum);
+    }
+
+    pa_hashmap_free(mixers);
+    pa_alsa_profile_set_free(ps);
+}
+
+void pa_alsa_probe_cache_prefetch(pa_core *c, const char * const *dev_ids, unsigned n, bool use_ucm) {
+    struct prefetch *p;
+    pa_alsa_profile_set *ps;
+    pa_usec_t start;
+    char *checksum;
+    unsigned i, n_started = 0;
+
+    pa_assert(c);
+    pa_assert(dev_ids || n == 0);
+
+    /* Only used for the checksum of the default profile set */
+    if (!(ps = pa_alsa_profile_set_new(NULL, &c->default_channel_map)))
+        return;
+
+    start = pa_rtclock_now();
+    checksum = pa_alsa_probe_cache_checksum(ps, &c->default_sample_spec, c->default_n_fragments, c->default_fragment_size_msec);
+    p = pa_xnew0(struct prefetch, n);
+
+    for (i = 0; i < n; i++) {
+        pa_alsa_probe_cache_entry *e;
+        char *thread_name;
+
+        if (!(p[i].key = pa_alsa_probe_cache_card_key(dev_ids[i])))
+            continue;
+
+        if ((e = pa_alsa_probe_cache_load(p[i].key))) {
+            bool valid = pa_streq(e->checksum, checksum);
+
+            pa_alsa_probe_cache_entry_free(e);
+
+            if (valid)
+                continue;
+        }
+
+        p[i].core = c;
+        p[i].dev_id = pa_xstrdup(dev_ids[i]);
+        p[i].use_ucm = use_ucm;
+
+        thread_name = pa_sprintf_malloc("alsa-probe-%s", dev_ids[i]);
+        if ((p[i].thread = pa_thread_new(thread_name, prefetch_thread, &p[i])))
+            n_started++;
+        pa_xfree(thread_name);
+    }
+
+    for (i = 0; i < n; i++) {
+        if (p[i].thread) {
+            pa_thread_free(p[i].thread);
+
+            if (p[i].entry) {
+                pa_alsa_probe_cache_save(p[i].key, p[i].entry);
+                pa_alsa_probe_cache_entry_free(p[i].entry);
+            }
+        }
+
+        pa_xfree(p[i].dev_id);
+        pa_xfree(p[i].key);
+    }
+
+    if (n_started > 0)
+        pa_log_info("Probed %u of %u cards in %0.2f ms.", n_started, n, (double) (pa_rtclock_now() - start) / PA_USEC_PER_MSEC);
+
+    pa_xfree(p);
+    pa_xfree(checksum);
+    pa_alsa_profile_set_free(ps);
+}
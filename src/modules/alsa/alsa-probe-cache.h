@@ -0,0 +1,69 @@
+#ifndef fooalsaprobecachehfoo
+#define fooalsaprobecachehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/hashmap.h>
+
+#include "alsa-mixer.h"
+
+/* Probing a profile set opens the PCMs of every mapping, which takes long
+ * on cards with many of them. The outcome, i.e. which profiles are supported
+ * and the hw device behind each mapping, is stored in a database keyed by the
+ * identity of the card, together with a checksum over everything else it
+ * depends on: the profile set file, the ALSA configuration, the kernel and
+ * the probing parameters. If any of these changes, the card is probed again.
+ *
+ * Mixer paths are not cached, they are probed for the supported mappings as
+ * usual. */
+
+/* Identity of the card behind dev_id, NULL if it cannot be determined */
+char *pa_alsa_probe_cache_card_key(const char *dev_id);
+
+char *pa_alsa_probe_cache_checksum(pa_alsa_profile_set *ps, const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec);
+
+/* Records the result of pa_alsa_profile_set_probe() */
+pa_alsa_probe_cache_entry *pa_alsa_probe_cache_entry_new(pa_alsa_profile_set *ps, const char *checksum);
+void pa_alsa_probe_cache_entry_free(pa_alsa_probe_cache_entry *e);
+
+const char *pa_alsa_probe_cache_entry_get_checksum(pa_alsa_probe_cache_entry *e);
+
+/* Unsupported profiles are not recorded, they are dropped from the profile
+ * set by the probing */
+bool pa_alsa_probe_cache_entry_get_supported(pa_alsa_probe_cache_entry *e, const char *profile);
+bool pa_alsa_probe_cache_entry_get_hw_device_index(pa_alsa_probe_cache_entry *e, const char *mapping, int *hw_device_index);
+
+pa_alsa_probe_cache_entry *pa_alsa_probe_cache_load(const char *key);
+void pa_alsa_probe_cache_save(const char *key, pa_alsa_probe_cache_entry *e);
+
+/* pa_alsa_profile_set_probe(), using and updating the cache. alsa_card_index
+ * is used to open the mixer when no PCM was opened. Not for UCM profile
+ * sets. */
+void pa_alsa_profile_set_probe_cached(pa_alsa_profile_set *ps, pa_hashmap *mixers, const char *dev_id, int alsa_card_index,
+                                      const pa_sample_spec *ss, unsigned default_n_fragments, unsigned default_fragment_size_msec);
+
+/* Probes the default profile set of all given cards that have no valid
+ * cache entry, each in a thread of its own, and stores the results. With
+ * use_ucm cards with a UCM configuration are skipped. Returns when all
+ * cards are done. Called from main context before the cards are loaded. */
+void pa_alsa_probe_cache_prefetch(pa_core *c, const char * const *dev_ids, unsigned n, bool use_ucm);
+
+#endif
@@ -44,6 +44,7 @@
 
 #include <pulsecore/core.h>
 #include <pulsecore/i18n.h>
+#include <pulsecore/message-handler.h>
 #include <pulsecore/module.h>
 #include <pulsecore/memchunk.h>
 #include <pulsecore/sink.h>
@@ -55,6 +56,7 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
+#include <pulsecore/trace.h>
 #include <pulsecore/rtpoll.h>
 
 #ifdef USE_SMOOTHER_2
@@ -67,6 +69,8 @@
 
 #include "alsa-util.h"
 #include "alsa-sink.h"
+#include "alsa-io-thread.h"
+#include "alsa-timing.h"
 
 /* #define DEBUG_TIMING */
 
@@ -84,6 +88,13 @@
 /* Note that TSCHED_WATERMARK_INC_THRESHOLD_USEC == 0 means that we
  * will increase the watermark only if we hit a real underrun. */
 
+#define TSCHED_WATERMARK_UNDERRUN_PROBABILITY 0.001                /* 0.1%  -- Acceptable share of wakeups that come too late */
+#define TSCHED_WATERMARK_MODEL_MARGIN_PERCENT 125                  /* 125%  -- Headroom on top of the watermark the wakeup statistics ask for */
+
+/* Once enough timer wakeups have been observed, the watermark follows the
+ * quantile of the wakeup statistics in alsa-timing.h instead of the fixed
+ * steps above. Underruns are still answered by increase_watermark(). */
+
 #define TSCHED_MIN_SLEEP_USEC (10*PA_USEC_PER_MSEC)                /* 10ms  -- Sleep at least 10ms on each iteration */
 #define TSCHED_MIN_WAKEUP_USEC (4*PA_USEC_PER_MSEC)                /* 4ms   -- Wakeup at least this long before the buffer runs empty*/
 
@@ -104,6 +115,18 @@
 
 #define DEFAULT_WRITE_ITERATION_THRESHOLD 0.03 /* don't iterate write if < 3% of the buffer is available */
 
+typedef struct duplex_msg {
+    pa_msgobject parent;
+    struct userdata *userdata;
+} duplex_msg;
+
+PA_DEFINE_PRIVATE_CLASS(duplex_msg, pa_msgobject);
+#define DUPLEX_MSG(o) (duplex_msg_cast(o))
+
+enum {
+    DUPLEX_MESSAGE_LINKED
+};
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -113,6 +136,16 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
+    /* Set instead of thread/thread_mq if we run on a shared IO thread */
+    pa_alsa_io_thread *io_thread;
+    pa_alsa_io_device *io_device;
+    bool io_pending;
+
+    /* Duplex mode, see pa_alsa_io_thread_link_pcm() */
+    bool duplex, duplex_linked;
+    char *clock_domain;
+    duplex_msg *duplex_msg;
+
     snd_pcm_t *pcm_handle;
 
     char *paths_dir;
@@ -168,6 +201,16 @@ struct userdata {
     bool first, after_rewind;
 
     pa_rtpoll_item *alsa_rtpoll_item;
+    unsigned short revents;
+    pa_usec_t rtpoll_sleep, sleep_start;
+
+    /* Wakeup statistics, owned by the IO thread */
+    pa_alsa_timing timing;
+    pa_usec_t left_to_play_usec;    /* fill level after the last write */
+    pa_usec_t wakeup_expected_left; /* fill level expected at the next timer wakeup, 0 if unknown */
+    pa_usec_t wakeup_usage;
+    pa_usec_t render_usec;
+    bool wakeup_sampled;
 
 #ifdef USE_SMOOTHER_2
     pa_smoother_2 *smoother;
@@ -191,10 +234,18 @@ struct userdata {
 
     /* ucm context */
     pa_alsa_ucm_mapping_context *ucm_context;
+
+    char *message_handler_path;
 };
 
 enum {
-    SINK_MESSAGE_SYNC_MIXER = PA_SINK_MESSAGE_MAX
+    SINK_MESSAGE_SYNC_MIXER = PA_SINK_MESSAGE_MAX,
+    SINK_MESSAGE_GET_TIMING_STATS
+};
+
+struct timing_stats {
+    pa_alsa_timing timing;
+    pa_usec_t watermark;
 };
 
 static void userdata_free(struct userdata *u);
@@ -377,6 +428,7 @@ static void increase_watermark(struct userdata *u) {
     if (old_watermark != u->tsched_watermark) {
         pa_log_info("Increasing wakeup watermark to %0.2f ms",
                     (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC);
+        pa_alsa_timing_watermark_changed(&u->timing, pa_rtclock_now(), u->tsched_watermark_usec, true);
         return;
     }
 
@@ -400,8 +452,42 @@ static void increase_watermark(struct userdata *u) {
     /* When we reach this we're officially fucked! */
 }
 
-static void decrease_watermark(struct userdata *u) {
+/* Watermark the wakeup statistics ask for, if there are enough of them */
+static bool model_watermark(struct userdata *u, size_t *watermark) {
+    pa_usec_t usec;
+
+    if (!pa_alsa_timing_required_watermark(&u->timing, TSCHED_WATERMARK_UNDERRUN_PROBABILITY, &usec))
+        return false;
+
+    usec = usec * TSCHED_WATERMARK_MODEL_MARGIN_PERCENT / 100;
+    *watermark = pa_usec_to_bytes_round_up(usec, &u->sink->sample_spec);
+
+    return true;
+}
+
+/* Raise the watermark before wakeups that come later and later actually
+ * underrun */
+static void raise_watermark(struct userdata *u, size_t watermark) {
     size_t old_watermark;
+
+    pa_assert(u);
+    pa_assert(u->use_tsched);
+
+    old_watermark = u->tsched_watermark;
+    u->tsched_watermark = watermark;
+    fix_tsched_watermark(u);
+
+    if (old_watermark != u->tsched_watermark) {
+        pa_log_info("Raising wakeup watermark to %0.2f ms to cover observed wakeup delays",
+                    (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC);
+        pa_alsa_timing_watermark_changed(&u->timing, pa_rtclock_now(), u->tsched_watermark_usec, false);
+    }
+
+    u->watermark_dec_not_before = 0;
+}
+
+static void decrease_watermark(struct userdata *u) {
+    size_t old_watermark, target;
     pa_usec_t now;
 
     pa_assert(u);
@@ -417,16 +503,20 @@ static void decrease_watermark(struct userdata *u) {
 
     old_watermark = u->tsched_watermark;
 
-    if (u->tsched_watermark < u->watermark_dec_step)
+    if (model_watermark(u, &target))
+        u->tsched_watermark = PA_MAX(u->tsched_watermark / 2, target);
+    else if (u->tsched_watermark < u->watermark_dec_step)
         u->tsched_watermark = u->tsched_watermark / 2;
     else
         u->tsched_watermark = PA_MAX(u->tsched_watermark / 2, u->tsched_watermark - u->watermark_dec_step);
 
     fix_tsched_watermark(u);
 
-    if (old_watermark != u->tsched_watermark)
+    if (old_watermark != u->tsched_watermark) {
         pa_log_info("Decreasing wakeup watermark to %0.2f ms",
                     (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC);
+        pa_alsa_timing_watermark_changed(&u->timing, now, u->tsched_watermark_usec, false);
+    }
 
     /* We don't change the latency range*/
 
@@ -465,6 +555,8 @@ static void reset_watermark(struct userdata *u, size_t tsched_watermark, pa_samp
 
     pa_log_info("Time scheduling watermark is %0.2fms",
                 (double) u->tsched_watermark_usec / PA_USEC_PER_MSEC);
+
+    pa_alsa_timing_watermark_changed(&u->timing, pa_rtclock_now(), u->tsched_watermark_usec, false);
 }
 
 static void hw_sleep_time(struct userdata *u, pa_usec_t *sleep_usec, pa_usec_t*process_usec) {
@@ -513,10 +605,63 @@ static void reset_vars(struct userdata *u) {
     u->write_count = 0;
 }
 
+/* Called from IO context */
+static void set_duplex_linked(struct userdata *u, bool linked) {
+    if (u->duplex_linked == linked)
+        return;
+
+    u->duplex_linked = linked;
+
+    /* The clock domain is only announced while the PCMs are linked */
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(u->duplex_msg), DUPLEX_MESSAGE_LINKED, NULL, linked, NULL, NULL);
+}
+
+/* Called from IO context */
+static void duplex_link(struct userdata *u, pa_alsa_io_device *d) {
+    if (u->duplex && d && u->pcm_handle)
+        set_duplex_linked(u, pa_alsa_io_thread_link_pcm(u->io_thread, d, PA_ALSA_DIRECTION_OUTPUT, u->pcm_handle));
+}
+
+/* Called from IO context */
+static void duplex_unlink(struct userdata *u) {
+    if (u->duplex && u->io_device)
+        pa_alsa_io_thread_unlink_pcm(u->io_thread, u->io_device);
+
+    set_duplex_linked(u, false);
+}
+
+/* Called from main context */
+static int duplex_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    struct userdata *u = DUPLEX_MSG(o)->userdata;
+    pa_proplist *pl;
+
+    /* The module may be gone already */
+    if (!u || !u->sink)
+        return 0;
+
+    switch (code) {
+        case DUPLEX_MESSAGE_LINKED:
+            if (offset) {
+                pl = pa_proplist_new();
+                pa_proplist_sets(pl, PA_PROP_DEVICE_CLOCK_DOMAIN, u->clock_domain);
+                pa_sink_update_proplist(u->sink, PA_UPDATE_REPLACE, pl);
+                pa_proplist_free(pl);
+            } else if (pa_proplist_contains(u->sink->proplist, PA_PROP_DEVICE_CLOCK_DOMAIN)) {
+                pa_proplist_unset(u->sink->proplist, PA_PROP_DEVICE_CLOCK_DOMAIN);
+                pa_sink_update_proplist(u->sink, PA_UPDATE_REPLACE, NULL);
+            }
+
+            return 0;
+    }
+
+    return 0;
+}
+
 /* Called from IO context */
 static void close_pcm(struct userdata *u) {
     /* Let's suspend -- we don't call snd_pcm_drain() here since that might
      * take awfully long with our long buffer sizes today. */
+    duplex_unlink(u);
     snd_pcm_close(u->pcm_handle);
     u->pcm_handle = NULL;
 
@@ -535,12 +680,17 @@ static int try_recover(struct userdata *u, const char *call, int err) {
 
     pa_assert(err != -EAGAIN);
 
-    if (err == -EPIPE)
+    if (err == -EPIPE) {
         pa_log_debug("%s: Buffer underrun!", call);
+        PA_TRACE_INSTANT(PA_TRACE_UNDERRUN, u->sink->index, 0);
+    }
 
     if (err == -ESTRPIPE)
         pa_log_debug("%s: System suspended!", call);
 
+    /* An xrun stops both linked PCMs, each side recovers on its own */
+    duplex_unlink(u);
+
     if ((err = snd_pcm_recover(u->pcm_handle, err, 1)) < 0) {
         pa_log("%s: %s, trying to restart PCM", call, pa_alsa_strerror(err));
 
@@ -573,13 +723,18 @@ static size_t check_left_to_play(struct userdata *u, size_t n_bytes, bool on_tim
         left_to_play = 0;
         underrun = true;
 
+        PA_TRACE_INSTANT(PA_TRACE_UNDERRUN, u->sink->index, n_bytes - u->hwbuf_size);
+
 #if 0
         PA_DEBUG_TRAP;
 #endif
 
-        if (!u->first && !u->after_rewind)
+        if (!u->first && !u->after_rewind) {
             if (pa_log_ratelimit(PA_LOG_INFO))
                 pa_log_info("Underrun!");
+
+            pa_alsa_timing_add_underrun(&u->timing);
+        }
     }
 
 #ifdef DEBUG_TIMING
@@ -591,11 +746,33 @@ static size_t check_left_to_play(struct userdata *u, size_t n_bytes, bool on_tim
 
     if (u->use_tsched) {
         bool reset_not_before = true;
+        size_t target;
+
+        /* Remember how much of the expected fill level the wakeup ate
+         * into, it is added to the statistics once we know how long
+         * rendering took */
+        if (on_timeout && u->wakeup_expected_left > 0 && !u->first && !u->after_rewind) {
+            pa_usec_t left_usec = pa_bytes_to_usec(left_to_play, &u->sink->sample_spec);
+
+            u->wakeup_usage = u->wakeup_expected_left > left_usec ? u->wakeup_expected_left - left_usec : 0;
+            u->wakeup_sampled = true;
+        }
 
         if (!u->first && !u->after_rewind) {
             if (underrun || left_to_play < u->watermark_inc_threshold)
                 increase_watermark(u);
-            else if (left_to_play > u->watermark_dec_threshold) {
+            else if (model_watermark(u, &target)) {
+                reset_not_before = false;
+
+                /* Only timer wakeups tell us anything about the
+                 * deadlines we can meet */
+                if (on_timeout) {
+                    if (target > u->tsched_watermark)
+                        raise_watermark(u, target);
+                    else if (target < u->tsched_watermark)
+                        decrease_watermark(u);
+                }
+            } else if (left_to_play > u->watermark_dec_threshold) {
                 reset_not_before = false;
 
                 /* We decrease the watermark only if have actually
@@ -716,6 +893,7 @@ static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
             snd_pcm_uframes_t offset, frames;
             snd_pcm_sframes_t sframes;
             size_t written;
+            pa_usec_t render_start;
 
             frames = (snd_pcm_uframes_t) (n_bytes / u->frame_size);
 /*             pa_log_debug("%lu frames to write", (unsigned long) frames); */
@@ -758,7 +936,9 @@ static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
             chunk.length = pa_memblock_get_length(chunk.memblock);
             chunk.index = 0;
 
+            render_start = pa_rtclock_now();
             pa_sink_render_into_full(u->sink, &chunk);
+            u->render_usec += pa_rtclock_now() - render_start;
             pa_memblock_unref_fixed(chunk.memblock);
 
             if (PA_UNLIKELY((sframes = snd_pcm_mmap_commit(u->pcm_handle, offset, frames)) < 0)) {
@@ -796,7 +976,7 @@ static int mmap_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
     if (u->use_tsched) {
         pa_usec_t underrun_sleep = pa_bytes_to_usec_round_up(input_underrun, &u->sink->sample_spec);
 
-        *sleep_usec = pa_bytes_to_usec(left_to_play, &u->sink->sample_spec);
+        *sleep_usec = u->left_to_play_usec = pa_bytes_to_usec(left_to_play, &u->sink->sample_spec);
         process_usec = u->tsched_watermark_usec;
 
         if (*sleep_usec > process_usec)
@@ -898,8 +1078,12 @@ static int unix_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
 
 /*         pa_log_debug("%lu frames to write", (unsigned long) frames); */
 
-            if (u->memchunk.length <= 0)
+            if (u->memchunk.length <= 0) {
+                pa_usec_t render_start = pa_rtclock_now();
+
                 pa_sink_render(u->sink, n_bytes, &u->memchunk);
+                u->render_usec += pa_rtclock_now() - render_start;
+            }
 
             pa_assert(u->memchunk.length > 0);
 
@@ -960,7 +1144,7 @@ static int unix_write(struct userdata *u, pa_usec_t *sleep_usec, bool polled, bo
     if (u->use_tsched) {
         pa_usec_t underrun_sleep = pa_bytes_to_usec_round_up(input_underrun, &u->sink->sample_spec);
 
-        *sleep_usec = pa_bytes_to_usec(left_to_play, &u->sink->sample_spec);
+        *sleep_usec = u->left_to_play_usec = pa_bytes_to_usec(left_to_play, &u->sink->sample_spec);
         process_usec = u->tsched_watermark_usec;
 
         if (*sleep_usec > process_usec)
@@ -1292,6 +1476,8 @@ static int unsuspend(struct userdata *u, bool recovering) {
     if (u->use_tsched && !recovering)
         reset_watermark(u, u->tsched_watermark_ref, &u->sink->sample_spec, true);
 
+    duplex_link(u, u->io_device);
+
     pa_log_info("Resumed successfully...");
 
     pa_xfree(device_name);
@@ -1349,6 +1535,8 @@ static void sync_mixer(struct userdata *u, pa_device_port *port) {
 static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
     struct userdata *u = PA_SINK(o)->userdata;
 
+    u->io_pending = true;
+
     switch (code) {
 
         case PA_SINK_MESSAGE_GET_LATENCY: {
@@ -1368,11 +1556,55 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
             sync_mixer(u, port);
             return 0;
         }
+
+        case SINK_MESSAGE_GET_TIMING_STATS: {
+            struct timing_stats *stats = data;
+
+            stats->timing = u->timing;
+            stats->watermark = u->use_tsched ? u->tsched_watermark_usec : 0;
+            return 0;
+        }
     }
 
     return pa_sink_process_msg(o, code, data, offset, chunk);
 }
 
+/* Called from main context */
+static int sink_message_handler(const char *object_path, const char *message, const pa_json_object *parameters, char **response, void *userdata) {
+    struct userdata *u = userdata;
+    struct timing_stats stats;
+    pa_json_encoder *encoder;
+    pa_usec_t required;
+
+    pa_assert(u);
+    pa_assert(message);
+    pa_assert(response);
+
+    if (!pa_streq(message, "get-timing-stats"))
+        return -PA_ERR_NOTIMPLEMENTED;
+
+    pa_assert_se(pa_asyncmsgq_send(u->sink->asyncmsgq, PA_MSGOBJECT(u->sink), SINK_MESSAGE_GET_TIMING_STATS, &stats, 0, NULL) == 0);
+
+    encoder = pa_json_encoder_new();
+    pa_json_encoder_begin_element_object(encoder);
+
+    pa_json_encoder_add_member_bool(encoder, "tsched", u->use_tsched);
+    pa_json_encoder_add_member_int(encoder, "watermark_usec", (int64_t) stats.watermark);
+
+    /* Same computation as model_watermark(), on the copied statistics */
+    if (u->use_tsched && pa_alsa_timing_required_watermark(&stats.timing, TSCHED_WATERMARK_UNDERRUN_PROBABILITY, &required))
+        pa_json_encoder_add_member_int(encoder, "model_watermark_usec", (int64_t) (required * TSCHED_WATERMARK_MODEL_MARGIN_PERCENT / 100));
+    else
+        pa_json_encoder_add_member_null(encoder, "model_watermark_usec");
+
+    pa_alsa_timing_to_json(&stats.timing, encoder);
+
+    pa_json_encoder_end_object(encoder);
+    *response = pa_json_encoder_to_string_free(encoder);
+
+    return PA_OK;
+}
+
 /* Called from main context */
 static int sink_set_state_in_main_thread_cb(pa_sink *s, pa_sink_state_t new_state, pa_suspend_cause_t new_suspend_cause) {
     pa_sink_state_t old_state;
@@ -1768,6 +2000,7 @@ static void sink_update_requested_latency_cb(pa_sink *s) {
         return;
 
     update_sw_params(u, true);
+    u->io_pending = true;
 }
 
 static pa_idxset* sink_get_formats(pa_sink *s) {
@@ -1967,182 +2200,231 @@ rewind_done:
     return 0;
 }
 
-static void thread_func(void *userdata) {
-    struct userdata *u = userdata;
-    unsigned short revents = 0;
+/* Called from IO context. Renders and writes what is due and computes
+ * how long to sleep until the next round, in u->rtpoll_sleep. */
+static int thread_process(struct userdata *u, bool on_timeout) {
+    pa_usec_t rtpoll_sleep = 0;
 
-    pa_assert(u);
+#ifdef DEBUG_TIMING
+    pa_log_debug("Loop");
+#endif
 
-    pa_log_debug("Thread starting up");
+    if (PA_UNLIKELY(u->sink->thread_info.rewind_requested)) {
+        if (process_rewind(u) < 0)
+            return -1;
+    }
 
-    if (u->core->realtime_scheduling)
-        pa_thread_make_realtime(u->core->realtime_priority);
+    /* Render some data and write it to the dsp */
+    if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
+        int work_done;
+        pa_usec_t sleep_usec = 0;
 
-    pa_thread_mq_install(&u->thread_mq);
+        u->render_usec = 0;
 
-    for (;;) {
-        int ret;
-        pa_usec_t rtpoll_sleep = 0, real_sleep;
+        PA_TRACE_BEGIN(PA_TRACE_ALSA_WRITE, u->sink->index, 0);
 
-#ifdef DEBUG_TIMING
-        pa_log_debug("Loop");
-#endif
+        if (u->use_mmap)
+            work_done = mmap_write(u, &sleep_usec, u->revents & POLLOUT, on_timeout);
+        else
+            work_done = unix_write(u, &sleep_usec, u->revents & POLLOUT, on_timeout);
 
-        if (PA_UNLIKELY(u->sink->thread_info.rewind_requested)) {
-            if (process_rewind(u) < 0)
-                goto fail;
-        }
+        PA_TRACE_END(PA_TRACE_ALSA_WRITE, u->sink->index, sleep_usec);
 
-        /* Render some data and write it to the dsp */
-        if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
-            int work_done;
-            pa_usec_t sleep_usec = 0;
-            bool on_timeout = pa_rtpoll_timer_elapsed(u->rtpoll);
+        if (work_done < 0)
+            return -1;
 
-            if (u->use_mmap)
-                work_done = mmap_write(u, &sleep_usec, revents & POLLOUT, on_timeout);
-            else
-                work_done = unix_write(u, &sleep_usec, revents & POLLOUT, on_timeout);
+        if (u->render_usec > 0)
+            pa_alsa_timing_add_render(&u->timing, u->render_usec);
 
-            if (work_done < 0)
-                goto fail;
+        if (u->wakeup_sampled) {
+            pa_alsa_timing_add_usage(&u->timing, pa_rtclock_now(), u->wakeup_usage + u->render_usec);
+            u->wakeup_sampled = false;
+        }
+
+        u->wakeup_expected_left = 0;
 
-/*             pa_log_debug("work_done = %i", work_done); */
+/*         pa_log_debug("work_done = %i", work_done); */
 
-            if (work_done) {
+        if (work_done) {
 
-                if (u->first) {
-                    pa_log_info("Starting playback.");
-                    snd_pcm_start(u->pcm_handle);
+            if (u->first) {
+                pa_log_info("Starting playback.");
+                snd_pcm_start(u->pcm_handle);
 
 #ifdef USE_SMOOTHER_2
-                    pa_smoother_2_resume(u->smoother, pa_rtclock_now());
+                pa_smoother_2_resume(u->smoother, pa_rtclock_now());
 #else
-                    pa_smoother_resume(u->smoother, pa_rtclock_now(), true);
+                pa_smoother_resume(u->smoother, pa_rtclock_now(), true);
 #endif
 
-                    u->first = false;
-                }
-
-                update_smoother(u);
+                u->first = false;
             }
 
-            if (u->use_tsched) {
-                pa_usec_t cusec;
+            update_smoother(u);
+        }
 
-                if (u->since_start <= u->hwbuf_size) {
+        if (u->use_tsched) {
+            pa_usec_t cusec;
 
-                    /* USB devices on ALSA seem to hit a buffer
-                     * underrun during the first iterations much
-                     * quicker then we calculate here, probably due to
-                     * the transport latency. To accommodate for that
-                     * we artificially decrease the sleep time until
-                     * we have filled the buffer at least once
-                     * completely.*/
+            if (u->since_start <= u->hwbuf_size) {
 
-                    if (pa_log_ratelimit(PA_LOG_DEBUG))
-                        pa_log_debug("Cutting sleep time for the initial iterations by half.");
-                    sleep_usec /= 2;
-                }
+                /* USB devices on ALSA seem to hit a buffer
+                 * underrun during the first iterations much
+                 * quicker then we calculate here, probably due to
+                 * the transport latency. To accommodate for that
+                 * we artificially decrease the sleep time until
+                 * we have filled the buffer at least once
+                 * completely.*/
+
+                if (pa_log_ratelimit(PA_LOG_DEBUG))
+                    pa_log_debug("Cutting sleep time for the initial iterations by half.");
+                sleep_usec /= 2;
+            }
 
-                /* OK, the playback buffer is now full, let's
-                 * calculate when to wake up next */
+            /* OK, the playback buffer is now full, let's
+             * calculate when to wake up next */
 #ifdef DEBUG_TIMING
-                pa_log_debug("Waking up in %0.2fms (sound card clock).", (double) sleep_usec / PA_USEC_PER_MSEC);
+            pa_log_debug("Waking up in %0.2fms (sound card clock).", (double) sleep_usec / PA_USEC_PER_MSEC);
 #endif
 
-                /* Convert from the sound card time domain to the
-                 * system time domain */
+            /* Convert from the sound card time domain to the
+             * system time domain */
 #ifdef USE_SMOOTHER_2
-                cusec = pa_smoother_2_translate(u->smoother, sleep_usec);
+            cusec = pa_smoother_2_translate(u->smoother, sleep_usec);
 #else
-                cusec = pa_smoother_translate(u->smoother, pa_rtclock_now(), sleep_usec);
+            cusec = pa_smoother_translate(u->smoother, pa_rtclock_now(), sleep_usec);
 #endif
 
 #ifdef DEBUG_TIMING
-                pa_log_debug("Waking up in %0.2fms (system clock).", (double) cusec / PA_USEC_PER_MSEC);
+            pa_log_debug("Waking up in %0.2fms (system clock).", (double) cusec / PA_USEC_PER_MSEC);
 #endif
 
-                /* We don't trust the conversion, so we wake up whatever comes first */
-                rtpoll_sleep = PA_MIN(sleep_usec, cusec);
-            }
-
-            u->after_rewind = false;
+            /* We don't trust the conversion, so we wake up whatever comes first */
+            rtpoll_sleep = PA_MIN(sleep_usec, cusec);
 
+            if (rtpoll_sleep > 0 && u->left_to_play_usec > rtpoll_sleep)
+                u->wakeup_expected_left = u->left_to_play_usec - rtpoll_sleep;
         }
 
-        if (u->sink->flags & PA_SINK_DEFERRED_VOLUME) {
-            pa_usec_t volume_sleep;
-            pa_sink_volume_change_apply(u->sink, &volume_sleep);
-            if (volume_sleep > 0) {
-                if (rtpoll_sleep > 0)
-                    rtpoll_sleep = PA_MIN(volume_sleep, rtpoll_sleep);
-                else
-                    rtpoll_sleep = volume_sleep;
-            }
-        }
+        u->after_rewind = false;
+
+    }
 
-        if (rtpoll_sleep > 0) {
-            pa_rtpoll_set_timer_relative(u->rtpoll, rtpoll_sleep);
-            real_sleep = pa_rtclock_now();
+    if (u->sink->flags & PA_SINK_DEFERRED_VOLUME) {
+        pa_usec_t volume_sleep;
+        pa_sink_volume_change_apply(u->sink, &volume_sleep);
+        if (volume_sleep > 0) {
+            /* A wakeup for the volume change says nothing about
+             * our deadlines */
+            if (rtpoll_sleep > 0 && volume_sleep < rtpoll_sleep)
+                u->wakeup_expected_left = 0;
+
+            if (rtpoll_sleep > 0)
+                rtpoll_sleep = PA_MIN(volume_sleep, rtpoll_sleep);
+            else
+                rtpoll_sleep = volume_sleep;
         }
-        else
-            pa_rtpoll_set_timer_disabled(u->rtpoll);
+    }
 
-        /* Hmm, nothing to do. Let's sleep */
-        if ((ret = pa_rtpoll_run(u->rtpoll)) < 0)
-            goto fail;
+    u->rtpoll_sleep = rtpoll_sleep;
 
-        if (rtpoll_sleep > 0) {
-            real_sleep = pa_rtclock_now() - real_sleep;
+    if (rtpoll_sleep > 0)
+        u->sleep_start = pa_rtclock_now();
+
+    return 0;
+}
+
+/* Called from IO context after polling */
+static int thread_after_poll(struct userdata *u, bool on_timeout) {
+
+    if (u->rtpoll_sleep > 0) {
+        pa_usec_t real_sleep = pa_rtclock_now() - u->sleep_start;
 #ifdef DEBUG_TIMING
-            pa_log_debug("Expected sleep: %0.2fms, real sleep: %0.2fms (diff %0.2f ms)",
-                (double) rtpoll_sleep / PA_USEC_PER_MSEC, (double) real_sleep / PA_USEC_PER_MSEC,
-                (double) ((int64_t) real_sleep - (int64_t) rtpoll_sleep) / PA_USEC_PER_MSEC);
+        pa_log_debug("Expected sleep: %0.2fms, real sleep: %0.2fms (diff %0.2f ms)",
+            (double) u->rtpoll_sleep / PA_USEC_PER_MSEC, (double) real_sleep / PA_USEC_PER_MSEC,
+            (double) ((int64_t) real_sleep - (int64_t) u->rtpoll_sleep) / PA_USEC_PER_MSEC);
 #endif
-            if (u->use_tsched && real_sleep > rtpoll_sleep + u->tsched_watermark_usec)
-                pa_log_info("Scheduling delay of %0.2f ms > %0.2f ms, you might want to investigate this to improve latency...",
-                    (double) (real_sleep - rtpoll_sleep) / PA_USEC_PER_MSEC,
-                    (double) (u->tsched_watermark_usec) / PA_USEC_PER_MSEC);
+        if (u->use_tsched && on_timeout)
+            pa_alsa_timing_add_jitter(&u->timing, real_sleep > u->rtpoll_sleep ? real_sleep - u->rtpoll_sleep : 0);
+
+        if (u->use_tsched && real_sleep > u->rtpoll_sleep + u->tsched_watermark_usec)
+            pa_log_info("Scheduling delay of %0.2f ms > %0.2f ms, you might want to investigate this to improve latency...",
+                (double) (real_sleep - u->rtpoll_sleep) / PA_USEC_PER_MSEC,
+                (double) (u->tsched_watermark_usec) / PA_USEC_PER_MSEC);
+    }
+
+    if (u->sink->flags & PA_SINK_DEFERRED_VOLUME)
+        pa_sink_volume_change_apply(u->sink, NULL);
+
+    /* Tell ALSA about this and process its response */
+    if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
+        struct pollfd *pollfd;
+        int err;
+        unsigned n;
+
+        pollfd = pa_rtpoll_item_get_pollfd(u->alsa_rtpoll_item, &n);
+
+        if ((err = snd_pcm_poll_descriptors_revents(u->pcm_handle, pollfd, n, &u->revents)) < 0) {
+            pa_log("snd_pcm_poll_descriptors_revents() failed: %s", pa_alsa_strerror(err));
+            return -1;
         }
 
-        if (u->sink->flags & PA_SINK_DEFERRED_VOLUME)
-            pa_sink_volume_change_apply(u->sink, NULL);
+        if (u->revents & ~POLLOUT) {
+            duplex_unlink(u);
 
-        if (ret == 0)
-            goto finish;
+            if ((err = pa_alsa_recover_from_poll(u->pcm_handle, u->revents)) < 0)
+                return -1;
 
-        /* Tell ALSA about this and process its response */
-        if (PA_SINK_IS_OPENED(u->sink->thread_info.state)) {
-            struct pollfd *pollfd;
-            int err;
-            unsigned n;
+            /* Stream needs to be restarted */
+            if (err == 1) {
+                close_pcm(u);
+                if (unsuspend(u, true) < 0)
+                    return -1;
+            } else
+                reset_vars(u);
 
-            pollfd = pa_rtpoll_item_get_pollfd(u->alsa_rtpoll_item, &n);
+            u->revents = 0;
+        } else if (u->revents && u->use_tsched && pa_log_ratelimit(PA_LOG_DEBUG))
+            pa_log_debug("Wakeup from ALSA!");
 
-            if ((err = snd_pcm_poll_descriptors_revents(u->pcm_handle, pollfd, n, &revents)) < 0) {
-                pa_log("snd_pcm_poll_descriptors_revents() failed: %s", pa_alsa_strerror(err));
-                goto fail;
-            }
+    } else
+        u->revents = 0;
 
-            if (revents & ~POLLOUT) {
-                if ((err = pa_alsa_recover_from_poll(u->pcm_handle, revents)) < 0)
-                    goto fail;
+    return 0;
+}
+
+static void thread_func(void *userdata) {
+    struct userdata *u = userdata;
 
-                /* Stream needs to be restarted */
-                if (err == 1) {
-                    close_pcm(u);
-                    if (unsuspend(u, true) < 0)
-                        goto fail;
-                } else
-                    reset_vars(u);
+    pa_assert(u);
 
-                revents = 0;
-            } else if (revents && u->use_tsched && pa_log_ratelimit(PA_LOG_DEBUG))
-                pa_log_debug("Wakeup from ALSA!");
+    pa_log_debug("Thread starting up");
 
-        } else
-            revents = 0;
+    if (u->core->realtime_scheduling)
+        pa_thread_make_realtime(u->core->realtime_priority);
+
+    pa_thread_mq_install(&u->thread_mq);
+
+    for (;;) {
+        int ret;
+
+        if (thread_process(u, pa_rtpoll_timer_elapsed(u->rtpoll)) < 0)
+            goto fail;
+
+        if (u->rtpoll_sleep > 0)
+            pa_rtpoll_set_timer_relative(u->rtpoll, u->rtpoll_sleep);
+        else
+            pa_rtpoll_set_timer_disabled(u->rtpoll);
+
+        /* Hmm, nothing to do. Let's sleep */
+        if ((ret = pa_rtpoll_run(u->rtpoll)) < 0)
+            goto fail;
+
+        if (ret == 0)
+            goto finish;
+
+        if (thread_after_poll(u, pa_rtpoll_timer_elapsed(u->rtpoll)) < 0)
+            goto fail;
     }
 
 fail:
@@ -2155,6 +2437,95 @@ finish:
     pa_log_debug("Thread shutting down");
 }
 
+/* Called from IO context, when running on a shared IO thread */
+static int io_device_attach(void *userdata, pa_alsa_io_device *d) {
+    struct userdata *u = userdata;
+
+    if (u->mixer_pd && pa_alsa_set_mixer_rtpoll(u->mixer_pd, u->mixer_handle, u->rtpoll) < 0) {
+        pa_log("Failed to initialize file descriptor monitoring");
+        return -1;
+    }
+
+    duplex_link(u, d);
+
+    return 0;
+}
+
+static void io_device_detach(void *userdata) {
+    struct userdata *u = userdata;
+
+    duplex_unlink(u);
+
+    /* Our rtpoll items live in the shared rtpoll, free them while the
+     * IO thread cannot be looking at them */
+    if (u->alsa_rtpoll_item) {
+        pa_rtpoll_item_free(u->alsa_rtpoll_item);
+        u->alsa_rtpoll_item = NULL;
+    }
+
+    if (u->mixer_pd) {
+        pa_alsa_mixer_pdata_free(u->mixer_pd);
+        u->mixer_pd = NULL;
+    }
+}
+
+static void io_device_restart(void *userdata) {
+    struct userdata *u = userdata;
+
+    /* The other side stopped and prepared our PCM to link it */
+    reset_vars(u);
+    u->io_pending = true;
+}
+
+static void io_device_linked(void *userdata, bool linked) {
+    struct userdata *u = userdata;
+
+    /* The other side linked or unlinked the PCMs */
+    set_duplex_linked(u, linked);
+    u->io_pending = true;
+}
+
+static void io_device_fail(struct userdata *u) {
+    /* The IO thread won't run us anymore, have the module unloaded */
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(u->core), PA_CORE_MESSAGE_UNLOAD_MODULE, u->module, 0, NULL, NULL);
+}
+
+static int io_device_process(void *userdata, bool on_timeout, pa_usec_t *sleep_usec) {
+    struct userdata *u = userdata;
+
+    u->io_pending = false;
+
+    if (thread_process(u, on_timeout) < 0) {
+        io_device_fail(u);
+        return -1;
+    }
+
+    *sleep_usec = u->rtpoll_sleep;
+    return 0;
+}
+
+static int io_device_after_poll(void *userdata, bool on_timeout) {
+    struct userdata *u = userdata;
+
+    if (thread_after_poll(u, on_timeout) < 0) {
+        io_device_fail(u);
+        return -1;
+    }
+
+    /* Our own thread would run after every message, we only do so after
+     * messages that were meant for us */
+    return u->io_pending || u->revents || u->sink->thread_info.rewind_requested;
+}
+
+static const pa_alsa_io_device_cb io_device_cb = {
+    .attach = io_device_attach,
+    .detach = io_device_detach,
+    .process = io_device_process,
+    .after_poll = io_device_after_poll,
+    .restart = io_device_restart,
+    .linked = io_device_linked,
+};
+
 static void set_sink_name(pa_sink_new_data *data, pa_modargs *ma, const char *device_id, const char *device_name, pa_alsa_mapping *mapping) {
     const char *n;
     char *t;
@@ -2309,7 +2680,9 @@ static int setup_mixer(struct userdata *u, bool ignore_dB) {
             u->mixer_pd = pa_alsa_mixer_pdata_new();
             mixer_callback = io_mixer_callback;
 
-            if (pa_alsa_set_mixer_rtpoll(u->mixer_pd, u->mixer_handle, u->rtpoll) < 0) {
+            /* A shared IO thread is already running, it sets this up
+             * itself in io_device_attach() */
+            if (!u->io_thread && pa_alsa_set_mixer_rtpoll(u->mixer_pd, u->mixer_handle, u->rtpoll) < 0) {
                 pa_log("Failed to initialize file descriptor monitoring");
                 return -1;
             }
@@ -2335,7 +2708,8 @@ static int setup_mixer(struct userdata *u, bool ignore_dB) {
 pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_card *card, pa_alsa_mapping *mapping) {
 
     struct userdata *u = NULL;
-    const char *dev_id = NULL, *key, *mod_name;
+    const char *dev_id = NULL, *key, *mod_name, *io_thread_name;
+    bool duplex = false;
     pa_sample_spec ss;
     char *thread_name = NULL;
     uint32_t alternate_sample_rate;
@@ -2450,6 +2824,23 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "duplex", &duplex) < 0) {
+        pa_log("Failed to parse duplex argument.");
+        goto fail;
+    }
+
+    /* Both directions of a card have to be served by the same thread to be
+     * linked, without an explicit name that is the thread of the card */
+    io_thread_name = pa_modargs_get_value(ma, "io_thread", NULL);
+    if (duplex && !io_thread_name) {
+        if (card)
+            io_thread_name = card->name;
+        else {
+            pa_log_warn("Duplex mode requires io_thread= if not loaded from module-alsa-card, disabling.");
+            duplex = false;
+        }
+    }
+
     use_tsched = pa_alsa_may_tsched(use_tsched);
 
     u = pa_xnew0(struct userdata, 1);
@@ -2465,13 +2856,30 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     u->initial_info.rewind_safeguard = (size_t) rewind_safeguard;
     u->deferred_volume = deferred_volume;
     u->fixed_latency_range = fixed_latency_range;
+    u->duplex = duplex;
+
+    if (duplex) {
+        u->clock_domain = pa_sprintf_malloc("alsa-duplex-%s", io_thread_name);
+        u->duplex_msg = pa_msgobject_new(duplex_msg);
+        u->duplex_msg->parent.process_msg = duplex_process_msg;
+        u->duplex_msg->userdata = u;
+    }
     u->first = true;
     u->rewind_safeguard = rewind_safeguard;
-    u->rtpoll = pa_rtpoll_new();
+    pa_alsa_timing_init(&u->timing, pa_rtclock_now());
 
-    if (pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll) < 0) {
-        pa_log("pa_thread_mq_init() failed.");
-        goto fail;
+    if (io_thread_name) {
+        if (!(u->io_thread = pa_alsa_io_thread_get(m->core, io_thread_name)))
+            goto fail;
+
+        u->rtpoll = pa_alsa_io_thread_get_rtpoll(u->io_thread);
+    } else {
+        u->rtpoll = pa_rtpoll_new();
+
+        if (pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll) < 0) {
+            pa_log("pa_thread_mq_init() failed.");
+            goto fail;
+        }
     }
 
 #ifndef USE_SMOOTHER_2
@@ -2754,7 +3162,7 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
     u->sink->reconfigure = sink_reconfigure_cb;
     u->sink->userdata = u;
 
-    pa_sink_set_asyncmsgq(u->sink, u->thread_mq.inq);
+    pa_sink_set_asyncmsgq(u->sink, u->io_thread ? pa_alsa_io_thread_get_thread_mq(u->io_thread)->inq : u->thread_mq.inq);
     pa_sink_set_rtpoll(u->sink, u->rtpoll);
 
     u->frame_size = frame_size;
@@ -2794,13 +3202,20 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
 
     pa_alsa_dump(PA_LOG_DEBUG, u->pcm_handle);
 
-    thread_name = pa_sprintf_malloc("alsa-sink-%s", pa_strnull(pa_proplist_gets(u->sink->proplist, "alsa.id")));
-    if (!(u->thread = pa_thread_new(thread_name, thread_func, u))) {
-        pa_log("Failed to create thread.");
-        goto fail;
+    if (u->io_thread) {
+        if (!(u->io_device = pa_alsa_io_thread_add_device(u->io_thread, &io_device_cb, u))) {
+            pa_log("Failed to add device to IO thread %s.", io_thread_name);
+            goto fail;
+        }
+    } else {
+        thread_name = pa_sprintf_malloc("alsa-sink-%s", pa_strnull(pa_proplist_gets(u->sink->proplist, "alsa.id")));
+        if (!(u->thread = pa_thread_new(thread_name, thread_func, u))) {
+            pa_log("Failed to create thread.");
+            goto fail;
+        }
+        pa_xfree(thread_name);
+        thread_name = NULL;
     }
-    pa_xfree(thread_name);
-    thread_name = NULL;
 
     /* Get initial mixer settings */
     if (volume_is_set) {
@@ -2843,6 +3258,10 @@ pa_sink *pa_alsa_sink_new(pa_module *m, pa_modargs *ma, const char*driver, pa_ca
 
     pa_sink_put(u->sink);
 
+    u->message_handler_path = pa_sprintf_malloc("/sink/%s/alsa", u->sink->name);
+    pa_message_handler_register(u->core, u->message_handler_path, "ALSA sink message handler",
+                                sink_message_handler, (void *) u);
+
     if (profile_set)
         pa_alsa_profile_set_free(profile_set);
 
@@ -2880,15 +3299,32 @@ fail:
 static void userdata_free(struct userdata *u) {
     pa_assert(u);
 
+    if (u->message_handler_path) {
+        pa_message_handler_unregister(u->core, u->message_handler_path);
+        pa_xfree(u->message_handler_path);
+    }
+
     if (u->sink)
         pa_sink_unlink(u->sink);
 
+    if (u->io_device)
+        pa_alsa_io_thread_remove_device(u->io_thread, u->io_device);
+
+    /* Messages still queued for the main loop must not touch us anymore */
+    if (u->duplex_msg) {
+        u->duplex_msg->userdata = NULL;
+        pa_msgobject_unref(PA_MSGOBJECT(u->duplex_msg));
+    }
+
+    pa_xfree(u->clock_domain);
+
     if (u->thread) {
         pa_asyncmsgq_send(u->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
         pa_thread_free(u->thread);
     }
 
-    pa_thread_mq_done(&u->thread_mq);
+    if (!u->io_thread)
+        pa_thread_mq_done(&u->thread_mq);
 
     if (u->sink)
         pa_sink_unref(u->sink);
@@ -2902,7 +3338,9 @@ static void userdata_free(struct userdata *u) {
     if (u->alsa_rtpoll_item)
         pa_rtpoll_item_free(u->alsa_rtpoll_item);
 
-    if (u->rtpoll)
+    if (u->io_thread)
+        pa_alsa_io_thread_unref(u->io_thread);
+    else if (u->rtpoll)
         pa_rtpoll_free(u->rtpoll);
 
     if (u->pcm_handle) {
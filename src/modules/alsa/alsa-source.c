@@ -62,6 +62,7 @@
 
 #include "alsa-util.h"
 #include "alsa-source.h"
+#include "alsa-io-thread.h"
 
 /* #define DEBUG_TIMING */
 
@@ -92,6 +93,18 @@
 
 #define VOLUME_ACCURACY (PA_VOLUME_NORM/100)
 
+typedef struct duplex_msg {
+    pa_msgobject parent;
+    struct userdata *userdata;
+} duplex_msg;
+
+PA_DEFINE_PRIVATE_CLASS(duplex_msg, pa_msgobject);
+#define DUPLEX_MSG(o) (duplex_msg_cast(o))
+
+enum {
+    DUPLEX_MESSAGE_LINKED
+};
+
 struct userdata {
     pa_core *core;
     pa_module *module;
@@ -101,6 +114,16 @@ struct userdata {
     pa_thread_mq thread_mq;
     pa_rtpoll *rtpoll;
 
+    /* Set instead of thread/thread_mq if we run on a shared IO thread */
+    pa_alsa_io_thread *io_thread;
+    pa_alsa_io_device *io_device;
+    bool io_pending;
+
+    /* Duplex mode, see pa_alsa_io_thread_link_pcm() */
+    bool duplex, duplex_linked;
+    char *clock_domain;
+    duplex_msg *duplex_msg;
+
     snd_pcm_t *pcm_handle;
 
     char *paths_dir;
@@ -152,6 +175,8 @@ struct userdata {
     bool first;
 
     pa_rtpoll_item *alsa_rtpoll_item;
+    unsigned short revents;
+    pa_usec_t rtpoll_sleep, sleep_start;
 
 #ifdef USE_SMOOTHER_2
     pa_smoother_2 *smoother;
@@ -484,6 +509,58 @@ static void reset_vars(struct userdata *u) {
     u->first = true;
 }
 
+/* Called from IO context */
+static void set_duplex_linked(struct userdata *u, bool linked) {
+    if (u->duplex_linked == linked)
+        return;
+
+    u->duplex_linked = linked;
+
+    /* The clock domain is only announced while the PCMs are linked */
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(u->duplex_msg), DUPLEX_MESSAGE_LINKED, NULL, linked, NULL, NULL);
+}
+
+/* Called from IO context */
+static void duplex_link(struct userdata *u, pa_alsa_io_device *d) {
+    if (u->duplex && d && u->pcm_handle)
+        set_duplex_linked(u, pa_alsa_io_thread_link_pcm(u->io_thread, d, PA_ALSA_DIRECTION_INPUT, u->pcm_handle));
+}
+
+/* Called from IO context */
+static void duplex_unlink(struct userdata *u) {
+    if (u->duplex && u->io_device)
+        pa_alsa_io_thread_unlink_pcm(u->io_thread, u->io_device);
+
+    set_duplex_linked(u, false);
+}
+
+/* Called from main context */
+static int duplex_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    struct userdata *u = DUPLEX_MSG(o)->userdata;
+    pa_proplist *pl;
+
+    /* The module may be gone already */
+    if (!u || !u->source)
+        return 0;
+
+    switch (code) {
+        case DUPLEX_MESSAGE_LINKED:
+            if (offset) {
+                pl = pa_proplist_new();
+                pa_proplist_sets(pl, PA_PROP_DEVICE_CLOCK_DOMAIN, u->clock_domain);
+                pa_source_update_proplist(u->source, PA_UPDATE_REPLACE, pl);
+                pa_proplist_free(pl);
+            } else if (pa_proplist_contains(u->source->proplist, PA_PROP_DEVICE_CLOCK_DOMAIN)) {
+                pa_proplist_unset(u->source->proplist, PA_PROP_DEVICE_CLOCK_DOMAIN);
+                pa_source_update_proplist(u->source, PA_UPDATE_REPLACE, NULL);
+            }
+
+            return 0;
+    }
+
+    return 0;
+}
+
 /* Called from IO context */
 static void close_pcm(struct userdata *u) {
 
@@ -494,6 +571,7 @@ static void close_pcm(struct userdata *u) {
 #endif
 
     /* Let's suspend */
+    duplex_unlink(u);
     snd_pcm_close(u->pcm_handle);
     u->pcm_handle = NULL;
 
@@ -518,6 +596,9 @@ static int try_recover(struct userdata *u, const char *call, int err) {
     if (err == -ESTRPIPE)
         pa_log_debug("%s: System suspended!", call);
 
+    /* An xrun stops both linked PCMs, each side recovers on its own */
+    duplex_unlink(u);
+
     if ((err = snd_pcm_recover(u->pcm_handle, err, 1)) < 0) {
         pa_log("%s: %s, trying to restart PCM", call, pa_alsa_strerror(err));
 
@@ -1169,6 +1250,8 @@ static int unsuspend(struct userdata *u, bool recovering) {
     if (u->use_tsched && !recovering)
         reset_watermark(u, u->tsched_watermark_ref, &u->source->sample_spec, true);
 
+    duplex_link(u, u->io_device);
+
     pa_log_info("Resumed successfully...");
 
     return 0;
@@ -1223,6 +1306,8 @@ static void sync_mixer(struct userdata *u, pa_device_port *port) {
 static int source_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
     struct userdata *u = PA_SOURCE(o)->userdata;
 
+    u->io_pending = true;
+
     switch (code) {
 
         case PA_SOURCE_MESSAGE_GET_LATENCY: {
@@ -1637,6 +1722,7 @@ static void source_update_requested_latency_cb(pa_source *s) {
         return;
 
     update_sw_params(u);
+    u->io_pending = true;
 }
 
 static void source_reconfigure_cb(pa_source *s, pa_sample_spec *spec, bool passthrough) {
@@ -1699,154 +1785,184 @@ static void source_reconfigure_cb(pa_source *s, pa_sample_spec *spec, bool passt
 
 }
 
-static void thread_func(void *userdata) {
-    struct userdata *u = userdata;
-    unsigned short revents = 0;
-
-    pa_assert(u);
-
-    pa_log_debug("Thread starting up");
-
-    if (u->core->realtime_scheduling)
-        pa_thread_make_realtime(u->core->realtime_priority);
-
-    pa_thread_mq_install(&u->thread_mq);
-
-    for (;;) {
-        int ret;
-        pa_usec_t rtpoll_sleep = 0, real_sleep;
+/* Called from IO context. Reads what is available and computes how long
+ * to sleep until the next round, in u->rtpoll_sleep. */
+static int thread_process(struct userdata *u, bool on_timeout) {
+    pa_usec_t rtpoll_sleep = 0;
 
 #ifdef DEBUG_TIMING
-        pa_log_debug("Loop");
+    pa_log_debug("Loop");
 #endif
 
-        /* Read some data and pass it to the sources */
-        if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
-            int work_done;
-            pa_usec_t sleep_usec = 0;
-            bool on_timeout = pa_rtpoll_timer_elapsed(u->rtpoll);
+    /* Read some data and pass it to the sources */
+    if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
+        int work_done;
+        pa_usec_t sleep_usec = 0;
 
-            if (u->first) {
+        /* When linked to the playback PCM, starting that one starts us too */
+        if (u->first && (!u->duplex_linked || snd_pcm_state(u->pcm_handle) == SND_PCM_STATE_RUNNING)) {
+            if (!u->duplex_linked) {
                 pa_log_info("Starting capture.");
                 snd_pcm_start(u->pcm_handle);
+            }
 
 #ifdef USE_SMOOTHER_2
-                pa_smoother_2_resume(u->smoother, pa_rtclock_now());
+            pa_smoother_2_resume(u->smoother, pa_rtclock_now());
 #else
-                pa_smoother_resume(u->smoother, pa_rtclock_now(), true);
+            pa_smoother_resume(u->smoother, pa_rtclock_now(), true);
 #endif
 
-                u->first = false;
-            }
+            u->first = false;
+        }
 
-            if (u->use_mmap)
-                work_done = mmap_read(u, &sleep_usec, revents & POLLIN, on_timeout);
-            else
-                work_done = unix_read(u, &sleep_usec, revents & POLLIN, on_timeout);
+        if (u->use_mmap)
+            work_done = mmap_read(u, &sleep_usec, u->revents & POLLIN, on_timeout);
+        else
+            work_done = unix_read(u, &sleep_usec, u->revents & POLLIN, on_timeout);
 
-            if (work_done < 0)
-                goto fail;
+        if (work_done < 0)
+            return -1;
 
-/*             pa_log_debug("work_done = %i", work_done); */
+/*         pa_log_debug("work_done = %i", work_done); */
 
-            if (work_done)
-                update_smoother(u);
+        if (work_done)
+            update_smoother(u);
 
-            if (u->use_tsched) {
-                pa_usec_t cusec;
+        if (u->use_tsched) {
+            pa_usec_t cusec;
 
-                /* OK, the capture buffer is now empty, let's
-                 * calculate when to wake up next */
+            /* OK, the capture buffer is now empty, let's
+             * calculate when to wake up next */
 
-/*                 pa_log_debug("Waking up in %0.2fms (sound card clock).", (double) sleep_usec / PA_USEC_PER_MSEC); */
+/*             pa_log_debug("Waking up in %0.2fms (sound card clock).", (double) sleep_usec / PA_USEC_PER_MSEC); */
 
-                /* Convert from the sound card time domain to the
-                 * system time domain */
+            /* Convert from the sound card time domain to the
+             * system time domain */
 #ifdef USE_SMOOTHER_2
-                cusec = pa_smoother_2_translate(u->smoother, sleep_usec);
+            cusec = pa_smoother_2_translate(u->smoother, sleep_usec);
 #else
-                cusec = pa_smoother_translate(u->smoother, pa_rtclock_now(), sleep_usec);
+            cusec = pa_smoother_translate(u->smoother, pa_rtclock_now(), sleep_usec);
 #endif
 
-/*                 pa_log_debug("Waking up in %0.2fms (system clock).", (double) cusec / PA_USEC_PER_MSEC); */
+/*             pa_log_debug("Waking up in %0.2fms (system clock).", (double) cusec / PA_USEC_PER_MSEC); */
 
-                /* We don't trust the conversion, so we wake up whatever comes first */
-                rtpoll_sleep = PA_MIN(sleep_usec, cusec);
-            }
-        }
+            /* We don't trust the conversion, so we wake up whatever comes first */
+            rtpoll_sleep = PA_MIN(sleep_usec, cusec);
 
-        if (u->source->flags & PA_SOURCE_DEFERRED_VOLUME) {
-            pa_usec_t volume_sleep;
-            pa_source_volume_change_apply(u->source, &volume_sleep);
-            if (volume_sleep > 0) {
-                if (rtpoll_sleep > 0)
-                    rtpoll_sleep = PA_MIN(volume_sleep, rtpoll_sleep);
-                else
-                    rtpoll_sleep = volume_sleep;
-            }
+            /* Until the playback side started us we cannot know when data
+             * will be available, check back soon */
+            if (u->first && u->duplex_linked)
+                rtpoll_sleep = PA_MIN(rtpoll_sleep, u->tsched_watermark_usec);
         }
+    }
 
-        if (rtpoll_sleep > 0) {
-            pa_rtpoll_set_timer_relative(u->rtpoll, rtpoll_sleep);
-            real_sleep = pa_rtclock_now();
+    if (u->source->flags & PA_SOURCE_DEFERRED_VOLUME) {
+        pa_usec_t volume_sleep;
+        pa_source_volume_change_apply(u->source, &volume_sleep);
+        if (volume_sleep > 0) {
+            if (rtpoll_sleep > 0)
+                rtpoll_sleep = PA_MIN(volume_sleep, rtpoll_sleep);
+            else
+                rtpoll_sleep = volume_sleep;
         }
-        else
-            pa_rtpoll_set_timer_disabled(u->rtpoll);
+    }
 
-        /* Hmm, nothing to do. Let's sleep */
-        if ((ret = pa_rtpoll_run(u->rtpoll)) < 0)
-            goto fail;
+    u->rtpoll_sleep = rtpoll_sleep;
 
-        if (rtpoll_sleep > 0) {
-            real_sleep = pa_rtclock_now() - real_sleep;
+    if (rtpoll_sleep > 0)
+        u->sleep_start = pa_rtclock_now();
+
+    return 0;
+}
+
+/* Called from IO context after polling */
+static int thread_after_poll(struct userdata *u) {
+
+    if (u->rtpoll_sleep > 0) {
+        pa_usec_t real_sleep = pa_rtclock_now() - u->sleep_start;
 #ifdef DEBUG_TIMING
-            pa_log_debug("Expected sleep: %0.2fms, real sleep: %0.2fms (diff %0.2f ms)",
-                (double) rtpoll_sleep / PA_USEC_PER_MSEC, (double) real_sleep / PA_USEC_PER_MSEC,
-                (double) ((int64_t) real_sleep - (int64_t) rtpoll_sleep) / PA_USEC_PER_MSEC);
+        pa_log_debug("Expected sleep: %0.2fms, real sleep: %0.2fms (diff %0.2f ms)",
+            (double) u->rtpoll_sleep / PA_USEC_PER_MSEC, (double) real_sleep / PA_USEC_PER_MSEC,
+            (double) ((int64_t) real_sleep - (int64_t) u->rtpoll_sleep) / PA_USEC_PER_MSEC);
 #endif
-            if (u->use_tsched && real_sleep > rtpoll_sleep + u->tsched_watermark_usec)
-                pa_log_info("Scheduling delay of %0.2f ms > %0.2f ms, you might want to investigate this to improve latency...",
-                    (double) (real_sleep - rtpoll_sleep) / PA_USEC_PER_MSEC,
-                    (double) (u->tsched_watermark_usec) / PA_USEC_PER_MSEC);
+        if (u->use_tsched && real_sleep > u->rtpoll_sleep + u->tsched_watermark_usec)
+            pa_log_info("Scheduling delay of %0.2f ms > %0.2f ms, you might want to investigate this to improve latency...",
+                (double) (real_sleep - u->rtpoll_sleep) / PA_USEC_PER_MSEC,
+                (double) (u->tsched_watermark_usec) / PA_USEC_PER_MSEC);
+    }
+
+    if (u->source->flags & PA_SOURCE_DEFERRED_VOLUME)
+        pa_source_volume_change_apply(u->source, NULL);
+
+    /* Tell ALSA about this and process its response */
+    if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
+        struct pollfd *pollfd;
+        int err;
+        unsigned n;
+
+        pollfd = pa_rtpoll_item_get_pollfd(u->alsa_rtpoll_item, &n);
+
+        if ((err = snd_pcm_poll_descriptors_revents(u->pcm_handle, pollfd, n, &u->revents)) < 0) {
+            pa_log("snd_pcm_poll_descriptors_revents() failed: %s", pa_alsa_strerror(err));
+            return -1;
         }
 
-        if (u->source->flags & PA_SOURCE_DEFERRED_VOLUME)
-            pa_source_volume_change_apply(u->source, NULL);
+        if (u->revents & ~POLLIN) {
+            duplex_unlink(u);
 
-        if (ret == 0)
-            goto finish;
+            if ((err = pa_alsa_recover_from_poll(u->pcm_handle, u->revents)) < 0)
+                return -1;
 
-        /* Tell ALSA about this and process its response */
-        if (PA_SOURCE_IS_OPENED(u->source->thread_info.state)) {
-            struct pollfd *pollfd;
-            int err;
-            unsigned n;
+            /* Stream needs to be restarted */
+            if (err == 1) {
+                close_pcm(u);
+                if (unsuspend(u, true) < 0)
+                    return -1;
+            } else
+                reset_vars(u);
 
-            pollfd = pa_rtpoll_item_get_pollfd(u->alsa_rtpoll_item, &n);
+            u->revents = 0;
+        } else if (u->revents && u->use_tsched && pa_log_ratelimit(PA_LOG_DEBUG))
+            pa_log_debug("Wakeup from ALSA!");
 
-            if ((err = snd_pcm_poll_descriptors_revents(u->pcm_handle, pollfd, n, &revents)) < 0) {
-                pa_log("snd_pcm_poll_descriptors_revents() failed: %s", pa_alsa_strerror(err));
-                goto fail;
-            }
+    } else
+        u->revents = 0;
 
-            if (revents & ~POLLIN) {
-                if ((err = pa_alsa_recover_from_poll(u->pcm_handle, revents)) < 0)
-                    goto fail;
+    return 0;
+}
 
-                /* Stream needs to be restarted */
-                if (err == 1) {
-                    close_pcm(u);
-                    if (unsuspend(u, true) < 0)
-                        goto fail;
-                } else
-                    reset_vars(u);
+static void thread_func(void *userdata) {
+    struct userdata *u = userdata;
 
-                revents = 0;
-            } else if (revents && u->use_tsched && pa_log_ratelimit(PA_LOG_DEBUG))
-                pa_log_debug("Wakeup from ALSA!");
+    pa_assert(u);
 
-        } else
-            revents = 0;
+    pa_log_debug("Thread starting up");
+
+    if (u->core->realtime_scheduling)
+        pa_thread_make_realtime(u->core->realtime_priority);
+
+    pa_thread_mq_install(&u->thread_mq);
+
+    for (;;) {
+        int ret;
+
+        if (thread_process(u, pa_rtpoll_timer_elapsed(u->rtpoll)) < 0)
+            goto fail;
+
+        if (u->rtpoll_sleep > 0)
+            pa_rtpoll_set_timer_relative(u->rtpoll, u->rtpoll_sleep);
+        else
+            pa_rtpoll_set_timer_disabled(u->rtpoll);
+
+        /* Hmm, nothing to do. Let's sleep */
+        if ((ret = pa_rtpoll_run(u->rtpoll)) < 0)
+            goto fail;
+
+        if (ret == 0)
+            goto finish;
+
+        if (thread_after_poll(u) < 0)
+            goto fail;
     }
 
 fail:
@@ -1859,6 +1975,90 @@ finish:
     pa_log_debug("Thread shutting down");
 }
 
+/* Called from IO context, when running on a shared IO thread */
+static int io_device_attach(void *userdata, pa_alsa_io_device *d) {
+    struct userdata *u = userdata;
+
+    if (u->mixer_pd && pa_alsa_set_mixer_rtpoll(u->mixer_pd, u->mixer_handle, u->rtpoll) < 0) {
+        pa_log("Failed to initialize file descriptor monitoring");
+        return -1;
+    }
+
+    duplex_link(u, d);
+
+    return 0;
+}
+
+static void io_device_detach(void *userdata) {
+    struct userdata *u = userdata;
+
+    duplex_unlink(u);
+
+    if (u->alsa_rtpoll_item) {
+        pa_rtpoll_item_free(u->alsa_rtpoll_item);
+        u->alsa_rtpoll_item = NULL;
+    }
+
+    if (u->mixer_pd) {
+        pa_alsa_mixer_pdata_free(u->mixer_pd);
+        u->mixer_pd = NULL;
+    }
+}
+
+static void io_device_restart(void *userdata) {
+    struct userdata *u = userdata;
+
+    /* The other side stopped and prepared our PCM to link it */
+    reset_vars(u);
+    u->io_pending = true;
+}
+
+static void io_device_linked(void *userdata, bool linked) {
+    struct userdata *u = userdata;
+
+    /* The other side linked or unlinked the PCMs */
+    set_duplex_linked(u, linked);
+    u->io_pending = true;
+}
+
+static void io_device_fail(struct userdata *u) {
+    pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(u->core), PA_CORE_MESSAGE_UNLOAD_MODULE, u->module, 0, NULL, NULL);
+}
+
+static int io_device_process(void *userdata, bool on_timeout, pa_usec_t *sleep_usec) {
+    struct userdata *u = userdata;
+
+    u->io_pending = false;
+
+    if (thread_process(u, on_timeout) < 0) {
+        io_device_fail(u);
+        return -1;
+    }
+
+    *sleep_usec = u->rtpoll_sleep;
+    return 0;
+}
+
+static int io_device_after_poll(void *userdata, bool on_timeout) {
+    struct userdata *u = userdata;
+
+    if (thread_after_poll(u) < 0) {
+        io_device_fail(u);
+        return -1;
+    }
+
+    return u->io_pending || u->revents;
+}
+
+static const pa_alsa_io_device_cb io_device_cb = {
+    .attach = io_device_attach,
+    .detach = io_device_detach,
+    .process = io_device_process,
+    .after_poll = io_device_after_poll,
+    .restart = io_device_restart,
+    .linked = io_device_linked,
+};
+
 static void set_source_name(pa_source_new_data *data, pa_modargs *ma, const char *device_id, const char *device_name, pa_alsa_mapping *mapping) {
     const char *n;
     char *t;
@@ -2013,7 +2213,9 @@ static int setup_mixer(struct userdata *u, bool ignore_dB) {
             u->mixer_pd = pa_alsa_mixer_pdata_new();
             mixer_callback = io_mixer_callback;
 
-            if (pa_alsa_set_mixer_rtpoll(u->mixer_pd, u->mixer_handle, u->rtpoll) < 0) {
+            /* A shared IO thread is already running, it sets this up
+             * itself in io_device_attach() */
+            if (!u->io_thread && pa_alsa_set_mixer_rtpoll(u->mixer_pd, u->mixer_handle, u->rtpoll) < 0) {
                 pa_log("Failed to initialize file descriptor monitoring");
                 return -1;
             }
@@ -2039,7 +2241,8 @@ static int setup_mixer(struct userdata *u, bool ignore_dB) {
 pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, pa_card *card, pa_alsa_mapping *mapping) {
 
     struct userdata *u = NULL;
-    const char *dev_id = NULL, *key, *mod_name;
+    const char *dev_id = NULL, *key, *mod_name, *io_thread_name;
+    bool duplex = false;
     pa_sample_spec ss;
     char *thread_name = NULL;
     uint32_t alternate_sample_rate;
@@ -2143,6 +2346,23 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
         goto fail;
     }
 
+    if (pa_modargs_get_value_boolean(ma, "duplex", &duplex) < 0) {
+        pa_log("Failed to parse duplex argument.");
+        goto fail;
+    }
+
+    /* Both directions of a card have to be served by the same thread to be
+     * linked, without an explicit name that is the thread of the card */
+    io_thread_name = pa_modargs_get_value(ma, "io_thread", NULL);
+    if (duplex && !io_thread_name) {
+        if (card)
+            io_thread_name = card->name;
+        else {
+            pa_log_warn("Duplex mode requires io_thread= if not loaded from module-alsa-card, disabling.");
+            duplex = false;
+        }
+    }
+
     use_tsched = pa_alsa_may_tsched(use_tsched);
 
     u = pa_xnew0(struct userdata, 1);
@@ -2157,12 +2377,28 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
     u->initial_info.tsched_watermark = (size_t) tsched_watermark;
     u->deferred_volume = deferred_volume;
     u->fixed_latency_range = fixed_latency_range;
+    u->duplex = duplex;
+
+    if (duplex) {
+        u->clock_domain = pa_sprintf_malloc("alsa-duplex-%s", io_thread_name);
+        u->duplex_msg = pa_msgobject_new(duplex_msg);
+        u->duplex_msg->parent.process_msg = duplex_process_msg;
+        u->duplex_msg->userdata = u;
+    }
     u->first = true;
-    u->rtpoll = pa_rtpoll_new();
 
-    if (pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll) < 0) {
-        pa_log("pa_thread_mq_init() failed.");
-        goto fail;
+    if (io_thread_name) {
+        if (!(u->io_thread = pa_alsa_io_thread_get(m->core, io_thread_name)))
+            goto fail;
+
+        u->rtpoll = pa_alsa_io_thread_get_rtpoll(u->io_thread);
+    } else {
+        u->rtpoll = pa_rtpoll_new();
+
+        if (pa_thread_mq_init(&u->thread_mq, m->core->mainloop, u->rtpoll) < 0) {
+            pa_log("pa_thread_mq_init() failed.");
+            goto fail;
+        }
     }
 
 #ifndef USE_SMOOTHER_2
@@ -2413,7 +2649,7 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
     u->source->reconfigure = source_reconfigure_cb;
     u->source->userdata = u;
 
-    pa_source_set_asyncmsgq(u->source, u->thread_mq.inq);
+    pa_source_set_asyncmsgq(u->source, u->io_thread ? pa_alsa_io_thread_get_thread_mq(u->io_thread)->inq : u->thread_mq.inq);
     pa_source_set_rtpoll(u->source, u->rtpoll);
 
     u->frame_size = frame_size;
@@ -2446,13 +2682,20 @@ pa_source *pa_alsa_source_new(pa_module *m, pa_modargs *ma, const char*driver, p
 
     pa_alsa_dump(PA_LOG_DEBUG, u->pcm_handle);
 
-    thread_name = pa_sprintf_malloc("alsa-source-%s", pa_strnull(pa_proplist_gets(u->source->proplist, "alsa.id")));
-    if (!(u->thread = pa_thread_new(thread_name, thread_func, u))) {
-        pa_log("Failed to create thread.");
-        goto fail;
+    if (u->io_thread) {
+        if (!(u->io_device = pa_alsa_io_thread_add_device(u->io_thread, &io_device_cb, u))) {
+            pa_log("Failed to add device to IO thread %s.", io_thread_name);
+            goto fail;
+        }
+    } else {
+        thread_name = pa_sprintf_malloc("alsa-source-%s", pa_strnull(pa_proplist_gets(u->source->proplist, "alsa.id")));
+        if (!(u->thread = pa_thread_new(thread_name, thread_func, u))) {
+            pa_log("Failed to create thread.");
+            goto fail;
+        }
+        pa_xfree(thread_name);
+        thread_name = NULL;
     }
-    pa_xfree(thread_name);
-    thread_name = NULL;
 
     /* Get initial mixer settings */
     if (volume_is_set) {
@@ -2503,12 +2746,24 @@ static void userdata_free(struct userdata *u) {
     if (u->source)
         pa_source_unlink(u->source);
 
+    if (u->io_device)
+        pa_alsa_io_thread_remove_device(u->io_thread, u->io_device);
+
+    /* Messages still queued for the main loop must not touch us anymore */
+    if (u->duplex_msg) {
+        u->duplex_msg->userdata = NULL;
+        pa_msgobject_unref(PA_MSGOBJECT(u->duplex_msg));
+    }
+
+    pa_xfree(u->clock_domain);
+
     if (u->thread) {
         pa_asyncmsgq_send(u->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
         pa_thread_free(u->thread);
     }
 
-    pa_thread_mq_done(&u->thread_mq);
+    if (!u->io_thread)
+        pa_thread_mq_done(&u->thread_mq);
 
     if (u->source)
         pa_source_unref(u->source);
@@ -2519,7 +2774,9 @@ static void userdata_free(struct userdata *u) {
     if (u->alsa_rtpoll_item)
         pa_rtpoll_item_free(u->alsa_rtpoll_item);
 
-    if (u->rtpoll)
+    if (u->io_thread)
+        pa_alsa_io_thread_unref(u->io_thread);
+    else if (u->rtpoll)
         pa_rtpoll_free(u->rtpoll);
 
     if (u->pcm_handle) {
@@ -0,0 +1,181 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/macro.h>
+
+#include "alsa-timing.h"
+
+static void histogram_add(pa_alsa_timing_histogram *h, pa_usec_t value) {
+    pa_usec_t i;
+
+    i = PA_MIN(value / PA_ALSA_TIMING_BUCKET_USEC, (pa_usec_t) PA_ALSA_TIMING_BUCKETS);
+
+    h->buckets[i]++;
+    h->n++;
+
+    if (value > h->max)
+        h->max = value;
+}
+
+static void histogram_to_json(const pa_alsa_timing_histogram *h, const char *name, pa_json_encoder *encoder) {
+    unsigned i;
+
+    pa_json_encoder_begin_member_object(encoder, name);
+    pa_json_encoder_add_member_int(encoder, "count", h->n);
+    pa_json_encoder_add_member_int(encoder, "max_usec", (int64_t) h->max);
+    pa_json_encoder_add_member_int(encoder, "bucket_usec", PA_ALSA_TIMING_BUCKET_USEC);
+    pa_json_encoder_begin_member_array(encoder, "buckets");
+    for (i = 0; i <= PA_ALSA_TIMING_BUCKETS; i++)
+        pa_json_encoder_add_element_int(encoder, h->buckets[i]);
+    pa_json_encoder_end_array(encoder);
+    pa_json_encoder_end_object(encoder);
+}
+
+void pa_alsa_timing_init(pa_alsa_timing *t, pa_usec_t now) {
+    pa_assert(t);
+
+    pa_zero(*t);
+    t->window_start = now;
+}
+
+void pa_alsa_timing_add_usage(pa_alsa_timing *t, pa_usec_t now, pa_usec_t usage) {
+    pa_assert(t);
+
+    /* Start a new generation, dropping the one before the current */
+    if (now >= t->window_start + PA_ALSA_TIMING_WINDOW_USEC) {
+        t->current ^= 1;
+        pa_zero(t->usage[t->current]);
+        t->window_start = now;
+    }
+
+    histogram_add(&t->usage[t->current], usage);
+    t->n_wakeups++;
+}
+
+void pa_alsa_timing_add_jitter(pa_alsa_timing *t, pa_usec_t delay) {
+    pa_assert(t);
+
+    histogram_add(&t->jitter, delay);
+}
+
+void pa_alsa_timing_add_render(pa_alsa_timing *t, pa_usec_t render_usec) {
+    pa_assert(t);
+
+    t->n_renders++;
+    t->render_usec += render_usec;
+
+    if (render_usec > t->render_max_usec)
+        t->render_max_usec = render_usec;
+}
+
+void pa_alsa_timing_add_underrun(pa_alsa_timing *t) {
+    pa_assert(t);
+
+    t->n_underruns++;
+}
+
+void pa_alsa_timing_watermark_changed(pa_alsa_timing *t, pa_usec_t now, pa_usec_t watermark, bool underrun) {
+    pa_alsa_watermark_change *c;
+
+    pa_assert(t);
+
+    c = &t->history[t->n_history % PA_ALSA_TIMING_HISTORY];
+    c->time = now;
+    c->watermark = watermark;
+    c->underrun = underrun;
+
+    t->n_history++;
+}
+
+bool pa_alsa_timing_required_watermark(const pa_alsa_timing *t, double probability, pa_usec_t *watermark) {
+    const pa_alsa_timing_histogram *a, *b;
+    uint32_t n, allowed, tail;
+    int i;
+
+    pa_assert(t);
+    pa_assert(watermark);
+    pa_assert(probability >= 0 && probability < 1);
+
+    a = &t->usage[0];
+    b = &t->usage[1];
+    n = a->n + b->n;
+
+    if (n < PA_ALSA_TIMING_MIN_SAMPLES)
+        return false;
+
+    /* Number of samples that may lie above the watermark. With fewer than
+     * 1/probability samples this is zero, i.e. we cover the worst case seen. */
+    allowed = (uint32_t) (probability * n);
+
+    tail = a->buckets[PA_ALSA_TIMING_BUCKETS] + b->buckets[PA_ALSA_TIMING_BUCKETS];
+    if (tail > allowed)
+        return false;
+
+    for (i = PA_ALSA_TIMING_BUCKETS - 1; i > 0; i--) {
+        tail += a->buckets[i] + b->buckets[i];
+
+        if (tail > allowed)
+            break;
+    }
+
+    /* If the quantile falls into the topmost bucket in use, the maximum is a
+     * tighter bound than the bucket edge */
+    *watermark = PA_MIN((pa_usec_t) (i + 1) * PA_ALSA_TIMING_BUCKET_USEC, PA_MAX(a->max, b->max));
+    return true;
+}
+
+void pa_alsa_timing_to_json(const pa_alsa_timing *t, pa_json_encoder *encoder) {
+    pa_alsa_timing_histogram usage;
+    unsigned i;
+
+    pa_assert(t);
+    pa_assert(encoder);
+
+    pa_zero(usage);
+    for (i = 0; i <= PA_ALSA_TIMING_BUCKETS; i++)
+        usage.buckets[i] = t->usage[0].buckets[i] + t->usage[1].buckets[i];
+    usage.n = t->usage[0].n + t->usage[1].n;
+    usage.max = PA_MAX(t->usage[0].max, t->usage[1].max);
+
+    pa_json_encoder_add_member_int(encoder, "wakeups", (int64_t) t->n_wakeups);
+    pa_json_encoder_add_member_int(encoder, "underruns", (int64_t) t->n_underruns);
+
+    pa_json_encoder_begin_member_object(encoder, "render");
+    pa_json_encoder_add_member_int(encoder, "count", (int64_t) t->n_renders);
+    pa_json_encoder_add_member_int(encoder, "total_usec", (int64_t) t->render_usec);
+    pa_json_encoder_add_member_int(encoder, "max_usec", (int64_t) t->render_max_usec);
+    pa_json_encoder_end_object(encoder);
+
+    histogram_to_json(&t->jitter, "wakeup_jitter", encoder);
+    histogram_to_json(&usage, "watermark_usage", encoder);
+
+    pa_json_encoder_begin_member_array(encoder, "watermark_history");
+    for (i = t->n_history > PA_ALSA_TIMING_HISTORY ? t->n_history - PA_ALSA_TIMING_HISTORY : 0; i < t->n_history; i++) {
+        const pa_alsa_watermark_change *c = &t->history[i % PA_ALSA_TIMING_HISTORY];
+
+        pa_json_encoder_begin_element_object(encoder);
+        pa_json_encoder_add_member_int(encoder, "time_usec", (int64_t) c->time);
+        pa_json_encoder_add_member_int(encoder, "watermark_usec", (int64_t) c->watermark);
+        pa_json_encoder_add_member_bool(encoder, "underrun", c->underrun);
+        pa_json_encoder_end_object(encoder);
+    }
+    pa_json_encoder_end_array(encoder);
+}
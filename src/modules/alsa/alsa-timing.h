@@ -0,0 +1,93 @@
+#ifndef fooalsatiminghfoo
+#define fooalsatiminghfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/sample.h>
+#include <pulse/timeval.h>
+
+#include <pulsecore/json.h>
+
+/* Timer based scheduling statistics of an ALSA device, and the model the
+ * wakeup watermark is derived from.
+ *
+ * For every wakeup caused by our own timer the IO thread records how much of
+ * the watermark was used up before the buffer was refilled: the difference
+ * between the fill level we expected when arming the timer and the one we
+ * found, plus the time spent rendering. This covers scheduling delay as well
+ * as errors of the clock smoother. The watermark needed to make an underrun
+ * less likely than some probability p is then the (1-p) quantile of these
+ * samples. Samples are kept in two generations of PA_ALSA_TIMING_WINDOW_USEC
+ * each, so that the estimate follows changes of the system load. */
+
+#define PA_ALSA_TIMING_BUCKETS 64
+#define PA_ALSA_TIMING_BUCKET_USEC (500)                    /* 0.5ms */
+#define PA_ALSA_TIMING_WINDOW_USEC (30*PA_USEC_PER_SEC)     /* 30s */
+#define PA_ALSA_TIMING_MIN_SAMPLES 100
+#define PA_ALSA_TIMING_HISTORY 16
+
+typedef struct pa_alsa_timing_histogram {
+    /* The last bucket collects everything beyond the covered range */
+    uint32_t buckets[PA_ALSA_TIMING_BUCKETS + 1];
+    uint32_t n;
+    pa_usec_t max;
+} pa_alsa_timing_histogram;
+
+typedef struct pa_alsa_watermark_change {
+    pa_usec_t time;
+    pa_usec_t watermark;
+    bool underrun;
+} pa_alsa_watermark_change;
+
+typedef struct pa_alsa_timing {
+    pa_alsa_timing_histogram usage[2];
+    unsigned current;
+    pa_usec_t window_start;
+
+    /* Delay of timer wakeups against the requested sleep time, since start */
+    pa_alsa_timing_histogram jitter;
+
+    uint64_t n_wakeups;
+    uint64_t n_underruns;
+
+    uint64_t n_renders;
+    pa_usec_t render_usec;
+    pa_usec_t render_max_usec;
+
+    pa_alsa_watermark_change history[PA_ALSA_TIMING_HISTORY];
+    unsigned n_history;
+} pa_alsa_timing;
+
+void pa_alsa_timing_init(pa_alsa_timing *t, pa_usec_t now);
+
+void pa_alsa_timing_add_usage(pa_alsa_timing *t, pa_usec_t now, pa_usec_t usage);
+void pa_alsa_timing_add_jitter(pa_alsa_timing *t, pa_usec_t delay);
+void pa_alsa_timing_add_render(pa_alsa_timing *t, pa_usec_t render_usec);
+void pa_alsa_timing_add_underrun(pa_alsa_timing *t);
+void pa_alsa_timing_watermark_changed(pa_alsa_timing *t, pa_usec_t now, pa_usec_t watermark, bool underrun);
+
+/* Smallest watermark for which the fraction of recorded wakeups that would
+ * have underrun does not exceed probability. Returns false if there are not
+ * enough samples yet or the tail lies beyond the histogram range. */
+bool pa_alsa_timing_required_watermark(const pa_alsa_timing *t, double probability, pa_usec_t *watermark);
+
+void pa_alsa_timing_to_json(const pa_alsa_timing *t, pa_json_encoder *encoder);
+
+#endif
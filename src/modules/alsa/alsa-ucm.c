@@ -208,9 +208,6 @@ static void ucm_add_devices_to_idxset(
 
         name = pa_proplist_gets(d->proplist, PA_ALSA_PROP_UCM_NAME);
 
-#ifdef HAVE_OPENMP
-#pragma omp parallel for
-#endif
         for (i = 0; i < n; i++)
             if (pa_streq(dev_names[i], name))
                 pa_idxset_put(idxset, d, NULL);
@@ -615,9 +612,6 @@ static int ucm_get_devices(pa_alsa_ucm_verb *verb, snd_use_case_mgr_t *uc_mgr) {
     if (num_dev < 0)
         return num_dev;
 
-#ifdef HAVE_OPENMP
-#pragma omp parallel for
-#endif
     for (i = 0; i < num_dev; i += 2) {
         pa_alsa_ucm_device *d = pa_xnew0(pa_alsa_ucm_device, 1);
 
@@ -717,9 +711,6 @@ static int ucm_get_modifiers(pa_alsa_ucm_verb *verb, snd_use_case_mgr_t *uc_mgr)
     if (num_mod < 0)
         return num_mod;
 
-#ifdef HAVE_OPENMP
-#pragma omp parallel for
-#endif
     for (i = 0; i < num_mod; i += 2) {
         pa_alsa_ucm_modifier *m;
 
@@ -962,9 +953,6 @@ int pa_alsa_ucm_query_profiles(pa_alsa_ucm_config *ucm, int card_index) {
     }
 
     /* get the properties of each UCM verb */
-#ifdef HAVE_OPENMP
-#pragma omp parallel for
-#endif
     for (i = 0; i < num_verbs; i += 2) {
         pa_alsa_ucm_verb *verb;
 
@@ -1149,9 +1137,6 @@ static char *devset_name(pa_idxset *devices, const char *sep) {
     /* Sort by alphabetical order so as to have a deterministic naming scheme */
     qsort(&sorted[0], num, sizeof(pa_alsa_ucm_device *), pa_alsa_ucm_device_cmp);
 
-#ifdef HAVE_OPENMP
-#pragma omp parallel for
-#endif
     for (i = 0; i < num; i++) {
         dev = sorted[i];
         const char *dev_name = pa_proplist_gets(dev->proplist, PA_ALSA_PROP_UCM_NAME);
@@ -1184,9 +1169,6 @@ PA_UNUSED static char *devset_description(pa_idxset *devices, const char *sep) {
     /* Sort by alphabetical order to match devset_name() */
     qsort(&sorted[0], num, sizeof(pa_alsa_ucm_device *), pa_alsa_ucm_device_cmp);
 
-#ifdef HAVE_OPENMP
-#pragma omp parallel for
-#endif
     for (i = 0; i < num; i++) {
         dev = sorted[i];
         const char *dev_desc = pa_proplist_gets(dev->proplist, PA_ALSA_PROP_UCM_DESCRIPTION);
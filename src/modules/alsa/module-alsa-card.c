@@ -36,6 +36,7 @@
 
 #include "alsa-util.h"
 #include "alsa-ucm.h"
+#include "alsa-probe-cache.h"
 #include "alsa-sink.h"
 #include "alsa-source.h"
 
@@ -70,6 +71,8 @@ PA_MODULE_USAGE(
         "use_ucm=<load use case manager> "
         "avoid_resampling=<use stream original sample rate if possible?> "
         "control=<name of mixer control> "
+        "io_thread=<name of an IO thread to share with other devices> "
+        "duplex=<link playback and capture to run from one clock?> "
 );
 
 static const char* const valid_modargs[] = {
@@ -99,6 +102,8 @@ static const char* const valid_modargs[] = {
     "use_ucm",
     "avoid_resampling",
     "control",
+    "io_thread",
+    "duplex",
     NULL
 };
 
@@ -999,7 +1004,11 @@ int pa__init(pa_module *m) {
 
     u->profile_set->ignore_dB = ignore_dB;
 
-    pa_alsa_profile_set_probe(u->profile_set, u->mixers, u->device_id, &m->core->default_sample_spec, m->core->default_n_fragments, m->core->default_fragment_size_msec);
+    if (u->use_ucm)
+        pa_alsa_profile_set_probe(u->profile_set, u->mixers, u->device_id, &m->core->default_sample_spec, m->core->default_n_fragments, m->core->default_fragment_size_msec);
+    else
+        pa_alsa_profile_set_probe_cached(u->profile_set, u->mixers, u->device_id, u->alsa_card_index,
+                                         &m->core->default_sample_spec, m->core->default_n_fragments, m->core->default_fragment_size_msec);
     pa_alsa_profile_set_dump(u->profile_set);
 
     pa_card_new_data_init(&data);
@@ -57,7 +57,9 @@ PA_MODULE_USAGE(
         "deferred_volume=<Synchronize software and hardware volume changes to avoid momentary jumps?> "
         "deferred_volume_safety_margin=<usec adjustment depending on volume direction> "
         "deferred_volume_extra_delay=<usec adjustment to HW volume changes> "
-        "fixed_latency_range=<disable latency range changes on underrun?>");
+        "fixed_latency_range=<disable latency range changes on underrun?> "
+        "io_thread=<name of an IO thread to share with other devices> "
+        "duplex=<link with the device of the other direction on the same IO thread?>");
 
 static const char* const valid_modargs[] = {
     "name",
@@ -84,6 +86,8 @@ static const char* const valid_modargs[] = {
     "deferred_volume_safety_margin",
     "deferred_volume_extra_delay",
     "fixed_latency_range",
+    "io_thread",
+    "duplex",
     NULL
 };
 
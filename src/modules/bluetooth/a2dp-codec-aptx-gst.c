@@ -441,12 +441,15 @@ static void deinit(void *codec_info) {
 }
 
 static int reset(void *codec_info) {
+    gst_codec_reset(codec_info);
+
     return 0;
 }
 
 static int reset_hd(void *codec_info) {
     struct gst_info *info = (struct gst_info *) codec_info;
 
+    gst_codec_reset(codec_info);
     info->seq_num = 0;
 
     return 0;
@@ -515,7 +518,7 @@ static size_t encode_buffer_hd(void *codec_info, uint32_t timestamp, const uint8
         header->v = 2;
         header->pt = 96;
         header->sequence_number = htons(info->seq_num++);
-        header->timestamp = htonl(timestamp);
+        header->timestamp = htonl(info->output_timestamp);
         header->ssrc = htonl(1);
         written += sizeof(*header);
     }
@@ -574,6 +577,7 @@ const pa_a2dp_endpoint_conf pa_a2dp_endpoint_conf_aptx = {
         .reduce_encoder_bitrate = reduce_encoder_bitrate,
         .encode_buffer = encode_buffer,
         .decode_buffer = decode_buffer,
+        .get_encoder_delay = gst_codec_get_encoder_delay,
     },
 };
 
@@ -597,5 +601,6 @@ const pa_a2dp_endpoint_conf pa_a2dp_endpoint_conf_aptx_hd = {
         .reduce_encoder_bitrate = reduce_encoder_bitrate,
         .encode_buffer = encode_buffer_hd,
         .decode_buffer = decode_buffer_hd,
+        .get_encoder_delay = gst_codec_get_encoder_delay,
     },
 };
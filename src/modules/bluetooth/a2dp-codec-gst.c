@@ -27,6 +27,7 @@
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/once.h>
+#include <pulsecore/core.h>
 #include <pulsecore/core-util.h>
 #include <pulse/sample.h>
 #include <pulse/timeval.h>
@@ -127,6 +128,170 @@ static GstCaps *gst_create_caps_from_sample_spec(const pa_sample_spec *ss) {
     return caps;
 }
 
+struct gst_packet {
+    /* Input block, reused for the next block once the encoder is done */
+    GstBuffer *input;
+    uint32_t timestamp;
+
+    /* Encoded data, handed over to the IO thread as is */
+    GstBuffer *output;
+    bool failed;
+};
+
+/* Sentinel telling the encoder thread to quit */
+static struct gst_packet quit_packet;
+
+static GstClockTime gst_timestamp(struct gst_info *info, uint32_t timestamp) {
+    if (timestamp == (uint32_t) -1)
+        return GST_CLOCK_TIME_NONE;
+
+    /* Timestamp is monotonically increasing with samplerate/packets-per-second;
+     * convert it to a timestamp in nanoseconds */
+    return timestamp * PA_USEC_PER_SEC / info->ss->rate;
+}
+
+/* Pushes in_buf through the pipeline and collects everything the appsink has
+ * produced into a single buffer, without copying the sample data. Takes over
+ * the caller's reference to in_buf. */
+static bool gst_chain_buffer(struct gst_info *info, GstBuffer *in_buf, GstBuffer **out_buf) {
+    GstFlowReturn ret;
+    GstSample *sample;
+
+    pa_assert(info->pad_sink);
+
+    *out_buf = NULL;
+
+    ret = gst_pad_chain(info->pad_sink, in_buf);
+    if (ret != GST_FLOW_OK) {
+        pa_log_error("failed to push buffer for transcoding %d", ret);
+        return false;
+    }
+
+    while ((sample = gst_app_sink_try_pull_sample(GST_APP_SINK(info->app_sink), 0))) {
+        GstBuffer *buf = gst_buffer_ref(gst_sample_get_buffer(sample));
+
+        gst_sample_unref(sample);
+        *out_buf = *out_buf ? gst_buffer_append(*out_buf, buf) : buf;
+    }
+
+    return true;
+}
+
+/* Copies the encoded data straight out of the GStreamer memory into the
+ * caller's buffer and drops it */
+static size_t gst_take_output(GstBuffer **out_buf, uint8_t *output_buffer, size_t output_size) {
+    size_t size;
+
+    if (!*out_buf)
+        return 0;
+
+    size = gst_buffer_get_size(*out_buf);
+    pa_assert(size <= output_size);
+    pa_assert_se(gst_buffer_extract(*out_buf, 0, output_buffer, size) == size);
+
+    gst_buffer_unref(*out_buf);
+    *out_buf = NULL;
+
+    return size;
+}
+
+/* Called from the encoder thread */
+static void encoder_thread_func(void *userdata) {
+    struct gst_info *info = userdata;
+    struct gst_packet *p;
+
+    pa_log_debug("GStreamer encoder thread starting up");
+
+    if (info->core && info->core->realtime_scheduling)
+        pa_thread_make_realtime(info->core->realtime_priority);
+
+    while ((p = pa_asyncq_pop(info->encoder_input, true)) != &quit_packet) {
+        /* Keep our reference, the input buffer is reused for a later block */
+        p->failed = !gst_chain_buffer(info, gst_buffer_ref(p->input), &p->output);
+
+        pa_assert_se(pa_asyncq_push(info->encoder_output, p, true) == 0);
+    }
+
+    pa_log_debug("GStreamer encoder thread shutting down");
+}
+
+static void packet_free(struct gst_packet *p) {
+    if (p->input)
+        gst_buffer_unref(p->input);
+    if (p->output)
+        gst_buffer_unref(p->output);
+
+    pa_xfree(p);
+}
+
+static void encoder_start(struct gst_info *info) {
+    unsigned i;
+
+    info->encoder_input = pa_asyncq_new(GST_ENCODER_PACKETS * 2);
+    info->encoder_output = pa_asyncq_new(GST_ENCODER_PACKETS * 2);
+
+    for (i = 0; i < GST_ENCODER_PACKETS; i++)
+        info->encoder_free[i] = pa_xnew0(struct gst_packet, 1);
+    info->n_encoder_free = GST_ENCODER_PACKETS;
+    info->encoder_in_flight = 0;
+
+    if (!(info->encoder_thread = pa_thread_new("bt-gst-encoder", encoder_thread_func, info)))
+        pa_log_warn("Failed to create GStreamer encoder thread, encoding on the IO thread");
+}
+
+/* Waits for the oldest packet queued to the encoder thread and returns it to
+ * the free list. Its encoded data is left in p->output. */
+static struct gst_packet *encoder_collect(struct gst_info *info) {
+    struct gst_packet *p;
+
+    pa_assert(info->encoder_in_flight > 0);
+
+    pa_assert_se(p = pa_asyncq_pop(info->encoder_output, true));
+    info->encoder_in_flight--;
+
+    pa_assert(info->n_encoder_free < GST_ENCODER_PACKETS);
+    info->encoder_free[info->n_encoder_free++] = p;
+
+    return p;
+}
+
+static void encoder_flush(struct gst_info *info) {
+    while (info->encoder_in_flight > 0) {
+        struct gst_packet *p = encoder_collect(info);
+
+        if (p->output) {
+            gst_buffer_unref(p->output);
+            p->output = NULL;
+        }
+    }
+}
+
+static void encoder_stop(struct gst_info *info) {
+    unsigned i;
+
+    if (info->encoder_thread) {
+        encoder_flush(info);
+
+        pa_assert_se(pa_asyncq_push(info->encoder_input, &quit_packet, true) == 0);
+        pa_thread_free(info->encoder_thread);
+        info->encoder_thread = NULL;
+    }
+
+    for (i = 0; i < info->n_encoder_free; i++)
+        packet_free(info->encoder_free[i]);
+    info->n_encoder_free = 0;
+
+    if (info->encoder_input) {
+        pa_asyncq_free(info->encoder_input, NULL);
+        info->encoder_input = NULL;
+    }
+
+    if (info->encoder_output) {
+        pa_asyncq_free(info->encoder_output, NULL);
+        info->encoder_output = NULL;
+    }
+}
+
 bool gst_codec_init(struct gst_info *info, bool for_encoding, GstElement *transcoder) {
     GstPad *pad;
     GstCaps *caps;
@@ -186,6 +351,11 @@ bool gst_codec_init(struct gst_info *info, bool for_encoding, GstElement *transc
     event = gst_event_new_segment(&segment);
     gst_pad_send_event(info->pad_sink, event);
 
+    /* Encoding runs on its own thread, so that it does not eat into the
+     * deadline of the IO thread */
+    if (for_encoding)
+        encoder_start(info);
+
     pa_log_info("GStreamer pipeline initialisation succeeded");
 
     return true;
@@ -208,15 +378,61 @@ common_fail:
     return false;
 }
 
+/* Called from the IO thread. Queues the block to the encoder thread and
+ * returns the data encoded from the block queued GST_ENCODER_PIPELINE_DEPTH
+ * calls earlier. That block has had a whole block period to be encoded, so
+ * collecting it should not have to wait. */
+static size_t gst_transcode_buffer_async(struct gst_info *info, uint32_t timestamp, const uint8_t *input_buffer, size_t input_size, uint8_t *output_buffer, size_t output_size, size_t *processed) {
+    struct gst_packet *p;
+    size_t written;
+
+    pa_assert(info->n_encoder_free > 0);
+    p = info->encoder_free[--info->n_encoder_free];
+
+    /* The input has to be copied, the caller's buffer is gone once we return.
+     * Reuse the packet's buffer unless the pipeline still holds on to it. */
+    if (p->input && (gst_buffer_get_size(p->input) != input_size || !gst_buffer_is_writable(p->input))) {
+        gst_buffer_unref(p->input);
+        p->input = NULL;
+    }
+
+    if (!p->input)
+        p->input = gst_buffer_new_allocate(NULL, input_size, NULL);
+    pa_assert(p->input);
+
+    pa_assert_se(gst_buffer_fill(p->input, 0, input_buffer, input_size) == input_size);
+    GST_BUFFER_TIMESTAMP(p->input) = gst_timestamp(info, timestamp);
+    p->timestamp = timestamp;
+
+    pa_assert_se(pa_asyncq_push(info->encoder_input, p, true) == 0);
+    info->encoder_in_flight++;
+    info->encoder_block_size = input_size;
+
+    *processed = input_size;
+
+    if (info->encoder_in_flight <= GST_ENCODER_PIPELINE_DEPTH)
+        return 0;
+
+    p = encoder_collect(info);
+
+    if (p->failed) {
+        *processed = 0;
+        return 0;
+    }
+
+    written = gst_take_output(&p->output, output_buffer, output_size);
+    info->output_timestamp = p->timestamp;
+
+    return written;
+}
+
 size_t gst_transcode_buffer(void *codec_info, uint32_t timestamp, const uint8_t *input_buffer, size_t input_size, uint8_t *output_buffer, size_t output_size, size_t *processed) {
     struct gst_info *info = (struct gst_info *) codec_info;
-    gsize transcoded;
-    GstBuffer *in_buf;
-    GstFlowReturn ret;
-    size_t written = 0;
-    GstSample *sample;
+    GstBuffer *in_buf, *out_buf;
+    bool ok;
 
-    pa_assert(info->pad_sink);
+    if (info->encoder_thread)
+        return gst_transcode_buffer_async(info, timestamp, input_buffer, input_size, output_buffer, output_size, processed);
 
     in_buf = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY,
                 (gpointer)input_buffer, input_size, 0, input_size, NULL, NULL);
@@ -225,15 +441,9 @@ size_t gst_transcode_buffer(void *codec_info, uint32_t timestamp, const uint8_t
     gst_mini_object_ref(GST_MINI_OBJECT_CAST(in_buf));
     pa_assert(GST_MINI_OBJECT_REFCOUNT_VALUE(in_buf) == 2);
 
-    if (timestamp == -1)
-        GST_BUFFER_TIMESTAMP(in_buf) = GST_CLOCK_TIME_NONE;
-    else {
-        // Timestamp is monotonically increasing with samplerate/packets-per-second;
-        // convert it to a timestamp in nanoseconds:
-        GST_BUFFER_TIMESTAMP(in_buf) = timestamp * PA_USEC_PER_SEC / info->ss->rate;
-    }
+    GST_BUFFER_TIMESTAMP(in_buf) = gst_timestamp(info, timestamp);
 
-    ret = gst_pad_chain(info->pad_sink, in_buf);
+    ok = gst_chain_buffer(info, in_buf, &out_buf);
     /**
      * Ensure we're the only one holding a reference to this buffer after gst_pad_chain,
      * which internally holds a pointer reference to input_buffer.  The caller provides
@@ -242,38 +452,36 @@ size_t gst_transcode_buffer(void *codec_info, uint32_t timestamp, const uint8_t
     pa_assert(GST_MINI_OBJECT_REFCOUNT_VALUE(in_buf) == 1);
     gst_mini_object_unref(GST_MINI_OBJECT_CAST(in_buf));
 
-    if (ret != GST_FLOW_OK) {
-        pa_log_error("failed to push buffer for transcoding %d", ret);
-        goto fail;
-    }
-
-    while ((sample = gst_app_sink_try_pull_sample(GST_APP_SINK(info->app_sink), 0))) {
-        in_buf = gst_sample_get_buffer(sample);
+    info->output_timestamp = timestamp;
+    *processed = ok ? input_size : 0;
 
-        transcoded = gst_buffer_get_size(in_buf);
-        written += transcoded;
-        pa_assert(written <= output_size);
+    return gst_take_output(&out_buf, output_buffer, output_size);
+}
 
-        GstMapInfo map_info;
-        pa_assert_se(gst_buffer_map(in_buf, &map_info, GST_MAP_READ));
-        memcpy(output_buffer, map_info.data, transcoded);
-        gst_buffer_unmap(in_buf, &map_info);
-        gst_sample_unref(sample);
-    }
+/* Drops the blocks queued to the encoder thread */
+void gst_codec_reset(void *codec_info) {
+    struct gst_info *info = (struct gst_info *) codec_info;
 
-    *processed = input_size;
+    if (info->encoder_thread)
+        encoder_flush(info);
+}
 
-    return written;
+/* The encoder thread hands the data of a block out GST_ENCODER_PIPELINE_DEPTH
+ * blocks late */
+pa_usec_t gst_codec_get_encoder_delay(void *codec_info) {
+    struct gst_info *info = (struct gst_info *) codec_info;
 
-fail:
-    *processed = 0;
+    if (!info->encoder_thread)
+        return 0;
 
-    return written;
+    return GST_ENCODER_PIPELINE_DEPTH * pa_bytes_to_usec(info->encoder_block_size, info->ss);
 }
 
 void gst_codec_deinit(void *codec_info) {
     struct gst_info *info = (struct gst_info *) codec_info;
 
+    encoder_stop(info);
+
     if (info->bin) {
         gst_element_set_state(info->bin, GST_STATE_NULL);
         gst_object_unref(info->bin);
@@ -21,7 +21,9 @@
 #include <gst/app/gstappsrc.h>
 #include <gst/app/gstappsink.h>
 #include <gst/base/gstadapter.h>
+#include <pulsecore/asyncq.h>
 #include <pulsecore/fdsem.h>
+#include <pulsecore/thread.h>
 
 enum a2dp_codec_type {
     AAC = 0,
@@ -32,6 +34,13 @@ enum a2dp_codec_type {
     LDAC_EQMID_MQ
 };
 
+/* Number of blocks the encoder thread may be working on while the IO thread
+ * renders the next one. Each block adds one block of latency. */
+#define GST_ENCODER_PIPELINE_DEPTH 1
+#define GST_ENCODER_PACKETS (GST_ENCODER_PIPELINE_DEPTH + 1)
+
+struct gst_packet;
+
 struct gst_info {
     pa_core *core;
     pa_sample_spec *ss;
@@ -50,8 +59,24 @@ struct gst_info {
     GstPad *pad_sink;
 
     uint16_t seq_num;
+    /* Timestamp of the block whose encoded data was returned last */
+    uint32_t output_timestamp;
+
+    /* Encoder thread and the queues of packets going to and coming back
+     * from it, NULL when decoding */
+    pa_thread *encoder_thread;
+    pa_asyncq *encoder_input;
+    pa_asyncq *encoder_output;
+    /* Packets not queued to the encoder thread, owned by the IO thread */
+    struct gst_packet *encoder_free[GST_ENCODER_PACKETS];
+    unsigned n_encoder_free;
+    unsigned encoder_in_flight;
+    /* Size of the last block queued to the encoder thread */
+    size_t encoder_block_size;
 };
 
 bool gst_codec_init(struct gst_info *info, bool for_encoding, GstElement *transcoder);
 size_t gst_transcode_buffer(void *codec_info, uint32_t timestamp, const uint8_t *input_buffer, size_t input_size, uint8_t *output_buffer, size_t output_size, size_t *processed);
+void gst_codec_reset(void *codec_info);
+pa_usec_t gst_codec_get_encoder_delay(void *codec_info);
 void gst_codec_deinit(void *codec_info);
@@ -333,6 +333,8 @@ static void deinit(void *codec_info) {
 }
 
 static int reset(void *codec_info) {
+    gst_codec_reset(codec_info);
+
     return 0;
 }
 
@@ -421,7 +423,7 @@ static size_t encode_buffer(void *codec_info, uint32_t timestamp, const uint8_t
         header->v = 2;
         header->pt = 96;
         header->sequence_number = htons(info->seq_num++);
-        header->timestamp = htonl(timestamp);
+        header->timestamp = htonl(info->output_timestamp);
         header->ssrc = htonl(1);
         payload = (struct rtp_payload*) (output_buffer + sizeof(*header));
         payload->frame_count = get_ldac_num_frames(codec_info, info->codec_type);
@@ -450,6 +452,7 @@ const pa_a2dp_endpoint_conf pa_a2dp_endpoint_conf_ldac_eqmid_hq = {
         .get_encoded_block_size = get_encoded_block_size,
         .reduce_encoder_bitrate = reduce_encoder_bitrate,
         .encode_buffer = encode_buffer,
+        .get_encoder_delay = gst_codec_get_encoder_delay,
     },
 };
 
@@ -472,6 +475,7 @@ const pa_a2dp_endpoint_conf pa_a2dp_endpoint_conf_ldac_eqmid_sq = {
         .get_encoded_block_size = get_encoded_block_size,
         .reduce_encoder_bitrate = reduce_encoder_bitrate,
         .encode_buffer = encode_buffer,
+        .get_encoder_delay = gst_codec_get_encoder_delay,
     },
 };
 
@@ -494,5 +498,6 @@ const pa_a2dp_endpoint_conf pa_a2dp_endpoint_conf_ldac_eqmid_mq = {
         .get_encoded_block_size = get_encoded_block_size,
         .reduce_encoder_bitrate = reduce_encoder_bitrate,
         .encode_buffer = encode_buffer,
+        .get_encoder_delay = gst_codec_get_encoder_delay,
     },
 };
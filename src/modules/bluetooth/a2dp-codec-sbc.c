@@ -29,6 +29,7 @@
 #include <pulse/xmalloc.h>
 
 #include <arpa/inet.h>
+#include <limits.h>
 
 #include <sbc/sbc.h>
 
@@ -1069,72 +1070,81 @@ static size_t increase_encoder_bitrate(void *codec_info, size_t write_link_mtu)
     return get_block_size(codec_info, write_link_mtu);
 }
 
-static size_t encode_buffer(void *codec_info, uint32_t timestamp, const uint8_t *input_buffer, size_t input_size, uint8_t *output_buffer, size_t output_size, size_t *processed) {
-    struct sbc_info *sbc_info = (struct sbc_info *) codec_info;
-    struct rtp_header *header;
-    struct rtp_payload *payload;
-    uint8_t *d;
-    const uint8_t *p;
-    size_t to_write, to_encode;
-    uint8_t frame_count;
-
-    header = (struct rtp_header*) output_buffer;
-    payload = (struct rtp_payload*) (output_buffer + sizeof(*header));
-
-    frame_count = 0;
+/* Encodes as many whole frames as both buffers hold, at most max_frames,
+ * straight from input_buffer into output_buffer. Frames are stored
+ * frame_length apart, any padding after the SBC frame is zeroed. Returns the
+ * number of frames encoded. */
+static unsigned encode_frames(struct sbc_info *sbc_info, const uint8_t *input_buffer, size_t input_size,
+                              uint8_t *output_buffer, size_t output_size, unsigned max_frames,
+                              size_t *processed, size_t *written) {
+    const uint8_t *p = input_buffer;
+    uint8_t *d = output_buffer;
+    unsigned frame_count, i;
 
-    p = input_buffer;
-    to_encode = input_size;
+    frame_count = PA_MIN(input_size / sbc_info->codesize, output_size / sbc_info->frame_length);
+    frame_count = PA_MIN(frame_count, max_frames);
 
-    d = output_buffer + sizeof(*header) + sizeof(*payload);
-    to_write = output_size - sizeof(*header) - sizeof(*payload);
-
-    /* frame_count is only 4 bit number */
-    while (PA_LIKELY(to_encode > 0 && to_write > 0 && frame_count < 15)) {
-        ssize_t written;
-        ssize_t encoded;
+    for (i = 0; i < frame_count; i++) {
+        ssize_t encoded, frame_written;
 
         encoded = sbc_encode(&sbc_info->sbc,
-                             p, to_encode,
-                             d, to_write,
-                             &written);
-
-        if (PA_UNLIKELY(encoded <= 0)) {
-            pa_log_error("SBC encoding error (%li)", (long) encoded);
-            break;
-        }
+                             p, sbc_info->codesize,
+                             d, sbc_info->frame_length,
+                             &frame_written);
 
-        if (PA_UNLIKELY(written < 0)) {
-            pa_log_error("SBC encoding error (%li)", (long) written);
+        if (PA_UNLIKELY(encoded <= 0 || frame_written < 0)) {
+            pa_log_error("SBC encoding error (%li)", (long) (encoded <= 0 ? encoded : frame_written));
             break;
         }
 
-        pa_assert_fp((size_t) encoded <= to_encode);
         pa_assert_fp((size_t) encoded == sbc_info->codesize);
+        pa_assert_fp((size_t) frame_written <= sbc_info->frame_length);
 
-        pa_assert_fp((size_t) written <= to_write);
-        pa_assert_fp((size_t) written == sbc_info->frame_length);
+        if (PA_UNLIKELY((size_t) frame_written < sbc_info->frame_length))
+            memset(d + frame_written, 0, sbc_info->frame_length - frame_written);
 
-        p += encoded;
-        to_encode -= encoded;
-
-        d += written;
-        to_write -= written;
-
-        frame_count++;
+        p += sbc_info->codesize;
+        d += sbc_info->frame_length;
     }
 
     PA_ONCE_BEGIN {
         pa_log_debug("Using SBC codec implementation: %s", pa_strnull(sbc_get_implementation_info(&sbc_info->sbc)));
     } PA_ONCE_END;
 
+    *processed = p - input_buffer;
+    *written = d - output_buffer;
+
+    return i;
+}
+
+static size_t encode_buffer(void *codec_info, uint32_t timestamp, const uint8_t *input_buffer, size_t input_size, uint8_t *output_buffer, size_t output_size, size_t *processed) {
+    struct sbc_info *sbc_info = (struct sbc_info *) codec_info;
+    struct rtp_header *header;
+    struct rtp_payload *payload;
+    size_t rtp_size = sizeof(*header) + sizeof(*payload);
+    size_t written;
+    unsigned frame_count;
+
+    if (PA_UNLIKELY(output_size < rtp_size)) {
+        *processed = 0;
+        return 0;
+    }
+
+    header = (struct rtp_header*) output_buffer;
+    payload = (struct rtp_payload*) (output_buffer + sizeof(*header));
+
+    /* frame_count is only 4 bit number */
+    frame_count = encode_frames(sbc_info, input_buffer, input_size,
+                                output_buffer + rtp_size, output_size - rtp_size, 15,
+                                processed, &written);
+
     if (PA_UNLIKELY(frame_count == 0)) {
         *processed = 0;
         return 0;
     }
 
     /* write it to the fifo */
-    pa_memzero(output_buffer, sizeof(*header) + sizeof(*payload));
+    pa_memzero(output_buffer, rtp_size);
     header->v = 2;
 
     /* A2DP spec: "A payload type in the RTP dynamic range shall be chosen".
@@ -1147,74 +1157,20 @@ static size_t encode_buffer(void *codec_info, uint32_t timestamp, const uint8_t
     header->ssrc = htonl(1);
     payload->frame_count = frame_count;
 
-    *processed = p - input_buffer;
-    return d - output_buffer;
+    return rtp_size + written;
 }
 
 static size_t encode_buffer_faststream(void *codec_info, uint32_t timestamp, const uint8_t *input_buffer, size_t input_size, uint8_t *output_buffer, size_t output_size, size_t *processed) {
     struct sbc_info *sbc_info = (struct sbc_info *) codec_info;
-    uint8_t *d;
-    const uint8_t *p;
-    size_t to_write, to_encode;
-    uint8_t frame_count;
-
-    frame_count = 0;
-
-    p = input_buffer;
-    to_encode = input_size;
-
-    d = output_buffer;
-    to_write = output_size;
-
-    /* frame_count is only 4 bit number */
-    while (PA_LIKELY(to_encode > 0 && to_write > 0)) {
-        ssize_t written;
-        ssize_t encoded;
-
-        encoded = sbc_encode(&sbc_info->sbc,
-                             p, to_encode,
-                             d, to_write,
-                             &written);
-
-        if (PA_UNLIKELY(encoded <= 0)) {
-            pa_log_error("SBC encoding error (%li)", (long) encoded);
-            break;
-        }
-
-        if (PA_UNLIKELY(written < 0)) {
-            pa_log_error("SBC encoding error (%li)", (long) written);
-            break;
-        }
-
-        while (written < sbc_info->frame_length && written < to_write)
-            d[written++] = 0;
-
-        pa_assert_fp((size_t) encoded <= to_encode);
-        pa_assert_fp((size_t) encoded == sbc_info->codesize);
-
-        pa_assert_fp((size_t) written <= to_write);
-        pa_assert_fp((size_t) written == sbc_info->frame_length);
-
-        p += encoded;
-        to_encode -= encoded;
-
-        d += written;
-        to_write -= written;
-
-        frame_count++;
-    }
-
-    PA_ONCE_BEGIN {
-        pa_log_debug("Using SBC codec implementation: %s", pa_strnull(sbc_get_implementation_info(&sbc_info->sbc)));
-    } PA_ONCE_END;
+    size_t written;
 
-    if (PA_UNLIKELY(frame_count == 0)) {
+    /* FastStream frames are padded to an even length, see init_faststream() */
+    if (PA_UNLIKELY(encode_frames(sbc_info, input_buffer, input_size, output_buffer, output_size, UINT_MAX, processed, &written) == 0)) {
         *processed = 0;
         return 0;
     }
 
-    *processed = p - input_buffer;
-    return d - output_buffer;
+    return written;
 }
 
 static size_t decode_buffer(void *codec_info, const uint8_t *input_buffer, size_t input_size, uint8_t *output_buffer, size_t output_size, size_t *processed) {
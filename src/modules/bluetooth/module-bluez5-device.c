@@ -1110,6 +1110,10 @@ static int sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offse
                 delay = wi - ri;
             }
 
+            /* Audio the encoder still holds has not been sent out yet */
+            if (u->encoder_info && u->bt_codec->get_encoder_delay)
+                delay += (int64_t) u->bt_codec->get_encoder_delay(u->encoder_info);
+
             *((int64_t*) data) = u->sink->thread_info.fixed_latency + delay;
 
             return 0;
@@ -80,6 +80,7 @@ static void handle_set_mute(DBusConnection *conn, DBusMessage *msg, DBusMessageI
 static void handle_get_buffer_latency(DBusConnection *conn, DBusMessage *msg, void *userdata);
 static void handle_get_device_latency(DBusConnection *conn, DBusMessage *msg, void *userdata);
 static void handle_get_resample_method(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void handle_get_processing_time(DBusConnection *conn, DBusMessage *msg, void *userdata);
 static void handle_get_property_list(DBusConnection *conn, DBusMessage *msg, void *userdata);
 
 static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdata);
@@ -101,6 +102,7 @@ enum property_handler_index {
     PROPERTY_HANDLER_BUFFER_LATENCY,
     PROPERTY_HANDLER_DEVICE_LATENCY,
     PROPERTY_HANDLER_RESAMPLE_METHOD,
+    PROPERTY_HANDLER_PROCESSING_TIME,
     PROPERTY_HANDLER_PROPERTY_LIST,
     PROPERTY_HANDLER_MAX
 };
@@ -119,6 +121,7 @@ static pa_dbus_property_handler property_handlers[PROPERTY_HANDLER_MAX] = {
     [PROPERTY_HANDLER_BUFFER_LATENCY]  = { .property_name = "BufferLatency",  .type = "t",      .get_cb = handle_get_buffer_latency,  .set_cb = NULL },
     [PROPERTY_HANDLER_DEVICE_LATENCY]  = { .property_name = "DeviceLatency",  .type = "t",      .get_cb = handle_get_device_latency,  .set_cb = NULL },
     [PROPERTY_HANDLER_RESAMPLE_METHOD] = { .property_name = "ResampleMethod", .type = "s",      .get_cb = handle_get_resample_method, .set_cb = NULL },
+    [PROPERTY_HANDLER_PROCESSING_TIME] = { .property_name = "ProcessingTime", .type = "at",     .get_cb = handle_get_processing_time, .set_cb = NULL },
     [PROPERTY_HANDLER_PROPERTY_LIST]   = { .property_name = "PropertyList",   .type = "a{say}", .get_cb = handle_get_property_list,   .set_cb = NULL }
 };
 
@@ -499,6 +502,43 @@ static void handle_get_resample_method(DBusConnection *conn, DBusMessage *msg, v
     pa_dbus_send_basic_variant_reply(conn, msg, DBUS_TYPE_STRING, &resample_method);
 }
 
+/* Four values per stage, in the order of pa_render_stage_t: the number of
+ * runs, the total, the longest and the 99th percentile run time in usec */
+#define PROCESSING_TIME_VALUES (PA_RENDER_STAGE_MAX * 4)
+
+static void get_processing_time(pa_dbusiface_stream *s, dbus_uint64_t values[PROCESSING_TIME_VALUES]) {
+    pa_render_stage_stats stats[PA_RENDER_STAGE_MAX];
+    unsigned i;
+
+    pa_assert(s);
+    pa_assert(values);
+
+    if (s->type == STREAM_TYPE_PLAYBACK)
+        pa_render_stats_get(s->sink_input->render_stats, stats);
+    else
+        pa_render_stats_get(s->source_output->render_stats, stats);
+
+    for (i = 0; i < PA_RENDER_STAGE_MAX; i++) {
+        values[i * 4] = stats[i].count;
+        values[i * 4 + 1] = stats[i].total_usec;
+        values[i * 4 + 2] = stats[i].max_usec;
+        values[i * 4 + 3] = pa_render_stage_stats_p99(&stats[i]);
+    }
+}
+
+static void handle_get_processing_time(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    pa_dbusiface_stream *s = userdata;
+    dbus_uint64_t values[PROCESSING_TIME_VALUES];
+
+    pa_assert(conn);
+    pa_assert(msg);
+    pa_assert(s);
+
+    get_processing_time(s, values);
+
+    pa_dbus_send_basic_array_variant_reply(conn, msg, DBUS_TYPE_UINT64, values, PROCESSING_TIME_VALUES);
+}
+
 static void handle_get_property_list(DBusConnection *conn, DBusMessage *msg, void *userdata) {
     pa_dbusiface_stream *s = userdata;
 
@@ -528,6 +568,7 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
     dbus_uint64_t buffer_latency = 0;
     dbus_uint64_t device_latency = 0;
     const char *resample_method = NULL;
+    dbus_uint64_t processing_time[PROCESSING_TIME_VALUES];
     unsigned i = 0;
 
     pa_assert(conn);
@@ -568,6 +609,7 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
         channels[i] = channel_map->map[i];
     if (!resample_method)
         resample_method = "";
+    get_processing_time(s, processing_time);
 
     pa_assert_se((reply = dbus_message_new_method_return(msg)));
 
@@ -598,6 +640,7 @@ static void handle_get_all(DBusConnection *conn, DBusMessage *msg, void *userdat
     pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_BUFFER_LATENCY].property_name, DBUS_TYPE_UINT64, &buffer_latency);
     pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_DEVICE_LATENCY].property_name, DBUS_TYPE_UINT64, &device_latency);
     pa_dbus_append_basic_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_RESAMPLE_METHOD].property_name, DBUS_TYPE_STRING, &resample_method);
+    pa_dbus_append_basic_array_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_PROCESSING_TIME].property_name, DBUS_TYPE_UINT64, processing_time, PROCESSING_TIME_VALUES);
     pa_dbus_append_proplist_variant_dict_entry(&dict_iter, property_handlers[PROPERTY_HANDLER_PROPERTY_LIST].property_name, s->proplist);
 
     pa_assert_se(dbus_message_iter_close_container(&msg_iter, &dict_iter));
@@ -137,6 +137,7 @@ static const pa_echo_canceller ec_table[] = {
 #define DEFAULT_CHANNELS 1
 #define DEFAULT_ADJUST_TIME_USEC (1*PA_USEC_PER_SEC)
 #define DEFAULT_ADJUST_TOLERANCE (5*PA_USEC_PER_MSEC)
+#define SHARED_CLOCK_ADJUST_TIME_FACTOR 10 /* slower drift checks if source and sink share a clock */
 #define DEFAULT_SAVE_AEC false
 #define DEFAULT_AUTOLOADED false
 #define DEFAULT_USE_MASTER_FORMAT false
@@ -393,7 +394,13 @@ static void time_callback(pa_mainloop_api *a, const pa_time_event *e, const stru
         pa_sink_input_set_rate(u->sink_input, new_rate);
     }
 
-    pa_core_rttime_restart(u->core, u->time_event, pa_rtclock_now() + u->adjust_time);
+    /* If capture and playback run from the same clock their distance stays
+     * constant once it is right. It only changes if one of them is
+     * restarted, e.g. after an xrun, so checking now and then is enough. */
+    if (diff_time >= 0 && diff_time <= u->adjust_threshold && pa_sink_same_clock_domain(u->sink_input->sink, u->source_output->source))
+        pa_core_rttime_restart(u->core, u->time_event, pa_rtclock_now() + u->adjust_time * SHARED_CLOCK_ADJUST_TIME_FACTOR);
+    else
+        pa_core_rttime_restart(u->core, u->time_event, pa_rtclock_now() + u->adjust_time);
 }
 
 /* Called from source I/O thread context */
@@ -1491,6 +1498,11 @@ static void source_output_moving_cb(pa_source_output *o, pa_source *dest) {
     } else
         pa_source_set_asyncmsgq(u->source, NULL);
 
+    /* Drift checks may have been slowed down for a source sharing the clock
+     * of the sink */
+    if (dest && u->time_event)
+        pa_core_rttime_restart(u->core, u->time_event, pa_rtclock_now() + u->adjust_time);
+
     /* Propagate asyncmsq change to attached virtual sources */
     PA_IDXSET_FOREACH(output, u->source->outputs, idx) {
         if (output->destination_source && output->moving)
@@ -1529,6 +1541,9 @@ static void sink_input_moving_cb(pa_sink_input *i, pa_sink *dest) {
     } else
         pa_sink_set_asyncmsgq(u->sink, NULL);
 
+    if (dest && u->time_event)
+        pa_core_rttime_restart(u->core, u->time_event, pa_rtclock_now() + u->adjust_time);
+
     if (u->sink_auto_desc && dest) {
         const char *y, *z;
         pa_proplist *pl;
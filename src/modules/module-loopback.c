@@ -125,6 +125,9 @@ struct userdata {
     double drift_filter;
     double drift_compensation_rate;
 
+    /* Source and sink are in the same clock domain and cannot drift */
+    bool shared_clock;
+
     /* Variables for Kalman filter and error tracking*/
     double latency_variance;
     double kalman_variance;
@@ -323,7 +326,12 @@ static uint32_t rate_controller(
     /* Calculate rate difference between source and sink. Skip calculation
      * after a source/sink change, an underrun or latency offset change */
 
-    if (!u->underrun_occured && !u->source_sink_changed && !u->source_latency_offset_changed && !u->sink_latency_offset_changed) {
+    if (u->shared_clock) {
+        /* No drift between source and sink, forget any estimate from
+         * before the devices were linked */
+        u->drift_filter = 0;
+        u->drift_compensation_rate = 0;
+    } else if (!u->underrun_occured && !u->source_sink_changed && !u->source_latency_offset_changed && !u->sink_latency_offset_changed) {
         /* Latency difference between last iterations */
         latency_drift = latency_difference_at_base_rate - u->last_latency_difference;
 
@@ -474,6 +482,10 @@ static void adjust_rates(struct userdata *u) {
     }
     u->adjust_time_stamp = now;
 
+    /* If source and sink share a clock the rate only needs to be changed to
+     * reach the target latency, there is no drift to estimate */
+    u->shared_clock = pa_sink_same_clock_domain(u->sink_input->sink, u->source_output->source);
+
     /* Rates and latencies */
     old_rate = u->sink_input->sample_spec.rate;
     base_rate = u->source_output->sample_spec.rate;
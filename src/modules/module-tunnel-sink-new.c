@@ -30,6 +30,8 @@
 #include <pulse/mainloop.h>
 #include <pulse/introspect.h>
 #include <pulse/error.h>
+#include <pulse/format.h>
+#include <pulse/internal.h>
 
 #include <pulsecore/core.h>
 #include <pulsecore/core-util.h>
@@ -42,6 +44,11 @@
 #include <pulsecore/poll.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/proplist-util.h>
+#include <pulsecore/native-common.h>
+
+#ifdef HAVE_OPUS
+#include <pulsecore/opus-codec.h>
+#endif
 
 PA_MODULE_AUTHOR("Alexander Couzens");
 PA_MODULE_DESCRIPTION("Create a network sink which connects via a stream to a remote PulseAudio server");
@@ -57,7 +64,8 @@ PA_MODULE_USAGE(
         "channels=<number of channels> "
         "rate=<sample rate> "
         "channel_map=<channel map> "
-        "cookie=<cookie file path>"
+        "cookie=<cookie file path> "
+        "compression=<none or opus> "
         );
 
 #define MAX_LATENCY_USEC (200 * PA_USEC_PER_MSEC)
@@ -116,6 +124,10 @@ struct userdata {
     tunnel_msg *msg;
 
     pa_usec_t reconnect_interval_us;
+
+    bool compression;
+    size_t transport_frame_size;
+    pa_usec_t transport_delay;
 };
 
 struct module_restart_data {
@@ -134,6 +146,7 @@ static const char* const valid_modargs[] = {
     "channel_map",
     "cookie",
     "reconnect_interval_ms",
+    "compression",
     NULL,
 };
 
@@ -229,30 +242,43 @@ static void thread_func(void *userdata) {
             size_t writable;
 
             writable = pa_stream_writable_size(u->stream);
-            if (writable > 0) {
+            while (writable > 0) {
                 pa_memchunk memchunk;
-                const void *p;
+                void *p;
+                size_t nbytes = writable;
+
+                /* Render straight into a block of the context's mempool. If
+                 * the remote server is local, that pool is shared (SHM or
+                 * memfd) and the block is handed over without any copy. */
+                if (pa_stream_begin_write(u->stream, &p, &nbytes) < 0) {
+                    pa_log_error("Could not get a write buffer from the stream: %s", pa_strerror(pa_context_errno(u->context)));
+                    u->thread_mainloop_api->quit(u->thread_mainloop_api, TUNNEL_THREAD_FAILED_MAINLOOP);
+                    break;
+                }
+
+                pa_assert(nbytes > 0);
 
-                pa_sink_render_full(u->sink, writable, &memchunk);
+                memchunk.memblock = pa_memblock_new_fixed(u->module->core->mempool, p, nbytes, false);
+                memchunk.index = 0;
+                memchunk.length = nbytes;
 
-                pa_assert(memchunk.length > 0);
+                pa_sink_render_into_full(u->sink, &memchunk);
+                pa_memblock_unref_fixed(memchunk.memblock);
 
-                /* we have new data to write */
-                p = pa_memblock_acquire(memchunk.memblock);
-                /* TODO: Use pa_stream_begin_write() to reduce copying. */
                 ret = pa_stream_write(u->stream,
-                                      (uint8_t*) p + memchunk.index,
-                                      memchunk.length,
-                                      NULL,     /**< A cleanup routine for the data or NULL to request an internal copy */
+                                      p,
+                                      nbytes,
+                                      NULL,     /**< The data belongs to the block from pa_stream_begin_write() */
                                       0,        /** offset */
                                       PA_SEEK_RELATIVE);
-                pa_memblock_release(memchunk.memblock);
-                pa_memblock_unref(memchunk.memblock);
 
                 if (ret != 0) {
                     pa_log_error("Could not write data into the stream ... ret = %i", ret);
                     u->thread_mainloop_api->quit(u->thread_mainloop_api, TUNNEL_THREAD_FAILED_MAINLOOP);
+                    break;
                 }
+
+                writable -= PA_MIN(writable, nbytes);
             }
         }
 
@@ -271,6 +297,9 @@ fail:
 
 finish:
     if (u->stream) {
+        if (u->transport_frame_size > 0 && u->context->pstream)
+            pa_pstream_set_encoder(u->context->pstream, u->stream->channel, NULL);
+
         pa_stream_disconnect(u->stream);
         pa_stream_unref(u->stream);
         u->stream = NULL;
@@ -285,6 +314,54 @@ finish:
     pa_log_debug("Thread shutting down");
 }
 
+/* Returns the tlength to ask for. The encoder of a compressed transport
+ * keeps back less than a frame, so the buffer has to hold at least one or
+ * the server would never get to see what we wrote. */
+static size_t transport_tlength(struct userdata *u, size_t tlength) {
+#ifdef HAVE_OPUS
+    if (u->compression)
+        tlength = PA_MAX(tlength, pa_opus_codec_frame_size(&u->sink->sample_spec));
+#endif
+
+    return tlength;
+}
+
+/* Installs the Opus encoder for our stream if the server accepted the
+ * compressed transport offered in on_sink_created(). */
+static void setup_transport_codec(struct userdata *u) {
+#ifdef HAVE_OPUS
+    const pa_format_info *format;
+    pa_pstream_codec *encoder;
+    char *codec = NULL;
+
+    if (!u->compression || u->transport_frame_size > 0)
+        return;
+
+    format = pa_stream_get_format_info(u->stream);
+    if (!format ||
+        pa_format_info_get_prop_string(format, PA_NATIVE_TRANSPORT_CODEC, &codec) < 0 ||
+        !pa_streq(codec, PA_OPUS_CODEC_NAME)) {
+        pa_log_info("Remote server does not support compressed streams, sending uncompressed audio.");
+        pa_xfree(codec);
+        return;
+    }
+    pa_xfree(codec);
+
+    /* The server passes unflagged frames through, so uncompressed audio is a
+     * valid fallback here. */
+    if (!(encoder = pa_opus_encoder_new(&u->sink->sample_spec))) {
+        pa_log_warn("Failed to set up the Opus encoder, sending uncompressed audio.");
+        return;
+    }
+
+    pa_pstream_set_encoder(u->context->pstream, u->stream->channel, encoder);
+    u->transport_frame_size = pa_opus_codec_frame_size(&u->sink->sample_spec);
+    u->transport_delay = pa_opus_codec_get_delay(&u->sink->sample_spec);
+
+    pa_log_info("Sending Opus compressed audio, %0.1f ms codec delay.", (double) u->transport_delay / PA_USEC_PER_MSEC);
+#endif
+}
+
 static void stream_state_cb(pa_stream *stream, void *userdata) {
     struct userdata *u = userdata;
 
@@ -300,6 +377,8 @@ static void stream_state_cb(pa_stream *stream, void *userdata) {
             pa_log_debug("Stream terminated.");
             break;
         case PA_STREAM_READY:
+            setup_transport_codec(u);
+
             if (PA_SINK_IS_OPENED(u->sink->thread_info.state))
                 cork_stream(u, false);
 
@@ -387,11 +466,23 @@ static void on_sink_created(struct userdata *u) {
     }
 
     proplist = tunnel_new_proplist(u);
-    u->stream = pa_stream_new_with_proplist(u->context,
-                                            stream_name,
-                                            &u->sink->sample_spec,
-                                            &u->sink->channel_map,
-                                            proplist);
+#ifdef HAVE_OPUS
+    if (u->compression) {
+        pa_format_info *format;
+
+        /* Offer a compressed transport as a property of the PCM format.
+         * Servers which don't know about it simply ignore the property. */
+        format = pa_format_info_from_sample_spec(&u->sink->sample_spec, &u->sink->channel_map);
+        pa_format_info_set_prop_string(format, PA_NATIVE_TRANSPORT_CODECS, PA_OPUS_CODEC_NAME);
+        u->stream = pa_stream_new_extended(u->context, stream_name, &format, 1, proplist);
+        pa_format_info_free(format);
+    } else
+#endif
+        u->stream = pa_stream_new_with_proplist(u->context,
+                                                stream_name,
+                                                &u->sink->sample_spec,
+                                                &u->sink->channel_map,
+                                                proplist);
     pa_proplist_free(proplist);
     pa_xfree(stream_name);
 
@@ -406,7 +497,7 @@ static void on_sink_created(struct userdata *u) {
         requested_latency = u->sink->thread_info.max_latency;
 
     reset_bufferattr(&bufferattr);
-    bufferattr.tlength = pa_usec_to_bytes(requested_latency, &u->sink->sample_spec);
+    bufferattr.tlength = transport_tlength(u, pa_usec_to_bytes(requested_latency, &u->sink->sample_spec));
 
     pa_log_debug("tlength requested at %lu.", (unsigned long) bufferattr.tlength);
 
@@ -478,6 +569,8 @@ static void sink_update_requested_latency_cb(pa_sink *s) {
     nbytes = pa_usec_to_bytes(block_usec, &s->sample_spec);
     pa_sink_set_max_request_within_thread(s, nbytes);
 
+    nbytes = transport_tlength(u, nbytes);
+
     if (u->stream) {
         switch (pa_stream_get_state(u->stream)) {
             case PA_STREAM_READY:
@@ -530,7 +623,7 @@ static int sink_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t of
                 return 0;
             }
 
-            *((int64_t*) data) = remote_latency;
+            *((int64_t*) data) = remote_latency + u->transport_delay;
             return 0;
         }
         case TUNNEL_MESSAGE_SINK_CREATED:
@@ -652,6 +745,7 @@ static int do_init(pa_module *m) {
     struct module_restart_data *rd;
     pa_modargs *ma = NULL;
     const char *remote_server = NULL;
+    const char *compression;
     char *default_sink_name = NULL;
     uint32_t reconnect_interval_ms = 0;
 
@@ -730,6 +824,23 @@ static int do_init(pa_module *m) {
     pa_modargs_get_value_u32(ma, "reconnect_interval_ms", &reconnect_interval_ms);
     u->reconnect_interval_us = reconnect_interval_ms * PA_USEC_PER_MSEC;
 
+    compression = pa_modargs_get_value(ma, "compression", "none");
+    if (pa_streq(compression, "opus")) {
+#ifdef HAVE_OPUS
+        if (!pa_opus_codec_supported(&u->sample_spec)) {
+            pa_log("Opus compression requires s16 or float32 samples at 8, 12, 16, 24 or 48 kHz.");
+            goto fail;
+        }
+        u->compression = true;
+#else
+        pa_log("Opus compression is not supported by this build.");
+        goto fail;
+#endif
+    } else if (!pa_streq(compression, "none")) {
+        pa_log("Invalid compression '%s'.", compression);
+        goto fail;
+    }
+
     if (!(u->thread = pa_thread_new("tunnel-sink", thread_func, u))) {
         pa_log("Failed to create thread.");
         goto fail;
@@ -30,6 +30,8 @@
 #include <pulse/mainloop.h>
 #include <pulse/introspect.h>
 #include <pulse/error.h>
+#include <pulse/format.h>
+#include <pulse/internal.h>
 
 #include <pulsecore/core.h>
 #include <pulsecore/core-util.h>
@@ -42,6 +44,11 @@
 #include <pulsecore/poll.h>
 #include <pulsecore/rtpoll.h>
 #include <pulsecore/proplist-util.h>
+#include <pulsecore/native-common.h>
+
+#ifdef HAVE_OPUS
+#include <pulsecore/opus-codec.h>
+#endif
 
 PA_MODULE_AUTHOR("Alexander Couzens");
 PA_MODULE_DESCRIPTION("Create a network source which connects via a stream to a remote PulseAudio server");
@@ -57,7 +64,8 @@ PA_MODULE_USAGE(
         "channels=<number of channels> "
         "rate=<sample rate> "
         "channel_map=<channel map> "
-        "cookie=<cookie file path>"
+        "cookie=<cookie file path> "
+        "compression=<none or opus> "
         );
 
 #define TUNNEL_THREAD_FAILED_MAINLOOP 1
@@ -114,6 +122,10 @@ struct userdata {
     tunnel_msg *msg;
 
     pa_usec_t reconnect_interval_us;
+
+    bool compression;
+    bool transport_codec;
+    pa_usec_t transport_delay;
 };
 
 struct module_restart_data {
@@ -132,6 +144,7 @@ static const char* const valid_modargs[] = {
     "channel_map",
     "cookie",
     "reconnect_interval_ms",
+    "compression",
     NULL,
 };
 
@@ -193,8 +206,15 @@ static void read_new_samples(struct userdata *u) {
             return;
         }
 
-        if (PA_LIKELY(p)) {
-            /* we have valid data */
+        if (PA_LIKELY(p) && pa_memblock_is_ours(u->stream->peek_memchunk.memblock)) {
+            /* The data lives in a block of the context's own mempool, so we
+             * can pass that block on as it is. */
+            pa_source_post(u->source, &u->stream->peek_memchunk);
+        } else if (PA_LIKELY(p)) {
+            /* The block was imported from the remote server's SHM/memfd pool.
+             * Releasing it has to happen in this thread, so wrap the data and
+             * let pa_memblock_unref_fixed() copy it only if someone downstream
+             * keeps a reference. */
             memchunk.memblock = pa_memblock_new_fixed(u->module->core->mempool, (void *) p, nbytes, true);
             memchunk.length = nbytes;
             memchunk.index = 0;
@@ -285,6 +305,9 @@ fail:
 
 finish:
     if (u->stream) {
+        if (u->transport_codec && u->context->pstream)
+            pa_pstream_set_decoder(u->context->pstream, u->stream->channel, NULL);
+
         pa_stream_disconnect(u->stream);
         pa_stream_unref(u->stream);
         u->stream = NULL;
@@ -299,6 +322,43 @@ finish:
     pa_log_debug("Thread shutting down");
 }
 
+/* Installs the Opus decoder for our stream if the server accepted the
+ * compressed transport offered in on_source_created(). */
+static void setup_transport_codec(struct userdata *u) {
+#ifdef HAVE_OPUS
+    const pa_format_info *format;
+    pa_pstream_codec *decoder;
+    char *codec = NULL;
+
+    if (!u->compression || u->transport_codec)
+        return;
+
+    format = pa_stream_get_format_info(u->stream);
+    if (!format ||
+        pa_format_info_get_prop_string(format, PA_NATIVE_TRANSPORT_CODEC, &codec) < 0 ||
+        !pa_streq(codec, PA_OPUS_CODEC_NAME)) {
+        pa_log_info("Remote server does not support compressed streams, receiving uncompressed audio.");
+        pa_xfree(codec);
+        return;
+    }
+    pa_xfree(codec);
+
+    /* The server has already switched to compressed frames, which we
+     * can't make sense of without a decoder. */
+    if (!(decoder = pa_opus_decoder_new(&u->source->sample_spec))) {
+        pa_log_error("Failed to set up the Opus decoder.");
+        u->thread_mainloop_api->quit(u->thread_mainloop_api, TUNNEL_THREAD_FAILED_MAINLOOP);
+        return;
+    }
+
+    pa_pstream_set_decoder(u->context->pstream, u->stream->channel, decoder);
+    u->transport_codec = true;
+    u->transport_delay = pa_opus_codec_get_delay(&u->source->sample_spec);
+
+    pa_log_info("Receiving Opus compressed audio, %0.1f ms codec delay.", (double) u->transport_delay / PA_USEC_PER_MSEC);
+#endif
+}
+
 static void stream_state_cb(pa_stream *stream, void *userdata) {
     struct userdata *u = userdata;
 
@@ -314,6 +374,8 @@ static void stream_state_cb(pa_stream *stream, void *userdata) {
             pa_log_debug("Stream terminated.");
             break;
         case PA_STREAM_READY:
+            setup_transport_codec(u);
+
             if (PA_SOURCE_IS_OPENED(u->source->thread_info.state))
                 cork_stream(u, false);
 
@@ -371,11 +433,23 @@ static void on_source_created(struct userdata *u) {
     }
 
     proplist = tunnel_new_proplist(u);
-    u->stream = pa_stream_new_with_proplist(u->context,
-                                            stream_name,
-                                            &u->source->sample_spec,
-                                            &u->source->channel_map,
-                                            proplist);
+#ifdef HAVE_OPUS
+    if (u->compression) {
+        pa_format_info *format;
+
+        /* Offer a compressed transport as a property of the PCM format.
+         * Servers which don't know about it simply ignore the property. */
+        format = pa_format_info_from_sample_spec(&u->source->sample_spec, &u->source->channel_map);
+        pa_format_info_set_prop_string(format, PA_NATIVE_TRANSPORT_CODECS, PA_OPUS_CODEC_NAME);
+        u->stream = pa_stream_new_extended(u->context, stream_name, &format, 1, proplist);
+        pa_format_info_free(format);
+    } else
+#endif
+        u->stream = pa_stream_new_with_proplist(u->context,
+                                                stream_name,
+                                                &u->source->sample_spec,
+                                                &u->source->channel_map,
+                                                proplist);
     pa_proplist_free(proplist);
     pa_xfree(stream_name);
 
@@ -505,6 +579,8 @@ static int source_process_msg_cb(pa_msgobject *o, int code, void *data, int64_t
             else
                 *((int64_t*) data) = remote_latency;
 
+            *((int64_t*) data) += u->transport_delay;
+
             return 0;
         }
         case TUNNEL_MESSAGE_SOURCE_CREATED:
@@ -624,6 +700,7 @@ static int do_init(pa_module *m) {
     struct module_restart_data *rd;
     pa_modargs *ma = NULL;
     const char *remote_server = NULL;
+    const char *compression;
     char *default_source_name = NULL;
     uint32_t reconnect_interval_ms = 0;
 
@@ -701,6 +778,23 @@ static int do_init(pa_module *m) {
     pa_modargs_get_value_u32(ma, "reconnect_interval_ms", &reconnect_interval_ms);
     u->reconnect_interval_us = reconnect_interval_ms * PA_USEC_PER_MSEC;
 
+    compression = pa_modargs_get_value(ma, "compression", "none");
+    if (pa_streq(compression, "opus")) {
+#ifdef HAVE_OPUS
+        if (!pa_opus_codec_supported(&u->sample_spec)) {
+            pa_log("Opus compression requires s16 or float32 samples at 8, 12, 16, 24 or 48 kHz.");
+            goto fail;
+        }
+        u->compression = true;
+#else
+        pa_log("Opus compression is not supported by this build.");
+        goto fail;
+#endif
+    } else if (!pa_streq(compression, "none")) {
+        pa_log("Invalid compression '%s'.", compression);
+        goto fail;
+    }
+
     if (!(u->thread = pa_thread_new("tunnel-source", thread_func, u))) {
         pa_log("Failed to create thread.");
         goto fail;
@@ -196,6 +196,7 @@ static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
     [PA_COMMAND_STARTED] = command_started,
 #endif
     [PA_COMMAND_SUBSCRIBE_EVENT] = command_subscribe_event,
+    [PA_COMMAND_SUBSCRIBE_EVENT_BATCH] = command_subscribe_event,
     [PA_COMMAND_OVERFLOW] = command_overflow_or_underflow,
     [PA_COMMAND_UNDERFLOW] = command_overflow_or_underflow,
     [PA_COMMAND_PLAYBACK_STREAM_KILLED] = command_stream_killed,
@@ -1232,6 +1233,29 @@ static int read_formats(struct userdata *u, pa_tagstruct *t) {
 
 #ifdef TUNNEL_SINK
 
+static int read_stage_stats(struct userdata *u, pa_tagstruct *t) {
+    uint32_t n_stages;
+
+    if (pa_tagstruct_getu32(t, &n_stages) < 0) { /* no. of stages */
+        pa_log("Parse failure");
+        return -PA_ERR_PROTOCOL;
+    }
+
+    for (uint32_t j = 0; j < n_stages; j++) {
+        uint64_t count;
+        pa_usec_t total, max, p99;
+
+        if (pa_tagstruct_getu64(t, &count) < 0 ||
+            pa_tagstruct_get_usec(t, &total) < 0 ||
+            pa_tagstruct_get_usec(t, &max) < 0 ||
+            pa_tagstruct_get_usec(t, &p99) < 0) {
+            pa_log("Parse failure");
+            return -PA_ERR_PROTOCOL;
+        }
+    }
+    return 0;
+}
+
 /* Called from main context */
 static void sink_info_cb(pa_pdispatch *pd, uint32_t command,  uint32_t tag, pa_tagstruct *t, void *userdata) {
     struct userdata *u = userdata;
@@ -1406,6 +1430,9 @@ static void sink_input_info_cb(pa_pdispatch *pd, uint32_t command,  uint32_t tag
         pa_format_info_free(format);
     }
 
+    if (u->version >= 36 && read_stage_stats(u, t) < 0)
+        goto fail;
+
     if (!pa_tagstruct_eof(t)) {
         pa_log("Packet too long");
         goto fail;
@@ -1570,30 +1597,36 @@ static void command_subscribe_event(pa_pdispatch *pd,  uint32_t command,  uint32
     struct userdata *u = userdata;
     pa_subscription_event_type_t e;
     uint32_t idx;
+    bool changed = false;
 
     pa_assert(pd);
     pa_assert(t);
     pa_assert(u);
-    pa_assert(command == PA_COMMAND_SUBSCRIBE_EVENT);
+    pa_assert(command == PA_COMMAND_SUBSCRIBE_EVENT || command == PA_COMMAND_SUBSCRIBE_EVENT_BATCH);
 
-    if (pa_tagstruct_getu32(t, &e) < 0 ||
-        pa_tagstruct_getu32(t, &idx) < 0) {
-        pa_log("Invalid protocol reply");
-        unload_module(u->module->userdata);
-        return;
-    }
+    /* A batch holds any number of events, a single event packet one */
+    do {
+        if (pa_tagstruct_getu32(t, &e) < 0 ||
+            pa_tagstruct_getu32(t, &idx) < 0) {
+            pa_log("Invalid protocol reply");
+            unload_module(u->module->userdata);
+            return;
+        }
 
-    if (e != (PA_SUBSCRIPTION_EVENT_SERVER|PA_SUBSCRIPTION_EVENT_CHANGE) &&
+        if (e == (PA_SUBSCRIPTION_EVENT_SERVER|PA_SUBSCRIPTION_EVENT_CHANGE) ||
 #ifdef TUNNEL_SINK
-        e != (PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE) &&
-        e != (PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE)
+            e == (PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE) ||
+            e == (PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE)
 #else
-        e != (PA_SUBSCRIPTION_EVENT_SOURCE|PA_SUBSCRIPTION_EVENT_CHANGE)
+            e == (PA_SUBSCRIPTION_EVENT_SOURCE|PA_SUBSCRIPTION_EVENT_CHANGE)
 #endif
-        )
-        return;
+            )
+            changed = true;
 
-    request_info(u);
+    } while (command == PA_COMMAND_SUBSCRIBE_EVENT_BATCH && !pa_tagstruct_eof(t));
+
+    if (changed)
+        request_info(u);
 }
 
 /* Called from main context */
@@ -1612,6 +1645,11 @@ static void start_subscribe(struct userdata *u) {
 #endif
                         );
 
+    if (u->version >= 37) {
+        pa_tagstruct_putu32(t, PA_SUBSCRIPTION_TYPE_MASK_CHANGE);
+        pa_tagstruct_put_usec(t, 0);
+    }
+
     pa_pstream_send_tagstruct(u->pstream, t);
 }
 
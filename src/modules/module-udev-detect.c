@@ -36,6 +36,10 @@
 #include <pulsecore/ratelimit.h>
 #include <pulsecore/strbuf.h>
 
+#ifdef HAVE_ALSA
+#include <modules/alsa/alsa-probe-cache.h>
+#endif
+
 PA_MODULE_AUTHOR("Lennart Poettering");
 PA_MODULE_DESCRIPTION("Detect available audio hardware and load matching drivers");
 PA_MODULE_VERSION(PACKAGE_VERSION);
@@ -497,6 +501,54 @@ static void process_path(struct userdata *u, const char *path) {
     udev_device_unref(dev);
 }
 
+#ifdef HAVE_ALSA
+/* Probes all cards found at startup in parallel, so that module-alsa-card
+ * finds the results in the probe cache when it is loaded for them. Cards
+ * with their own profile set are left to module-alsa-card, the prefetch
+ * only knows the default one. */
+static void prefetch_cards(struct userdata *u, struct udev_list_entry *first) {
+    struct udev_list_entry *item;
+    const char **ids;
+    unsigned n = 0, n_allocated = 0;
+
+    udev_list_entry_foreach(item, first)
+        n_allocated++;
+
+    if (n_allocated == 0)
+        return;
+
+    ids = pa_xnew(const char *, n_allocated);
+
+    udev_list_entry_foreach(item, first) {
+        const char *path, *id, *ff;
+        struct udev_device *dev;
+
+        path = udev_list_entry_get_name(item);
+
+        if (!(id = path_get_card_id(path)))
+            continue;
+
+        if (!(dev = udev_device_new_from_syspath(u->udev, path)))
+            continue;
+
+        if (!udev_device_get_property_value(dev, "PULSE_IGNORE") &&
+            !((ff = udev_device_get_property_value(dev, "SOUND_CLASS")) && pa_streq(ff, "modem")) &&
+            !udev_device_get_property_value(dev, "PULSE_PROFILE_SET") &&
+            udev_device_get_property_value(dev, "SOUND_INITIALIZED") &&
+            !is_card_busy(id))
+            ids[n++] = id;
+
+        udev_device_unref(dev);
+    }
+
+    /* A single card is probed by module-alsa-card just as fast */
+    if (n > 1)
+        pa_alsa_probe_cache_prefetch(u->core, (const char * const *) ids, n, u->use_ucm);
+
+    pa_xfree(ids);
+}
+#endif
+
 static void monitor_cb(
         pa_mainloop_api*a,
         pa_io_event* e,
@@ -808,6 +860,11 @@ int pa__init(pa_module *m) {
     }
 
     first = udev_enumerate_get_list_entry(enumerate);
+
+#ifdef HAVE_ALSA
+    prefetch_cards(u, first);
+#endif
+
     udev_list_entry_foreach(item, first)
         process_path(u, udev_list_entry_get_name(item));
 
@@ -47,6 +47,7 @@
 #include <pulsecore/core-error.h>
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/endianmacros.h>
 #include <pulsecore/iochannel.h>
 #include <pulsecore/arpa-inet.h>
 #include <pulsecore/socket-client.h>
@@ -222,94 +223,46 @@ static inline uint64_t timeval_to_ntp(struct timeval *tv) {
     return ntp;
 }
 
-/**
- * Function to write bits into a buffer.
- * @param buffer Handle to the buffer. It will be incremented if new data requires it.
- * @param bit_pos A pointer to a position buffer to keep track the current write location (0 for MSB, 7 for LSB)
- * @param size A pointer to the byte size currently written. This allows the calling function to do simple buffer overflow checks
- * @param data The data to write
- * @param data_bit_len The number of bits from data to write
- */
-static inline void bit_writer(uint8_t **buffer, uint8_t *bit_pos, size_t *size, uint8_t data, uint8_t data_bit_len) {
-    int bits_left, bit_overflow;
-    uint8_t bit_data;
+/* Writes an uncompressed ALAC frame. The frame starts with a 23 bit header
+ * (channels=1 for stereo [3], unknown [4+8+4], has-size [1], unused [2],
+ * is-not-compressed [1]), followed by the number of samples and then the
+ * samples byte swapped to big endian. Since the header leaves one bit of
+ * its last byte free, everything after it is shifted by 7 bits: we emit
+ * whole 32 bit words shifted left by one, topped up with the MSB of the
+ * next word. raw is expected to hold S16LE stereo frames. */
+static size_t write_ALAC_data(uint8_t *packet, const size_t max, uint8_t *raw, size_t *length, bool compress) {
+    uint32_t nbs = (*length / 2) / 2;
+    uint32_t word, next, i;
+    uint8_t *bp;
 
-    if (!data_bit_len)
-        return;
+    pa_assert(max >= 7 + 4 * (size_t) nbs);
 
-    /* If bit pos is zero, we will definitely use at least one bit from the current byte so size increments. */
-    if (!*bit_pos)
-        *size += 1;
-
-    /* Calc the number of bits left in the current byte of buffer. */
-    bits_left = 7 - *bit_pos  + 1;
-    /* Calc the overflow of bits in relation to how much space we have left... */
-    bit_overflow = bits_left - data_bit_len;
-    if (bit_overflow >= 0) {
-        /* We can fit the new data in our current byte.
-         * As we write from MSB->LSB we need to left shift by the overflow amount. */
-        bit_data = data << bit_overflow;
-        if (*bit_pos)
-            **buffer |= bit_data;
-        else
-            **buffer = bit_data;
-        /* If our data fits exactly into the current byte, we need to increment our pointer. */
-        if (0 == bit_overflow) {
-            /* Do not increment size as it will be incremented on next call as bit_pos is zero. */
-            *buffer += 1;
-            *bit_pos = 0;
-        } else {
-            *bit_pos += data_bit_len;
-        }
-    } else {
-        /* bit_overflow is negative, there for we will need a new byte from our buffer
-         * Firstly fill up what's left in the current byte. */
-        bit_data = data >> -bit_overflow;
-        **buffer |= bit_data;
-        /* Increment our buffer pointer and size counter. */
-        *buffer += 1;
-        *size += 1;
-        **buffer = data << (8 + bit_overflow);
-        *bit_pos = -bit_overflow;
-    }
-}
+    /* The first word is the sample count */
+    word = nbs;
 
-static size_t write_ALAC_data(uint8_t *packet, const size_t max, uint8_t *raw, size_t *length, bool compress) {
-    uint32_t nbs = (*length / 2) / 2;
-    uint8_t *ibp, *maxibp;
-    uint8_t *bp, bpos;
-    size_t size = 0;
+    packet[0] = 0x20;
+    packet[1] = 0x00;
+    packet[2] = 0x12 | (uint8_t) (word >> 31);
+    bp = packet + 3;
 
-    bp = packet;
-    pa_memzero(packet, max);
-    size = bpos = 0;
-
-    bit_writer(&bp, &bpos, &size, 1, 3); /* channel=1, stereo */
-    bit_writer(&bp, &bpos, &size, 0, 4); /* Unknown */
-    bit_writer(&bp, &bpos, &size, 0, 8); /* Unknown */
-    bit_writer(&bp, &bpos, &size, 0, 4); /* Unknown */
-    bit_writer(&bp, &bpos, &size, 1, 1); /* Hassize */
-    bit_writer(&bp, &bpos, &size, 0, 2); /* Unused */
-    bit_writer(&bp, &bpos, &size, 1, 1); /* Is-not-compressed */
-    /* Size of data, integer, big endian. */
-    bit_writer(&bp, &bpos, &size, (nbs >> 24) & 0xff, 8);
-    bit_writer(&bp, &bpos, &size, (nbs >> 16) & 0xff, 8);
-    bit_writer(&bp, &bpos, &size, (nbs >> 8)  & 0xff, 8);
-    bit_writer(&bp, &bpos, &size, (nbs)       & 0xff, 8);
-
-    ibp = raw;
-    maxibp = raw + (4 * nbs) - 4;
-    while (ibp <= maxibp) {
-        /* Byte swap stereo data. */
-        bit_writer(&bp, &bpos, &size, *(ibp + 1), 8);
-        bit_writer(&bp, &bpos, &size, *(ibp + 0), 8);
-        bit_writer(&bp, &bpos, &size, *(ibp + 3), 8);
-        bit_writer(&bp, &bpos, &size, *(ibp + 2), 8);
-        ibp += 4;
+    for (i = 0; i < nbs; i++, raw += 4) {
+        /* Swap both channels to big endian, keeping L before R */
+        memcpy(&next, raw, sizeof(next));
+        next = PA_UINT32_FROM_LE(next);
+        next = (next << 16) | (next >> 16);
+
+        word = PA_UINT32_TO_BE((word << 1) | (next >> 31));
+        memcpy(bp, &word, sizeof(word));
+        bp += 4;
+
+        word = next;
     }
 
-    *length = (ibp - raw);
-    return size;
+    word = PA_UINT32_TO_BE(word << 1);
+    memcpy(bp, &word, sizeof(word));
+
+    *length = 4 * (size_t) nbs;
+    return 7 + 4 * (size_t) nbs;
 }
 
 static size_t build_tcp_audio_packet(pa_raop_client *c, pa_memchunk *block, pa_memchunk *packet) {
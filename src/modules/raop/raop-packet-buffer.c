@@ -37,6 +37,10 @@
 
 struct pa_raop_packet_buffer {
     pa_memchunk *packets;
+    /* Backing storage of each slot. It outlives the packet stored in the
+     * slot and is reused for later packets, so that steady streaming does
+     * not allocate. packets[i].memblock is either NULL or blocks[i]. */
+    pa_memblock **blocks;
     pa_mempool *mempool;
 
     size_t size;
@@ -56,6 +60,7 @@ pa_raop_packet_buffer *pa_raop_packet_buffer_new(pa_mempool *mempool, const size
     pb->size = size;
     pb->mempool = mempool;
     pb->packets = pa_xnew0(pa_memchunk, size);
+    pb->blocks = pa_xnew0(pa_memblock *, size);
     pb->seq = pb->pos = 0;
 
     return pb;
@@ -66,12 +71,12 @@ void pa_raop_packet_buffer_free(pa_raop_packet_buffer *pb) {
 
     pa_assert(pb);
 
-    for (i = 0; pb->packets && i < pb->size; i++) {
-        if (pb->packets[i].memblock)
-            pa_memblock_unref(pb->packets[i].memblock);
-        pa_memchunk_reset(&pb->packets[i]);
+    for (i = 0; pb->blocks && i < pb->size; i++) {
+        if (pb->blocks[i])
+            pa_memblock_unref(pb->blocks[i]);
     }
 
+    pa_xfree(pb->blocks);
     pa_xfree(pb->packets);
     pb->packets = NULL;
     pa_xfree(pb);
@@ -86,11 +91,8 @@ void pa_raop_packet_buffer_reset(pa_raop_packet_buffer *pb, uint16_t seq) {
     pb->pos = 0;
     pb->count = 0;
     pb->seq = (!seq) ? UINT16_MAX : seq - 1;
-    for (i = 0; i < pb->size; i++) {
-        if (pb->packets[i].memblock)
-            pa_memblock_unref(pb->packets[i].memblock);
+    for (i = 0; i < pb->size; i++)
         pa_memchunk_reset(&pb->packets[i]);
-    }
 }
 
 pa_memchunk *pa_raop_packet_buffer_prepare(pa_raop_packet_buffer *pb, uint16_t seq, const size_t size) {
@@ -112,11 +114,18 @@ pa_memchunk *pa_raop_packet_buffer_prepare(pa_raop_packet_buffer *pb, uint16_t s
 
     i = (pb->pos + 1) % pb->size;
 
-    if (pb->packets[i].memblock)
-        pa_memblock_unref(pb->packets[i].memblock);
-    pa_memchunk_reset(&pb->packets[i]);
+    /* Only allocate if the slot is new, too small, or its block is still
+     * referenced from somewhere else */
+    if (pb->blocks[i] &&
+        (pa_memblock_get_length(pb->blocks[i]) < size || !pa_memblock_ref_is_one(pb->blocks[i]))) {
+        pa_memblock_unref(pb->blocks[i]);
+        pb->blocks[i] = NULL;
+    }
+
+    if (!pb->blocks[i])
+        pb->blocks[i] = pa_memblock_new(pb->mempool, size);
 
-    pb->packets[i].memblock = pa_memblock_new(pb->mempool, size);
+    pb->packets[i].memblock = pb->blocks[i];
     pb->packets[i].length = size;
     pb->packets[i].index = 0;
 
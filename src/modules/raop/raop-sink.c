@@ -572,12 +572,23 @@ static void thread_func(void *userdata) {
 
         if (u->memchunk.length <= 0) {
             if (intvl < now + u->block_usec) {
-                if (u->memchunk.memblock)
+                /* Render into the block of the previous packet if nobody
+                 * else holds on to it, the packet itself has been encoded
+                 * into the client's packet buffer already */
+                if (u->memchunk.memblock &&
+                    (!pa_memblock_ref_is_one(u->memchunk.memblock) ||
+                     pa_memblock_get_length(u->memchunk.memblock) < u->block_size)) {
                     pa_memblock_unref(u->memchunk.memblock);
-                pa_memchunk_reset(&u->memchunk);
+                    pa_memchunk_reset(&u->memchunk);
+                }
+
+                if (!u->memchunk.memblock)
+                    u->memchunk.memblock = pa_memblock_new(u->core->mempool, u->block_size);
+                u->memchunk.index = 0;
+                u->memchunk.length = u->block_size;
 
                 /* Grab unencoded audio data from PulseAudio */
-                pa_sink_render_full(u->sink, u->block_size, &u->memchunk);
+                pa_sink_render_into_full(u->sink, &u->memchunk);
                 offset = u->memchunk.index;
             }
         }
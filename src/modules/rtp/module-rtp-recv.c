@@ -49,6 +49,7 @@
 #include <pulsecore/modargs.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/sample-util.h>
+#include <pulsecore/mix.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/socket-util.h>
 #include <pulsecore/atomic.h>
@@ -77,6 +78,21 @@ PA_MODULE_USAGE(
 #define MAX_SESSIONS 16
 #define DEATH_TIMEOUT 20
 #define RATE_UPDATE_INTERVAL (5*PA_USEC_PER_SEC)
+#define MAX_PACKETS_PER_WAKEUP 64
+#define STATS_UPDATE_INTERVAL (5*PA_USEC_PER_SEC)
+
+/* The target latency follows the measured jitter, between latency_msec and
+ * this upper bound */
+#define MAX_ADAPTIVE_LATENCY (2*PA_USEC_PER_SEC)
+#define JITTER_LATENCY_FACTOR 4
+
+/* Lost packets are concealed by repeating the last audio, which fades out
+ * with each repetition, and fades back in when real data resumes */
+#define PLC_HISTORY_USEC (20*PA_USEC_PER_MSEC)
+#define PLC_MAX_REPEATS 4
+#define PLC_ATTENUATION 0.6
+#define PLC_FADE_IN_USEC (4*PA_USEC_PER_MSEC)
+#define PLC_FADE_IN_STEPS 4
 
 static const char* const valid_modargs[] = {
     "sink",
@@ -111,6 +127,28 @@ struct session {
     pa_usec_t last_latency;
     double estimated_rate;
     double avg_estimated_rate;
+
+    /* Jitter buffer state, only touched from the I/O thread */
+    uint32_t last_rtp_timestamp;
+    pa_usec_t last_arrival;
+    double jitter;
+    pa_usec_t packet_usec;
+    pa_usec_t min_latency;
+    uint64_t concealed_bytes;
+
+    /* Packet loss concealment, I/O thread only */
+    pa_memchunk plc_history;
+    size_t plc_pos;
+    unsigned plc_repeats;
+
+    /* Statistics, written from the I/O thread and exported to the
+     * proplist from the main thread */
+    pa_atomic_t stat_packets;
+    pa_atomic_t stat_late;
+    pa_atomic_t stat_reordered;
+    pa_atomic_t stat_concealed_msec;
+    pa_atomic_t stat_jitter;
+    pa_atomic_t stat_latency;
 };
 
 struct userdata {
@@ -121,6 +159,7 @@ struct userdata {
     pa_io_event* sap_event;
 
     pa_time_event *check_death_event;
+    pa_time_event *stats_event;
 
     char *sink_name;
 
@@ -149,17 +188,141 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *data, int64_t
     return pa_sink_input_process_msg(o, code, data, offset, chunk);
 }
 
+/* Called from I/O thread context */
+static void plc_reset(struct session *s) {
+    if (s->plc_history.memblock)
+        pa_memblock_unref(s->plc_history.memblock);
+
+    pa_memchunk_reset(&s->plc_history);
+    s->plc_pos = 0;
+    s->plc_repeats = 0;
+}
+
+/* Called from I/O thread context */
+static void plc_remember(struct session *s, const pa_memchunk *chunk) {
+    size_t max = pa_usec_to_bytes(PLC_HISTORY_USEC, &s->sink_input->sample_spec);
+
+    if (s->plc_history.memblock)
+        pa_memblock_unref(s->plc_history.memblock);
+
+    /* Keep a reference on the tail of what we just played */
+    s->plc_history = *chunk;
+    pa_memblock_ref(s->plc_history.memblock);
+
+    if (s->plc_history.length > max) {
+        s->plc_history.index += s->plc_history.length - max;
+        s->plc_history.length = max;
+    }
+
+    s->plc_pos = 0;
+    s->plc_repeats = 0;
+}
+
+/* Called from I/O thread context. Fills the hole described by chunk (which
+ * has no memblock) with concealment audio of at most length bytes. */
+static void plc_conceal(struct session *s, pa_memchunk *chunk, size_t length) {
+    const pa_sample_spec *ss = &s->sink_input->sample_spec;
+    size_t n = PA_MIN(chunk->length, length);
+
+    if (!s->plc_history.memblock || s->plc_repeats >= PLC_MAX_REPEATS) {
+        pa_silence_memchunk_get(&s->userdata->core->silence_cache, s->userdata->core->mempool, chunk, ss, n);
+    } else {
+        pa_cvolume volume;
+        void *src, *dst;
+
+        n = PA_MIN(n, s->plc_history.length - s->plc_pos);
+
+        chunk->memblock = pa_memblock_new(s->userdata->core->mempool, n);
+        chunk->index = 0;
+        chunk->length = n;
+
+        src = pa_memblock_acquire(s->plc_history.memblock);
+        dst = pa_memblock_acquire(chunk->memblock);
+        memcpy(dst, (uint8_t*) src + s->plc_history.index + s->plc_pos, n);
+        pa_memblock_release(chunk->memblock);
+        pa_memblock_release(s->plc_history.memblock);
+
+        pa_cvolume_set(&volume, ss->channels, pa_sw_volume_from_linear(pow(PLC_ATTENUATION, s->plc_repeats + 1)));
+        pa_volume_memchunk(chunk, ss, &volume);
+
+        s->plc_pos += n;
+        if (s->plc_pos >= s->plc_history.length) {
+            s->plc_pos = 0;
+            s->plc_repeats++;
+        }
+    }
+
+    s->concealed_bytes += chunk->length;
+    pa_atomic_store(&s->stat_concealed_msec, (int) (pa_bytes_to_usec(s->concealed_bytes, ss) / PA_USEC_PER_MSEC));
+}
+
+/* Called from I/O thread context. Ramps up the first real data after a
+ * concealed stretch, chunk is replaced by a faded copy of its start. */
+static void plc_fade_in(struct session *s, pa_memchunk *chunk) {
+    const pa_sample_spec *ss = &s->sink_input->sample_spec;
+    pa_memchunk faded;
+    size_t step, i;
+    void *src, *dst;
+
+    step = pa_usec_to_bytes(PLC_FADE_IN_USEC / PLC_FADE_IN_STEPS, ss);
+    faded.length = PA_MIN(chunk->length, step * PLC_FADE_IN_STEPS);
+    faded.memblock = pa_memblock_new(s->userdata->core->mempool, faded.length);
+    faded.index = 0;
+
+    src = pa_memblock_acquire_chunk(chunk);
+    dst = pa_memblock_acquire(faded.memblock);
+    memcpy(dst, src, faded.length);
+    pa_memblock_release(faded.memblock);
+    pa_memblock_release(chunk->memblock);
+
+    for (i = 0; i * step < faded.length; i++) {
+        pa_memchunk part;
+        pa_cvolume volume;
+
+        part.memblock = faded.memblock;
+        part.index = i * step;
+        part.length = PA_MIN(step, faded.length - part.index);
+
+        pa_cvolume_set(&volume, ss->channels, pa_sw_volume_from_linear((double) (i + 1) / (PLC_FADE_IN_STEPS + 1)));
+        pa_volume_memchunk(&part, ss, &volume);
+    }
+
+    pa_memblock_unref(chunk->memblock);
+    *chunk = faded;
+}
+
 /* Called from I/O thread context */
 static int sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *chunk) {
     struct session *s;
+    bool concealed;
+
     pa_sink_input_assert_ref(i);
     pa_assert_se(s = i->userdata);
 
     if (pa_memblockq_peek(s->memblockq, chunk) < 0)
         return -1;
 
+    /* The queue has no silence set, so holes left by lost (or hopelessly
+     * late) packets show up without a memblock */
+    if (!chunk->memblock) {
+        plc_conceal(s, chunk, length);
+        pa_memblockq_drop(s->memblockq, chunk->length);
+        return 0;
+    }
+
+    concealed = s->plc_repeats > 0 || s->plc_pos > 0;
+    if (concealed)
+        plc_fade_in(s, chunk);
+
     pa_memblockq_drop(s->memblockq, chunk->length);
 
+    if (!concealed)
+        plc_remember(s, chunk);
+    else {
+        s->plc_pos = 0;
+        s->plc_repeats = 0;
+    }
+
     return 0;
 }
 
@@ -171,6 +334,7 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes) {
     pa_assert_se(s = i->userdata);
 
     pa_memblockq_rewind(s->memblockq, nbytes);
+    plc_reset(s);
 }
 
 /* Called from I/O thread context */
@@ -198,46 +362,42 @@ static void sink_input_suspend_within_thread(pa_sink_input* i, bool b) {
     pa_sink_input_assert_ref(i);
     pa_assert_se(s = i->userdata);
 
-    if (b)
+    if (b) {
         pa_memblockq_flush_read(s->memblockq);
-    else
+        plc_reset(s);
+    } else
         s->first_packet = false;
 }
 
-/* Called from I/O thread context */
-static int rtpoll_work_cb(pa_rtpoll_item *i) {
-    pa_memchunk chunk;
-    uint32_t timestamp;
-    int64_t k, j, delta;
-    struct timeval now = { 0, 0 };
-    struct session *s;
-    struct pollfd *p;
+/* Called from I/O thread context. Derives the buffer target from the
+ * measured jitter, never going below the configured latency. */
+static void update_target_latency(struct session *s) {
+    pa_usec_t target;
 
-    pa_assert_se(s = pa_rtpoll_item_get_work_userdata(i));
+    target = s->sink_latency + (pa_usec_t) (JITTER_LATENCY_FACTOR * s->jitter) + 2 * s->packet_usec;
+    target = PA_CLAMP(target, s->min_latency, PA_MAX(s->min_latency, MAX_ADAPTIVE_LATENCY));
 
-    p = pa_rtpoll_item_get_pollfd(i, NULL);
+    if (target != s->intended_latency) {
+        pa_log_debug("Jitter %0.2f ms, target latency now %0.2f ms", s->jitter / PA_USEC_PER_MSEC, (double) target / PA_USEC_PER_MSEC);
 
-    if (p->revents & (POLLERR|POLLNVAL|POLLHUP|POLLOUT)) {
-        pa_log("poll() signalled bad revents.");
-        return -1;
+        s->intended_latency = target;
+        pa_memblockq_set_prebuf(s->memblockq, pa_usec_to_bytes(s->intended_latency - s->sink_latency, &s->sink_input->sample_spec));
     }
 
-    if ((p->revents & POLLIN) == 0)
-        return 0;
-
-    p->revents = 0;
-
-    if (pa_rtp_recv(s->rtp_context, &chunk, s->userdata->module->core->mempool, &timestamp, &now) < 0)
-        return 0;
+    pa_atomic_store(&s->stat_latency, (int) s->intended_latency);
+}
 
-    if (!PA_SINK_IS_OPENED(s->sink_input->sink->thread_info.state)) {
-        pa_memblock_unref(chunk.memblock);
-        return 0;
-    }
+/* Called from I/O thread context */
+static void handle_packet(struct session *s, pa_memchunk *chunk, uint32_t timestamp, struct timeval now) {
+    int64_t k, j, delta;
+    int64_t write_index;
+    pa_usec_t arrival;
 
     if (!s->first_packet) {
         s->first_packet = true;
         s->offset = timestamp;
+        s->last_rtp_timestamp = timestamp;
+        s->last_arrival = 0;
     }
 
     /* Check whether there was a timestamp overflow */
@@ -252,6 +412,18 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
     pa_memblockq_seek(s->memblockq, delta * (int64_t) pa_rtp_context_get_frame_size(s->rtp_context), PA_SEEK_RELATIVE,
             true);
 
+    /* The timestamp places the packet in the queue, so packets that arrive
+     * out of order still end up in sequence. Anything that ends before the
+     * read index came too late and is dropped by the queue; its hole has
+     * been concealed already. */
+    write_index = pa_memblockq_get_write_index(s->memblockq);
+    if (write_index + (int64_t) chunk->length <= pa_memblockq_get_read_index(s->memblockq))
+        pa_atomic_inc(&s->stat_late);
+    else if (delta < 0)
+        pa_atomic_inc(&s->stat_reordered);
+
+    pa_atomic_inc(&s->stat_packets);
+
     if (now.tv_sec == 0) {
         PA_ONCE_BEGIN {
             pa_log_warn("Using artificial time instead of timestamp");
@@ -260,17 +432,31 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
     } else
         pa_rtclock_from_wallclock(&now);
 
-    if (pa_memblockq_push(s->memblockq, &chunk) < 0) {
+    /* Interarrival jitter as in RFC 3550, A.8, but kept in usec */
+    arrival = pa_timeval_load(&now);
+    if (s->last_arrival > 0) {
+        double d;
+
+        d = (double) ((int64_t) arrival - (int64_t) s->last_arrival) -
+            (double) (int32_t) (timestamp - s->last_rtp_timestamp) * PA_USEC_PER_SEC / s->base_rate;
+        s->jitter += (fabs(d) - s->jitter) / 16;
+        pa_atomic_store(&s->stat_jitter, (int) s->jitter);
+    }
+    s->last_arrival = arrival;
+    s->last_rtp_timestamp = timestamp;
+    s->packet_usec = pa_bytes_to_usec(chunk->length, &s->sink_input->sample_spec);
+
+    if (pa_memblockq_push(s->memblockq, chunk) < 0) {
         pa_log_warn("Queue overrun");
-        pa_memblockq_seek(s->memblockq, (int64_t) chunk.length, PA_SEEK_RELATIVE, true);
+        pa_memblockq_seek(s->memblockq, (int64_t) chunk->length, PA_SEEK_RELATIVE, true);
     }
 
 /*     pa_log("blocks in q: %u", pa_memblockq_get_nblocks(s->memblockq)); */
 
-    pa_memblock_unref(chunk.memblock);
+    pa_memblock_unref(chunk->memblock);
 
     /* The next timestamp we expect */
-    s->offset = timestamp + (uint32_t) (chunk.length / pa_rtp_context_get_frame_size(s->rtp_context));
+    s->offset = timestamp + (uint32_t) (chunk->length / pa_rtp_context_get_frame_size(s->rtp_context));
 
     pa_atomic_store(&s->timestamp, (int) now.tv_sec);
 
@@ -282,6 +468,8 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
 
         pa_log_debug("Updating sample rate");
 
+        update_target_latency(s);
+
         wi = pa_bytes_to_usec((uint64_t) pa_memblockq_get_write_index(s->memblockq), &s->sink_input->sample_spec);
         ri = pa_bytes_to_usec((uint64_t) pa_memblockq_get_read_index(s->memblockq), &s->sink_input->sample_spec);
 
@@ -365,6 +553,49 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
 
         s->last_rate_update = pa_timeval_load(&now);
     }
+}
+
+/* Called from I/O thread context */
+static int rtpoll_work_cb(pa_rtpoll_item *i) {
+    pa_memchunk chunk;
+    uint32_t timestamp;
+    struct timeval now = { 0, 0 };
+    struct session *s;
+    struct pollfd *p;
+    unsigned n;
+
+    pa_assert_se(s = pa_rtpoll_item_get_work_userdata(i));
+
+    p = pa_rtpoll_item_get_pollfd(i, NULL);
+
+    if (p->revents & (POLLERR|POLLNVAL|POLLHUP|POLLOUT)) {
+        pa_log("poll() signalled bad revents.");
+        return -1;
+    }
+
+    if ((p->revents & POLLIN) == 0)
+        return 0;
+
+    /* The RTP backend reads packets in batches, so take everything that is
+     * queued now instead of one packet per wakeup. If we stop early, revents
+     * stays set and we get called again before the next poll(). */
+    for (n = 0; n < MAX_PACKETS_PER_WAKEUP; n++) {
+        if (pa_rtp_recv(s->rtp_context, &chunk, s->userdata->module->core->mempool, &timestamp, &now) < 0)
+            break;
+
+        if (!PA_SINK_IS_OPENED(s->sink_input->sink->thread_info.state)) {
+            pa_memblock_unref(chunk.memblock);
+            continue;
+        }
+
+        handle_packet(s, &chunk, timestamp, now);
+    }
+
+    if (n < MAX_PACKETS_PER_WAKEUP)
+        p->revents = 0;
+
+    if (n == 0)
+        return 0;
 
     if (pa_memblockq_is_readable(s->memblockq) &&
         s->sink_input->thread_info.underrun_for > 0) {
@@ -479,7 +710,6 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
     struct session *s = NULL;
     pa_sink *sink;
     int fd = -1;
-    pa_memchunk silence;
     pa_sink_input_new_data data;
     struct timeval now;
 
@@ -552,13 +782,15 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
     s->sink_input->detach = sink_input_detach;
     s->sink_input->suspend_within_thread = sink_input_suspend_within_thread;
 
-    pa_sink_input_get_silence(s->sink_input, &silence);
-
     s->sink_latency = pa_sink_input_set_requested_latency(s->sink_input, s->intended_latency/2);
 
     if (s->intended_latency < s->sink_latency*2)
         s->intended_latency = s->sink_latency*2;
 
+    s->min_latency = s->intended_latency;
+    pa_memchunk_reset(&s->plc_history);
+    pa_atomic_store(&s->stat_latency, (int) s->intended_latency);
+
     s->memblockq = pa_memblockq_new(
             "module-rtp-recv memblockq",
             0,
@@ -568,9 +800,7 @@ static struct session *session_new(struct userdata *u, const pa_sdp_info *sdp_in
             pa_usec_to_bytes(s->intended_latency - s->sink_latency, &s->sink_input->sample_spec),
             0,
             0,
-            &silence);
-
-    pa_memblock_unref(silence.memblock);
+            NULL);
 
     if (!(s->rtp_context = pa_rtp_context_new_recv(fd, sdp_info->payload, &s->sdp_info.sample_spec, sdp_info->enable_opus)))
         goto fail;
@@ -606,6 +836,7 @@ static void session_free(struct session *s) {
     pa_assert(s->userdata->n_sessions >= 1);
     s->userdata->n_sessions--;
 
+    plc_reset(s);
     pa_memblockq_free(s->memblockq);
     pa_sdp_info_destroy(&s->sdp_info);
     pa_rtp_context_free(s->rtp_context);
@@ -677,6 +908,46 @@ static void check_death_event_cb(pa_mainloop_api *m, const pa_time_event *t, con
     pa_core_rttime_restart(u->module->core, t, pa_rtclock_now() + DEATH_TIMEOUT * PA_USEC_PER_SEC);
 }
 
+/* Whether any property in p differs from what the sink input has already */
+static bool stats_changed(struct session *s, pa_proplist *p) {
+    const char *key, *old;
+    void *state = NULL;
+
+    while ((key = pa_proplist_iterate(p, &state)))
+        if (!(old = pa_proplist_gets(s->sink_input->proplist, key)) || !pa_streq(old, pa_proplist_gets(p, key)))
+            return true;
+
+    return false;
+}
+
+static void stats_event_cb(pa_mainloop_api *m, const pa_time_event *t, const struct timeval *tv, void *userdata) {
+    struct userdata *u = userdata;
+    struct session *s;
+
+    pa_assert(m);
+    pa_assert(t);
+    pa_assert(u);
+
+    for (s = u->sessions; s; s = s->next) {
+        pa_proplist *p = pa_proplist_new();
+
+        pa_proplist_setf(p, "rtp.packets", "%i", pa_atomic_load(&s->stat_packets));
+        pa_proplist_setf(p, "rtp.packets_late", "%i", pa_atomic_load(&s->stat_late));
+        pa_proplist_setf(p, "rtp.packets_reordered", "%i", pa_atomic_load(&s->stat_reordered));
+        pa_proplist_setf(p, "rtp.concealed_msec", "%i", pa_atomic_load(&s->stat_concealed_msec));
+        pa_proplist_setf(p, "rtp.jitter_usec", "%i", pa_atomic_load(&s->stat_jitter));
+        pa_proplist_setf(p, "rtp.target_latency_usec", "%i", pa_atomic_load(&s->stat_latency));
+
+        /* Idle sessions would otherwise post a change event every interval */
+        if (stats_changed(s, p))
+            pa_sink_input_update_proplist(s->sink_input, PA_UPDATE_REPLACE, p);
+
+        pa_proplist_free(p);
+    }
+
+    pa_core_rttime_restart(u->module->core, t, pa_rtclock_now() + STATS_UPDATE_INTERVAL);
+}
+
 int pa__init(pa_module*m) {
     struct userdata *u;
     pa_modargs *ma = NULL;
@@ -765,6 +1036,7 @@ int pa__init(pa_module*m) {
     u->by_origin = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func, NULL, (pa_free_cb_t) session_free);
 
     u->check_death_event = pa_core_rttime_new(m->core, pa_rtclock_now() + DEATH_TIMEOUT * PA_USEC_PER_SEC, check_death_event_cb, u);
+    u->stats_event = pa_core_rttime_new(m->core, pa_rtclock_now() + STATS_UPDATE_INTERVAL, stats_event_cb, u);
 
     pa_modargs_free(ma);
 
@@ -803,6 +1075,9 @@ void pa__done(pa_module*m) {
     if (u->check_death_event)
         m->core->mainloop->time_free(u->check_death_event);
 
+    if (u->stats_event)
+        m->core->mainloop->time_free(u->stats_event);
+
     pa_sap_context_destroy(&u->sap_context);
 
     if (u->by_origin)
@@ -602,6 +602,8 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, uint32_
     uint8_t *data;
     uint64_t data_len = 0;
 
+    pa_memchunk_reset(chunk);
+
     if (!process_bus_messages(c))
         goto fail;
 
@@ -653,6 +655,10 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, uint32_
         gst_sample_unref(sample);
     }
 
+    /* Nothing (more) queued, the caller reads until we run dry */
+    if (data_len == 0)
+        goto fail;
+
     buf_list = gst_adapter_take_buffer_list(adapter, data_len);
     pa_assert(buf_list);
 
@@ -35,6 +35,10 @@
 #include <sys/uio.h>
 #endif
 
+#ifdef HAVE_NETINET_UDP_H
+#include <netinet/udp.h>
+#endif
+
 #include <pulsecore/core-error.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
@@ -44,6 +48,42 @@
 
 #include "rtp.h"
 
+#define MAX_IOVECS 16
+
+#ifdef HAVE_SENDMMSG
+#define SEND_BATCH 16
+#else
+#define SEND_BATCH 1
+#endif
+
+#ifdef HAVE_RECVMMSG
+#define RECV_BATCH 16
+#else
+#define RECV_BATCH 1
+#endif
+
+/* Upper bound for a GSO send, leaving room for the IPv6 and UDP headers */
+#define GSO_MAX_BYTES (65535 - 48)
+
+struct rtp_send_packet {
+    uint32_t header[3];
+    struct iovec iov[MAX_IOVECS];
+    pa_memblock *mb[MAX_IOVECS];
+    unsigned n_iov;
+    size_t length;
+};
+
+struct rtp_recv_slot {
+    uint8_t *data;
+    size_t length;
+    int flags;
+    union {
+        uint8_t buf[128];
+        struct cmsghdr align;
+    } aux;
+    size_t aux_length;
+};
+
 typedef struct pa_rtp_context {
     int fd;
     uint16_t sequence;
@@ -53,6 +93,16 @@ typedef struct pa_rtp_context {
     size_t frame_size;
     size_t mtu;
 
+    /* Packets built by pa_rtp_send() that still need to go out. They keep
+     * their memblocks acquired until then. */
+    struct rtp_send_packet *send_packets;
+    unsigned n_send_packets;
+    bool use_gso, gso_verified;
+
+    /* Datagrams read by the last batch receive, recv_buf holds RECV_BATCH
+     * slots of recv_buf_size bytes each. */
+    struct rtp_recv_slot *recv_slots;
+    unsigned n_recv_slots, next_recv_slot;
     uint8_t *recv_buf;
     size_t recv_buf_size;
     pa_memchunk memchunk;
@@ -75,6 +125,11 @@ pa_rtp_context* pa_rtp_context_new_send(int fd, uint8_t payload, size_t mtu, con
     c->frame_size = pa_frame_size(ss);
     c->mtu = mtu;
 
+    c->send_packets = pa_xnew0(struct rtp_send_packet, SEND_BATCH);
+#ifdef UDP_SEGMENT
+    c->use_gso = SEND_BATCH > 1;
+#endif
+
     c->recv_buf = NULL;
     c->recv_buf_size = 0;
     pa_memchunk_reset(&c->memchunk);
@@ -82,13 +137,156 @@ pa_rtp_context* pa_rtp_context_new_send(int fd, uint8_t payload, size_t mtu, con
     return c;
 }
 
-#define MAX_IOVECS 16
+static void release_send_packets(pa_rtp_context *c) {
+    unsigned i, j;
+
+    for (i = 0; i < c->n_send_packets; i++) {
+        struct rtp_send_packet *p = &c->send_packets[i];
+
+        for (j = 1; j < p->n_iov; j++) {
+            pa_memblock_release(p->mb[j]);
+            pa_memblock_unref(p->mb[j]);
+        }
+    }
+
+    c->n_send_packets = 0;
+}
+
+#ifdef UDP_SEGMENT
+/* Hand the whole batch to the kernel as one buffer and let it split that
+ * into datagrams (UDP GSO). That only works if all packets but the last
+ * one have the same size, which is the normal case for us. Returns 1 if
+ * the batch was sent, 0 if it has to go out the regular way and -1 if
+ * sending failed. */
+static int send_packets_gso(pa_rtp_context *c) {
+    struct iovec iov[SEND_BATCH * MAX_IOVECS];
+    union {
+        uint8_t buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    } control;
+    struct cmsghdr *cm;
+    struct msghdr m;
+    size_t segment_size, total = 0;
+    unsigned i, n_iov = 0;
+    uint16_t gso_size;
+
+    segment_size = sizeof(c->send_packets[0].header) + c->mtu;
+
+    if (c->n_send_packets < 2 || segment_size > UINT16_MAX)
+        return 0;
+
+    for (i = 0; i < c->n_send_packets; i++) {
+        struct rtp_send_packet *p = &c->send_packets[i];
+
+        if (i < c->n_send_packets - 1 && p->length != c->mtu)
+            return 0;
+
+        memcpy(iov + n_iov, p->iov, p->n_iov * sizeof(struct iovec));
+        n_iov += p->n_iov;
+        total += sizeof(p->header) + p->length;
+    }
+
+    if (total > GSO_MAX_BYTES)
+        return 0;
+
+    pa_zero(control);
+    pa_zero(m);
+    m.msg_iov = iov;
+    m.msg_iovlen = n_iov;
+    m.msg_control = control.buf;
+    m.msg_controllen = sizeof(control.buf);
+
+    gso_size = (uint16_t) segment_size;
+    cm = CMSG_FIRSTHDR(&m);
+    cm->cmsg_level = IPPROTO_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(gso_size));
+    memcpy(CMSG_DATA(cm), &gso_size, sizeof(gso_size));
+
+    if (sendmsg(c->fd, &m, MSG_DONTWAIT) < 0) {
+        /* Older kernels and some interfaces refuse segmentation offload,
+         * which shows on the first send. Don't try again on this socket. */
+        if (!c->gso_verified && (errno == EIO || errno == EINVAL || errno == EOPNOTSUPP)) {
+            pa_log_info("UDP segmentation offload not available (%s), sending packets individually.", pa_cstrerror(errno));
+            c->use_gso = false;
+            return 0;
+        }
+
+        if (errno != EAGAIN && errno != EINTR) /* If the queue is full, just ignore it */
+            pa_log("sendmsg() failed: %s", pa_cstrerror(errno));
+        return -1;
+    }
+
+    c->gso_verified = true;
+
+    return 1;
+}
+#endif
+
+/* Send the packets batched up by pa_rtp_send() with as few syscalls as
+ * possible. */
+static int send_packets(pa_rtp_context *c) {
+    unsigned i;
+    int r = 0;
+
+    if (c->n_send_packets == 0)
+        return 0;
+
+#ifdef UDP_SEGMENT
+    if (c->use_gso && (r = send_packets_gso(c)) != 0) {
+        release_send_packets(c);
+        return r < 0 ? -1 : 0;
+    }
+#endif
+
+#ifdef HAVE_SENDMMSG
+    {
+        struct mmsghdr msgs[SEND_BATCH];
+        unsigned sent = 0;
+
+        pa_zero(msgs);
+        for (i = 0; i < c->n_send_packets; i++) {
+            msgs[i].msg_hdr.msg_iov = c->send_packets[i].iov;
+            msgs[i].msg_hdr.msg_iovlen = c->send_packets[i].n_iov;
+        }
+
+        while (sent < c->n_send_packets) {
+            int k;
+
+            if ((k = sendmmsg(c->fd, msgs + sent, c->n_send_packets - sent, MSG_DONTWAIT)) < 0) {
+                if (errno != EAGAIN && errno != EINTR) /* If the queue is full, just ignore it */
+                    pa_log("sendmmsg() failed: %s", pa_cstrerror(errno));
+                r = -1;
+                break;
+            }
+
+            sent += (unsigned) k;
+        }
+    }
+#else
+    for (i = 0; i < c->n_send_packets; i++) {
+        struct msghdr m;
+
+        pa_zero(m);
+        m.msg_iov = c->send_packets[i].iov;
+        m.msg_iovlen = c->send_packets[i].n_iov;
+
+        if (sendmsg(c->fd, &m, MSG_DONTWAIT) < 0) {
+            if (errno != EAGAIN && errno != EINTR) /* If the queue is full, just ignore it */
+                pa_log("sendmsg() failed: %s", pa_cstrerror(errno));
+            r = -1;
+            break;
+        }
+    }
+#endif
+
+    release_send_packets(c);
+
+    return r;
+}
 
 int pa_rtp_send(pa_rtp_context *c, pa_memblockq *q) {
-    struct iovec iov[MAX_IOVECS];
-    pa_memblock* mb[MAX_IOVECS];
-    int iov_idx = 1;
-    size_t n = 0;
+    struct rtp_send_packet *p = NULL;
 
     pa_assert(c);
     pa_assert(q);
@@ -100,71 +298,57 @@ int pa_rtp_send(pa_rtp_context *c, pa_memblockq *q) {
         int r;
         pa_memchunk chunk;
 
+        if (!p) {
+            p = &c->send_packets[c->n_send_packets];
+            p->n_iov = 1;
+            p->length = 0;
+        }
+
         pa_memchunk_reset(&chunk);
 
+        /* The payload is referenced straight from the queue's memblocks,
+         * nothing gets copied before the kernel does it. */
         if ((r = pa_memblockq_peek(q, &chunk)) >= 0) {
 
-            size_t k = n + chunk.length > c->mtu ? c->mtu - n : chunk.length;
+            size_t k = p->length + chunk.length > c->mtu ? c->mtu - p->length : chunk.length;
 
             pa_assert(chunk.memblock);
 
-            iov[iov_idx].iov_base = pa_memblock_acquire_chunk(&chunk);
-            iov[iov_idx].iov_len = k;
-            mb[iov_idx] = chunk.memblock;
-            iov_idx ++;
+            p->iov[p->n_iov].iov_base = pa_memblock_acquire_chunk(&chunk);
+            p->iov[p->n_iov].iov_len = k;
+            p->mb[p->n_iov] = chunk.memblock;
+            p->n_iov++;
 
-            n += k;
+            p->length += k;
             pa_memblockq_drop(q, k);
         }
 
-        pa_assert(n % c->frame_size == 0);
-
-        if (r < 0 || n >= c->mtu || iov_idx >= MAX_IOVECS) {
-            uint32_t header[3];
-            struct msghdr m;
-            ssize_t k;
-            int i;
+        pa_assert(p->length % c->frame_size == 0);
 
-            if (n > 0) {
-                header[0] = htonl(((uint32_t) 2 << 30) | ((uint32_t) c->payload << 16) | ((uint32_t) c->sequence));
-                header[1] = htonl(c->timestamp);
-                header[2] = htonl(c->ssrc);
+        if (r < 0 || p->length >= c->mtu || p->n_iov >= MAX_IOVECS) {
+            bool done = r < 0 || pa_memblockq_get_length(q) < c->mtu;
 
-                iov[0].iov_base = (void*)header;
-                iov[0].iov_len = sizeof(header);
+            if (p->length > 0) {
+                p->header[0] = htonl(((uint32_t) 2 << 30) | ((uint32_t) c->payload << 16) | ((uint32_t) c->sequence));
+                p->header[1] = htonl(c->timestamp);
+                p->header[2] = htonl(c->ssrc);
 
-                m.msg_name = NULL;
-                m.msg_namelen = 0;
-                m.msg_iov = iov;
-                m.msg_iovlen = (size_t) iov_idx;
-                m.msg_control = NULL;
-                m.msg_controllen = 0;
-                m.msg_flags = 0;
-
-                k = sendmsg(c->fd, &m, MSG_DONTWAIT);
-
-                for (i = 1; i < iov_idx; i++) {
-                    pa_memblock_release(mb[i]);
-                    pa_memblock_unref(mb[i]);
-                }
+                p->iov[0].iov_base = (void*) p->header;
+                p->iov[0].iov_len = sizeof(p->header);
 
+                c->n_send_packets++;
                 c->sequence++;
-            } else
-                k = 0;
+            }
 
-            c->timestamp += (unsigned) (n/c->frame_size);
+            c->timestamp += (unsigned) (p->length/c->frame_size);
+            p = NULL;
 
-            if (k < 0) {
-                if (errno != EAGAIN && errno != EINTR) /* If the queue is full, just ignore it */
-                    pa_log("sendmsg() failed: %s", pa_cstrerror(errno));
-                return -1;
-            }
+            if (done || c->n_send_packets >= SEND_BATCH)
+                if (send_packets(c) < 0)
+                    return -1;
 
-            if (r < 0 || pa_memblockq_get_length(q) < c->mtu)
+            if (done)
                 break;
-
-            n = 0;
-            iov_idx = 1;
         }
     }
 
@@ -182,31 +366,20 @@ pa_rtp_context* pa_rtp_context_new_recv(int fd, uint8_t payload, const pa_sample
     c->payload = payload;
     c->frame_size = pa_frame_size(ss);
 
+    c->recv_slots = pa_xnew0(struct rtp_recv_slot, RECV_BATCH);
     c->recv_buf_size = 2000;
-    c->recv_buf = pa_xmalloc(c->recv_buf_size);
+    c->recv_buf = pa_xmalloc(c->recv_buf_size * RECV_BATCH);
     pa_memchunk_reset(&c->memchunk);
 
     return c;
 }
 
-int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, uint32_t *rtp_tstamp, struct timeval *tstamp) {
-    int size;
-    size_t audio_length;
-    size_t metadata_length;
-    struct msghdr m;
-    struct cmsghdr *cm;
-    struct iovec iov;
-    uint32_t header;
-    uint32_t ssrc;
-    uint8_t payload;
-    unsigned cc;
-    uint8_t aux[1024];
-    bool found_tstamp = false;
+/* Read as many datagrams as the socket has queued, up to RECV_BATCH, into
+ * the receive slots. */
+static int recv_batch(pa_rtp_context *c) {
+    int size, n;
 
-    pa_assert(c);
-    pa_assert(chunk);
-
-    pa_memchunk_reset(chunk);
+    c->n_recv_slots = c->next_recv_slot = 0;
 
     /* FIONREAD works on both BSD and Linux, but they do something different:
      * - on Linux it returns the amount of bytes in the next datagram
@@ -214,12 +387,14 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, uint32_
      *   more than one datagram and includes headers
      *
      * So the result will be a lower bound of how many bytes are needed, but might not be
-     * the exact size of the buffer size needed.
+     * the exact size of the buffer size needed. Later datagrams of a batch which don't
+     * fit into their slot are dropped, the slots grow as soon as such a datagram is
+     * seen first.
      */
 
     if (ioctl(c->fd, FIONREAD, &size) < 0) {
         pa_log_warn("FIONREAD failed: %s", pa_cstrerror(errno));
-        goto fail;
+        return -1;
     }
 
     if (size <= 0) {
@@ -227,6 +402,7 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, uint32_
          *
          * 1. Somebody sent us a perfectly valid zero-length UDP packet.
          * 2. Somebody sent us a UDP packet with a bad CRC.
+         * 3. Nothing is queued at all (we read until the socket runs dry).
          *
          * It is unknown whether size can actually be less than zero.
          *
@@ -236,8 +412,8 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, uint32_
          * now and discard it later, when comparing the number of bytes
          * received (0) with the number of bytes wanted (1, see below).
          *
-         * In the second case, recvmsg() will fail, thus allowing us to
-         * return the error.
+         * In the second and third case, the receive will fail, thus
+         * allowing us to return the error.
          *
          * Just to avoid passing zero-sized memchunks and NULL pointers to
          * recvmsg(), let's force allocation of at least one byte by setting
@@ -254,38 +430,100 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, uint32_
             c->recv_buf_size *= 2;
         while (c->recv_buf_size < (size_t) size);
 
-        c->recv_buf = pa_xrealloc(c->recv_buf, c->recv_buf_size);
+        c->recv_buf = pa_xrealloc(c->recv_buf, c->recv_buf_size * RECV_BATCH);
     }
 
     pa_assert(c->recv_buf_size >= (size_t) size);
 
-    iov.iov_base = c->recv_buf;
-    iov.iov_len = (size_t) size;
+#ifdef HAVE_RECVMMSG
+    {
+        struct mmsghdr msgs[RECV_BATCH];
+        struct iovec iov[RECV_BATCH];
+        int i;
+
+        pa_zero(msgs);
+        for (i = 0; i < RECV_BATCH; i++) {
+            iov[i].iov_base = c->recv_buf + i * c->recv_buf_size;
+            iov[i].iov_len = c->recv_buf_size;
+
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_control = c->recv_slots[i].aux.buf;
+            msgs[i].msg_hdr.msg_controllen = sizeof(c->recv_slots[i].aux.buf);
+        }
 
-    m.msg_name = NULL;
-    m.msg_namelen = 0;
-    m.msg_iov = &iov;
-    m.msg_iovlen = 1;
-    m.msg_control = aux;
-    m.msg_controllen = sizeof(aux);
-    m.msg_flags = 0;
+        if ((n = recvmmsg(c->fd, msgs, RECV_BATCH, MSG_DONTWAIT, NULL)) < 0) {
+            if (errno != EAGAIN && errno != EINTR)
+                pa_log_warn("recvmmsg() failed: %s", pa_cstrerror(errno));
+            return -1;
+        }
 
-    size = recvmsg(c->fd, &m, 0);
+        for (i = 0; i < n; i++) {
+            c->recv_slots[i].data = iov[i].iov_base;
+            c->recv_slots[i].length = msgs[i].msg_len;
+            c->recv_slots[i].flags = msgs[i].msg_hdr.msg_flags;
+            c->recv_slots[i].aux_length = msgs[i].msg_hdr.msg_controllen;
+        }
+    }
+#else
+    {
+        struct msghdr m;
+        struct iovec iov;
+        ssize_t r;
+
+        iov.iov_base = c->recv_buf;
+        iov.iov_len = c->recv_buf_size;
+
+        pa_zero(m);
+        m.msg_iov = &iov;
+        m.msg_iovlen = 1;
+        m.msg_control = c->recv_slots[0].aux.buf;
+        m.msg_controllen = sizeof(c->recv_slots[0].aux.buf);
+
+        if ((r = recvmsg(c->fd, &m, MSG_DONTWAIT)) < 0) {
+            if (errno != EAGAIN && errno != EINTR)
+                pa_log_warn("recvmsg() failed: %s", pa_cstrerror(errno));
+            return -1;
+        }
+
+        c->recv_slots[0].data = c->recv_buf;
+        c->recv_slots[0].length = (size_t) r;
+        c->recv_slots[0].flags = m.msg_flags;
+        c->recv_slots[0].aux_length = m.msg_controllen;
+        n = 1;
+    }
+#endif
+
+    c->n_recv_slots = (unsigned) n;
+
+    return 0;
+}
+
+static int parse_packet(pa_rtp_context *c, struct rtp_recv_slot *slot, pa_memchunk *chunk, pa_mempool *pool, uint32_t *rtp_tstamp, struct timeval *tstamp) {
+    size_t size = slot->length;
+    size_t audio_length;
+    size_t metadata_length;
+    struct msghdr m;
+    struct cmsghdr *cm;
+    uint32_t header;
+    uint32_t ssrc;
+    uint8_t payload;
+    unsigned cc;
+    bool found_tstamp = false;
 
-    if (size < 0) {
-        if (errno != EAGAIN && errno != EINTR)
-            pa_log_warn("recvmsg() failed: %s", pa_cstrerror(errno));
-        goto fail;
+    if (slot->flags & MSG_TRUNC) {
+        pa_log_warn("RTP packet larger than the receive buffer.");
+        return -1;
     }
 
     if (size < 12) {
         pa_log_warn("RTP packet too short.");
-        goto fail;
+        return -1;
     }
 
-    memcpy(&header, iov.iov_base, sizeof(uint32_t));
-    memcpy(rtp_tstamp, (uint8_t*) iov.iov_base + 4, sizeof(uint32_t));
-    memcpy(&ssrc, (uint8_t*) iov.iov_base + 8, sizeof(uint32_t));
+    memcpy(&header, slot->data, sizeof(uint32_t));
+    memcpy(rtp_tstamp, slot->data + 4, sizeof(uint32_t));
+    memcpy(&ssrc, slot->data + 8, sizeof(uint32_t));
 
     header = ntohl(header);
     *rtp_tstamp = ntohl(*rtp_tstamp);
@@ -293,22 +531,22 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, uint32_
 
     if ((header >> 30) != 2) {
         pa_log_warn("Unsupported RTP version.");
-        goto fail;
+        return -1;
     }
 
     if ((header >> 29) & 1) {
         pa_log_warn("RTP padding not supported.");
-        goto fail;
+        return -1;
     }
 
     if ((header >> 28) & 1) {
         pa_log_warn("RTP header extensions not supported.");
-        goto fail;
+        return -1;
     }
 
     if (ssrc != c->ssrc) {
         pa_log_debug("Got unexpected SSRC");
-        goto fail;
+        return -1;
     }
 
     cc = (header >> 24) & 0xF;
@@ -319,19 +557,19 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, uint32_
 
     if (payload != c->payload) {
         pa_log_debug("Got unexpected payload: %u", payload);
-        goto fail;
+        return -1;
     }
 
-    if (metadata_length > (unsigned) size) {
+    if (metadata_length > size) {
         pa_log_warn("RTP packet too short. (CSRC)");
-        goto fail;
+        return -1;
     }
 
     audio_length = size - metadata_length;
 
     if (audio_length % c->frame_size != 0) {
         pa_log_warn("Bad RTP packet size.");
-        goto fail;
+        return -1;
     }
 
     if (c->memchunk.length < audio_length) {
@@ -347,7 +585,7 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, uint32_
         c->memchunk.length = pa_memblock_get_length(c->memchunk.memblock);
     }
 
-    memcpy(pa_memblock_acquire_chunk(&c->memchunk), c->recv_buf + metadata_length, audio_length);
+    memcpy(pa_memblock_acquire_chunk(&c->memchunk), slot->data + metadata_length, audio_length);
     pa_memblock_release(c->memchunk.memblock);
 
     chunk->memblock = pa_memblock_ref(c->memchunk.memblock);
@@ -362,6 +600,10 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, uint32_
         pa_memchunk_reset(&c->memchunk);
     }
 
+    pa_zero(m);
+    m.msg_control = slot->aux.buf;
+    m.msg_controllen = slot->aux_length;
+
     for (cm = CMSG_FIRSTHDR(&m); cm; cm = CMSG_NXTHDR(&m, cm))
         if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_TIMESTAMP) {
             memcpy(tstamp, CMSG_DATA(cm), sizeof(struct timeval));
@@ -375,22 +617,37 @@ int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, uint32_
     }
 
     return 0;
+}
 
-fail:
-    if (chunk->memblock)
-        pa_memblock_unref(chunk->memblock);
+int pa_rtp_recv(pa_rtp_context *c, pa_memchunk *chunk, pa_mempool *pool, uint32_t *rtp_tstamp, struct timeval *tstamp) {
+    pa_assert(c);
+    pa_assert(chunk);
+
+    pa_memchunk_reset(chunk);
 
-    return -1;
+    /* Skip over broken packets of a batch instead of failing, a failure
+     * tells the caller that the socket has run dry. */
+    for (;;) {
+        if (c->next_recv_slot >= c->n_recv_slots && recv_batch(c) < 0)
+            return -1;
+
+        if (parse_packet(c, &c->recv_slots[c->next_recv_slot++], chunk, pool, rtp_tstamp, tstamp) >= 0)
+            return 0;
+    }
 }
 
 void pa_rtp_context_free(pa_rtp_context *c) {
     pa_assert(c);
 
+    release_send_packets(c);
+
     pa_assert_se(pa_close(c->fd) == 0);
 
     if (c->memchunk.memblock)
         pa_memblock_unref(c->memchunk.memblock);
 
+    pa_xfree(c->send_packets);
+    pa_xfree(c->recv_slots);
     pa_xfree(c->recv_buf);
     pa_xfree(c);
 }
@@ -25,6 +25,11 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/stat.h>
+
+#ifndef OS_IS_WIN32
+#include <dirent.h>
+#endif
 
 #include <pulse/xmalloc.h>
 
@@ -35,6 +40,8 @@
 #include <pulsecore/conf-parser.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/authkey.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/strbuf.h>
 
 #include "client-conf.h"
 
@@ -68,9 +75,17 @@ static const pa_client_conf default_conf = {
     .disable_memfd = false,
     .shm_size = 0,
     .auto_connect_localhost = false,
-    .auto_connect_display = false
+    .auto_connect_display = false,
+    .pipeline_handshake = true
 };
 
+/* The result of the last parse of the configuration file and its drop-ins.
+ * Every context loads the configuration, but the files rarely change during
+ * the lifetime of a process, so they are only parsed again if they did. */
+static pa_static_mutex cache_mutex = PA_STATIC_MUTEX_INIT;
+static pa_client_conf *cache_conf = NULL;
+static char *cache_key = NULL;
+
 pa_client_conf *pa_client_conf_new(void) {
     pa_client_conf *c = pa_xmemdup(&default_conf, sizeof(default_conf));
 
@@ -126,6 +141,113 @@ static void load_env(pa_client_conf *c) {
     }
 }
 
+static void replace_string(char **dst, const char *src) {
+    pa_xfree(*dst);
+    *dst = pa_xstrdup(src);
+}
+
+/* Copies what the configuration file can set */
+static void copy_file_settings(pa_client_conf *dst, const pa_client_conf *src) {
+    replace_string(&dst->daemon_binary, src->daemon_binary);
+    replace_string(&dst->extra_arguments, src->extra_arguments);
+    replace_string(&dst->default_sink, src->default_sink);
+    replace_string(&dst->default_source, src->default_source);
+    replace_string(&dst->default_server, src->default_server);
+    replace_string(&dst->default_dbus_server, src->default_dbus_server);
+    replace_string(&dst->cookie_file_from_client_conf, src->cookie_file_from_client_conf);
+    dst->autospawn = src->autospawn;
+    dst->disable_shm = src->disable_shm;
+    dst->disable_memfd = src->disable_memfd;
+    dst->shm_size = src->shm_size;
+    dst->auto_connect_localhost = src->auto_connect_localhost;
+    dst->auto_connect_display = src->auto_connect_display;
+    dst->pipeline_handshake = src->pipeline_handshake;
+}
+
+/* To make valgrind shut up. */
+static void cache_destructor(void) PA_GCC_DESTRUCTOR;
+static void cache_destructor(void) {
+    if (!pa_in_valgrind())
+        return;
+
+    if (cache_conf)
+        pa_client_conf_free(cache_conf);
+
+    pa_xfree(cache_key);
+}
+
+static void cache_key_add(pa_strbuf *buf, const char *fn, const struct stat *st) {
+    unsigned long nsec = 0;
+
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    nsec = (unsigned long) st->st_mtim.tv_nsec;
+#endif
+
+    pa_strbuf_printf(buf, "%s:%llu:%llu:%llu:%llu.%09lu;", fn,
+                     (unsigned long long) st->st_dev,
+                     (unsigned long long) st->st_ino,
+                     (unsigned long long) st->st_size,
+                     (unsigned long long) st->st_mtime, nsec);
+}
+
+#ifndef OS_IS_WIN32
+static int conf_filter(const struct dirent *entry) {
+    return pa_endswith(entry->d_name, ".conf");
+}
+#endif
+
+/* Describes the configuration file and the drop-ins pa_config_parse() reads
+ * along with it. Returns NULL if that can't be told, and the files have to
+ * be parsed. Files pulled in with .include are not covered. */
+static char *cache_key_new(const char *fn, FILE *f) {
+#ifdef OS_IS_WIN32
+    return NULL;
+#else
+    pa_strbuf *buf;
+    struct stat st;
+    struct dirent **entries = NULL;
+    char *dir_name;
+    int n, i;
+
+    if (fstat(fileno(f), &st) < 0)
+        return NULL;
+
+    buf = pa_strbuf_new();
+    cache_key_add(buf, fn, &st);
+
+    dir_name = pa_sprintf_malloc("%s.d", fn);
+
+    if ((n = scandir(dir_name, &entries, conf_filter, alphasort)) < 0) {
+        pa_xfree(dir_name);
+
+        if (errno != ENOENT) {
+            pa_strbuf_free(buf);
+            return NULL;
+        }
+
+        return pa_strbuf_to_string_free(buf);
+    }
+
+    for (i = 0; i < n; i++) {
+        char *fn2;
+
+        fn2 = pa_sprintf_malloc("%s" PA_PATH_SEP "%s", dir_name, entries[i]->d_name);
+
+        /* The parser skips what it can't open, so do we */
+        if (stat(fn2, &st) >= 0)
+            cache_key_add(buf, fn2, &st);
+
+        pa_xfree(fn2);
+        free(entries[i]);
+    }
+
+    free(entries);
+    pa_xfree(dir_name);
+
+    return pa_strbuf_to_string_free(buf);
+#endif
+}
+
 void pa_client_conf_load(pa_client_conf *c, bool load_from_x11, bool load_from_env) {
     FILE *f = NULL;
     char *fn = NULL;
@@ -146,12 +268,40 @@ void pa_client_conf_load(pa_client_conf *c, bool load_from_x11, bool load_from_e
         { "shm-size-bytes",         pa_config_parse_size,     &c->shm_size, NULL },
         { "auto-connect-localhost", pa_config_parse_bool,     &c->auto_connect_localhost, NULL },
         { "auto-connect-display",   pa_config_parse_bool,     &c->auto_connect_display, NULL },
+        { "pipeline-handshake",     pa_config_parse_bool,     &c->pipeline_handshake, NULL },
         { NULL,                     NULL,                     NULL, NULL },
     };
 
     f = pa_open_config_file(DEFAULT_CLIENT_CONFIG_FILE, DEFAULT_CLIENT_CONFIG_FILE_USER, ENV_CLIENT_CONFIG_FILE, &fn);
     if (f) {
-        pa_config_parse(fn, f, table, NULL, true, NULL);
+        pa_mutex *m;
+        char *key;
+
+        key = cache_key_new(fn, f);
+
+        m = pa_static_mutex_get(&cache_mutex, false, false);
+        pa_mutex_lock(m);
+
+        /* The cache holds the settings of a fresh configuration object, as
+         * all callers pass one in */
+        if (key && cache_conf && pa_streq(key, cache_key)) {
+            copy_file_settings(c, cache_conf);
+            pa_xfree(key);
+        } else {
+            pa_config_parse(fn, f, table, NULL, true, NULL);
+
+            if (key) {
+                if (!cache_conf)
+                    cache_conf = pa_client_conf_new();
+
+                copy_file_settings(cache_conf, c);
+                pa_xfree(cache_key);
+                cache_key = key;
+            }
+        }
+
+        pa_mutex_unlock(m);
+
         pa_xfree(fn);
         fclose(f);
     }
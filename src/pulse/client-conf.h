@@ -43,6 +43,7 @@ typedef struct pa_client_conf {
     bool disable_memfd;
     bool auto_connect_localhost;
     bool auto_connect_display;
+    bool pipeline_handshake;
 } pa_client_conf;
 
 /* Create a new configuration data object and reset it to defaults */
@@ -51,7 +52,8 @@ void pa_client_conf_free(pa_client_conf *c);
 
 /* Load the configuration data from the client configuration file and
  * optionally from X11 and/or environment variables, overwriting the current
- * settings in *c. */
+ * settings in *c. *c must be fresh from pa_client_conf_new(), as the parsed
+ * file is cached for the process and applied on top of the defaults. */
 void pa_client_conf_load(pa_client_conf *c, bool load_from_x11, bool load_from_env);
 
 /* Load the cookie from the cookie sources specified in the configuration, or
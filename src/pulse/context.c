@@ -83,6 +83,7 @@ static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
     [PA_COMMAND_RECORD_STREAM_SUSPENDED] = pa_command_stream_suspended,
     [PA_COMMAND_STARTED] = pa_command_stream_started,
     [PA_COMMAND_SUBSCRIBE_EVENT] = pa_command_subscribe_event,
+    [PA_COMMAND_SUBSCRIBE_EVENT_BATCH] = pa_command_subscribe_event,
     [PA_COMMAND_EXTENSION] = pa_command_extension,
     [PA_COMMAND_PLAYBACK_STREAM_EVENT] = pa_command_stream_event,
     [PA_COMMAND_RECORD_STREAM_EVENT] = pa_command_stream_event,
@@ -110,6 +111,7 @@ static void reset_callbacks(pa_context *c) {
     c->state_userdata = NULL;
 
     c->subscribe_callback = NULL;
+    c->subscribe_types = PA_SUBSCRIPTION_TYPE_MASK_ALL;
     c->subscribe_userdata = NULL;
 
     c->event_callback = NULL;
@@ -426,6 +428,32 @@ static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t o
         return;
     }
 
+    if (channel == PA_NATIVE_TIMING_PAGE_CHANNEL && c->version >= 38) {
+
+        /* The offset names the playback stream the page belongs to. If
+         * the block could not be sent as an SHM reference, the pstream
+         * gave us a copy that never changes, so leave that alone. */
+        if (chunk->memblock &&
+            !pa_memblock_is_ours(chunk->memblock) &&
+            chunk->length >= sizeof(pa_timing_page) &&
+            (s = pa_hashmap_get(c->playback_streams, PA_UINT32_TO_PTR((uint32_t) offset))) &&
+            !s->timing_page_memblock) {
+
+            s->timing_page_memblock = pa_memblock_ref(chunk->memblock);
+            s->timing_page_index = chunk->index;
+        }
+
+        pa_context_unref(c);
+        return;
+    }
+
+    /* Encoded data is only sent on streams that set up a decoder */
+    if (pa_pstream_memblock_is_encoded(p)) {
+        pa_log_warn("Received encoded data for stream %u we can't decode, dropping it.", channel);
+        pa_context_unref(c);
+        return;
+    }
+
     if ((s = pa_hashmap_get(c->record_streams, PA_UINT32_TO_PTR(channel)))) {
 
         if (chunk->memblock) {
@@ -484,6 +512,49 @@ int pa_context_handle_error(pa_context *c, uint32_t command, pa_tagstruct *t, bo
     return 0;
 }
 
+static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata);
+
+static void send_client_name(pa_context *c, bool with_proplist) {
+    pa_tagstruct *t;
+    uint32_t tag;
+
+    t = pa_tagstruct_command(c, PA_COMMAND_SET_CLIENT_NAME, &tag);
+
+    if (with_proplist) {
+        pa_init_proplist(c->proplist);
+        pa_tagstruct_put_proplist(t, c->proplist);
+    } else
+        pa_tagstruct_puts(t, pa_proplist_gets(c->proplist, PA_PROP_APPLICATION_NAME));
+
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, setup_complete_callback, c, NULL);
+}
+
+static int try_next_connection(pa_context *c);
+
+/* The server is too old for the name we sent along with the authentication
+ * and is about to drop the connection. Connect to it again, this time
+ * waiting for the reply first. The context stays in the AUTHORIZING state
+ * meanwhile. */
+static void reconnect_without_pipelining(pa_context *c) {
+    pa_assert(c);
+    pa_assert(c->server);
+
+    pa_log_debug("Server protocol version %u is too old for a pipelined handshake, connecting again.", c->version);
+
+    pa_pdispatch_unref(c->pdispatch);
+    c->pdispatch = NULL;
+
+    pa_pstream_unlink(c->pstream);
+    pa_pstream_unref(c->pstream);
+    c->pstream = NULL;
+
+    c->conf->pipeline_handshake = false;
+    c->server_list = pa_strlist_prepend(c->server_list, c->server);
+
+    try_next_connection(c);
+}
+
 static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_context *c = userdata;
 
@@ -500,7 +571,6 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
 
     switch(c->state) {
         case PA_CONTEXT_AUTHORIZING: {
-            pa_tagstruct *reply;
             bool shm_on_remote = false;
             bool memfd_on_remote = false;
 
@@ -574,16 +644,12 @@ static void setup_complete_callback(pa_pdispatch *pd, uint32_t command, uint32_t
             pa_log_debug("Memfd possible: %s", pa_yes_no(c->memfd_on_local));
             pa_log_debug("Negotiated SHM type: %s", pa_mem_type_to_string(c->shm_type));
 
-            reply = pa_tagstruct_command(c, PA_COMMAND_SET_CLIENT_NAME, &tag);
-
-            if (c->version >= 13) {
-                pa_init_proplist(c->proplist);
-                pa_tagstruct_put_proplist(reply, c->proplist);
-            } else
-                pa_tagstruct_puts(reply, pa_proplist_gets(c->proplist, PA_PROP_APPLICATION_NAME));
-
-            pa_pstream_send_tagstruct(c->pstream, reply);
-            pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, setup_complete_callback, c, NULL);
+            if (!c->conf->pipeline_handshake)
+                send_client_name(c, c->version >= 13);
+            else if (c->version < 13) {
+                reconnect_without_pipelining(c);
+                goto finish;
+            }
 
             pa_context_set_state(c, PA_CONTEXT_SETTING_NAME);
             break;
@@ -665,6 +731,15 @@ static void setup_context(pa_context *c, pa_iochannel *io) {
 
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, setup_complete_callback, c, NULL);
 
+    /* The server handles the commands in order, so the name can follow
+     * right away instead of one round trip later, which is a good share of
+     * the connection time of short-lived clients. The version of the server
+     * is not known yet, so this needs version 13 or newer, older servers are
+     * connected to again without it. The reply is handled once the
+     * authentication succeeded. */
+    if (c->conf->pipeline_handshake)
+        send_client_name(c, true);
+
     pa_context_set_state(c, PA_CONTEXT_AUTHORIZING);
 }
 
@@ -911,7 +986,7 @@ static void on_connection(pa_socket_client *client, pa_iochannel*io, void *userd
 
     pa_assert(client);
     pa_assert(c);
-    pa_assert(c->state == PA_CONTEXT_CONNECTING);
+    pa_assert(c->state == PA_CONTEXT_CONNECTING || c->state == PA_CONTEXT_AUTHORIZING);
 
     pa_context_ref(c);
 
@@ -623,6 +623,26 @@ typedef enum pa_subscription_event_type {
 /** Return one if an event type t matches an event mask bitfield */
 #define pa_subscription_match_flags(m, t) (!!((m) & (1 << ((t) & PA_SUBSCRIPTION_EVENT_FACILITY_MASK))))
 
+/** Subscription event operation masks, as used by
+ * pa_context_subscribe_filtered() \since 16.0 */
+typedef enum pa_subscription_type_mask {
+    PA_SUBSCRIPTION_TYPE_MASK_NEW = 0x0001U,
+    /**< Objects being created */
+
+    PA_SUBSCRIPTION_TYPE_MASK_CHANGE = 0x0002U,
+    /**< Objects being modified */
+
+    PA_SUBSCRIPTION_TYPE_MASK_REMOVE = 0x0004U,
+    /**< Objects being removed */
+
+    PA_SUBSCRIPTION_TYPE_MASK_ALL = 0x0007U
+    /**< All operations */
+} pa_subscription_type_mask_t;
+
+/** Return one if the operation of an event type t matches an operation mask
+ * bitfield \since 16.0 */
+#define pa_subscription_match_type(m, t) (!!((m) & (1 << (((t) & PA_SUBSCRIPTION_EVENT_TYPE_MASK) >> 4))))
+
 /** \cond fulldocs */
 #define PA_SUBSCRIPTION_MASK_NULL PA_SUBSCRIPTION_MASK_NULL
 #define PA_SUBSCRIPTION_MASK_SINK PA_SUBSCRIPTION_MASK_SINK
@@ -651,6 +671,10 @@ typedef enum pa_subscription_event_type {
 #define PA_SUBSCRIPTION_EVENT_CHANGE PA_SUBSCRIPTION_EVENT_CHANGE
 #define PA_SUBSCRIPTION_EVENT_REMOVE PA_SUBSCRIPTION_EVENT_REMOVE
 #define PA_SUBSCRIPTION_EVENT_TYPE_MASK PA_SUBSCRIPTION_EVENT_TYPE_MASK
+#define PA_SUBSCRIPTION_TYPE_MASK_NEW PA_SUBSCRIPTION_TYPE_MASK_NEW
+#define PA_SUBSCRIPTION_TYPE_MASK_CHANGE PA_SUBSCRIPTION_TYPE_MASK_CHANGE
+#define PA_SUBSCRIPTION_TYPE_MASK_REMOVE PA_SUBSCRIPTION_TYPE_MASK_REMOVE
+#define PA_SUBSCRIPTION_TYPE_MASK_ALL PA_SUBSCRIPTION_TYPE_MASK_ALL
 /** \endcond */
 
 /** A structure for all kinds of timing information of a stream. See
@@ -1099,6 +1123,15 @@ typedef enum pa_device_port_type {
     PA_DEVICE_PORT_TYPE_ANALOG = 22,
 } pa_device_port_type_t;
 
+/** Processing stages of a stream in the server, see pa_stream_stage_info.
+ * New stages can be added in the future. \since 16.0 */
+typedef enum pa_stream_stage {
+    PA_STREAM_STAGE_DATA = 0,     /**< Exchanging data with the client side of the stream */
+    PA_STREAM_STAGE_RESAMPLE = 1, /**< Resampling and remapping */
+    PA_STREAM_STAGE_VOLUME = 2,   /**< Applying the stream volume */
+    PA_STREAM_STAGE_MAX = 3       /**< Number of stages known to this version of the library */
+} pa_stream_stage_t;
+
 PA_C_DECL_END
 
 #endif
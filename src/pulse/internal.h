@@ -40,6 +40,7 @@
 #include <pulsecore/memblockq.h>
 #include <pulsecore/hashmap.h>
 #include <pulsecore/refcnt.h>
+#include <pulsecore/timing-page.h>
 
 #ifdef USE_SMOOTHER_2
 #include <pulsecore/time-smoother_2.h>
@@ -97,6 +98,7 @@ struct pa_context {
     void *state_userdata;
     pa_context_subscribe_cb_t subscribe_callback;
     void *subscribe_userdata;
+    pa_subscription_type_mask_t subscribe_types;
     pa_context_event_cb_t event_callback;
     void *event_userdata;
 
@@ -139,6 +141,9 @@ struct pa_context {
 
 #define PA_MAX_WRITE_INDEX_CORRECTIONS 32
 
+/* How many buffers from pa_stream_begin_write_buffer() may be outstanding */
+#define PA_MAX_WRITE_BUFFERS 8
+
 typedef struct pa_index_correction {
     int64_t value;
     uint32_t tag;
@@ -186,9 +191,14 @@ struct pa_stream {
     uint32_t device_index;
     char *device_name;
 
-    /* playback */
-    pa_memblock *write_memblock;
-    void *write_data;
+    /* playback, the buffers handed out by pa_stream_begin_write() and
+     * pa_stream_begin_write_buffer() that were not written yet, the most
+     * recent one last */
+    struct {
+        pa_memblock *memblock;
+        void *data;
+    } write_buffers[PA_MAX_WRITE_BUFFERS];
+    unsigned n_write_buffers;
     int64_t latest_underrun_at_index;
 
     /* recording */
@@ -199,6 +209,13 @@ struct pa_stream {
     /* Store latest latency info */
     pa_timing_info timing_info;
 
+    /* playback, the timing the server publishes in shared memory, and the
+     * time of the snapshot last copied into timing_info */
+    pa_memblock *timing_page_memblock;
+    size_t timing_page_index;
+    pa_usec_t timing_page_timestamp;
+    struct timeval timing_page_timeval;
+
     /* Use to make sure that time advances monotonically */
     pa_usec_t previous_time;
 
@@ -1201,6 +1201,29 @@ pa_operation* pa_context_get_module_info_list(pa_context *c, pa_module_info_cb_t
 
 /*** Sink input info ***/
 
+static int fill_stream_stage_info(pa_tagstruct *t, pa_stream_stage_info *stages) {
+    uint32_t n_stages, j;
+
+    if (pa_tagstruct_getu32(t, &n_stages) < 0)
+        return -PA_ERR_PROTOCOL;
+
+    for (j = 0; j < n_stages; j++) {
+        pa_stream_stage_info info;
+
+        if (pa_tagstruct_getu64(t, &info.count) < 0 ||
+            pa_tagstruct_get_usec(t, &info.total_usec) < 0 ||
+            pa_tagstruct_get_usec(t, &info.max_usec) < 0 ||
+            pa_tagstruct_get_usec(t, &info.p99_usec) < 0)
+            return -PA_ERR_PROTOCOL;
+
+        /* Skip stages newer than this library */
+        if (j < PA_STREAM_STAGE_MAX)
+            stages[j] = info;
+    }
+
+    return 0;
+}
+
 static void context_get_sink_input_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_operation *o = userdata;
     int eol = 1;
@@ -1244,7 +1267,8 @@ static void context_get_sink_input_info_callback(pa_pdispatch *pd, uint32_t comm
                 (o->context->version >= 19 && pa_tagstruct_get_boolean(t, &corked) < 0) ||
                 (o->context->version >= 20 && (pa_tagstruct_get_boolean(t, &has_volume) < 0 ||
                                                pa_tagstruct_get_boolean(t, &volume_writable) < 0)) ||
-                (o->context->version >= 21 && pa_tagstruct_get_format_info(t, i.format) < 0)) {
+                (o->context->version >= 21 && pa_tagstruct_get_format_info(t, i.format) < 0) ||
+                (o->context->version >= 36 && fill_stream_stage_info(t, i.stages) < 0)) {
 
                 pa_context_fail(o->context, PA_ERR_PROTOCOL);
                 pa_proplist_free(i.proplist);
@@ -1349,7 +1373,8 @@ static void context_get_source_output_info_callback(pa_pdispatch *pd, uint32_t c
                                                pa_tagstruct_get_boolean(t, &mute) < 0 ||
                                                pa_tagstruct_get_boolean(t, &has_volume) < 0 ||
                                                pa_tagstruct_get_boolean(t, &volume_writable) < 0 ||
-                                               pa_tagstruct_get_format_info(t, i.format) < 0))) {
+                                               pa_tagstruct_get_format_info(t, i.format) < 0)) ||
+                (o->context->version >= 36 && fill_stream_stage_info(t, i.stages) < 0)) {
 
                 pa_context_fail(o->context, PA_ERR_PROTOCOL);
                 pa_proplist_free(i.proplist);
@@ -640,6 +640,15 @@ pa_operation* pa_context_set_port_latency_offset(pa_context *c, const char *card
 
 /** @{ \name Sink Inputs */
 
+/** Time the server spent in one processing stage of a stream, accumulated
+ * since the stream was created. \since 16.0 */
+typedef struct pa_stream_stage_info {
+    uint64_t count;                      /**< Number of times the stage ran */
+    pa_usec_t total_usec;                /**< Total time spent in the stage */
+    pa_usec_t max_usec;                  /**< Longest single run */
+    pa_usec_t p99_usec;                  /**< Approximate 99th percentile of the run time */
+} pa_stream_stage_info;
+
 /** Stores information about sink inputs. Please note that this structure
  * can be extended as part of evolutionary API updates at any time in
  * any new release. */
@@ -662,6 +671,7 @@ typedef struct pa_sink_input_info {
     int has_volume;                      /**< Stream has volume. If not set, then the meaning of this struct's volume member is unspecified. \since 1.0 */
     int volume_writable;                 /**< The volume can be set. If not set, the volume can still change even though clients can't control the volume. \since 1.0 */
     pa_format_info *format;              /**< Stream format information. \since 1.0 */
+    pa_stream_stage_info stages[PA_STREAM_STAGE_MAX]; /**< Processing time per stage, indexed by pa_stream_stage_t. All zero if the server does not provide it. \since 16.0 */
 } pa_sink_input_info;
 
 /** Callback prototype for pa_context_get_sink_input_info() and friends */
@@ -714,6 +724,7 @@ typedef struct pa_source_output_info {
     int has_volume;                      /**< Stream has volume. If not set, then the meaning of this struct's volume member is unspecified. \since 1.0 */
     int volume_writable;                 /**< The volume can be set. If not set, the volume can still change even though clients can't control the volume. \since 1.0 */
     pa_format_info *format;              /**< Stream format information. \since 1.0 */
+    pa_stream_stage_info stages[PA_STREAM_STAGE_MAX]; /**< Processing time per stage, indexed by pa_stream_stage_t. All zero if the server does not provide it. \since 16.0 */
 } pa_source_output_info;
 
 /** Callback prototype for pa_context_get_source_output_info() and friends */
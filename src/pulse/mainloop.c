@@ -32,6 +32,10 @@
 #include <pulsecore/pipe.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #ifdef OS_IS_WIN32
 #include <winsock2.h>
 #endif
@@ -43,6 +47,7 @@
 #include <pulsecore/poll.h>
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
 #include <pulsecore/i18n.h>
 #include <pulsecore/llist.h>
 #include <pulsecore/log.h>
@@ -65,9 +70,30 @@ struct pa_io_event {
     void *userdata;
     pa_io_event_destroy_cb_t destroy_callback;
 
+#ifdef HAVE_SYS_EPOLL_H
+    /* The other io events on the same fd */
+    pa_io_event *epoll_next;
+#endif
+
     PA_LLIST_FIELDS(pa_io_event);
 };
 
+#ifdef HAVE_SYS_EPOLL_H
+/* The io events on one fd, which epoll can only watch once. The
+ * registration carries the fd and a generation, so that events of a
+ * registration that outlived its watch can be told apart from those of a
+ * later watch on the same fd number. */
+typedef struct epoll_watch {
+    int fd;
+    uint32_t generation;
+    uint32_t events;
+    pa_io_event *io_events;
+} epoll_watch;
+
+/* Data of ready events that are to be ignored, like the wakeup pipe */
+#define EPOLL_DATA_NONE UINT64_MAX
+#endif
+
 struct pa_time_event {
     pa_mainloop *mainloop;
     bool dead:1;
@@ -76,6 +102,11 @@ struct pa_time_event {
     bool use_rtclock:1;
     pa_usec_t time;
 
+    /* When enabled: the order of arming, which breaks ties between events
+     * of the same time, and the position in the timer heap */
+    uint64_t seq;
+    unsigned heap_index;
+
     pa_time_event_cb_t callback;
     void *userdata;
     pa_time_event_destroy_cb_t destroy_callback;
@@ -101,22 +132,42 @@ struct pa_mainloop {
     PA_LLIST_HEAD(pa_time_event, time_events);
     PA_LLIST_HEAD(pa_defer_event, defer_events);
 
-    unsigned short n_enabled_defer_events, n_enabled_time_events, n_io_events;
-    unsigned short io_events_please_scan, time_events_please_scan, defer_events_please_scan;
+    unsigned n_enabled_defer_events, n_io_events;
+    unsigned io_events_please_scan, time_events_please_scan, defer_events_please_scan;
 
     int wakeup_pipe[2];
     int wakeup_pipe_type;
 
     pa_usec_t prepared_timeout;
-    pa_time_event *cached_next_time_event;
+
+    /* The enabled time events as a binary min-heap, the one to elapse
+     * next comes first */
+    pa_time_event **time_heap;
+    unsigned n_time_heap, max_time_heap;
+    uint64_t time_seq;
 
     pa_mainloop_api api;
 
     struct pollfd *pollfds;
-    unsigned short max_pollfds;
-    unsigned short n_pollfds;
+    unsigned max_pollfds;
+    unsigned n_pollfds;
+
+#ifdef HAVE_SYS_EPOLL_H
+    /* -1 when using poll(). The io events are registered with the epoll
+     * instance right away, so nothing needs to be rebuilt per iteration. */
+    int epoll_fd;
+    struct epoll_event *epoll_events;
+    unsigned max_epoll_events;
+
+    /* fd -> epoll_watch */
+    pa_hashmap *epoll_watches;
+    uint32_t epoll_generation;
+
+    /* An fd could not be added, switch to poll() in the next iteration */
+    bool epoll_failed:1;
+#endif
 
-    short poll_func_ret : 6;
+    int poll_func_ret;
 
     bool rebuild_pollfds:1;
 
@@ -151,6 +202,206 @@ static pa_io_event_flags_t map_flags_from_libc(short flags) {
         (flags & POLLHUP ? PA_IO_EVENT_HANGUP : 0);
 }
 
+#ifdef HAVE_SYS_EPOLL_H
+static uint32_t map_flags_to_epoll(pa_io_event_flags_t flags) {
+    return
+        (flags & PA_IO_EVENT_INPUT ? EPOLLIN : 0) |
+        (flags & PA_IO_EVENT_OUTPUT ? EPOLLOUT : 0) |
+        (flags & PA_IO_EVENT_ERROR ? EPOLLERR : 0) |
+        (flags & PA_IO_EVENT_HANGUP ? EPOLLHUP : 0);
+}
+
+static pa_io_event_flags_t map_flags_from_epoll(uint32_t flags) {
+    return
+        (flags & EPOLLIN ? PA_IO_EVENT_INPUT : 0) |
+        (flags & EPOLLOUT ? PA_IO_EVENT_OUTPUT : 0) |
+        (flags & EPOLLERR ? PA_IO_EVENT_ERROR : 0) |
+        (flags & EPOLLHUP ? PA_IO_EVENT_HANGUP : 0);
+}
+
+static bool epoll_enabled(pa_mainloop *m) {
+    return m->epoll_fd >= 0;
+}
+
+static uint64_t epoll_watch_data(epoll_watch *w) {
+    return ((uint64_t) w->generation << 32) | (uint32_t) w->fd;
+}
+
+/* Registers the union of what the io events on the fd want */
+static int epoll_watch_update(pa_mainloop *m, epoll_watch *w, int op) {
+    struct epoll_event ev;
+    pa_io_event *e;
+
+    ev.events = 0;
+    for (e = w->io_events; e; e = e->epoll_next)
+        ev.events |= map_flags_to_epoll(e->events);
+
+    if (op == EPOLL_CTL_MOD && ev.events == w->events)
+        return 0;
+
+    ev.data.u64 = epoll_watch_data(w);
+
+    if (epoll_ctl(m->epoll_fd, op, w->fd, &ev) < 0) {
+        pa_log_debug("Cannot watch fd %i with epoll: %s", w->fd, pa_cstrerror(errno));
+        return -1;
+    }
+
+    w->events = ev.events;
+    return 0;
+}
+
+static void epoll_add(pa_mainloop *m, pa_io_event *e) {
+    epoll_watch *w;
+
+    if ((w = pa_hashmap_get(m->epoll_watches, PA_INT_TO_PTR(e->fd)))) {
+        e->epoll_next = w->io_events;
+        w->io_events = e;
+
+        if (epoll_watch_update(m, w, EPOLL_CTL_MOD) < 0)
+            m->epoll_failed = true;
+
+        return;
+    }
+
+    w = pa_xnew(epoll_watch, 1);
+    w->fd = e->fd;
+    w->generation = m->epoll_generation++;
+    w->events = 0;
+    w->io_events = e;
+    e->epoll_next = NULL;
+
+    /* Regular files can't be watched, poll() handles them */
+    if (epoll_watch_update(m, w, EPOLL_CTL_ADD) < 0) {
+        pa_xfree(w);
+        m->epoll_failed = true;
+        return;
+    }
+
+    pa_assert_se(pa_hashmap_put(m->epoll_watches, PA_INT_TO_PTR(w->fd), w) >= 0);
+}
+
+static void epoll_modify(pa_mainloop *m, pa_io_event *e) {
+    epoll_watch *w;
+
+    if (!(w = pa_hashmap_get(m->epoll_watches, PA_INT_TO_PTR(e->fd))))
+        return;
+
+    if (epoll_watch_update(m, w, EPOLL_CTL_MOD) < 0)
+        m->epoll_failed = true;
+}
+
+static void epoll_remove(pa_mainloop *m, pa_io_event *e) {
+    epoll_watch *w;
+    pa_io_event **p;
+    uint64_t data;
+    int i;
+
+    if (!(w = pa_hashmap_get(m->epoll_watches, PA_INT_TO_PTR(e->fd))))
+        return;
+
+    /* e->epoll_next stays as it is, dispatch_epoll() may still follow it */
+    for (p = &w->io_events; *p; p = &(*p)->epoll_next)
+        if (*p == e) {
+            *p = e->epoll_next;
+            break;
+        }
+
+    if (w->io_events) {
+        /* The fd may be closed already, then its owner frees the other io
+         * events soon */
+        epoll_watch_update(m, w, EPOLL_CTL_MOD);
+        return;
+    }
+
+    pa_hashmap_remove(m->epoll_watches, PA_INT_TO_PTR(w->fd));
+
+    /* The fd may be closed already, in which case the kernel dropped it,
+     * unless a duplicate of it is still open, see epoll_drop_stale() */
+    epoll_ctl(m->epoll_fd, EPOLL_CTL_DEL, w->fd, NULL);
+
+    /* Ready events of this watch that weren't dispatched yet aren't stale */
+    data = epoll_watch_data(w);
+    if (m->state == STATE_POLLED)
+        for (i = 0; i < m->poll_func_ret; i++)
+            if (m->epoll_events[i].data.u64 == data)
+                m->epoll_events[i].data.u64 = EPOLL_DATA_NONE;
+
+    pa_xfree(w);
+}
+
+/* A registration nobody watches reports its events again and again. That
+ * happens if an fd was closed before its io event was freed while a
+ * duplicate of it stays open. */
+static void epoll_drop_stale(pa_mainloop *m, int fd, bool fd_watched) {
+    if (!fd_watched && epoll_ctl(m->epoll_fd, EPOLL_CTL_DEL, fd, NULL) >= 0)
+        return;
+
+    /* Without the fd the registration can't be removed, poll() doesn't
+     * have that problem */
+    pa_log_debug("Stale epoll registration for fd %i.", fd);
+    m->epoll_failed = true;
+}
+
+static void epoll_done(pa_mainloop *m) {
+    if (m->epoll_fd < 0)
+        return;
+
+    pa_close(m->epoll_fd);
+    m->epoll_fd = -1;
+
+    pa_hashmap_free(m->epoll_watches);
+    m->epoll_watches = NULL;
+
+    pa_xfree(m->epoll_events);
+    m->epoll_events = NULL;
+    m->max_epoll_events = 0;
+}
+
+static void epoll_init(pa_mainloop *m) {
+    const char *e;
+    struct epoll_event ev;
+
+    m->epoll_fd = -1;
+
+    if ((e = getenv("PULSE_MAINLOOP_BACKEND")) && !pa_streq(e, "epoll")) {
+        if (!pa_streq(e, "poll"))
+            pa_log_warn("Unknown main loop backend %s, using poll().", e);
+        return;
+    }
+
+    if ((m->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        pa_log_debug("epoll_create1() failed: %s", pa_cstrerror(errno));
+        return;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.u64 = EPOLL_DATA_NONE;
+
+    if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, m->wakeup_pipe[0], &ev) < 0) {
+        pa_log_debug("Cannot watch the wakeup pipe with epoll: %s", pa_cstrerror(errno));
+        pa_close(m->epoll_fd);
+        m->epoll_fd = -1;
+        return;
+    }
+
+    m->epoll_watches = pa_hashmap_new_full(NULL, NULL, NULL, pa_xfree);
+}
+
+/* Called at the beginning of an iteration only, so that no other thread
+ * polls the epoll fd while it is closed. */
+static void epoll_fall_back(pa_mainloop *m) {
+    pa_log_debug("Switching main loop to poll().");
+
+    epoll_done(m);
+    m->epoll_failed = false;
+    m->rebuild_pollfds = true;
+}
+#else
+static bool epoll_enabled(pa_mainloop *m) {
+    return false;
+}
+#endif
+
 /* IO events */
 static pa_io_event* mainloop_io_new(
         pa_mainloop_api *a,
@@ -183,6 +434,11 @@ static pa_io_event* mainloop_io_new(
     m->rebuild_pollfds = true;
     m->n_io_events ++;
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (epoll_enabled(m) && !m->epoll_failed)
+        epoll_add(m, e);
+#endif
+
     pa_mainloop_wakeup(m);
 
     return e;
@@ -197,6 +453,11 @@ static void mainloop_io_enable(pa_io_event *e, pa_io_event_flags_t events) {
 
     e->events = events;
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (e->mainloop->epoll_fd >= 0)
+        epoll_modify(e->mainloop, e);
+#endif
+
     if (e->pollfd)
         e->pollfd->events = map_flags_to_libc(events);
     else
@@ -215,6 +476,11 @@ static void mainloop_io_free(pa_io_event *e) {
     e->mainloop->n_io_events --;
     e->mainloop->rebuild_pollfds = true;
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (e->mainloop->epoll_fd >= 0)
+        epoll_remove(e->mainloop, e);
+#endif
+
     pa_mainloop_wakeup(e->mainloop);
 }
 
@@ -293,6 +559,84 @@ static void mainloop_defer_set_destroy(pa_defer_event *e, pa_defer_event_destroy
 }
 
 /* Time events */
+static bool time_event_before(const pa_time_event *a, const pa_time_event *b) {
+    return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static void time_heap_set(pa_mainloop *m, unsigned i, pa_time_event *e) {
+    m->time_heap[i] = e;
+    e->heap_index = i;
+}
+
+static void time_heap_up(pa_mainloop *m, unsigned i) {
+    pa_time_event *e = m->time_heap[i];
+
+    while (i > 0) {
+        unsigned parent = (i - 1) / 2;
+
+        if (!time_event_before(e, m->time_heap[parent]))
+            break;
+
+        time_heap_set(m, i, m->time_heap[parent]);
+        i = parent;
+    }
+
+    time_heap_set(m, i, e);
+}
+
+static void time_heap_down(pa_mainloop *m, unsigned i) {
+    pa_time_event *e = m->time_heap[i];
+
+    for (;;) {
+        unsigned child = 2 * i + 1;
+
+        if (child >= m->n_time_heap)
+            break;
+
+        if (child + 1 < m->n_time_heap && time_event_before(m->time_heap[child + 1], m->time_heap[child]))
+            child++;
+
+        if (!time_event_before(m->time_heap[child], e))
+            break;
+
+        time_heap_set(m, i, m->time_heap[child]);
+        i = child;
+    }
+
+    time_heap_set(m, i, e);
+}
+
+static void time_heap_insert(pa_mainloop *m, pa_time_event *e) {
+    if (m->n_time_heap >= m->max_time_heap) {
+        m->max_time_heap = PA_MAX(m->max_time_heap * 2, 16U);
+        m->time_heap = pa_xrenew(pa_time_event*, m->time_heap, m->max_time_heap);
+    }
+
+    e->seq = m->time_seq++;
+    time_heap_set(m, m->n_time_heap++, e);
+    time_heap_up(m, e->heap_index);
+}
+
+static void time_heap_remove(pa_mainloop *m, pa_time_event *e) {
+    unsigned i = e->heap_index;
+    pa_time_event *last;
+
+    pa_assert(i < m->n_time_heap);
+    pa_assert(m->time_heap[i] == e);
+
+    last = m->time_heap[--m->n_time_heap];
+
+    if (last == e)
+        return;
+
+    time_heap_set(m, i, last);
+
+    if (i > 0 && time_event_before(last, m->time_heap[(i - 1) / 2]))
+        time_heap_up(m, i);
+    else
+        time_heap_down(m, i);
+}
+
 static pa_usec_t make_rt(const struct timeval *tv, bool *use_rtclock) {
     struct timeval ttv;
 
@@ -339,14 +683,7 @@ static pa_time_event* mainloop_time_new(
         e->time = t;
         e->use_rtclock = use_rtclock;
 
-        m->n_enabled_time_events++;
-
-        if (m->cached_next_time_event) {
-            pa_assert(m->cached_next_time_event->enabled);
-
-            if (t < m->cached_next_time_event->time)
-                m->cached_next_time_event = e;
-        }
+        time_heap_insert(m, e);
     }
 
     e->callback = callback;
@@ -371,27 +708,16 @@ static void mainloop_time_restart(pa_time_event *e, const struct timeval *tv) {
     t = make_rt(tv, &use_rtclock);
 
     valid = (t != PA_USEC_INVALID);
-    if (e->enabled && !valid) {
-        pa_assert(e->mainloop->n_enabled_time_events > 0);
-        e->mainloop->n_enabled_time_events--;
-    } else if (!e->enabled && valid)
-        e->mainloop->n_enabled_time_events++;
+
+    if (e->enabled)
+        time_heap_remove(e->mainloop, e);
 
     if ((e->enabled = valid)) {
         e->time = t;
         e->use_rtclock = use_rtclock;
+        time_heap_insert(e->mainloop, e);
         pa_mainloop_wakeup(e->mainloop);
     }
-
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
-
-    if (e->mainloop->cached_next_time_event && e->enabled) {
-        pa_assert(e->mainloop->cached_next_time_event->enabled);
-
-        if (t < e->mainloop->cached_next_time_event->time)
-            e->mainloop->cached_next_time_event = e;
-    }
 }
 
 static void mainloop_time_free(pa_time_event *e) {
@@ -402,14 +728,10 @@ static void mainloop_time_free(pa_time_event *e) {
     e->mainloop->time_events_please_scan ++;
 
     if (e->enabled) {
-        pa_assert(e->mainloop->n_enabled_time_events > 0);
-        e->mainloop->n_enabled_time_events--;
+        time_heap_remove(e->mainloop, e);
         e->enabled = false;
     }
 
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
-
     /* no wakeup needed here. Think about it! */
 }
 
@@ -481,6 +803,10 @@ pa_mainloop *pa_mainloop_new(void) {
     pa_make_fd_nonblock(m->wakeup_pipe[0]);
     pa_make_fd_nonblock(m->wakeup_pipe[1]);
 
+#ifdef HAVE_SYS_EPOLL_H
+    epoll_init(m);
+#endif
+
     m->rebuild_pollfds = true;
 
     m->api = vtable;
@@ -538,8 +864,7 @@ static void cleanup_time_events(pa_mainloop *m, bool force) {
             }
 
             if (!e->dead && e->enabled) {
-                pa_assert(m->n_enabled_time_events > 0);
-                m->n_enabled_time_events--;
+                time_heap_remove(m, e);
                 e->enabled = false;
             }
 
@@ -593,6 +918,11 @@ void pa_mainloop_free(pa_mainloop *m) {
     cleanup_time_events(m, true);
 
     pa_xfree(m->pollfds);
+    pa_xfree(m->time_heap);
+
+#ifdef HAVE_SYS_EPOLL_H
+    epoll_done(m);
+#endif
 
     pa_close_pipe(m->wakeup_pipe);
 
@@ -657,6 +987,57 @@ static void rebuild_pollfds(pa_mainloop *m) {
     m->rebuild_pollfds = false;
 }
 
+#ifdef HAVE_SYS_EPOLL_H
+static unsigned dispatch_epoll(pa_mainloop *m) {
+    unsigned r = 0;
+    int i;
+
+    for (i = 0; i < m->poll_func_ret; i++) {
+        uint64_t data = m->epoll_events[i].data.u64;
+        epoll_watch *w;
+        pa_io_event *e, *n;
+        int fd;
+
+        if (m->quit)
+            break;
+
+        if (data == EPOLL_DATA_NONE)
+            continue;
+
+        fd = (int) (uint32_t) data;
+
+        if (!(w = pa_hashmap_get(m->epoll_watches, PA_INT_TO_PTR(fd))) || epoll_watch_data(w) != data) {
+            epoll_drop_stale(m, fd, !!w);
+            continue;
+        }
+
+        /* The callbacks may free io events and the watch. Freed io events
+         * are kept around until the next iteration, so the list can still
+         * be followed. */
+        for (e = w->io_events; e; e = n) {
+            pa_io_event_flags_t events;
+
+            n = e->epoll_next;
+
+            if (e->dead)
+                continue;
+
+            /* Like poll(), errors and hangups go to everyone */
+            events = map_flags_from_epoll(m->epoll_events[i].events) & (e->events | PA_IO_EVENT_ERROR | PA_IO_EVENT_HANGUP);
+            if (!events)
+                continue;
+
+            pa_assert(e->callback);
+
+            e->callback(&m->api, e, e->fd, events, e->userdata);
+            r++;
+        }
+    }
+
+    return r;
+}
+#endif
+
 static unsigned dispatch_pollfds(pa_mainloop *m) {
     pa_io_event *e;
     unsigned r = 0, k;
@@ -708,39 +1089,14 @@ static unsigned dispatch_defer(pa_mainloop *m) {
     return r;
 }
 
-static pa_time_event* find_next_time_event(pa_mainloop *m) {
-    pa_time_event *t, *n = NULL;
-    pa_assert(m);
-
-    if (m->cached_next_time_event)
-        return m->cached_next_time_event;
-
-    PA_LLIST_FOREACH(t, m->time_events) {
-
-        if (t->dead || !t->enabled)
-            continue;
-
-        if (!n || t->time < n->time) {
-            n = t;
-
-            /* Shortcut for time == 0 */
-            if (n->time == 0)
-                break;
-        }
-    }
-
-    m->cached_next_time_event = n;
-    return n;
-}
-
 static pa_usec_t calc_next_timeout(pa_mainloop *m) {
     pa_time_event *t;
     pa_usec_t clock_now;
 
-    if (m->n_enabled_time_events <= 0)
+    if (m->n_time_heap <= 0)
         return PA_USEC_INVALID;
 
-    pa_assert_se(t = find_next_time_event(m));
+    t = m->time_heap[0];
 
     if (t->time <= 0)
         return 0;
@@ -756,33 +1112,36 @@ static pa_usec_t calc_next_timeout(pa_mainloop *m) {
 static unsigned dispatch_timeout(pa_mainloop *m) {
     pa_time_event *e;
     pa_usec_t now;
+    uint64_t seq;
     unsigned r = 0;
     pa_assert(m);
 
-    if (m->n_enabled_time_events <= 0)
+    if (m->n_time_heap <= 0)
         return 0;
 
     now = pa_rtclock_now();
 
-    PA_LLIST_FOREACH(e, m->time_events) {
+    /* Events the callbacks arm again have to wait for the next iteration,
+     * even if they elapse right away */
+    seq = m->time_seq;
 
-        if (m->quit)
-            break;
+    while (m->n_time_heap > 0 && !m->quit) {
+        struct timeval tv;
 
-        if (e->dead || !e->enabled)
-            continue;
+        e = m->time_heap[0];
 
-        if (e->time <= now) {
-            struct timeval tv;
-            pa_assert(e->callback);
+        if (e->time > now || e->seq >= seq)
+            break;
 
-            /* Disable time event */
-            mainloop_time_restart(e, NULL);
+        pa_assert(!e->dead);
+        pa_assert(e->callback);
 
-            e->callback(&m->api, e, pa_timeval_rtstore(&tv, e->time, e->use_rtclock), e->userdata);
+        /* Disable time event */
+        mainloop_time_restart(e, NULL);
 
-            r++;
-        }
+        e->callback(&m->api, e, pa_timeval_rtstore(&tv, e->time, e->use_rtclock), e->userdata);
+
+        r++;
     }
 
     return r;
@@ -816,9 +1175,21 @@ int pa_mainloop_prepare(pa_mainloop *m, int timeout) {
     if (m->quit)
         goto quit;
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (m->epoll_failed)
+        epoll_fall_back(m);
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (m->epoll_fd >= 0 && m->max_epoll_events < m->n_io_events + 1) {
+        m->max_epoll_events = (m->n_io_events + 1) * 2;
+        m->epoll_events = pa_xrenew(struct epoll_event, m->epoll_events, m->max_epoll_events);
+    }
+#endif
+
     if (m->n_enabled_defer_events <= 0) {
 
-        if (m->rebuild_pollfds)
+        if (!epoll_enabled(m) && m->rebuild_pollfds)
             rebuild_pollfds(m);
 
         m->prepared_timeout = calc_next_timeout(m);
@@ -859,6 +1230,32 @@ int pa_mainloop_poll(pa_mainloop *m) {
 
     if (m->n_enabled_defer_events)
         m->poll_func_ret = 0;
+#ifdef HAVE_SYS_EPOLL_H
+    else if (m->epoll_fd >= 0) {
+        if (m->poll_func) {
+            struct pollfd pfd;
+
+            /* The epoll fd becomes readable when any of the fds it
+             * watches is ready */
+            pfd.fd = m->epoll_fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+
+            m->poll_func_ret = m->poll_func(&pfd, 1, usec_to_timeout(m->prepared_timeout), m->poll_func_userdata);
+
+            if (m->poll_func_ret > 0)
+                m->poll_func_ret = epoll_wait(m->epoll_fd, m->epoll_events, (int) m->max_epoll_events, 0);
+        } else
+            m->poll_func_ret = epoll_wait(m->epoll_fd, m->epoll_events, (int) m->max_epoll_events, usec_to_timeout(m->prepared_timeout));
+
+        if (m->poll_func_ret < 0) {
+            if (errno == EINTR)
+                m->poll_func_ret = 0;
+            else
+                pa_log("epoll_wait(): %s", pa_cstrerror(errno));
+        }
+    }
+#endif
     else {
         pa_assert(!m->rebuild_pollfds);
 
@@ -910,12 +1307,17 @@ int pa_mainloop_dispatch(pa_mainloop *m) {
     if (m->n_enabled_defer_events)
         dispatched += dispatch_defer(m);
     else {
-        if (m->n_enabled_time_events)
+        if (m->n_time_heap)
             dispatched += dispatch_timeout(m);
 
         if (m->quit)
             goto quit;
 
+#ifdef HAVE_SYS_EPOLL_H
+        if (m->poll_func_ret > 0 && m->epoll_fd >= 0)
+            dispatched += dispatch_epoll(m);
+        else
+#endif
         if (m->poll_func_ret > 0)
             dispatched += dispatch_pollfds(m);
     }
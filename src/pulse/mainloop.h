@@ -32,9 +32,9 @@ struct pollfd;
  *
  * \section overv_sec Overview
  *
- * The built-in main loop implementation is based on the poll() system call.
- * It supports the functions defined in the main loop abstraction and very
- * little else.
+ * The built-in main loop implementation is based on the poll() system call,
+ * or on epoll where available. It supports the functions defined in the
+ * main loop abstraction and very little else.
  *
  * The main loop is created using pa_mainloop_new() and destroyed using
  * pa_mainloop_free(). To get access to the main loop abstraction,
@@ -55,6 +55,15 @@ struct pollfd;
  * iteration, one at a time, using pa_mainloop_iterate(), or let the library
  * iterate automatically using pa_mainloop_run().
  *
+ * \section backend_sec Backends
+ *
+ * Where epoll is available, it is used by default, so that the cost of an
+ * iteration doesn't grow with the number of file descriptors watched. If
+ * a file descriptor can't be watched with epoll, e.g. because it refers to
+ * a regular file, the main loop falls back to poll() for good. Setting the
+ * environment variable PULSE_MAINLOOP_BACKEND to "poll" before creating
+ * the main loop always selects poll().
+ *
  * \section thread_sec Threads
  *
  * The main loop functions are designed to be thread safe, but the objects
@@ -126,7 +135,8 @@ void pa_mainloop_wakeup(pa_mainloop *m);
 /** Generic prototype of a poll() like function */
 typedef int (*pa_poll_func)(struct pollfd *ufds, unsigned long nfds, int timeout, void*userdata);
 
-/** Change the poll() implementation */
+/** Change the poll() implementation. With the epoll backend, the function
+ * is called for the epoll file descriptor only. */
 void pa_mainloop_set_poll_func(pa_mainloop *m, pa_poll_func poll_func, void *userdata);
 
 PA_C_DECL_END
@@ -273,6 +273,9 @@ PA_C_DECL_BEGIN
 /** For a bluez device: the currently selected codec name. \since 15.0 */
 #define PA_PROP_BLUETOOTH_CODEC                "bluetooth.codec"
 
+/** For devices: identifier of the clock the device runs from. Devices in the same clock domain do not drift against each other. \since 16.0 */
+#define PA_PROP_DEVICE_CLOCK_DOMAIN            "device.clock_domain"
+
 /** A property list object. Basically a dictionary with ASCII strings
  * as keys and arbitrary data as values. \since 0.9.11 */
 typedef struct pa_proplist pa_proplist;
@@ -39,6 +39,7 @@
 #include <pulse/xmalloc.h>
 #include <pulse/utf8.h>
 #include <pulse/thread-mainloop.h>
+#include <pulse/thread-mainloop-submit.h>
 #include <pulse/mainloop.h>
 #include <pulse/mainloop-signal.h>
 #include <pulse/util.h>
@@ -52,9 +53,9 @@
  * \ref context.h, \ref stream.h, \ref introspect.h, \ref subscribe.h, \ref
  * scache.h, \ref version.h, \ref error.h, \ref channelmap.h, \ref
  * operation.h,\ref volume.h, \ref xmalloc.h, \ref utf8.h, \ref
- * thread-mainloop.h, \ref mainloop.h, \ref util.h, \ref proplist.h,
- * \ref timeval.h, \ref rtclock.h and \ref mainloop-signal.h at
- * once */
+ * thread-mainloop.h, \ref thread-mainloop-submit.h, \ref mainloop.h,
+ * \ref util.h, \ref proplist.h, \ref timeval.h, \ref rtclock.h and \ref
+ * mainloop-signal.h at once */
 
 /** \mainpage
  *
@@ -177,8 +177,7 @@ static pa_stream *pa_stream_new_with_proplist_internal(
     s->suspended = false;
     s->corked = false;
 
-    s->write_memblock = NULL;
-    s->write_data = NULL;
+    s->n_write_buffers = 0;
 
     pa_memchunk_reset(&s->peek_memchunk);
     s->peek_data = NULL;
@@ -290,6 +289,11 @@ static void stream_unlink(pa_stream *s) {
         s->mainloop.time_free(s->auto_timing_update_event);
     }
 
+    if (s->timing_page_memblock) {
+        pa_memblock_unref(s->timing_page_memblock);
+        s->timing_page_memblock = NULL;
+    }
+
     reset_callbacks(s);
 }
 
@@ -300,10 +304,9 @@ static void stream_free(pa_stream *s) {
 
     stream_unlink(s);
 
-    if (s->write_memblock) {
-        if (s->write_data)
-            pa_memblock_release(s->write_memblock);
-        pa_memblock_unref(s->write_memblock);
+    for (i = 0; i < s->n_write_buffers; i++) {
+        pa_memblock_release(s->write_buffers[i].memblock);
+        pa_memblock_unref(s->write_buffers[i].memblock);
     }
 
     if (s->peek_memchunk.memblock) {
@@ -397,6 +400,8 @@ void pa_stream_set_state(pa_stream *s, pa_stream_state_t st) {
     pa_stream_unref(s);
 }
 
+static bool timing_page_refresh(pa_stream *s);
+
 static void request_auto_timing_update(pa_stream *s, bool force) {
     pa_assert(s);
     pa_assert(PA_REFCNT_VALUE(s) >= 1);
@@ -404,7 +409,13 @@ static void request_auto_timing_update(pa_stream *s, bool force) {
     if (!(s->flags & PA_STREAM_AUTO_TIMING_UPDATE))
         return;
 
-    if (s->state == PA_STREAM_READY &&
+    if (s->state == PA_STREAM_READY && !force && timing_page_refresh(s)) {
+
+        /* The server shares its timing with us, no need to ask */
+        if (s->latency_update_callback)
+            s->latency_update_callback(s, s->latency_update_userdata);
+
+    } else if (s->state == PA_STREAM_READY &&
         (force || !s->auto_timing_update_requested)) {
         pa_operation *o;
 
@@ -1454,6 +1465,43 @@ int pa_stream_connect_record(
     return create_stream(PA_STREAM_RECORD, s, dev, attr, flags, NULL, NULL);
 }
 
+static void write_buffer_new(pa_stream *s, size_t nbytes) {
+    pa_memblock *b;
+
+    if (nbytes != (size_t) -1) {
+        size_t m, fs;
+
+        m = pa_mempool_block_size_max(s->context.mempool);
+        fs = pa_frame_size(&s->sample_spec);
+
+        m = (m / fs) * fs;
+        if (nbytes > m)
+            nbytes = m;
+    }
+
+    b = pa_memblock_new(s->context.mempool, nbytes);
+
+    s->write_buffers[s->n_write_buffers].memblock = b;
+    s->write_buffers[s->n_write_buffers].data = pa_memblock_acquire(b);
+    s->n_write_buffers++;
+}
+
+/* Returns the index of the buffer handed out for writing that contains
+ * data, or -1 if there is none */
+static int write_buffer_find(pa_stream *s, const void *data, size_t length) {
+    unsigned i;
+
+    for (i = 0; i < s->n_write_buffers; i++) {
+        const char *d = s->write_buffers[i].data;
+
+        if ((const char*) data >= d &&
+            (const char*) data + length <= d + pa_memblock_get_length(s->write_buffers[i].memblock))
+            return (int) i;
+    }
+
+    return -1;
+}
+
 int pa_stream_begin_write(
         pa_stream *s,
         void **data,
@@ -1468,24 +1516,34 @@ int pa_stream_begin_write(
     PA_CHECK_VALIDITY(&s->context, data, PA_ERR_INVALID);
     PA_CHECK_VALIDITY(&s->context, nbytes && *nbytes != 0, PA_ERR_INVALID);
 
-    if (*nbytes != (size_t) -1) {
-        size_t m, fs;
+    if (s->n_write_buffers <= 0)
+        write_buffer_new(s, *nbytes);
 
-        m = pa_mempool_block_size_max(s->context.mempool);
-        fs = pa_frame_size(&s->sample_spec);
+    *data = s->write_buffers[s->n_write_buffers - 1].data;
+    *nbytes = pa_memblock_get_length(s->write_buffers[s->n_write_buffers - 1].memblock);
 
-        m = (m / fs) * fs;
-        if (*nbytes > m)
-            *nbytes = m;
-    }
+    return 0;
+}
 
-    if (!s->write_memblock) {
-        s->write_memblock = pa_memblock_new(s->context.mempool, *nbytes);
-        s->write_data = pa_memblock_acquire(s->write_memblock);
-    }
+int pa_stream_begin_write_buffer(
+        pa_stream *s,
+        void **data,
+        size_t *nbytes) {
+
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    PA_CHECK_VALIDITY(&s->context, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY(&s->context, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(&s->context, s->direction == PA_STREAM_PLAYBACK || s->direction == PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(&s->context, data, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(&s->context, nbytes && *nbytes != 0, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(&s->context, s->n_write_buffers < PA_MAX_WRITE_BUFFERS, PA_ERR_BUSY);
+
+    write_buffer_new(s, *nbytes);
 
-    *data = s->write_data;
-    *nbytes = pa_memblock_get_length(s->write_memblock);
+    *data = s->write_buffers[s->n_write_buffers - 1].data;
+    *nbytes = pa_memblock_get_length(s->write_buffers[s->n_write_buffers - 1].memblock);
 
     return 0;
 }
@@ -1493,20 +1551,22 @@ int pa_stream_begin_write(
 int pa_stream_cancel_write(
         pa_stream *s) {
 
+    unsigned i;
+
     pa_assert(s);
     pa_assert(PA_REFCNT_VALUE(s) >= 1);
 
     PA_CHECK_VALIDITY(&s->context, !pa_detect_fork(), PA_ERR_FORKED);
     PA_CHECK_VALIDITY(&s->context, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
     PA_CHECK_VALIDITY(&s->context, s->direction == PA_STREAM_PLAYBACK || s->direction == PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
-    PA_CHECK_VALIDITY(&s->context, s->write_memblock, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(&s->context, s->n_write_buffers > 0, PA_ERR_BADSTATE);
 
-    pa_assert(s->write_data);
+    for (i = 0; i < s->n_write_buffers; i++) {
+        pa_memblock_release(s->write_buffers[i].memblock);
+        pa_memblock_unref(s->write_buffers[i].memblock);
+    }
 
-    pa_memblock_release(s->write_memblock);
-    pa_memblock_unref(s->write_memblock);
-    s->write_memblock = NULL;
-    s->write_data = NULL;
+    s->n_write_buffers = 0;
 
     return 0;
 }
@@ -1520,6 +1580,8 @@ int pa_stream_write_ext_free(
         int64_t offset,
         pa_seek_mode_t seek) {
 
+    int i = -1;
+
     pa_assert(s);
     pa_assert(PA_REFCNT_VALUE(s) >= 1);
     pa_assert(data);
@@ -1529,28 +1591,30 @@ int pa_stream_write_ext_free(
     PA_CHECK_VALIDITY(&s->context, s->direction == PA_STREAM_PLAYBACK || s->direction == PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
     PA_CHECK_VALIDITY(&s->context, seek <= PA_SEEK_RELATIVE_END, PA_ERR_INVALID);
     PA_CHECK_VALIDITY(&s->context, s->direction == PA_STREAM_PLAYBACK || (seek == PA_SEEK_RELATIVE && offset == 0), PA_ERR_INVALID);
-    PA_CHECK_VALIDITY(&s->context,
-                      !s->write_memblock ||
-                      ((data >= s->write_data) &&
-                       ((const char*) data + length <= (const char*) s->write_data + pa_memblock_get_length(s->write_memblock))),
-                      PA_ERR_INVALID);
+
+    /* Data from pa_stream_begin_write() has to be written in place */
+    if (s->n_write_buffers > 0) {
+        i = write_buffer_find(s, data, length);
+        PA_CHECK_VALIDITY(&s->context, i >= 0, PA_ERR_INVALID);
+    }
+
     PA_CHECK_VALIDITY(&s->context, offset % pa_frame_size(&s->sample_spec) == 0, PA_ERR_INVALID);
     PA_CHECK_VALIDITY(&s->context, length % pa_frame_size(&s->sample_spec) == 0, PA_ERR_INVALID);
-    PA_CHECK_VALIDITY(&s->context, !free_cb || !s->write_memblock, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(&s->context, !free_cb || s->n_write_buffers <= 0, PA_ERR_INVALID);
 
-    if (s->write_memblock) {
+    if (s->n_write_buffers > 0) {
         pa_memchunk chunk;
 
         /* pa_stream_write_begin() was called before */
 
-        pa_memblock_release(s->write_memblock);
+        pa_memblock_release(s->write_buffers[i].memblock);
 
-        chunk.memblock = s->write_memblock;
-        chunk.index = (const char *) data - (const char *) s->write_data;
+        chunk.memblock = s->write_buffers[i].memblock;
+        chunk.index = (const char *) data - (const char *) s->write_buffers[i].data;
         chunk.length = length;
 
-        s->write_memblock = NULL;
-        s->write_data = NULL;
+        s->n_write_buffers--;
+        memmove(s->write_buffers + i, s->write_buffers + i + 1, (s->n_write_buffers - (unsigned) i) * sizeof(s->write_buffers[0]));
 
         pa_pstream_send_memblock(s->context.pstream, s->channel, offset, seek, &chunk, pa_frame_size(&s->sample_spec));
         pa_memblock_unref(chunk.memblock);
@@ -1757,6 +1821,9 @@ pa_operation * pa_stream_drain(pa_stream *s, pa_stream_success_cb_t cb, void *us
      * check_smoother_status() call in the started callback */
     request_auto_timing_update(s, true);
 
+    /* The drain has to cover what a transport encoder keeps back */
+    pa_pstream_flush_encoder(s->context.pstream, s->channel, false);
+
     o = pa_operation_new(&s->context, s, (pa_operation_cb_t) cb, userdata);
 
     t = pa_tagstruct_command(&s->context, PA_COMMAND_DRAIN_PLAYBACK_STREAM, &tag);
@@ -1838,6 +1905,109 @@ static inline uint64_t calc_bytes(pa_stream *s, bool ignore_transport) {
 }
 #endif
 
+/* Feeds the smoother with the timing data just stored in timing_info */
+static void update_smoother(pa_stream *s) {
+    pa_timing_info *i = &s->timing_info;
+    pa_usec_t u, x;
+
+    /* Update smoother if we're not corked */
+    if (!s->smoother || s->corked)
+        return;
+
+    u = x = pa_rtclock_now() - i->transport_usec;
+
+    if (s->direction == PA_STREAM_PLAYBACK && s->context.version >= 13) {
+        pa_usec_t su;
+
+        /* If we weren't playing then it will take some time
+         * until the audio will actually come out through the
+         * speakers. Since we follow that timing here, we need
+         * to try to fix this up */
+
+        su = pa_bytes_to_usec((uint64_t) i->since_underrun, &s->sample_spec);
+
+        if (su < i->sink_usec)
+            x += i->sink_usec - su;
+    }
+
+    if (!i->playing)
+#ifdef USE_SMOOTHER_2
+        pa_smoother_2_pause(s->smoother, x);
+#else
+        pa_smoother_pause(s->smoother, x);
+#endif
+
+    /* Update the smoother */
+    if ((s->direction == PA_STREAM_PLAYBACK && !i->read_index_corrupt) ||
+        (s->direction == PA_STREAM_RECORD && !i->write_index_corrupt))
+#ifdef USE_SMOOTHER_2
+        pa_smoother_2_put(s->smoother, u, calc_bytes(s, true));
+#else
+        pa_smoother_put(s->smoother, u, calc_time(s, true));
+#endif
+
+    if (i->playing)
+#ifdef USE_SMOOTHER_2
+        pa_smoother_2_resume(s->smoother, x);
+#else
+        pa_smoother_resume(s->smoother, x, true);
+#endif
+}
+
+/* Takes the latest snapshot from the timing page the server shares with us,
+ * if there is one. Only the read side is taken from there, so this needs
+ * valid timing data from a regular update to start with. Returns false if
+ * the caller has to ask the server instead. */
+static bool timing_page_refresh(pa_stream *s) {
+    pa_timing_info *i = &s->timing_info;
+    const pa_timing_page *page;
+    pa_timing_page_data d;
+    pa_usec_t now, age;
+    bool ok;
+
+    if (!s->timing_page_memblock ||
+        !s->timing_info_valid ||
+        i->read_index_corrupt ||
+        i->write_index_corrupt)
+        return false;
+
+    page = (const pa_timing_page *) ((const uint8_t *) pa_memblock_acquire(s->timing_page_memblock) + s->timing_page_index);
+    ok = pa_timing_page_read(page, &d);
+    pa_memblock_release(s->timing_page_memblock);
+
+    if (!ok || !(d.flags & PA_TIMING_PAGE_VALID))
+        return false;
+
+    /* Both sides use the same monotonic clock, the snapshot is as old as
+     * the data would have been in transit */
+    now = pa_rtclock_now();
+    age = now > d.timestamp ? now - d.timestamp : 0;
+
+    /* A playing stream gets a fresh snapshot on every render pass. If the
+     * sink's IO thread stopped updating it, ask the server. */
+    if ((d.flags & PA_TIMING_PAGE_PLAYING) && age > s->auto_timing_interval_usec)
+        return false;
+
+    /* Nothing changed on the server side since the last look */
+    if (d.timestamp == s->timing_page_timestamp)
+        return true;
+
+    s->timing_page_timestamp = d.timestamp;
+
+    i->sink_usec = d.sink_usec;
+    i->source_usec = 0;
+    i->playing = !!(d.flags & PA_TIMING_PAGE_PLAYING);
+    i->since_underrun = (int64_t) (i->playing ? d.playing_for : d.underrun_for);
+    i->read_index = d.read_index;
+    i->transport_usec = age;
+    i->synchronized_clocks = true;
+    i->timestamp = pa_timeval_sub(pa_gettimeofday(&s->timing_page_timeval), age);
+
+    update_smoother(s);
+
+    return true;
+}
+
 static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_operation *o = userdata;
     struct timeval local, remote, now;
@@ -1981,49 +2151,7 @@ static void stream_get_timing_info_callback(pa_pdispatch *pd, uint32_t command,
                 i->read_index -= (int64_t) pa_memblockq_get_length(o->stream->record_memblockq);
         }
 
-        /* Update smoother if we're not corked */
-        if (o->stream->smoother && !o->stream->corked) {
-            pa_usec_t u, x;
-
-            u = x = pa_rtclock_now() - i->transport_usec;
-
-            if (o->stream->direction == PA_STREAM_PLAYBACK && o->context->version >= 13) {
-                pa_usec_t su;
-
-                /* If we weren't playing then it will take some time
-                 * until the audio will actually come out through the
-                 * speakers. Since we follow that timing here, we need
-                 * to try to fix this up */
-
-                su = pa_bytes_to_usec((uint64_t) i->since_underrun, &o->stream->sample_spec);
-
-                if (su < i->sink_usec)
-                    x += i->sink_usec - su;
-            }
-
-            if (!i->playing)
-#ifdef USE_SMOOTHER_2
-                pa_smoother_2_pause(o->stream->smoother, x);
-#else
-                pa_smoother_pause(o->stream->smoother, x);
-#endif
-
-            /* Update the smoother */
-            if ((o->stream->direction == PA_STREAM_PLAYBACK && !i->read_index_corrupt) ||
-                (o->stream->direction == PA_STREAM_RECORD && !i->write_index_corrupt))
-#ifdef USE_SMOOTHER_2
-                pa_smoother_2_put(o->stream->smoother, u, calc_bytes(o->stream, true));
-#else
-                pa_smoother_put(o->stream->smoother, u, calc_time(o->stream, true));
-#endif
-
-            if (i->playing)
-#ifdef USE_SMOOTHER_2
-                pa_smoother_2_resume(o->stream->smoother, x);
-#else
-                pa_smoother_resume(o->stream->smoother, x, true);
-#endif
-        }
+        update_smoother(o->stream);
     }
 
     o->stream->auto_timing_update_requested = false;
@@ -2345,6 +2473,10 @@ pa_operation* pa_stream_cork(pa_stream *s, int b, pa_stream_success_cb_t cb, voi
 
     s->corked = b;
 
+    /* Don't let a transport encoder sit on the end of what was written */
+    if (b && s->direction == PA_STREAM_PLAYBACK)
+        pa_pstream_flush_encoder(s->context.pstream, s->channel, false);
+
     o = pa_operation_new(&s->context, s, (pa_operation_cb_t) cb, userdata);
 
     t = pa_tagstruct_command(
@@ -2401,6 +2533,9 @@ pa_operation* pa_stream_flush(pa_stream *s, pa_stream_success_cb_t cb, void *use
      * underflow message and update the smoother status*/
     request_auto_timing_update(s, true);
 
+    if (s->direction == PA_STREAM_PLAYBACK)
+        pa_pstream_flush_encoder(s->context.pstream, s->channel, true);
+
     if (!(o = stream_send_simple_command(s, (uint32_t) (s->direction == PA_STREAM_PLAYBACK ? PA_COMMAND_FLUSH_PLAYBACK_STREAM : PA_COMMAND_FLUSH_RECORD_STREAM), cb, userdata)))
         return NULL;
 
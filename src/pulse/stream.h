@@ -474,6 +474,22 @@ int pa_stream_begin_write(
         void **data,
         size_t *nbytes);
 
+/** Like pa_stream_begin_write(), but returns a new memory area on
+ * every call, so that several of them can be filled before they are
+ * written. This allows decoding straight into the memory shared with
+ * the server and submitting several blocks per wakeup without copying
+ * them. Up to eight memory areas may be outstanding at a time, beyond
+ * that this fails with PA_ERR_BUSY.
+ *
+ * Each memory area is written with its own pa_stream_write() call, in
+ * any order. While memory areas are outstanding, pa_stream_write() only
+ * accepts data within one of them, and pa_stream_begin_write() returns
+ * the one handed out last. Returns zero on success. \since 16.0 */
+int pa_stream_begin_write_buffer(
+        pa_stream *p,
+        void **data,
+        size_t *nbytes);
+
 /** Reverses the effect of pa_stream_begin_write() dropping all data
  * that has already been placed in the memory area returned by
  * pa_stream_begin_write(). Only valid to call if
@@ -481,7 +497,9 @@ int pa_stream_begin_write(
  * pa_stream_cancel_write() nor pa_stream_write() have been called
  * yet. Accessing the memory previously returned by
  * pa_stream_begin_write() after this call is invalid. Any further
- * explicit freeing of the memory area is not necessary.
+ * explicit freeing of the memory area is not necessary. All memory
+ * areas returned by pa_stream_begin_write_buffer() that were not
+ * written yet are dropped as well.
  * Returns zero on success. \since 0.9.16 */
 int pa_stream_cancel_write(
         pa_stream *p);
@@ -23,19 +23,30 @@
 
 #include <stdio.h>
 
+#include <pulse/timeval.h>
+
 #include <pulsecore/macro.h>
 #include <pulsecore/pstream-util.h>
 
 #include "internal.h"
 #include "subscribe.h"
 
+static void dispatch_event(pa_context *c, pa_subscription_event_type_t e, uint32_t idx) {
+    /* Servers before v37 don't filter by operation */
+    if (!pa_subscription_match_type(c->subscribe_types, e))
+        return;
+
+    if (c->subscribe_callback)
+        c->subscribe_callback(c, e, idx, c->subscribe_userdata);
+}
+
 void pa_command_subscribe_event(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_context *c = userdata;
     pa_subscription_event_type_t e;
     uint32_t idx;
 
     pa_assert(pd);
-    pa_assert(command == PA_COMMAND_SUBSCRIBE_EVENT);
+    pa_assert(command == PA_COMMAND_SUBSCRIBE_EVENT || command == PA_COMMAND_SUBSCRIBE_EVENT_BATCH);
     pa_assert(t);
     pa_assert(c);
     pa_assert(PA_REFCNT_VALUE(c) >= 1);
@@ -45,6 +56,22 @@ void pa_command_subscribe_event(pa_pdispatch *pd, uint32_t command, uint32_t tag
 
     pa_context_ref(c);
 
+    if (command == PA_COMMAND_SUBSCRIBE_EVENT_BATCH) {
+
+        /* Pairs of event and index up to the end of the packet */
+        while (!pa_tagstruct_eof(t) && c->state == PA_CONTEXT_READY) {
+            if (pa_tagstruct_getu32(t, &e) < 0 ||
+                pa_tagstruct_getu32(t, &idx) < 0) {
+                pa_context_fail(c, PA_ERR_PROTOCOL);
+                goto finish;
+            }
+
+            dispatch_event(c, e, idx);
+        }
+
+        goto finish;
+    }
+
     if (pa_tagstruct_getu32(t, &e) < 0 ||
         pa_tagstruct_getu32(t, &idx) < 0 ||
         !pa_tagstruct_eof(t)) {
@@ -52,14 +79,13 @@ void pa_command_subscribe_event(pa_pdispatch *pd, uint32_t command, uint32_t tag
         goto finish;
     }
 
-    if (c->subscribe_callback)
-        c->subscribe_callback(c, e, idx, c->subscribe_userdata);
+    dispatch_event(c, e, idx);
 
 finish:
     pa_context_unref(c);
 }
 
-pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata) {
+pa_operation* pa_context_subscribe_filtered(pa_context *c, pa_subscription_mask_t m, pa_subscription_type_mask_t types, pa_usec_t interval, pa_context_success_cb_t cb, void *userdata) {
     pa_operation *o;
     pa_tagstruct *t;
     uint32_t tag;
@@ -68,17 +94,31 @@ pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_c
     pa_assert(PA_REFCNT_VALUE(c) >= 1);
 
     PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, (types & ~PA_SUBSCRIPTION_TYPE_MASK_ALL) == 0, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, interval != PA_USEC_INVALID, PA_ERR_INVALID);
 
     o = pa_operation_new(c, NULL, (pa_operation_cb_t) cb, userdata);
 
+    c->subscribe_types = types;
+
     t = pa_tagstruct_command(c, PA_COMMAND_SUBSCRIBE, &tag);
     pa_tagstruct_putu32(t, m);
+
+    if (c->version >= 37) {
+        pa_tagstruct_putu32(t, types);
+        pa_tagstruct_put_usec(t, interval);
+    }
+
     pa_pstream_send_tagstruct(c->pstream, t);
     pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, pa_context_simple_ack_callback, pa_operation_ref(o), (pa_free_cb_t) pa_operation_unref);
 
     return o;
 }
 
+pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata) {
+    return pa_context_subscribe_filtered(c, m, PA_SUBSCRIPTION_TYPE_MASK_ALL, 0, cb, userdata);
+}
+
 void pa_context_set_subscribe_callback(pa_context *c, pa_context_subscribe_cb_t cb, void *userdata) {
     pa_assert(c);
     pa_assert(PA_REFCNT_VALUE(c) >= 1);
@@ -75,6 +75,13 @@ typedef void (*pa_context_subscribe_cb_t)(pa_context *c, pa_subscription_event_t
 /** Enable event notification */
 pa_operation* pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata);
 
+/** Enable event notification for the objects in m, but only for the
+ * operations in types. Events are delivered at most once per interval,
+ * several events regarding the same object in the meantime are merged into
+ * one. The server may enforce a longer interval. Older servers ignore the
+ * interval. \since 16.0 */
+pa_operation* pa_context_subscribe_filtered(pa_context *c, pa_subscription_mask_t m, pa_subscription_type_mask_t types, pa_usec_t interval, pa_context_success_cb_t cb, void *userdata);
+
 /** Set the context specific call back function that is called whenever the state of the daemon changes */
 void pa_context_set_subscribe_callback(pa_context *c, pa_context_subscribe_cb_t cb, void *userdata);
 
@@ -0,0 +1,66 @@
+#ifndef foothreadmainloopsubmithfoo
+#define foothreadmainloopsubmithfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/thread-mainloop.h>
+#include <pulse/context.h>
+#include <pulse/stream.h>
+#include <pulse/volume.h>
+#include <pulse/cdecl.h>
+#include <pulse/version.h>
+
+/** \file
+ *
+ * Stream and context operations that can be queued to a threaded main loop
+ * from any thread without holding its lock.
+ *
+ * See also \ref submit_sec */
+
+PA_C_DECL_BEGIN
+
+/** Completion callback of an operation submitted without the lock. Called
+ * from the event loop thread with the lock held. \since 16.0 */
+typedef void (*pa_threaded_mainloop_submit_cb_t)(pa_threaded_mainloop *m, int success, void *userdata);
+
+/** Queue a write of nbytes from data to the playback stream s, like
+ * pa_stream_write() with a relative seek of 0. May be called from any
+ * thread without holding the lock. If free_cb is non-NULL, the data is
+ * passed on to the stream as is and freed with free_cb once it is no longer
+ * needed, otherwise it is copied right away. cb may be NULL. \since 16.0 */
+void pa_threaded_mainloop_submit_write(pa_threaded_mainloop *m, pa_stream *s, const void *data, size_t nbytes,
+        pa_free_cb_t free_cb, pa_threaded_mainloop_submit_cb_t cb, void *userdata);
+
+/** Queue pa_stream_cork(). May be called from any thread without holding
+ * the lock. cb is called once the server replied. \since 16.0 */
+void pa_threaded_mainloop_submit_cork(pa_threaded_mainloop *m, pa_stream *s, int b,
+        pa_threaded_mainloop_submit_cb_t cb, void *userdata);
+
+/** Queue pa_stream_flush(). May be called from any thread without holding
+ * the lock. cb is called once the server replied. \since 16.0 */
+void pa_threaded_mainloop_submit_flush(pa_threaded_mainloop *m, pa_stream *s,
+        pa_threaded_mainloop_submit_cb_t cb, void *userdata);
+
+/** Queue pa_context_set_sink_input_volume(). May be called from any thread
+ * without holding the lock. cb is called once the server replied. \since 16.0 */
+void pa_threaded_mainloop_submit_sink_input_volume(pa_threaded_mainloop *m, pa_context *c, uint32_t idx, const pa_cvolume *volume,
+        pa_threaded_mainloop_submit_cb_t cb, void *userdata);
+
+PA_C_DECL_END
+
+#endif
@@ -31,6 +31,7 @@
 
 #include <pulse/xmalloc.h>
 #include <pulse/mainloop.h>
+#include <pulse/introspect.h>
 
 #include <pulsecore/i18n.h>
 #include <pulsecore/log.h>
@@ -38,8 +39,48 @@
 #include <pulsecore/mutex.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/poll.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/flist.h>
 
 #include "thread-mainloop.h"
+#include "thread-mainloop-submit.h"
+
+typedef enum submission_type {
+    SUBMISSION_WRITE,
+    SUBMISSION_CORK,
+    SUBMISSION_FLUSH,
+    SUBMISSION_VOLUME
+} submission_type_t;
+
+typedef struct submission submission;
+
+struct submission {
+    submission *next;
+    pa_threaded_mainloop *mainloop;
+    submission_type_t type;
+
+    pa_stream *stream;
+    pa_context *context;
+
+    /* SUBMISSION_WRITE */
+    void *data;
+    size_t nbytes;
+    pa_free_cb_t free_cb;
+
+    /* SUBMISSION_CORK */
+    int cork;
+
+    /* SUBMISSION_VOLUME */
+    uint32_t index;
+    pa_cvolume volume;
+
+    int success;
+    pa_threaded_mainloop_submit_cb_t callback;
+    void *userdata;
+};
+
+PA_STATIC_FLIST_DECLARE(submissions, 0, pa_xfree);
 
 struct pa_threaded_mainloop {
     pa_mainloop *real_mainloop;
@@ -50,6 +91,12 @@ struct pa_threaded_mainloop {
     pa_mutex* mutex;
     pa_cond* cond, *accept_cond;
 
+    /* Submissions are pushed here by any thread without taking the lock,
+     * newest first. The event loop thread takes them all at once. */
+    pa_atomic_ptr_t submissions;
+    pa_fdsem *submit_fdsem;
+    pa_io_event *submit_event;
+
     char *name;
 };
 
@@ -73,6 +120,142 @@ static int poll_func(struct pollfd *ufds, unsigned long nfds, int timeout, void
     return r;
 }
 
+static void submission_free(submission *sub) {
+    if (sub->stream)
+        pa_stream_unref(sub->stream);
+    if (sub->context)
+        pa_context_unref(sub->context);
+
+    if (pa_flist_push(PA_STATIC_FLIST_GET(submissions), sub) < 0)
+        pa_xfree(sub);
+}
+
+/* Called from the event loop thread, with the lock held */
+static void submission_done(submission *sub) {
+    if (sub->callback)
+        sub->callback(sub->mainloop, sub->success, sub->userdata);
+
+    submission_free(sub);
+}
+
+static void submission_operation_state_cb(pa_operation *o, void *userdata) {
+    submission *sub = userdata;
+
+    if (pa_operation_get_state(o) == PA_OPERATION_RUNNING)
+        return;
+
+    /* Also reached when the operation is cancelled because the stream or
+     * the context went away, the success callback is not called then */
+    pa_operation_set_state_callback(o, NULL, NULL);
+    pa_operation_unref(o);
+
+    submission_done(sub);
+}
+
+static void submission_stream_success_cb(pa_stream *s, int success, void *userdata) {
+    submission *sub = userdata;
+
+    sub->success = success;
+}
+
+static void submission_context_success_cb(pa_context *c, int success, void *userdata) {
+    submission *sub = userdata;
+
+    sub->success = success;
+}
+
+/* Called from the event loop thread, with the lock held */
+static void submission_run(submission *sub) {
+    pa_operation *o = NULL;
+
+    switch (sub->type) {
+        case SUBMISSION_WRITE:
+            if (pa_stream_write(sub->stream, sub->data, sub->nbytes, sub->free_cb, 0, PA_SEEK_RELATIVE) >= 0)
+                sub->success = 1;
+            else
+                sub->free_cb(sub->data);
+
+            submission_done(sub);
+            return;
+
+        case SUBMISSION_CORK:
+            o = pa_stream_cork(sub->stream, sub->cork, submission_stream_success_cb, sub);
+            break;
+
+        case SUBMISSION_FLUSH:
+            o = pa_stream_flush(sub->stream, submission_stream_success_cb, sub);
+            break;
+
+        case SUBMISSION_VOLUME:
+            o = pa_context_set_sink_input_volume(sub->context, sub->index, &sub->volume, submission_context_success_cb, sub);
+            break;
+    }
+
+    if (!o) {
+        submission_done(sub);
+        return;
+    }
+
+    pa_operation_set_state_callback(o, submission_operation_state_cb, sub);
+}
+
+/* Takes all pending submissions, oldest first */
+static submission *submissions_take(pa_threaded_mainloop *m) {
+    submission *list, *sub, *next, *fifo = NULL;
+
+    do {
+        list = pa_atomic_ptr_load(&m->submissions);
+    } while (list && !pa_atomic_ptr_cmpxchg(&m->submissions, list, NULL));
+
+    for (sub = list; sub; sub = next) {
+        next = sub->next;
+        sub->next = fifo;
+        fifo = sub;
+    }
+
+    return fifo;
+}
+
+static void submit_event_cb(pa_mainloop_api *api, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    pa_threaded_mainloop *m = userdata;
+    submission *sub, *next;
+
+    pa_fdsem_after_poll(m->submit_fdsem);
+
+    do {
+        for (sub = submissions_take(m); sub; sub = next) {
+            next = sub->next;
+            submission_run(sub);
+        }
+    } while (pa_fdsem_before_poll(m->submit_fdsem) < 0);
+}
+
+static void submit(pa_threaded_mainloop *m, submission *sub) {
+    submission *head;
+
+    do {
+        head = pa_atomic_ptr_load(&m->submissions);
+        sub->next = head;
+    } while (!pa_atomic_ptr_cmpxchg(&m->submissions, head, sub));
+
+    pa_fdsem_post(m->submit_fdsem);
+}
+
+static submission *submission_new(pa_threaded_mainloop *m, submission_type_t type, pa_threaded_mainloop_submit_cb_t cb, void *userdata) {
+    submission *sub;
+
+    if (!(sub = pa_flist_pop(PA_STATIC_FLIST_GET(submissions))))
+        sub = pa_xnew(submission, 1);
+
+    pa_zero(*sub);
+    sub->mainloop = m;
+    sub->type = type;
+    sub->callback = cb;
+    sub->userdata = userdata;
+
+    return sub;
+}
+
 static void thread(void *userdata) {
     pa_threaded_mainloop *m = userdata;
 
@@ -115,16 +298,29 @@ pa_threaded_mainloop *pa_threaded_mainloop_new(void) {
         return NULL;
     }
 
+    if (!(m->submit_fdsem = pa_fdsem_new())) {
+        pa_mainloop_free(m->real_mainloop);
+        pa_xfree(m);
+        return NULL;
+    }
+
     m->mutex = pa_mutex_new(true, true);
     m->cond = pa_cond_new();
     m->accept_cond = pa_cond_new();
 
     pa_mainloop_set_poll_func(m->real_mainloop, poll_func, m->mutex);
 
+    pa_assert_se(pa_fdsem_before_poll(m->submit_fdsem) >= 0);
+    m->submit_event = pa_mainloop_get_api(m->real_mainloop)->io_new(pa_mainloop_get_api(m->real_mainloop),
+                                                                    pa_fdsem_get(m->submit_fdsem),
+                                                                    PA_IO_EVENT_INPUT, submit_event_cb, m);
+
     return m;
 }
 
 void pa_threaded_mainloop_free(pa_threaded_mainloop* m) {
+    submission *sub, *next;
+
     pa_assert(m);
 
     /* Make sure that this function is not called from the helper thread */
@@ -135,7 +331,18 @@ void pa_threaded_mainloop_free(pa_threaded_mainloop* m) {
     if (m->thread)
         pa_thread_free(m->thread);
 
+    /* Whatever was submitted after the loop stopped is dropped */
+    for (sub = submissions_take(m); sub; sub = next) {
+        next = sub->next;
+
+        if (sub->type == SUBMISSION_WRITE)
+            sub->free_cb(sub->data);
+
+        submission_free(sub);
+    }
+
     pa_mainloop_free(m->real_mainloop);
+    pa_fdsem_free(m->submit_fdsem);
 
     pa_mutex_free(m->mutex);
     pa_cond_free(m->cond);
@@ -301,3 +508,70 @@ void pa_threaded_mainloop_once_unlocked(pa_threaded_mainloop *m, void (*callback
 
     pa_mainloop_api_once(api, once_unlocked_cb, data);
 }
+
+void pa_threaded_mainloop_submit_write(pa_threaded_mainloop *m, pa_stream *s, const void *data, size_t nbytes,
+        pa_free_cb_t free_cb, pa_threaded_mainloop_submit_cb_t cb, void *userdata) {
+    submission *sub;
+
+    pa_assert(m);
+    pa_assert(s);
+    pa_assert(data);
+    pa_assert(nbytes > 0);
+
+    sub = submission_new(m, SUBMISSION_WRITE, cb, userdata);
+    sub->stream = pa_stream_ref(s);
+    sub->nbytes = nbytes;
+
+    if (free_cb) {
+        sub->data = (void *) data;
+        sub->free_cb = free_cb;
+    } else {
+        sub->data = pa_xmemdup(data, nbytes);
+        sub->free_cb = pa_xfree;
+    }
+
+    submit(m, sub);
+}
+
+void pa_threaded_mainloop_submit_cork(pa_threaded_mainloop *m, pa_stream *s, int b,
+        pa_threaded_mainloop_submit_cb_t cb, void *userdata) {
+    submission *sub;
+
+    pa_assert(m);
+    pa_assert(s);
+
+    sub = submission_new(m, SUBMISSION_CORK, cb, userdata);
+    sub->stream = pa_stream_ref(s);
+    sub->cork = b;
+
+    submit(m, sub);
+}
+
+void pa_threaded_mainloop_submit_flush(pa_threaded_mainloop *m, pa_stream *s,
+        pa_threaded_mainloop_submit_cb_t cb, void *userdata) {
+    submission *sub;
+
+    pa_assert(m);
+    pa_assert(s);
+
+    sub = submission_new(m, SUBMISSION_FLUSH, cb, userdata);
+    sub->stream = pa_stream_ref(s);
+
+    submit(m, sub);
+}
+
+void pa_threaded_mainloop_submit_sink_input_volume(pa_threaded_mainloop *m, pa_context *c, uint32_t idx, const pa_cvolume *volume,
+        pa_threaded_mainloop_submit_cb_t cb, void *userdata) {
+    submission *sub;
+
+    pa_assert(m);
+    pa_assert(c);
+    pa_assert(volume);
+
+    sub = submission_new(m, SUBMISSION_VOLUME, cb, userdata);
+    sub->context = pa_context_ref(c);
+    sub->index = idx;
+    sub->volume = *volume;
+
+    submit(m, sub);
+}
@@ -232,6 +232,24 @@ PA_C_DECL_BEGIN
  *
  * \li State callbacks for contexts, streams, etc.
  * \li Subscription notifications
+ *
+ * \section submit_sec Submitting Without the Lock
+ *
+ * Applications that feed many streams from threads of their own end up
+ * serializing all of them on the lock. For the most common stream
+ * operations there are variants that can be called from any thread without
+ * taking the lock: pa_threaded_mainloop_submit_write(),
+ * pa_threaded_mainloop_submit_cork(), pa_threaded_mainloop_submit_flush()
+ * and pa_threaded_mainloop_submit_sink_input_volume(). They queue the
+ * operation without blocking and wake up the event loop thread, which
+ * carries it out in submission order. The optional completion callback is
+ * then called from the event loop thread, with the lock held, like any
+ * other callback.
+ *
+ * The objects passed in are referenced until the operation completed.
+ * Completion only tells whether the operation succeeded, the error itself
+ * can be retrieved with pa_context_errno() from the completion callback.
+ * These functions are declared in \ref thread-mainloop-submit.h.
  */
 
 /** \file
@@ -32,6 +32,7 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/mutex.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/trace.h>
 
 #include "asyncmsgq.h"
 
@@ -318,11 +319,16 @@ void pa_asyncmsgq_write_after_poll(pa_asyncmsgq *a) {
 }
 
 int pa_asyncmsgq_dispatch(pa_msgobject *object, int code, void *userdata, int64_t offset, pa_memchunk *memchunk) {
+    int ret;
+
+    if (!object)
+        return 0;
 
-    if (object)
-        return object->process_msg(object, code, userdata, offset, pa_memchunk_isset(memchunk) ? memchunk : NULL);
+    PA_TRACE_BEGIN(PA_TRACE_ASYNCMSGQ_DISPATCH, 0, (uint64_t) code);
+    ret = object->process_msg(object, code, userdata, offset, pa_memchunk_isset(memchunk) ? memchunk : NULL);
+    PA_TRACE_END(PA_TRACE_ASYNCMSGQ_DISPATCH, 0, (uint64_t) code);
 
-    return 0;
+    return ret;
 }
 
 void pa_asyncmsgq_flush(pa_asyncmsgq *a, bool run) {
@@ -61,6 +61,7 @@
 #include <pulsecore/core-error.h>
 #include <pulsecore/modinfo.h>
 #include <pulsecore/dynarray.h>
+#include <pulsecore/trace.h>
 
 #include "cli-command.h"
 
@@ -123,6 +124,8 @@ static int pa_cli_command_list_shared_props(pa_core *c, pa_tokenizer *t, pa_strb
 static int pa_cli_command_move_sink_input(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_move_source_output(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_vacuum(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_trace(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
+static int pa_cli_command_dump_trace(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_suspend_sink(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_suspend_source(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
 static int pa_cli_command_suspend(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail);
@@ -202,6 +205,8 @@ static const struct command commands[] = {
     { "dump",                    pa_cli_command_dump,               "Dump daemon configuration", 1},
     { "dump-volumes",            pa_cli_command_dump_volumes,       "Debug: Show the state of all volumes", 1 },
     { "shared",                  pa_cli_command_list_shared_props,  "Debug: Show shared properties", 1},
+    { "set-trace",               pa_cli_command_trace,              "Debug: Record trace events of the realtime threads (args: bool)", 2},
+    { "dump-trace",              pa_cli_command_dump_trace,         "Debug: Write the recorded trace events to a file (args: filename)", 2},
     { "exit",                    pa_cli_command_exit,               "Terminate the daemon",         1 },
     { "vacuum",                  pa_cli_command_vacuum,             NULL, 1},
     { NULL, NULL, NULL, 0 }
@@ -1328,6 +1333,54 @@ static int pa_cli_command_vacuum(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bo
     return 0;
 }
 
+static int pa_cli_command_trace(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    const char *m;
+    int b;
+
+    pa_core_assert_ref(c);
+    pa_assert(t);
+    pa_assert(buf);
+    pa_assert(fail);
+
+    if (!(m = pa_tokenizer_get(t, 1))) {
+        pa_strbuf_puts(buf, "You need to specify a boolean.\n");
+        return -1;
+    }
+
+    if ((b = pa_parse_boolean(m)) < 0) {
+        pa_strbuf_puts(buf, "Failed to parse trace setting.\n");
+        return -1;
+    }
+
+    if (b)
+        pa_trace_start();
+    else
+        pa_trace_stop();
+
+    return 0;
+}
+
+static int pa_cli_command_dump_trace(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
+    const char *fn;
+
+    pa_core_assert_ref(c);
+    pa_assert(t);
+    pa_assert(buf);
+    pa_assert(fail);
+
+    if (!(fn = pa_tokenizer_get(t, 1))) {
+        pa_strbuf_puts(buf, "You need to specify a file name.\n");
+        return -1;
+    }
+
+    if (pa_trace_dump(fn) < 0) {
+        pa_strbuf_printf(buf, "Failed to write trace file %s.\n", fn);
+        return -1;
+    }
+
+    return 0;
+}
+
 static int pa_cli_command_move_sink_input(pa_core *c, pa_tokenizer *t, pa_strbuf *buf, bool *fail) {
     const char *n, *k;
     pa_sink_input *si;
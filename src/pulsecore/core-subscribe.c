@@ -204,9 +204,14 @@ static void sched_event(pa_core *c) {
 
 /* Append a new subscription event to the subscription event queue and schedule a main loop event */
 void pa_subscription_post(pa_core *c, pa_subscription_event_type_t t, uint32_t idx) {
+    pa_subscription_post_data data;
     pa_subscription_event *e;
     pa_assert(c);
 
+    data.type = t;
+    data.index = idx;
+    pa_hook_fire(&c->hooks[PA_CORE_HOOK_SUBSCRIPTION_POST], &data);
+
     /* No need for queuing subscriptions of no one is listening */
     if (!c->subscriptions)
         return;
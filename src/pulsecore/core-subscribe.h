@@ -28,6 +28,14 @@ typedef struct pa_subscription_event pa_subscription_event;
 
 typedef void (*pa_subscription_cb_t)(pa_core *c, pa_subscription_event_type_t t, uint32_t idx, void *userdata);
 
+/* Hook data of PA_CORE_HOOK_SUBSCRIPTION_POST. Unlike the subscription
+ * callbacks, that hook fires right away when an event is posted, for those
+ * who can't miss changes made in the meantime. */
+typedef struct pa_subscription_post_data {
+    pa_subscription_event_type_t type;
+    uint32_t index;
+} pa_subscription_post_data;
+
 pa_subscription* pa_subscription_new(pa_core *c, pa_subscription_mask_t m,  pa_subscription_cb_t cb, void *userdata);
 void pa_subscription_free(pa_subscription*s);
 void pa_subscription_free_all(pa_core *c);
@@ -43,6 +43,7 @@
 #include <pulsecore/random.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/trace.h>
 #include <pulsecore/namereg.h>
 
 #include "core.h"
@@ -100,6 +101,40 @@ static int core_message_handler(const char *object_path, const char *message, co
         return PA_OK;
     }
 
+    if (pa_streq(message, "trace-start")) {
+        pa_trace_start();
+        return PA_OK;
+    }
+
+    if (pa_streq(message, "trace-stop")) {
+        pa_trace_stop();
+        return PA_OK;
+    }
+
+    if (pa_streq(message, "trace-dump")) {
+        pa_json_encoder *encoder;
+        char name[64], *fn;
+
+        /* Clients may only be able to reach the socket, so they don't get
+         * to pick what the daemon writes to */
+        pa_snprintf(name, sizeof(name), "trace-%llu.json", (unsigned long long) pa_rtclock_now());
+
+        if (!(fn = pa_runtime_path(name)))
+            return -PA_ERR_IO;
+
+        if (pa_trace_dump(fn) < 0) {
+            pa_xfree(fn);
+            return -PA_ERR_IO;
+        }
+
+        encoder = pa_json_encoder_new();
+        pa_json_encoder_add_element_string(encoder, fn);
+        *response = pa_json_encoder_to_string_free(encoder);
+
+        pa_xfree(fn);
+        return PA_OK;
+    }
+
     return -PA_ERR_NOTIMPLEMENTED;
 }
 
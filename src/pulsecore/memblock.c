@@ -47,6 +47,7 @@
 #include <pulsecore/flist.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/memtrap.h>
+#include <pulsecore/trace.h>
 
 #include "memblock.h"
 
@@ -310,6 +311,7 @@ static struct mempool_slot* mempool_allocate_slot(pa_mempool *p) {
             if (pa_log_ratelimit(PA_LOG_DEBUG))
                 pa_log_debug("Pool full");
             pa_atomic_inc(&p->stat.n_pool_full);
+            PA_TRACE_INSTANT(PA_TRACE_POOL_FULL, 0, p->block_size);
             return NULL;
         }
     }
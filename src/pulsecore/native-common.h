@@ -190,6 +190,10 @@ enum {
     /* Supported since protocol v34 (14.0) */
     PA_COMMAND_SEND_OBJECT_MESSAGE,
 
+    /* Supported since protocol v37 (16.0) */
+    /* SERVER->CLIENT */
+    PA_COMMAND_SUBSCRIBE_EVENT_BATCH,
+
     PA_COMMAND_MAX
 };
 
@@ -204,6 +208,18 @@ enum {
 
 #define PA_NATIVE_DEFAULT_UNIX_SOCKET "native"
 
+/* Compressed stream transport. A client lists the codecs it can use for a
+ * stream (comma separated) in the first property of the PCM format it
+ * offers. If the server enables one of them, it names it in the second
+ * property of the format sent back in the CREATE_*_STREAM reply, and both
+ * ends install the codec on the stream's pstream channel. */
+#define PA_NATIVE_TRANSPORT_CODECS "format.transport.codecs"
+#define PA_NATIVE_TRANSPORT_CODEC "format.transport.codec"
+
+/* Memblocks on this pstream channel hold the pa_timing_page of the playback
+ * stream whose channel is passed as offset. Supported since protocol v38. */
+#define PA_NATIVE_TIMING_PAGE_CHANNEL ((uint32_t) -2)
+
 int pa_common_command_register_memfd_shmid(pa_pstream *p, pa_pdispatch *pd, uint32_t version,
                                            uint32_t command, pa_tagstruct *t);
 
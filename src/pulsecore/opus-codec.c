@@ -0,0 +1,473 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#include <opus_multistream.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#include "opus-codec.h"
+
+/* Every encoded memblock looks like this on the wire:
+ *
+ *   uint32_t           length of the decoded data, network byte order
+ *   n times:
+ *     uint16_t         length of the Opus packet, network byte order
+ *     uint8_t[]        the Opus packet
+ *
+ * with n being the decoded length divided by the frame size, rounded up. PCM
+ * that doesn't fill a whole frame is kept by the encoder and goes into the
+ * first frame of the next memblock, so the encoder sees a continuous signal.
+ * Only when the encoder is flushed it pads the last frame with silence, and
+ * the decoder drops what the decoded length doesn't cover. */
+
+#define FRAME_USEC (10 * PA_USEC_PER_MSEC)
+#define HEADER_SIZE (sizeof(uint32_t))
+#define PACKET_HEADER_SIZE (sizeof(uint16_t))
+
+/* Never accept more decoded data per memblock than a pstream frame can hold */
+#define DECODED_SIZE_MAX (1024*1024*16)
+
+struct opus_codec {
+    pa_pstream_codec codec;
+
+    pa_sample_spec sample_spec;
+    int frame_samples;
+    size_t frame_size;
+    size_t max_packet_size;
+
+    OpusMSEncoder *encoder;
+    OpusMSDecoder *decoder;
+
+    uint8_t *buffer;
+    size_t buffer_size;
+
+    /* PCM not encoded yet, always shorter than one frame */
+    uint8_t *carry;
+    size_t carry_length;
+};
+
+bool pa_opus_codec_supported(const pa_sample_spec *ss) {
+    pa_assert(ss);
+
+    if (ss->format != PA_SAMPLE_S16NE && ss->format != PA_SAMPLE_FLOAT32NE)
+        return false;
+
+    switch (ss->rate) {
+        case 8000:
+        case 12000:
+        case 16000:
+        case 24000:
+        case 48000:
+            return true;
+        default:
+            return false;
+    }
+}
+
+size_t pa_opus_codec_frame_size(const pa_sample_spec *ss) {
+    pa_assert(ss);
+
+    return pa_usec_to_bytes(FRAME_USEC, ss);
+}
+
+/* Channels are coded in pairs in the order of the channel map, with a
+ * mono stream for an odd one out. Both ends derive this layout from the
+ * channel count alone, so it never has to be transmitted. */
+static void get_layout(const pa_sample_spec *ss, int *streams, int *coupled_streams, unsigned char *mapping) {
+    unsigned i;
+
+    *streams = (ss->channels + 1) / 2;
+    *coupled_streams = ss->channels / 2;
+
+    for (i = 0; i < ss->channels; i++)
+        mapping[i] = (unsigned char) i;
+}
+
+pa_usec_t pa_opus_codec_get_delay(const pa_sample_spec *ss) {
+    OpusMSEncoder *encoder;
+    unsigned char mapping[PA_CHANNELS_MAX];
+    int streams, coupled_streams, error;
+    opus_int32 lookahead = 0;
+
+    pa_assert(ss);
+    pa_assert(pa_opus_codec_supported(ss));
+
+    get_layout(ss, &streams, &coupled_streams, mapping);
+
+    if (!(encoder = opus_multistream_encoder_create((opus_int32) ss->rate, ss->channels, streams, coupled_streams,
+                                                    mapping, OPUS_APPLICATION_AUDIO, &error)))
+        return 0;
+
+    opus_multistream_encoder_ctl(encoder, OPUS_GET_LOOKAHEAD(&lookahead));
+    opus_multistream_encoder_destroy(encoder);
+
+    return (pa_usec_t) lookahead * PA_USEC_PER_SEC / ss->rate;
+}
+
+static void ensure_buffer(struct opus_codec *o, size_t size) {
+    if (o->buffer_size >= size)
+        return;
+
+    o->buffer_size = size;
+    o->buffer = pa_xrealloc(o->buffer, size);
+}
+
+static int encode_frame(struct opus_codec *o, const uint8_t *src, uint8_t **d) {
+    uint16_t packet_size;
+    int r;
+
+    if (o->sample_spec.format == PA_SAMPLE_S16NE)
+        r = opus_multistream_encode(o->encoder, (const opus_int16 *) src, o->frame_samples,
+                                    *d + PACKET_HEADER_SIZE, (opus_int32) o->max_packet_size);
+    else
+        r = opus_multistream_encode_float(o->encoder, (const float *) src, o->frame_samples,
+                                          *d + PACKET_HEADER_SIZE, (opus_int32) o->max_packet_size);
+
+    if (r < 0) {
+        pa_log_debug("Opus encoding failed: %s", opus_strerror(r));
+        return -1;
+    }
+
+    packet_size = htons((uint16_t) r);
+    memcpy(*d, &packet_size, PACKET_HEADER_SIZE);
+    *d += PACKET_HEADER_SIZE + r;
+
+    return 0;
+}
+
+/* Hands out what was put together in the buffer up to end */
+static void buffer_to_chunk(struct opus_codec *o, pa_mempool *pool, const uint8_t *end, pa_memchunk *out) {
+    void *dst;
+
+    out->index = 0;
+    out->length = (size_t) (end - o->buffer);
+    out->memblock = pa_memblock_new(pool, out->length);
+
+    dst = pa_memblock_acquire(out->memblock);
+    memcpy(dst, o->buffer, out->length);
+    pa_memblock_release(out->memblock);
+}
+
+static int encode(pa_pstream_codec *c, pa_mempool *pool, const pa_memchunk *in, pa_memchunk *out) {
+    struct opus_codec *o = c->userdata;
+    size_t n_frames, left, i;
+    const uint8_t *src;
+    uint8_t *d;
+    uint32_t length;
+    int r = 0;
+
+    pa_assert(o);
+    pa_assert(o->encoder);
+    pa_assert(in->memblock);
+
+    if (o->carry_length + in->length > DECODED_SIZE_MAX)
+        return -1;
+
+    pa_memchunk_reset(out);
+
+    n_frames = (o->carry_length + in->length) / o->frame_size;
+
+    src = pa_memblock_acquire_chunk(in);
+    left = in->length;
+
+    if (n_frames == 0) {
+        memcpy(o->carry + o->carry_length, src, left);
+        o->carry_length += left;
+        pa_memblock_release(in->memblock);
+        return 0;
+    }
+
+    ensure_buffer(o, HEADER_SIZE + n_frames * (PACKET_HEADER_SIZE + o->max_packet_size));
+
+    d = o->buffer;
+    length = htonl((uint32_t) (n_frames * o->frame_size));
+    memcpy(d, &length, HEADER_SIZE);
+    d += HEADER_SIZE;
+
+    for (i = 0; i < n_frames && r >= 0; i++) {
+        if (o->carry_length > 0) {
+            size_t n = o->frame_size - o->carry_length;
+
+            memcpy(o->carry + o->carry_length, src, n);
+            src += n;
+            left -= n;
+            o->carry_length = 0;
+
+            r = encode_frame(o, o->carry, &d);
+        } else {
+            r = encode_frame(o, src, &d);
+            src += o->frame_size;
+            left -= o->frame_size;
+        }
+    }
+
+    if (r >= 0) {
+        pa_assert(left < o->frame_size);
+        memcpy(o->carry, src, left);
+        o->carry_length = left;
+    }
+
+    pa_memblock_release(in->memblock);
+
+    if (r < 0)
+        return -1;
+
+    buffer_to_chunk(o, pool, d, out);
+
+    return 0;
+}
+
+static int flush(pa_pstream_codec *c, pa_mempool *pool, pa_memchunk *out) {
+    struct opus_codec *o = c->userdata;
+    uint32_t length;
+    uint8_t *d;
+
+    pa_assert(o);
+    pa_assert(o->encoder);
+
+    pa_memchunk_reset(out);
+
+    if (o->carry_length == 0)
+        return 0;
+
+    ensure_buffer(o, HEADER_SIZE + PACKET_HEADER_SIZE + o->max_packet_size);
+
+    pa_silence_memory(o->carry + o->carry_length, o->frame_size - o->carry_length, &o->sample_spec);
+
+    d = o->buffer;
+    length = htonl((uint32_t) o->carry_length);
+    memcpy(d, &length, HEADER_SIZE);
+    d += HEADER_SIZE;
+
+    o->carry_length = 0;
+
+    if (encode_frame(o, o->carry, &d) < 0)
+        return -1;
+
+    buffer_to_chunk(o, pool, d, out);
+
+    return 0;
+}
+
+static void reset(pa_pstream_codec *c) {
+    struct opus_codec *o = c->userdata;
+
+    pa_assert(o);
+
+    o->carry_length = 0;
+}
+
+static int decode(pa_pstream_codec *c, pa_mempool *pool, const pa_memchunk *in, pa_memchunk *out) {
+    struct opus_codec *o = c->userdata;
+    size_t n_frames, left, i;
+    const uint8_t *s, *src;
+    uint8_t *dst;
+    uint32_t length;
+    int r = 0;
+
+    pa_assert(o);
+    pa_assert(o->decoder);
+    pa_assert(in->memblock);
+
+    if (in->length < HEADER_SIZE)
+        return -1;
+
+    src = pa_memblock_acquire_chunk(in);
+    s = src;
+    left = in->length;
+
+    memcpy(&length, s, HEADER_SIZE);
+    length = ntohl(length);
+    s += HEADER_SIZE;
+    left -= HEADER_SIZE;
+
+    n_frames = (length + o->frame_size - 1) / o->frame_size;
+
+    if (length == 0 || length > DECODED_SIZE_MAX || length % pa_frame_size(&o->sample_spec) != 0 ||
+        n_frames * PACKET_HEADER_SIZE > left) {
+        pa_memblock_release(in->memblock);
+        return -1;
+    }
+
+    out->index = 0;
+    out->length = length;
+    out->memblock = pa_memblock_new(pool, length);
+    dst = pa_memblock_acquire(out->memblock);
+
+    /* Only the last frame may be padded, it is decoded into our buffer */
+    ensure_buffer(o, o->frame_size);
+
+    for (i = 0; i < n_frames; i++) {
+        uint16_t packet_size;
+        size_t n = PA_MIN(o->frame_size, length - i * o->frame_size);
+        uint8_t *frame = n < o->frame_size ? o->buffer : dst;
+
+        if (left < PACKET_HEADER_SIZE) {
+            r = -1;
+            break;
+        }
+
+        memcpy(&packet_size, s, PACKET_HEADER_SIZE);
+        packet_size = ntohs(packet_size);
+        s += PACKET_HEADER_SIZE;
+        left -= PACKET_HEADER_SIZE;
+
+        if (packet_size > left) {
+            r = -1;
+            break;
+        }
+
+        if (o->sample_spec.format == PA_SAMPLE_S16NE)
+            r = opus_multistream_decode(o->decoder, s, packet_size, (opus_int16 *) frame, o->frame_samples, 0);
+        else
+            r = opus_multistream_decode_float(o->decoder, s, packet_size, (float *) frame, o->frame_samples, 0);
+
+        if (r != o->frame_samples) {
+            if (r < 0)
+                pa_log_debug("Opus decoding failed: %s", opus_strerror(r));
+            r = -1;
+            break;
+        }
+
+        if (frame != dst)
+            memcpy(dst, frame, n);
+
+        s += packet_size;
+        left -= packet_size;
+        dst += n;
+    }
+
+    if (r >= 0 && left != 0)
+        r = -1;
+
+    pa_memblock_release(out->memblock);
+    pa_memblock_release(in->memblock);
+
+    if (r < 0) {
+        pa_memblock_unref(out->memblock);
+        pa_memchunk_reset(out);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void codec_free(pa_pstream_codec *c) {
+    struct opus_codec *o = c->userdata;
+
+    pa_assert(o);
+
+    if (o->encoder)
+        opus_multistream_encoder_destroy(o->encoder);
+
+    if (o->decoder)
+        opus_multistream_decoder_destroy(o->decoder);
+
+    pa_xfree(o->buffer);
+    pa_xfree(o->carry);
+    pa_xfree(o);
+}
+
+static struct opus_codec *codec_new(const pa_sample_spec *ss) {
+    struct opus_codec *o;
+    int streams, coupled_streams;
+    unsigned char mapping[PA_CHANNELS_MAX];
+
+    pa_assert(ss);
+    pa_assert(pa_sample_spec_valid(ss));
+
+    if (!pa_opus_codec_supported(ss))
+        return NULL;
+
+    get_layout(ss, &streams, &coupled_streams, mapping);
+
+    o = pa_xnew0(struct opus_codec, 1);
+    o->codec.free = codec_free;
+    o->codec.userdata = o;
+    o->sample_spec = *ss;
+    o->frame_size = pa_opus_codec_frame_size(ss);
+    o->frame_samples = (int) (o->frame_size / pa_frame_size(ss));
+
+    /* A packet never needs to be larger than the PCM it replaces, and this
+     * also keeps its size representable in the packet header. */
+    o->max_packet_size = PA_MIN(o->frame_size, (size_t) UINT16_MAX);
+    o->max_packet_size = PA_MIN(o->max_packet_size, (size_t) (1275 + 2) * streams);
+
+    return o;
+}
+
+pa_pstream_codec *pa_opus_encoder_new(const pa_sample_spec *ss) {
+    struct opus_codec *o;
+    int streams, coupled_streams, error;
+    unsigned char mapping[PA_CHANNELS_MAX];
+
+    if (!(o = codec_new(ss)))
+        return NULL;
+
+    get_layout(ss, &streams, &coupled_streams, mapping);
+
+    if (!(o->encoder = opus_multistream_encoder_create((opus_int32) ss->rate, ss->channels, streams, coupled_streams,
+                                                       mapping, OPUS_APPLICATION_AUDIO, &error))) {
+        pa_log("Failed to create Opus encoder: %s", opus_strerror(error));
+        codec_free(&o->codec);
+        return NULL;
+    }
+
+    o->codec.encode = encode;
+    o->codec.flush = flush;
+    o->codec.reset = reset;
+    o->carry = pa_xmalloc(o->frame_size);
+
+    return &o->codec;
+}
+
+pa_pstream_codec *pa_opus_decoder_new(const pa_sample_spec *ss) {
+    struct opus_codec *o;
+    int streams, coupled_streams, error;
+    unsigned char mapping[PA_CHANNELS_MAX];
+
+    if (!(o = codec_new(ss)))
+        return NULL;
+
+    get_layout(ss, &streams, &coupled_streams, mapping);
+
+    if (!(o->decoder = opus_multistream_decoder_create((opus_int32) ss->rate, ss->channels, streams, coupled_streams,
+                                                       mapping, &error))) {
+        pa_log("Failed to create Opus decoder: %s", opus_strerror(error));
+        codec_free(&o->codec);
+        return NULL;
+    }
+
+    o->codec.decode = decode;
+
+    return &o->codec;
+}
@@ -0,0 +1,46 @@
+#ifndef fooopuscodechfoo
+#define fooopuscodechfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <pulse/sample.h>
+
+#include <pulsecore/pstream.h>
+
+/* Opus transport codec for native protocol streams. The encoder compresses
+ * whole 10 ms frames and keeps back whatever is left of a memblock until the
+ * next one completes the frame, so a memblock may decode to less or more
+ * than was put in, or produce nothing at all. Flushing the encoder pads
+ * what it keeps back to a whole frame, the decoder drops the padding. */
+
+#define PA_OPUS_CODEC_NAME "opus"
+
+/* Whether streams with this sample spec can be carried by the codec */
+bool pa_opus_codec_supported(const pa_sample_spec *ss);
+
+/* Number of PCM bytes encoded into one Opus frame. The encoder keeps back
+ * less than this. */
+size_t pa_opus_codec_frame_size(const pa_sample_spec *ss);
+
+/* Algorithmic delay the encoder adds to the stream */
+pa_usec_t pa_opus_codec_get_delay(const pa_sample_spec *ss);
+
+pa_pstream_codec *pa_opus_encoder_new(const pa_sample_spec *ss);
+pa_pstream_codec *pa_opus_decoder_new(const pa_sample_spec *ss);
+
+#endif
@@ -24,6 +24,7 @@
 #include <stdlib.h>
 
 #include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/refcnt.h>
 #include <pulsecore/flist.h>
@@ -32,18 +33,84 @@
 
 #define MAX_APPENDED_SIZE 128
 
+/* Buffers are recycled in power of two size classes from 256 bytes up to
+ * the maximum tagstruct size, larger ones come straight from malloc(). */
+#define MIN_BUFFER_SHIFT 8
+#define MAX_BUFFER_SHIFT 16
+#define N_BUFFER_CLASSES (MAX_BUFFER_SHIFT - MIN_BUFFER_SHIFT + 1)
+
 struct pa_packet {
     PA_REFCNT_DECLARE;
-    enum { PA_PACKET_APPENDED, PA_PACKET_DYNAMIC } type;
+    enum { PA_PACKET_APPENDED, PA_PACKET_DYNAMIC, PA_PACKET_BUFFER } type;
     size_t length;
     uint8_t *data;
     union {
         uint8_t appended[MAX_APPENDED_SIZE];
+        size_t allocated;
     } per_type;
 };
 
 PA_STATIC_FLIST_DECLARE(packets, 0, pa_xfree);
 
+/* Keep fewer of the big buffers around */
+PA_STATIC_FLIST_DECLARE(buffers_256, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(buffers_512, 0, pa_xfree);
+PA_STATIC_FLIST_DECLARE(buffers_1k, 128, pa_xfree);
+PA_STATIC_FLIST_DECLARE(buffers_2k, 64, pa_xfree);
+PA_STATIC_FLIST_DECLARE(buffers_4k, 32, pa_xfree);
+PA_STATIC_FLIST_DECLARE(buffers_8k, 16, pa_xfree);
+PA_STATIC_FLIST_DECLARE(buffers_16k, 8, pa_xfree);
+PA_STATIC_FLIST_DECLARE(buffers_32k, 8, pa_xfree);
+PA_STATIC_FLIST_DECLARE(buffers_64k, 8, pa_xfree);
+
+static pa_flist *buffer_flist(unsigned class) {
+    switch (class) {
+        case 0: return PA_STATIC_FLIST_GET(buffers_256);
+        case 1: return PA_STATIC_FLIST_GET(buffers_512);
+        case 2: return PA_STATIC_FLIST_GET(buffers_1k);
+        case 3: return PA_STATIC_FLIST_GET(buffers_2k);
+        case 4: return PA_STATIC_FLIST_GET(buffers_4k);
+        case 5: return PA_STATIC_FLIST_GET(buffers_8k);
+        case 6: return PA_STATIC_FLIST_GET(buffers_16k);
+        case 7: return PA_STATIC_FLIST_GET(buffers_32k);
+        case 8: return PA_STATIC_FLIST_GET(buffers_64k);
+    }
+
+    pa_assert_not_reached();
+}
+
+void *pa_packet_buffer_new(size_t *size) {
+    unsigned shift;
+    void *data;
+
+    pa_assert(size);
+    pa_assert(*size > 0);
+
+    if (*size > (1U << MAX_BUFFER_SHIFT))
+        return pa_xmalloc(*size);
+
+    shift = *size <= (1U << MIN_BUFFER_SHIFT) ? MIN_BUFFER_SHIFT : pa_ulog2((unsigned) *size - 1) + 1;
+    *size = 1U << shift;
+
+    if (!(data = pa_flist_pop(buffer_flist(shift - MIN_BUFFER_SHIFT))))
+        data = pa_xmalloc(*size);
+
+    return data;
+}
+
+void pa_packet_buffer_free(void *data, size_t size) {
+    pa_assert(data);
+
+    /* Anything not of the exact size of a class came from malloc() */
+    if (size < (1U << MIN_BUFFER_SHIFT) || size > (1U << MAX_BUFFER_SHIFT) || (size & (size - 1))) {
+        pa_xfree(data);
+        return;
+    }
+
+    if (pa_flist_push(buffer_flist(pa_ulog2((unsigned) size) - MIN_BUFFER_SHIFT), data) < 0)
+        pa_xfree(data);
+}
+
 pa_packet* pa_packet_new(size_t length) {
     pa_packet *p;
 
@@ -54,8 +121,9 @@ pa_packet* pa_packet_new(size_t length) {
     PA_REFCNT_INIT(p);
     p->length = length;
     if (length > MAX_APPENDED_SIZE) {
-        p->data = pa_xmalloc(length);
-        p->type = PA_PACKET_DYNAMIC;
+        p->per_type.allocated = length;
+        p->data = pa_packet_buffer_new(&p->per_type.allocated);
+        p->type = PA_PACKET_BUFFER;
     } else {
         p->data = p->per_type.appended;
         p->type = PA_PACKET_APPENDED;
@@ -91,6 +159,24 @@ pa_packet* pa_packet_new_dynamic(void* data, size_t length) {
     return p;
 }
 
+pa_packet* pa_packet_new_buffer(void *data, size_t length, size_t allocated) {
+    pa_packet *p;
+
+    pa_assert(data);
+    pa_assert(length > 0);
+    pa_assert(length <= allocated);
+
+    if (!(p = pa_flist_pop(PA_STATIC_FLIST_GET(packets))))
+        p = pa_xnew(pa_packet, 1);
+    PA_REFCNT_INIT(p);
+    p->length = length;
+    p->data = data;
+    p->per_type.allocated = allocated;
+    p->type = PA_PACKET_BUFFER;
+
+    return p;
+}
+
 const void* pa_packet_data(pa_packet *p, size_t *l) {
     pa_assert(PA_REFCNT_VALUE(p) >= 1);
     pa_assert(p->data);
@@ -116,6 +202,8 @@ void pa_packet_unref(pa_packet *p) {
     if (PA_REFCNT_DEC(p) <= 0) {
         if (p->type == PA_PACKET_DYNAMIC)
             pa_xfree(p->data);
+        else if (p->type == PA_PACKET_BUFFER)
+            pa_packet_buffer_free(p->data, p->per_type.allocated);
         if (pa_flist_push(PA_STATIC_FLIST_GET(packets), p) < 0)
             pa_xfree(p);
     }
@@ -37,8 +37,18 @@ pa_packet* pa_packet_new_data(const void* data, size_t length);
  * i.e. memory is free()d with the packet */
 pa_packet* pa_packet_new_dynamic(void* data, size_t length);
 
+/* data must come from pa_packet_buffer_new() and allocated is the size that
+ * returned; the packet takes ownership of the buffer and recycles it */
+pa_packet* pa_packet_new_buffer(void *data, size_t length, size_t allocated);
+
 const void* pa_packet_data(pa_packet *p, size_t *l);
 
+/* Returns a buffer of at least *size bytes and updates *size to what was
+ * actually allocated. Buffers are kept on free lists, so that in the steady
+ * state packets and tagstructs don't need malloc(). */
+void *pa_packet_buffer_new(size_t *size);
+void pa_packet_buffer_free(void *data, size_t size);
+
 pa_packet* pa_packet_ref(pa_packet *p);
 void pa_packet_unref(pa_packet *p);
 
@@ -202,6 +202,9 @@ static const char *command_names[PA_COMMAND_MAX] = {
 
     /* Supported since protocol v35 (15.0) */
     [PA_COMMAND_SEND_OBJECT_MESSAGE] = "SEND_OBJECT_MESSAGE",
+
+    /* Supported since protocol v37 (16.0) */
+    [PA_COMMAND_SUBSCRIBE_EVENT_BATCH] = "SUBSCRIBE_EVENT_BATCH",
 };
 
 #endif
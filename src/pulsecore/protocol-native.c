@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <pulse/mainloop.h>
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
 #include <pulse/version.h>
@@ -55,9 +56,17 @@
 #include <pulsecore/sample-util.h>
 #include <pulsecore/creds.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/dynarray.h>
 #include <pulsecore/ipacl.h>
+#include <pulsecore/queue.h>
+#include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/mem.h>
+#include <pulsecore/timing-page.h>
+
+#ifdef HAVE_OPUS
+#include <pulsecore/opus-codec.h>
+#endif
 
 #include "protocol-native.h"
 
@@ -69,9 +78,30 @@
 /* Don't accept more connection than this */
 #define MAX_CONNECTIONS 64
 
+/* Each IO thread raises the limit by this much */
+#define MAX_IO_THREAD_CONNECTIONS 512
+
+/* Values an introspection object may have that change without an event */
+#define INFO_CACHE_LIVE_MAX 2
+
+/* Don't let clients ask for events to be held back longer than this */
+#define MAX_SUBSCRIBE_INTERVAL (10*PA_USEC_PER_SEC)
+
+/* Events per SUBSCRIBE_EVENT_BATCH packet */
+#define SUBSCRIBE_BATCH_MAX 256
+
+/* Each timing page keeps one of the 128 export slots of the connection's
+ * pstream until the client lets go of it, and audio memblocks need those
+ * too. Playback streams beyond this ask for their timing as before. */
+#define MAX_TIMING_PAGES 16
+
+/* The render path updates a timing page at most this often */
+#define TIMING_PAGE_INTERVAL (5*PA_USEC_PER_MSEC)
+
 #define MAX_MEMBLOCKQ_LENGTH (4*1024*1024) /* 4MB */
 #define DEFAULT_TLENGTH_MSEC 2000 /* 2s */
 #define DEFAULT_PROCESS_MSEC 20   /* 20ms */
+#define DEFAULT_SUBSCRIBE_INTERVAL_MSEC 10 /* 10ms */
 #define DEFAULT_FRAGSIZE_MSEC DEFAULT_TLENGTH_MSEC
 
 struct pa_native_protocol;
@@ -101,6 +131,12 @@ typedef struct record_stream {
     size_t on_the_fly_snapshot;
     pa_usec_t current_monitor_latency;
     pa_usec_t current_source_latency;
+
+    /* Set if the client receives compressed audio. The encoder is only used
+     * from thread context, the queue holds what it made of the PCM in
+     * memblockq, which is then kept for the accounting only. */
+    pa_pstream_codec *transport_encoder;
+    pa_queue *transport_queue;
 } record_stream;
 
 #define RECORD_STREAM(o) (record_stream_cast(o))
@@ -146,6 +182,14 @@ typedef struct playback_stream {
     size_t render_memblockq_length;
     pa_usec_t current_sink_latency;
     uint64_t playing_for, underrun_for;
+
+    /* Shared with the client, written from thread context only */
+    pa_memblock *timing_page_memblock;
+    pa_timing_page *timing_page;
+    pa_usec_t timing_page_next;
+
+    /* Set if the client sends compressed audio, only used from thread context */
+    pa_pstream_codec *transport_decoder;
 } playback_stream;
 
 #define PLAYBACK_STREAM(o) (playback_stream_cast(o))
@@ -168,9 +212,43 @@ typedef struct upload_stream {
 #define UPLOAD_STREAM(o) (upload_stream_cast(o))
 PA_DEFINE_PRIVATE_CLASS(upload_stream, output_stream);
 
+/* A thread doing the pstream IO for some of the connections, see the
+ * io-threads option. It takes socket IO, framing and SHM imports off the
+ * main thread. Tagstruct parsing and command dispatching stay
+ * in the main thread, since nearly every command reads or changes core
+ * objects, which aren't thread safe. Everything a connection receives is
+ * forwarded there, so a storm of commands is still served one by one. */
+typedef struct io_thread {
+    pa_msgobject parent;
+
+    pa_thread *thread;
+    pa_mainloop *mainloop;
+    pa_thread_mq thread_mq;
+
+    /* Only touched by the IO thread */
+    bool shutdown;
+
+    /* Only touched by the main thread */
+    unsigned n_connections;
+} io_thread;
+
+#define IO_THREAD(o) (io_thread_cast(o))
+PA_DEFINE_PRIVATE_CLASS(io_thread, pa_msgobject);
+
+/* A subscription event that was not sent to the client yet */
+typedef struct pending_event pending_event;
+
+struct pending_event {
+    pa_subscription_event_type_t type;
+    uint32_t index;
+
+    PA_LLIST_FIELDS(pending_event);
+};
+
 struct pa_native_connection {
     pa_msgobject parent;
     pa_native_protocol *protocol;
+    io_thread *io_thread;
     pa_native_options *options;
     bool authorized:1;
     bool is_local:1;
@@ -185,15 +263,41 @@ struct pa_native_connection {
     pa_pstream *pstream;
     pa_pdispatch *pdispatch;
     pa_idxset *record_streams, *output_streams;
+    unsigned n_timing_pages;
     uint32_t rrobin_index;
     pa_subscription *subscription;
     pa_time_event *auth_timeout_event;
     pa_srbchannel *srbpending;
+
+    /* Events are sent at most once per subscription_interval, and only the
+     * latest event per object is kept until then, see subscription_cb() */
+    PA_LLIST_HEAD(pending_event, pending_events);
+    pending_event *pending_events_tail;
+    pa_hashmap *pending_events_by_object;
+    unsigned n_pending_events;
+    pa_time_event *subscription_flush_event;
+    pa_usec_t subscription_interval;
+    pa_usec_t subscription_last_flush;
+    pa_subscription_type_mask_t subscription_types;
 };
 
 #define PA_NATIVE_CONNECTION(o) (pa_native_connection_cast(o))
 PA_DEFINE_PRIVATE_CLASS(pa_native_connection, pa_msgobject);
 
+/* The serialization of a sink, source, ... for one protocol version, which
+ * info list replies are put together from. Entries are dropped as soon as an
+ * event is posted for their object. The few values that change without one,
+ * latencies mostly, are filled in again each time, see info_cache_put(). */
+typedef struct info_cache_entry {
+    uint32_t version;
+    pa_tagstruct *data;
+
+    unsigned n_live;
+    struct {
+        size_t start, end;
+    } live[INFO_CACHE_LIVE_MAX];
+} info_cache_entry;
+
 struct pa_native_protocol {
     PA_REFCNT_DECLARE;
 
@@ -204,14 +308,22 @@ struct pa_native_protocol {
     pa_hook hooks[PA_NATIVE_HOOK_MAX];
 
     pa_hashmap *extensions;
+
+    pa_dynarray *io_threads;
+
+    /* Cached serializations by object index, one map per facility */
+    pa_hashmap *info_cache[PA_SUBSCRIPTION_EVENT_FACILITY_MASK + 1];
+    pa_hook_slot *subscription_post_slot;
 };
 
 enum {
-    SOURCE_OUTPUT_MESSAGE_UPDATE_LATENCY = PA_SOURCE_OUTPUT_MESSAGE_MAX
+    SOURCE_OUTPUT_MESSAGE_UPDATE_LATENCY = PA_SOURCE_OUTPUT_MESSAGE_MAX,
+    SOURCE_OUTPUT_MESSAGE_RESET_ENCODER
 };
 
 enum {
     SINK_INPUT_MESSAGE_POST_DATA = PA_SINK_INPUT_MESSAGE_MAX, /* data from main loop to sink input */
+    SINK_INPUT_MESSAGE_POST_ENCODED, /* the same, still to be decoded */
     SINK_INPUT_MESSAGE_DRAIN, /* disabled prebuf, get playback started. */
     SINK_INPUT_MESSAGE_FLUSH,
     SINK_INPUT_MESSAGE_TRIGGER,
@@ -231,14 +343,48 @@ enum {
 };
 
 enum {
-    RECORD_STREAM_MESSAGE_POST_DATA         /* data from source output to main loop */
+    RECORD_STREAM_MESSAGE_POST_DATA,        /* data from source output to main loop */
+    RECORD_STREAM_MESSAGE_POST_ENCODED      /* the same, with what to send to the client instead */
 };
 
 enum {
     CONNECTION_MESSAGE_RELEASE,
-    CONNECTION_MESSAGE_REVOKE
+    CONNECTION_MESSAGE_REVOKE,
+    CONNECTION_MESSAGE_PACKET,   /* forwarded from the IO thread */
+    CONNECTION_MESSAGE_MEMBLOCK, /* forwarded from the IO thread */
+    CONNECTION_MESSAGE_DRAIN,    /* forwarded from the IO thread */
+    CONNECTION_MESSAGE_DIE       /* forwarded from the IO thread */
 };
 
+enum {
+    IO_THREAD_MESSAGE_ATTACH,
+    IO_THREAD_MESSAGE_NEW_SRBCHANNEL,
+    IO_THREAD_MESSAGE_SET_SRBCHANNEL,
+    IO_THREAD_MESSAGE_FREE_SRBCHANNEL,
+    IO_THREAD_MESSAGE_SHUTDOWN
+};
+
+typedef struct packet_msg {
+    pa_packet *packet;
+#ifdef HAVE_CREDS
+    pa_cmsg_ancil_data ancil_data;
+#endif
+} packet_msg;
+
+typedef struct memblock_msg {
+    uint32_t channel;
+    pa_seek_mode_t seek;
+    pa_memchunk chunk;
+    bool encoded;
+} memblock_msg;
+
+/* What the transport encoder of a record stream made of length bytes of
+ * PCM. The encoder may keep data back, then the memblock is NULL. */
+typedef struct transport_chunk {
+    pa_memchunk encoded;
+    size_t length;
+} transport_chunk;
+
 static bool sink_input_process_underrun_cb(pa_sink_input *i);
 static int sink_input_pop_cb(pa_sink_input *i, size_t length, pa_memchunk *chunk);
 static void sink_input_kill_cb(pa_sink_input *i);
@@ -248,10 +394,20 @@ static void sink_input_process_rewind_cb(pa_sink_input *i, size_t nbytes);
 static void sink_input_update_max_rewind_cb(pa_sink_input *i, size_t nbytes);
 static void sink_input_update_max_request_cb(pa_sink_input *i, size_t nbytes);
 static void sink_input_send_event_cb(pa_sink_input *i, const char *event, pa_proplist *pl);
+static void sink_input_attach_cb(pa_sink_input *i);
+static void sink_input_detach_cb(pa_sink_input *i);
+static void sink_input_suspend_within_thread_cb(pa_sink_input *i, bool b);
 
 static void native_connection_send_memblock(pa_native_connection *c);
+static void pending_events_free(pa_native_connection *c);
+static void connection_srbchannel_free(pa_native_connection *c, pa_srbchannel *srb);
 static void playback_stream_request_bytes(struct playback_stream*s);
 
+static void pstream_packet_callback(pa_pstream *p, pa_packet *packet, pa_cmsg_ancil_data *ancil_data, void *userdata);
+static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata);
+static void handle_memblock(pa_native_connection *c, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, bool encoded);
+static void pstream_die_callback(pa_pstream *p, void *userdata);
+
 static void source_output_kill_cb(pa_source_output *o);
 static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk);
 static void source_output_suspend_cb(pa_source_output *o, pa_source_state_t old_state, pa_suspend_cause_t old_suspend_cause);
@@ -264,6 +420,80 @@ static int source_output_process_msg(pa_msgobject *o, int code, void *userdata,
 
 /* structure management */
 
+/* Called from main context */
+/* Creates the transport codec for a stream if the client offered one we
+ * support in the negotiated format, a decoder for playback and an encoder
+ * for record streams. Returns NULL if the stream stays uncompressed. */
+static pa_pstream_codec *transport_codec_new(const pa_format_info *format, const pa_sample_spec *ss, bool playback) {
+#ifdef HAVE_OPUS
+    pa_pstream_codec *codec;
+    char *codecs, *name;
+    const char *state = NULL;
+    bool offered = false;
+
+    pa_assert(ss);
+
+    if (!format || !pa_format_info_is_pcm(format))
+        return NULL;
+
+    if (pa_format_info_get_prop_string(format, PA_NATIVE_TRANSPORT_CODECS, &codecs) < 0)
+        return NULL;
+
+    while (!offered && (name = pa_split(codecs, ",", &state))) {
+        offered = pa_streq(name, PA_OPUS_CODEC_NAME);
+        pa_xfree(name);
+    }
+
+    pa_xfree(codecs);
+
+    if (!offered || !pa_opus_codec_supported(ss))
+        return NULL;
+
+    if (!(codec = playback ? pa_opus_decoder_new(ss) : pa_opus_encoder_new(ss)))
+        return NULL;
+
+    pa_log_info("Using %s transport codec for %s stream.", PA_OPUS_CODEC_NAME, playback ? "playback" : "record");
+    return codec;
+#else
+    return NULL;
+#endif
+}
+
+/* Called from main context */
+/* Puts the format we negotiated into a CREATE_*_STREAM reply, naming the
+ * transport codec if the stream uses one */
+static void reply_put_format(pa_tagstruct *reply, const pa_format_info *format, bool transport_codec) {
+    pa_format_info *f;
+
+    if (!format) {
+        f = pa_format_info_new();
+        pa_tagstruct_put_format_info(reply, f);
+        pa_format_info_free(f);
+        return;
+    }
+
+#ifdef HAVE_OPUS
+    if (transport_codec) {
+        f = pa_format_info_copy(format);
+        pa_format_info_set_prop_string(f, PA_NATIVE_TRANSPORT_CODEC, PA_OPUS_CODEC_NAME);
+        pa_tagstruct_put_format_info(reply, f);
+        pa_format_info_free(f);
+        return;
+    }
+#endif
+
+    pa_tagstruct_put_format_info(reply, format);
+}
+
+static void transport_chunk_free(void *userdata) {
+    transport_chunk *t = userdata;
+
+    if (t->encoded.memblock)
+        pa_memblock_unref(t->encoded.memblock);
+
+    pa_xfree(t);
+}
+
 /* Called from main context */
 static void upload_stream_unlink(upload_stream *s) {
     pa_assert(s);
@@ -352,6 +582,12 @@ static void record_stream_free(pa_object *o) {
 
     record_stream_unlink(s);
 
+    if (s->transport_queue)
+        pa_queue_free(s->transport_queue, transport_chunk_free);
+
+    if (s->transport_encoder)
+        s->transport_encoder->free(s->transport_encoder);
+
     pa_memblockq_free(s->memblockq);
     pa_xfree(s);
 }
@@ -381,6 +617,29 @@ static int record_stream_process_msg(pa_msgobject *o, int code, void*userdata, i
                 native_connection_send_memblock(s->connection);
 
             break;
+
+        case RECORD_STREAM_MESSAGE_POST_ENCODED: {
+            transport_chunk *t;
+
+            /* A flushed encoder hands out data without PCM to go along */
+            if (chunk) {
+                pa_atomic_sub(&s->on_the_fly, chunk->length);
+
+                if (pa_memblockq_push_align(s->memblockq, chunk) < 0)
+                    return -1;
+            }
+
+            /* The message frees its own copy */
+            t = pa_xmemdup(userdata, sizeof(transport_chunk));
+            if (t->encoded.memblock)
+                pa_memblock_ref(t->encoded.memblock);
+            pa_queue_push(s->transport_queue, t);
+
+            if (!pa_pstream_is_pending(s->connection->pstream))
+                native_connection_send_memblock(s->connection);
+
+            break;
+        }
     }
 
     return 0;
@@ -602,6 +861,9 @@ static record_stream* record_stream_new(
     pa_memblockq_get_attr(s->memblockq, &s->buffer_attr);
     fix_record_buffer_attr_post(s);
 
+    if (c->version >= 22 && (s->transport_encoder = transport_codec_new(source_output->format, &source_output->sample_spec, false)))
+        s->transport_queue = pa_queue_new();
+
     *ss = s->source_output->sample_spec;
     *map = s->source_output->channel_map;
 
@@ -644,6 +906,9 @@ static void playback_stream_unlink(playback_stream *s) {
     if (s->drain_request)
         pa_pstream_send_error(s->connection->pstream, s->drain_tag, PA_ERR_NOENTITY);
 
+    if (s->timing_page_memblock)
+        s->connection->n_timing_pages--;
+
     pa_assert_se(pa_idxset_remove_by_data(s->connection->output_streams, s, NULL) == s);
     s->connection = NULL;
     playback_stream_unref(s);
@@ -656,6 +921,14 @@ static void playback_stream_free(pa_object* o) {
 
     playback_stream_unlink(s);
 
+    if (s->timing_page_memblock) {
+        pa_memblock_release(s->timing_page_memblock);
+        pa_memblock_unref(s->timing_page_memblock);
+    }
+
+    if (s->transport_decoder)
+        s->transport_decoder->free(s->transport_decoder);
+
     pa_memblockq_free(s->memblockq);
     pa_xfree(s);
 }
@@ -1066,6 +1339,18 @@ static playback_stream* playback_stream_new(
     s->sink_input->send_event = sink_input_send_event_cb;
     s->sink_input->userdata = s;
 
+    /* The timing page only helps if the client can map it */
+    if (c->version >= 38 && pa_pstream_get_shm(c->pstream) &&
+        c->n_timing_pages < MAX_TIMING_PAGES &&
+        (s->timing_page_memblock = pa_memblock_new_pool(c->protocol->core->mempool, sizeof(pa_timing_page)))) {
+        c->n_timing_pages++;
+        s->timing_page = pa_memblock_acquire(s->timing_page_memblock);
+        memset(s->timing_page, 0, sizeof(pa_timing_page));
+        s->sink_input->attach = sink_input_attach_cb;
+        s->sink_input->detach = sink_input_detach_cb;
+        s->sink_input->suspend_within_thread = sink_input_suspend_within_thread_cb;
+    }
+
     start_index = ssync ? pa_memblockq_get_read_index(ssync->memblockq) : 0;
 
     fix_playback_buffer_attr(s);
@@ -1089,6 +1374,9 @@ static playback_stream* playback_stream_new(
 
     *missing = (uint32_t) pa_memblockq_pop_missing(s->memblockq);
 
+    if (c->version >= 21)
+        s->transport_decoder = transport_codec_new(sink_input->format, &sink_input->sample_spec, true);
+
 #ifdef PROTOCOL_NATIVE_DEBUG
     pa_log("missing original: %li", (long int) *missing);
 #endif
@@ -1168,6 +1456,32 @@ static int native_connection_process_msg(pa_msgobject *o, int code, void*userdat
         case CONNECTION_MESSAGE_RELEASE:
             pa_pstream_send_release(c->pstream, PA_PTR_TO_UINT(userdata));
             break;
+
+        case CONNECTION_MESSAGE_PACKET: {
+            packet_msg *m = userdata;
+
+#ifdef HAVE_CREDS
+            pstream_packet_callback(c->pstream, m->packet, &m->ancil_data, c);
+#else
+            pstream_packet_callback(c->pstream, m->packet, NULL, c);
+#endif
+            break;
+        }
+
+        case CONNECTION_MESSAGE_MEMBLOCK: {
+            memblock_msg *m = userdata;
+
+            handle_memblock(c, m->channel, offset, m->seek, &m->chunk, m->encoded);
+            break;
+        }
+
+        case CONNECTION_MESSAGE_DRAIN:
+            native_connection_send_memblock(c);
+            break;
+
+        case CONNECTION_MESSAGE_DIE:
+            pstream_die_callback(c->pstream, c);
+            break;
     }
 
     return 0;
@@ -1188,8 +1502,10 @@ static void native_connection_unlink(pa_native_connection *c) {
     if (c->options)
         pa_native_options_unref(c->options);
 
-    if (c->srbpending)
-        pa_srbchannel_free(c->srbpending);
+    if (c->srbpending) {
+        connection_srbchannel_free(c, c->srbpending);
+        c->srbpending = NULL;
+    }
 
     while ((r = pa_idxset_first(c->record_streams, NULL)))
         record_stream_unlink(r);
@@ -1203,9 +1519,19 @@ static void native_connection_unlink(pa_native_connection *c) {
     if (c->subscription)
         pa_subscription_free(c->subscription);
 
+    pending_events_free(c);
+
+    if (c->subscription_flush_event) {
+        c->protocol->core->mainloop->time_free(c->subscription_flush_event);
+        c->subscription_flush_event = NULL;
+    }
+
     if (c->pstream)
         pa_pstream_unlink(c->pstream);
 
+    if (c->io_thread)
+        c->io_thread->n_connections--;
+
     if (c->auth_timeout_event) {
         c->protocol->core->mainloop->time_free(c->auth_timeout_event);
         c->auth_timeout_event = NULL;
@@ -1226,6 +1552,7 @@ static void native_connection_free(pa_object *o) {
 
     pa_idxset_free(c->record_streams, NULL);
     pa_idxset_free(c->output_streams, NULL);
+    pa_hashmap_free(c->pending_events_by_object);
 
     pa_pdispatch_unref(c->pdispatch);
     pa_pstream_unref(c->pstream);
@@ -1254,6 +1581,28 @@ static void native_connection_send_memblock(pa_native_connection *c) {
         else if (start == c->rrobin_index)
             return;
 
+        if (r->transport_queue) {
+            transport_chunk *t;
+
+            /* Send what was encoded, dropping the PCM it stands for */
+            while ((t = pa_queue_pop(r->transport_queue))) {
+                bool sent = false;
+
+                if (t->encoded.memblock) {
+                    pa_pstream_send_encoded_memblock(c->pstream, r->index, &t->encoded);
+                    sent = true;
+                }
+
+                pa_memblockq_drop(r->memblockq, PA_MIN(t->length, pa_memblockq_get_length(r->memblockq)));
+                transport_chunk_free(t);
+
+                if (sent)
+                    return;
+            }
+
+            continue;
+        }
+
         if (pa_memblockq_peek(r->memblockq, &chunk) >= 0) {
             pa_memchunk schunk = chunk;
 
@@ -1315,6 +1664,47 @@ static void flush_write_no_account(pa_memblockq *q) {
     pa_memblockq_flush_write(q, false);
 }
 
+/* Called from thread context */
+static void playback_stream_publish_timing(playback_stream *s, bool valid) {
+    pa_sink_input *i = s->sink_input;
+    pa_timing_page_data d;
+
+    if (!s->timing_page)
+        return;
+
+    pa_zero(d);
+
+    if (valid) {
+        d.flags = PA_TIMING_PAGE_VALID;
+
+        if (i->thread_info.playing_for > 0 &&
+            i->sink->thread_info.state == PA_SINK_RUNNING &&
+            i->thread_info.state == PA_SINK_INPUT_RUNNING)
+            d.flags |= PA_TIMING_PAGE_PLAYING;
+
+        d.timestamp = pa_rtclock_now();
+        s->timing_page_next = d.timestamp + TIMING_PAGE_INTERVAL;
+
+        d.sink_usec = pa_sink_get_latency_within_thread(i->sink, false) +
+            pa_resampler_get_delay_usec(i->thread_info.resampler) +
+            pa_bytes_to_usec(pa_memblockq_get_length(i->thread_info.render_memblockq), &i->sink->sample_spec);
+        d.read_index = pa_memblockq_get_read_index(s->memblockq);
+        d.underrun_for = i->thread_info.underrun_for;
+        d.playing_for = i->thread_info.playing_for;
+    }
+
+    pa_timing_page_write(s->timing_page, &d);
+}
+
+/* Called from thread context. Querying the sink latency on every render
+ * pass is too expensive, and the client interpolates in between anyway. */
+static void playback_stream_publish_timing_from_render(playback_stream *s) {
+    if (!s->timing_page || pa_rtclock_now() < s->timing_page_next)
+        return;
+
+    playback_stream_publish_timing(s, true);
+}
+
 /* Called from thread context */
 static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
     pa_sink_input *i = PA_SINK_INPUT(o);
@@ -1327,8 +1717,26 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
     switch (code) {
 
         case SINK_INPUT_MESSAGE_SEEK:
-        case SINK_INPUT_MESSAGE_POST_DATA: {
+        case SINK_INPUT_MESSAGE_POST_DATA:
+        case SINK_INPUT_MESSAGE_POST_ENCODED: {
             int64_t windex = pa_memblockq_get_write_index(s->memblockq);
+            pa_memchunk decoded;
+
+            pa_memchunk_reset(&decoded);
+
+            if (code == SINK_INPUT_MESSAGE_POST_ENCODED) {
+                /* Decoding here keeps it off the main loop. The decoder
+                 * may keep data back and hand out nothing. */
+                pa_assert(s->transport_decoder);
+
+                if (s->transport_decoder->decode(s->transport_decoder, i->sink->core->mempool, chunk, &decoded) < 0) {
+                    if (pa_log_ratelimit(PA_LOG_WARN))
+                        pa_log_warn("Failed to decode data from client, dropping it.");
+                    pa_memchunk_reset(&decoded);
+                }
+
+                chunk = decoded.memblock ? &decoded : NULL;
+            }
 
             if (code == SINK_INPUT_MESSAGE_SEEK) {
                 /* The client side is incapable of accounting correctly
@@ -1346,6 +1754,9 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
                 pa_memblockq_seek(s->memblockq, (int64_t) chunk->length, PA_SEEK_RELATIVE, true);
             }
 
+            if (decoded.memblock)
+                pa_memblock_unref(decoded.memblock);
+
             /* If more data is in queue, we rewind later instead. */
             if (s->seek_windex != -1)
                 windex = PA_MIN(windex, s->seek_windex);
@@ -1427,10 +1838,13 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
             s->underrun_for = s->sink_input->thread_info.underrun_for;
             s->playing_for = s->sink_input->thread_info.playing_for;
 
+            playback_stream_publish_timing(s, true);
+
             return 0;
 
         case PA_SINK_INPUT_MESSAGE_SET_STATE: {
             int64_t windex;
+            int r;
 
             windex = pa_memblockq_get_write_index(s->memblockq);
 
@@ -1444,8 +1858,11 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
 
             handle_seek(s, windex);
 
-            /* Fall through to the default handler */
-            break;
+            /* The default handler updates the state, which the timing
+             * page has to reflect right away */
+            r = pa_sink_input_process_msg(o, code, userdata, offset, chunk);
+            playback_stream_publish_timing(s, true);
+            return r;
         }
 
         case PA_SINK_INPUT_MESSAGE_GET_LATENCY: {
@@ -1521,8 +1938,10 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
 
     /* This call will not fail with prebuf=0, hence we check for
        underrun explicitly in handle_input_underrun */
-    if (pa_memblockq_peek(s->memblockq, chunk) < 0)
+    if (pa_memblockq_peek(s->memblockq, chunk) < 0) {
+        playback_stream_publish_timing_from_render(s);
         return -1;
+    }
 
     chunk->length = PA_MIN(nbytes, chunk->length);
 
@@ -1531,6 +1950,7 @@ static int sink_input_pop_cb(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk
 
     pa_memblockq_drop(s->memblockq, chunk->length);
     playback_stream_request_bytes(s);
+    playback_stream_publish_timing_from_render(s);
 
     return 0;
 }
@@ -1620,6 +2040,40 @@ static void sink_input_send_event_cb(pa_sink_input *i, const char *event, pa_pro
     pa_pstream_send_tagstruct(s->connection->pstream, t);
 }
 
+/* Called from thread context */
+static void sink_input_attach_cb(pa_sink_input *i) {
+    playback_stream *s;
+
+    pa_sink_input_assert_ref(i);
+    s = PLAYBACK_STREAM(i->userdata);
+    playback_stream_assert_ref(s);
+
+    playback_stream_publish_timing(s, true);
+}
+
+/* Called from thread context */
+static void sink_input_detach_cb(pa_sink_input *i) {
+    playback_stream *s;
+
+    pa_sink_input_assert_ref(i);
+    s = PLAYBACK_STREAM(i->userdata);
+    playback_stream_assert_ref(s);
+
+    /* While the stream is moving nobody updates the page */
+    playback_stream_publish_timing(s, false);
+}
+
+/* Called from thread context */
+static void sink_input_suspend_within_thread_cb(pa_sink_input *i, bool b) {
+    playback_stream *s;
+
+    pa_sink_input_assert_ref(i);
+    s = PLAYBACK_STREAM(i->userdata);
+    playback_stream_assert_ref(s);
+
+    playback_stream_publish_timing(s, true);
+}
+
 /* Called from main context */
 static void sink_input_suspend_cb(pa_sink_input *i, pa_sink_state_t old_state, pa_suspend_cause_t old_suspend_cause) {
     playback_stream *s;
@@ -1706,6 +2160,34 @@ static int source_output_process_msg(pa_msgobject *_o, int code, void *userdata,
             s->current_source_latency += pa_resampler_get_delay_usec(o->thread_info.resampler);
             s->on_the_fly_snapshot = pa_atomic_load(&s->on_the_fly);
             return 0;
+
+        case SOURCE_OUTPUT_MESSAGE_RESET_ENCODER:
+            s->transport_encoder->reset(s->transport_encoder);
+            return 0;
+
+        case PA_SOURCE_OUTPUT_MESSAGE_SET_STATE: {
+            int r;
+
+            r = pa_source_output_process_msg(_o, code, userdata, offset, chunk);
+
+            /* Send out what the encoder keeps back before the pause */
+            if (s->transport_encoder && PA_PTR_TO_UINT(userdata) == PA_SOURCE_OUTPUT_CORKED) {
+                transport_chunk *t;
+
+                t = pa_xnew(transport_chunk, 1);
+                t->length = 0;
+
+                if (s->transport_encoder->flush(s->transport_encoder, o->source->core->mempool, &t->encoded) < 0 ||
+                    !t->encoded.memblock) {
+                    pa_xfree(t);
+                    return r;
+                }
+
+                pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), RECORD_STREAM_MESSAGE_POST_ENCODED, t, 0, NULL, transport_chunk_free);
+            }
+
+            return r;
+        }
     }
 
     return pa_source_output_process_msg(_o, code, userdata, offset, chunk);
@@ -1721,6 +2203,24 @@ static void source_output_push_cb(pa_source_output *o, const pa_memchunk *chunk)
     pa_assert(chunk);
 
     pa_atomic_add(&s->on_the_fly, chunk->length);
+
+    if (s->transport_encoder) {
+        transport_chunk *t;
+
+        /* Encoding here keeps it off the main loop */
+        t = pa_xnew(transport_chunk, 1);
+        t->length = chunk->length;
+
+        if (s->transport_encoder->encode(s->transport_encoder, o->source->core->mempool, chunk, &t->encoded) < 0) {
+            if (pa_log_ratelimit(PA_LOG_WARN))
+                pa_log_warn("Failed to encode data for client, dropping it.");
+            pa_memchunk_reset(&t->encoded);
+        }
+
+        pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), RECORD_STREAM_MESSAGE_POST_ENCODED, t, 0, chunk, transport_chunk_free);
+        return;
+    }
+
     pa_asyncmsgq_post(pa_thread_mq_get()->outq, PA_MSGOBJECT(s), RECORD_STREAM_MESSAGE_POST_DATA, NULL, 0, chunk, NULL);
 }
 
@@ -2110,19 +2610,22 @@ static void command_create_playback_stream(pa_pdispatch *pd, uint32_t command, u
     if (c->version >= 13)
         pa_tagstruct_put_usec(reply, s->configured_sink_latency);
 
-    if (c->version >= 21) {
-        /* Send back the format we negotiated */
-        if (s->sink_input->format)
-            pa_tagstruct_put_format_info(reply, s->sink_input->format);
-        else {
-            pa_format_info *f = pa_format_info_new();
-            pa_tagstruct_put_format_info(reply, f);
-            pa_format_info_free(f);
-        }
-    }
+    /* Send back the format we negotiated */
+    if (c->version >= 21)
+        reply_put_format(reply, s->sink_input->format, !!s->transport_decoder);
 
     pa_pstream_send_tagstruct(c->pstream, reply);
 
+    if (s->timing_page_memblock) {
+        pa_memchunk mc;
+
+        /* The client maps the page right after the stream was set up */
+        mc.memblock = s->timing_page_memblock;
+        mc.index = 0;
+        mc.length = sizeof(pa_timing_page);
+        pa_pstream_send_memblock(c->pstream, PA_NATIVE_TIMING_PAGE_CHANNEL, s->index, PA_SEEK_RELATIVE, &mc, 0);
+    }
+
 finish:
     if (p)
         pa_proplist_free(p);
@@ -2426,16 +2929,9 @@ static void command_create_record_stream(pa_pdispatch *pd, uint32_t command, uin
     if (c->version >= 13)
         pa_tagstruct_put_usec(reply, s->configured_source_latency);
 
-    if (c->version >= 22) {
-        /* Send back the format we negotiated */
-        if (s->source_output->format)
-            pa_tagstruct_put_format_info(reply, s->source_output->format);
-        else {
-            pa_format_info *f = pa_format_info_new();
-            pa_tagstruct_put_format_info(reply, f);
-            pa_format_info_free(f);
-        }
-    }
+    /* Send back the format we negotiated */
+    if (c->version >= 22)
+        reply_put_format(reply, s->source_output->format, !!s->transport_encoder);
 
     pa_pstream_send_tagstruct(c->pstream, reply);
 
@@ -2467,6 +2963,63 @@ static void command_exit(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_ta
     pa_pstream_send_simple_ack(c->pstream, tag); /* nonsense */
 }
 
+struct io_thread_srbchannel {
+    pa_pstream *pstream;
+    pa_mempool *pool;
+    pa_srbchannel *srb;
+};
+
+/* Called from main context. The srbchannel of a connection served by an IO
+ * thread hooks into the mainloop of that thread, so it is created, handed
+ * over to the pstream and freed there. */
+static pa_srbchannel *connection_srbchannel_new(pa_native_connection *c) {
+    struct io_thread_srbchannel s;
+
+    if (!c->io_thread)
+        return pa_srbchannel_new(c->protocol->core->mainloop, c->rw_mempool);
+
+    s.pstream = c->pstream;
+    s.pool = c->rw_mempool;
+    s.srb = NULL;
+
+    if (pa_asyncmsgq_send(c->io_thread->thread_mq.inq, PA_MSGOBJECT(c->io_thread), IO_THREAD_MESSAGE_NEW_SRBCHANNEL, &s, 0, NULL) < 0)
+        return NULL;
+
+    return s.srb;
+}
+
+/* Called from main context */
+static void connection_srbchannel_set(pa_native_connection *c, pa_srbchannel *srb) {
+    struct io_thread_srbchannel s;
+
+    if (!c->io_thread) {
+        pa_pstream_set_srbchannel(c->pstream, srb);
+        return;
+    }
+
+    s.pstream = c->pstream;
+    s.pool = NULL;
+    s.srb = srb;
+
+    pa_asyncmsgq_send(c->io_thread->thread_mq.inq, PA_MSGOBJECT(c->io_thread), IO_THREAD_MESSAGE_SET_SRBCHANNEL, &s, 0, NULL);
+}
+
+/* Called from main context */
+static void connection_srbchannel_free(pa_native_connection *c, pa_srbchannel *srb) {
+    struct io_thread_srbchannel s;
+
+    if (!c->io_thread) {
+        pa_srbchannel_free(srb);
+        return;
+    }
+
+    s.pstream = c->pstream;
+    s.pool = NULL;
+    s.srb = srb;
+
+    pa_asyncmsgq_send(c->io_thread->thread_mq.inq, PA_MSGOBJECT(c->io_thread), IO_THREAD_MESSAGE_FREE_SRBCHANNEL, &s, 0, NULL);
+}
+
 static void setup_srbchannel(pa_native_connection *c, pa_mem_type_t shm_type) {
     pa_srbchannel_template srbt;
     pa_srbchannel *srb;
@@ -2515,7 +3068,7 @@ static void setup_srbchannel(pa_native_connection *c, pa_mem_type_t shm_type) {
     }
     pa_mempool_set_is_remote_writable(c->rw_mempool, true);
 
-    srb = pa_srbchannel_new(c->protocol->core->mainloop, c->rw_mempool);
+    srb = connection_srbchannel_new(c);
     if (!srb) {
         pa_log_debug("Failed to create srbchannel");
         goto fail;
@@ -2556,7 +3109,7 @@ static void command_enable_srbchannel(pa_pdispatch *pd, uint32_t command, uint32
     }
 
     pa_log_debug("Client enabled srbchannel.");
-    pa_pstream_set_srbchannel(c->pstream, c->srbpending);
+    connection_srbchannel_set(c, c->srbpending);
     c->srbpending = NULL;
 }
 
@@ -3161,34 +3714,164 @@ static void fixup_sample_spec(pa_native_connection *c, pa_sample_spec *fixed, co
     }
 }
 
-static void sink_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sink *sink) {
-    pa_sample_spec fixed_ss;
+static void info_cache_entry_free(info_cache_entry *e) {
+    pa_assert(e);
 
-    pa_assert(t);
-    pa_sink_assert_ref(sink);
+    pa_tagstruct_free(e->data);
+    pa_xfree(e);
+}
 
-    fixup_sample_spec(c, &fixed_ss, &sink->sample_spec);
+/* Returns the entry of an object to fill in for the protocol version of c,
+ * or NULL if there is a valid one already, which is then put in e. */
+static info_cache_entry *info_cache_begin(pa_native_connection *c, pa_subscription_event_type_t facility, uint32_t idx, info_cache_entry **e) {
+    pa_hashmap **cache;
 
-    pa_tagstruct_put(
-        t,
-        PA_TAG_U32, sink->index,
-        PA_TAG_STRING, sink->name,
-        PA_TAG_STRING, pa_strnull(pa_proplist_gets(sink->proplist, PA_PROP_DEVICE_DESCRIPTION)),
-        PA_TAG_SAMPLE_SPEC, &fixed_ss,
-        PA_TAG_CHANNEL_MAP, &sink->channel_map,
-        PA_TAG_U32, sink->module ? sink->module->index : PA_INVALID_INDEX,
-        PA_TAG_CVOLUME, pa_sink_get_volume(sink, false),
-        PA_TAG_BOOLEAN, pa_sink_get_mute(sink, false),
-        PA_TAG_U32, sink->monitor_source ? sink->monitor_source->index : PA_INVALID_INDEX,
-        PA_TAG_STRING, sink->monitor_source ? sink->monitor_source->name : NULL,
-        PA_TAG_USEC, pa_sink_get_latency(sink),
-        PA_TAG_STRING, sink->driver,
-        PA_TAG_U32, sink->flags & PA_SINK_CLIENT_FLAGS_MASK,
-        PA_TAG_INVALID);
+    pa_assert(c);
+    pa_assert(e);
+
+    cache = &c->protocol->info_cache[facility & PA_SUBSCRIPTION_EVENT_FACILITY_MASK];
+
+    if (!*cache)
+        *cache = pa_hashmap_new_full(NULL, NULL, NULL, (pa_free_cb_t) info_cache_entry_free);
+
+    if ((*e = pa_hashmap_get(*cache, PA_UINT32_TO_PTR(idx)))) {
+        if ((*e)->version == c->version)
+            return NULL;
+
+        /* Clients speaking another version are rare, just start over */
+        pa_tagstruct_free((*e)->data);
+    } else {
+        *e = pa_xnew(info_cache_entry, 1);
+        pa_assert_se(pa_hashmap_put(*cache, PA_UINT32_TO_PTR(idx), *e) >= 0);
+    }
+
+    (*e)->version = c->version;
+    (*e)->data = pa_tagstruct_new();
+    (*e)->n_live = 0;
+
+    return *e;
+}
+
+/* Puts a value that may change without an event for the object. If e is
+ * given, the serialization goes into the cache, so remember where it is. */
+static void put_live_value(pa_tagstruct *t, info_cache_entry *e, uint8_t tag, uint64_t value) {
+    size_t start;
+
+    pa_tagstruct_data(t, &start);
+
+    if (tag == PA_TAG_USEC)
+        pa_tagstruct_put_usec(t, value);
+    else {
+        pa_assert(tag == PA_TAG_U32);
+        pa_tagstruct_putu32(t, (uint32_t) value);
+    }
+
+    if (e) {
+        pa_assert(e->n_live < INFO_CACHE_LIVE_MAX);
+
+        e->live[e->n_live].start = start;
+        pa_tagstruct_data(t, &e->live[e->n_live].end);
+        e->n_live++;
+    }
+}
+
+/* Appends the cached serialization, with the live values replaced by the
+ * current ones, in the order they were put */
+static void info_cache_put(pa_tagstruct *t, info_cache_entry *e, const uint64_t *live) {
+    const uint8_t *data;
+    size_t length, i = 0;
+    unsigned k;
+
+    pa_assert(t);
+    pa_assert(e);
+
+    data = pa_tagstruct_data(e->data, &length);
+
+    for (k = 0; k < e->n_live; k++) {
+        pa_tagstruct_append_data(t, data + i, e->live[k].start - i);
+        put_live_value(t, NULL, data[e->live[k].start], live[k]);
+        i = e->live[k].end;
+    }
+
+    pa_tagstruct_append_data(t, data + i, length - i);
+}
+
+static pa_hook_result_t subscription_post_cb(pa_core *core, pa_subscription_post_data *data, pa_native_protocol *p) {
+    pa_hashmap *cache;
+
+    pa_assert(data);
+    pa_assert(p);
+
+    if ((cache = p->info_cache[data->type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK]))
+        pa_hashmap_remove_and_free(cache, PA_UINT32_TO_PTR(data->index));
+
+    return PA_HOOK_OK;
+}
+
+static void sink_live_values(pa_native_connection *c, pa_sink *sink, uint64_t live[INFO_CACHE_LIVE_MAX]) {
+    live[0] = pa_sink_get_latency(sink);
+    live[1] = c->version >= 13 ? pa_sink_get_requested_latency(sink) : 0;
+}
+
+static void sink_fill_formats(pa_native_connection *c, pa_tagstruct *t, pa_sink *sink) {
+    uint32_t i;
+    pa_format_info *f;
+    pa_idxset *formats;
+
+    if (c->version < 21)
+        return;
+
+    formats = pa_sink_get_formats(sink);
+
+    pa_tagstruct_putu8(t, (uint8_t) pa_idxset_size(formats));
+    PA_IDXSET_FOREACH(f, formats, i) {
+        pa_tagstruct_put_format_info(t, f);
+    }
+
+    pa_idxset_free(formats, (pa_free_cb_t) pa_format_info_free);
+}
+
+/* If e is given, only the part to cache is filled in */
+static void sink_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sink *sink, info_cache_entry *e) {
+    pa_sample_spec fixed_ss;
+    uint64_t live[INFO_CACHE_LIVE_MAX];
+
+    pa_assert(t);
+    pa_sink_assert_ref(sink);
+
+    fixup_sample_spec(c, &fixed_ss, &sink->sample_spec);
+
+    /* The values put into the cache are replaced when sending anyway */
+    if (e)
+        memset(live, 0, sizeof(live));
+    else
+        sink_live_values(c, sink, live);
+
+    pa_tagstruct_put(
+        t,
+        PA_TAG_U32, sink->index,
+        PA_TAG_STRING, sink->name,
+        PA_TAG_STRING, pa_strnull(pa_proplist_gets(sink->proplist, PA_PROP_DEVICE_DESCRIPTION)),
+        PA_TAG_SAMPLE_SPEC, &fixed_ss,
+        PA_TAG_CHANNEL_MAP, &sink->channel_map,
+        PA_TAG_U32, sink->module ? sink->module->index : PA_INVALID_INDEX,
+        PA_TAG_CVOLUME, pa_sink_get_volume(sink, false),
+        PA_TAG_BOOLEAN, pa_sink_get_mute(sink, false),
+        PA_TAG_U32, sink->monitor_source ? sink->monitor_source->index : PA_INVALID_INDEX,
+        PA_TAG_STRING, sink->monitor_source ? sink->monitor_source->name : NULL,
+        PA_TAG_INVALID);
+
+    put_live_value(t, e, PA_TAG_USEC, live[0]);
+
+    pa_tagstruct_put(
+        t,
+        PA_TAG_STRING, sink->driver,
+        PA_TAG_U32, sink->flags & PA_SINK_CLIENT_FLAGS_MASK,
+        PA_TAG_INVALID);
 
     if (c->version >= 13) {
         pa_tagstruct_put_proplist(t, sink->proplist);
-        pa_tagstruct_put_usec(t, pa_sink_get_requested_latency(sink));
+        put_live_value(t, e, PA_TAG_USEC, live[1]);
     }
 
     if (c->version >= 15) {
@@ -3222,28 +3905,62 @@ static void sink_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sin
         pa_tagstruct_puts(t, sink->active_port ? sink->active_port->name : NULL);
     }
 
-    if (c->version >= 21) {
-        uint32_t i;
-        pa_format_info *f;
-        pa_idxset *formats = pa_sink_get_formats(sink);
+    /* Formats may change without an event */
+    if (!e)
+        sink_fill_formats(c, t, sink);
+}
 
-        pa_tagstruct_putu8(t, (uint8_t) pa_idxset_size(formats));
-        PA_IDXSET_FOREACH(f, formats, i) {
-            pa_tagstruct_put_format_info(t, f);
-        }
+static void sink_put_cached(pa_native_connection *c, pa_tagstruct *t, pa_sink *sink) {
+    info_cache_entry *e;
+    uint64_t live[INFO_CACHE_LIVE_MAX];
 
-        pa_idxset_free(formats, (pa_free_cb_t) pa_format_info_free);
+    if (info_cache_begin(c, PA_SUBSCRIPTION_EVENT_SINK, sink->index, &e))
+        sink_fill_tagstruct(c, e->data, sink, e);
+
+    sink_live_values(c, sink, live);
+    info_cache_put(t, e, live);
+    sink_fill_formats(c, t, sink);
+}
+
+static void source_live_values(pa_native_connection *c, pa_source *source, uint64_t live[INFO_CACHE_LIVE_MAX]) {
+    live[0] = pa_source_get_latency(source);
+    live[1] = c->version >= 13 ? pa_source_get_requested_latency(source) : 0;
+}
+
+static void source_fill_formats(pa_native_connection *c, pa_tagstruct *t, pa_source *source) {
+    uint32_t i;
+    pa_format_info *f;
+    pa_idxset *formats;
+
+    if (c->version < 22)
+        return;
+
+    formats = pa_source_get_formats(source);
+
+    pa_tagstruct_putu8(t, (uint8_t) pa_idxset_size(formats));
+    PA_IDXSET_FOREACH(f, formats, i) {
+        pa_tagstruct_put_format_info(t, f);
     }
+
+    pa_idxset_free(formats, (pa_free_cb_t) pa_format_info_free);
 }
 
-static void source_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_source *source) {
+/* If e is given, only the part to cache is filled in */
+static void source_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_source *source, info_cache_entry *e) {
     pa_sample_spec fixed_ss;
+    uint64_t live[INFO_CACHE_LIVE_MAX];
 
     pa_assert(t);
     pa_source_assert_ref(source);
 
     fixup_sample_spec(c, &fixed_ss, &source->sample_spec);
 
+    /* The values put into the cache are replaced when sending anyway */
+    if (e)
+        memset(live, 0, sizeof(live));
+    else
+        source_live_values(c, source, live);
+
     pa_tagstruct_put(
         t,
         PA_TAG_U32, source->index,
@@ -3256,14 +3973,19 @@ static void source_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_s
         PA_TAG_BOOLEAN, pa_source_get_mute(source, false),
         PA_TAG_U32, source->monitor_of ? source->monitor_of->index : PA_INVALID_INDEX,
         PA_TAG_STRING, source->monitor_of ? source->monitor_of->name : NULL,
-        PA_TAG_USEC, pa_source_get_latency(source),
+        PA_TAG_INVALID);
+
+    put_live_value(t, e, PA_TAG_USEC, live[0]);
+
+    pa_tagstruct_put(
+        t,
         PA_TAG_STRING, source->driver,
         PA_TAG_U32, source->flags & PA_SOURCE_CLIENT_FLAGS_MASK,
         PA_TAG_INVALID);
 
     if (c->version >= 13) {
         pa_tagstruct_put_proplist(t, source->proplist);
-        pa_tagstruct_put_usec(t, pa_source_get_requested_latency(source));
+        put_live_value(t, e, PA_TAG_USEC, live[1]);
     }
 
     if (c->version >= 15) {
@@ -3297,18 +4019,21 @@ static void source_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_s
         pa_tagstruct_puts(t, source->active_port ? source->active_port->name : NULL);
     }
 
-    if (c->version >= 22) {
-        uint32_t i;
-        pa_format_info *f;
-        pa_idxset *formats = pa_source_get_formats(source);
+    /* Formats may change without an event */
+    if (!e)
+        source_fill_formats(c, t, source);
+}
 
-        pa_tagstruct_putu8(t, (uint8_t) pa_idxset_size(formats));
-        PA_IDXSET_FOREACH(f, formats, i) {
-            pa_tagstruct_put_format_info(t, f);
-        }
+static void source_put_cached(pa_native_connection *c, pa_tagstruct *t, pa_source *source) {
+    info_cache_entry *e;
+    uint64_t live[INFO_CACHE_LIVE_MAX];
 
-        pa_idxset_free(formats, (pa_free_cb_t) pa_format_info_free);
-    }
+    if (info_cache_begin(c, PA_SUBSCRIPTION_EVENT_SOURCE, source->index, &e))
+        source_fill_tagstruct(c, e->data, source, e);
+
+    source_live_values(c, source, live);
+    info_cache_put(t, e, live);
+    source_fill_formats(c, t, source);
 }
 
 static void client_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_client *client) {
@@ -3324,6 +4049,15 @@ static void client_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_c
         pa_tagstruct_put_proplist(t, client->proplist);
 }
 
+static void client_put_cached(pa_native_connection *c, pa_tagstruct *t, pa_client *client) {
+    info_cache_entry *e;
+
+    if (info_cache_begin(c, PA_SUBSCRIPTION_EVENT_CLIENT, client->index, &e))
+        client_fill_tagstruct(c, e->data, client);
+
+    info_cache_put(t, e, NULL);
+}
+
 static void card_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_card *card) {
     void *state = NULL;
     pa_card_profile *p;
@@ -3383,14 +4117,23 @@ static void card_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_car
     }
 }
 
-static void module_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_module *module) {
+static void card_put_cached(pa_native_connection *c, pa_tagstruct *t, pa_card *card) {
+    info_cache_entry *e;
+
+    if (info_cache_begin(c, PA_SUBSCRIPTION_EVENT_CARD, card->index, &e))
+        card_fill_tagstruct(c, e->data, card);
+
+    info_cache_put(t, e, NULL);
+}
+
+static void module_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_module *module, info_cache_entry *e) {
     pa_assert(t);
     pa_assert(module);
 
     pa_tagstruct_putu32(t, module->index);
     pa_tagstruct_puts(t, module->name);
     pa_tagstruct_puts(t, module->argument);
-    pa_tagstruct_putu32(t, (uint32_t) pa_module_get_n_used(module));
+    put_live_value(t, e, PA_TAG_U32, (uint64_t) pa_module_get_n_used(module));
 
     if (c->version < 15)
         pa_tagstruct_put_boolean(t, false); /* autoload is obsolete */
@@ -3399,9 +4142,46 @@ static void module_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_m
         pa_tagstruct_put_proplist(t, module->proplist);
 }
 
-static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sink_input *s) {
-    pa_sample_spec fixed_ss;
+static void module_put_cached(pa_native_connection *c, pa_tagstruct *t, pa_module *module) {
+    info_cache_entry *e;
+    uint64_t live[INFO_CACHE_LIVE_MAX];
+
+    if (info_cache_begin(c, PA_SUBSCRIPTION_EVENT_MODULE, module->index, &e))
+        module_fill_tagstruct(c, e->data, module, e);
+
+    live[0] = (uint64_t) pa_module_get_n_used(module);
+    info_cache_put(t, e, live);
+}
+
+static void render_stats_fill_tagstruct(pa_tagstruct *t, pa_render_stats *s) {
+    pa_render_stage_stats stats[PA_RENDER_STAGE_MAX];
+    unsigned i;
+
+    pa_assert(t);
+    pa_assert(s);
+
+    pa_render_stats_get(s, stats);
+
+    pa_tagstruct_putu32(t, PA_RENDER_STAGE_MAX);
+    for (i = 0; i < PA_RENDER_STAGE_MAX; i++) {
+        pa_tagstruct_putu64(t, stats[i].count);
+        pa_tagstruct_put_usec(t, stats[i].total_usec);
+        pa_tagstruct_put_usec(t, stats[i].max_usec);
+        pa_tagstruct_put_usec(t, pa_render_stage_stats_p99(&stats[i]));
+    }
+}
+
+static void sink_input_live_values(pa_sink_input *s, uint64_t live[INFO_CACHE_LIVE_MAX]) {
     pa_usec_t sink_latency;
+
+    live[0] = pa_sink_input_get_latency(s, &sink_latency);
+    live[1] = sink_latency;
+}
+
+/* If e is given, only the part to cache is filled in */
+static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_sink_input *s, info_cache_entry *e) {
+    pa_sample_spec fixed_ss;
+    uint64_t live[INFO_CACHE_LIVE_MAX];
     pa_cvolume v;
     bool has_volume = false;
 
@@ -3410,6 +4190,12 @@ static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t,
 
     fixup_sample_spec(c, &fixed_ss, &s->sample_spec);
 
+    /* The values put into the cache are replaced when sending anyway */
+    if (e)
+        memset(live, 0, sizeof(live));
+    else
+        sink_input_live_values(s, live);
+
     has_volume = pa_sink_input_is_volume_readable(s);
     if (has_volume)
         pa_sink_input_get_volume(s, &v, true);
@@ -3424,8 +4210,8 @@ static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t,
     pa_tagstruct_put_sample_spec(t, &fixed_ss);
     pa_tagstruct_put_channel_map(t, &s->channel_map);
     pa_tagstruct_put_cvolume(t, &v);
-    pa_tagstruct_put_usec(t, pa_sink_input_get_latency(s, &sink_latency));
-    pa_tagstruct_put_usec(t, sink_latency);
+    put_live_value(t, e, PA_TAG_USEC, live[0]);
+    put_live_value(t, e, PA_TAG_USEC, live[1]);
     pa_tagstruct_puts(t, pa_resample_method_to_string(pa_sink_input_get_resample_method(s)));
     pa_tagstruct_puts(t, s->driver);
     if (c->version >= 11)
@@ -3440,11 +4226,35 @@ static void sink_input_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t,
     }
     if (c->version >= 21)
         pa_tagstruct_put_format_info(t, s->format);
+    if (c->version >= 36 && !e)
+        render_stats_fill_tagstruct(t, s->render_stats);
 }
 
-static void source_output_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_source_output *s) {
-    pa_sample_spec fixed_ss;
+static void sink_input_put_cached(pa_native_connection *c, pa_tagstruct *t, pa_sink_input *s) {
+    info_cache_entry *e;
+    uint64_t live[INFO_CACHE_LIVE_MAX];
+
+    if (info_cache_begin(c, PA_SUBSCRIPTION_EVENT_SINK_INPUT, s->index, &e))
+        sink_input_fill_tagstruct(c, e->data, s, e);
+
+    sink_input_live_values(s, live);
+    info_cache_put(t, e, live);
+
+    if (c->version >= 36)
+        render_stats_fill_tagstruct(t, s->render_stats);
+}
+
+static void source_output_live_values(pa_source_output *s, uint64_t live[INFO_CACHE_LIVE_MAX]) {
     pa_usec_t source_latency;
+
+    live[0] = pa_source_output_get_latency(s, &source_latency);
+    live[1] = source_latency;
+}
+
+/* If e is given, only the part to cache is filled in */
+static void source_output_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_source_output *s, info_cache_entry *e) {
+    pa_sample_spec fixed_ss;
+    uint64_t live[INFO_CACHE_LIVE_MAX];
     pa_cvolume v;
     bool has_volume = false;
 
@@ -3453,6 +4263,12 @@ static void source_output_fill_tagstruct(pa_native_connection *c, pa_tagstruct *
 
     fixup_sample_spec(c, &fixed_ss, &s->sample_spec);
 
+    /* The values put into the cache are replaced when sending anyway */
+    if (e)
+        memset(live, 0, sizeof(live));
+    else
+        source_output_live_values(s, live);
+
     has_volume = pa_source_output_is_volume_readable(s);
     if (has_volume)
         pa_source_output_get_volume(s, &v, true);
@@ -3466,8 +4282,8 @@ static void source_output_fill_tagstruct(pa_native_connection *c, pa_tagstruct *
     pa_tagstruct_putu32(t, s->source->index);
     pa_tagstruct_put_sample_spec(t, &fixed_ss);
     pa_tagstruct_put_channel_map(t, &s->channel_map);
-    pa_tagstruct_put_usec(t, pa_source_output_get_latency(s, &source_latency));
-    pa_tagstruct_put_usec(t, source_latency);
+    put_live_value(t, e, PA_TAG_USEC, live[0]);
+    put_live_value(t, e, PA_TAG_USEC, live[1]);
     pa_tagstruct_puts(t, pa_resample_method_to_string(pa_source_output_get_resample_method(s)));
     pa_tagstruct_puts(t, s->driver);
     if (c->version >= 13)
@@ -3481,6 +4297,22 @@ static void source_output_fill_tagstruct(pa_native_connection *c, pa_tagstruct *
         pa_tagstruct_put_boolean(t, s->volume_writable);
         pa_tagstruct_put_format_info(t, s->format);
     }
+    if (c->version >= 36 && !e)
+        render_stats_fill_tagstruct(t, s->render_stats);
+}
+
+static void source_output_put_cached(pa_native_connection *c, pa_tagstruct *t, pa_source_output *s) {
+    info_cache_entry *e;
+    uint64_t live[INFO_CACHE_LIVE_MAX];
+
+    if (info_cache_begin(c, PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT, s->index, &e))
+        source_output_fill_tagstruct(c, e->data, s, e);
+
+    source_output_live_values(s, live);
+    info_cache_put(t, e, live);
+
+    if (c->version >= 36)
+        render_stats_fill_tagstruct(t, s->render_stats);
 }
 
 static void scache_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_scache_entry *e) {
@@ -3593,19 +4425,19 @@ static void command_get_info(pa_pdispatch *pd, uint32_t command, uint32_t tag, p
 
     reply = reply_new(tag);
     if (sink)
-        sink_fill_tagstruct(c, reply, sink);
+        sink_fill_tagstruct(c, reply, sink, NULL);
     else if (source)
-        source_fill_tagstruct(c, reply, source);
+        source_fill_tagstruct(c, reply, source, NULL);
     else if (client)
         client_fill_tagstruct(c, reply, client);
     else if (card)
         card_fill_tagstruct(c, reply, card);
     else if (module)
-        module_fill_tagstruct(c, reply, module);
+        module_fill_tagstruct(c, reply, module, NULL);
     else if (si)
-        sink_input_fill_tagstruct(c, reply, si);
+        sink_input_fill_tagstruct(c, reply, si, NULL);
     else if (so)
-        source_output_fill_tagstruct(c, reply, so);
+        source_output_fill_tagstruct(c, reply, so, NULL);
     else
         scache_fill_tagstruct(c, reply, sce);
     pa_pstream_send_tagstruct(c->pstream, reply);
@@ -3652,19 +4484,19 @@ static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t t
     if (i) {
         PA_IDXSET_FOREACH(p, i, idx) {
             if (command == PA_COMMAND_GET_SINK_INFO_LIST)
-                sink_fill_tagstruct(c, reply, p);
+                sink_put_cached(c, reply, p);
             else if (command == PA_COMMAND_GET_SOURCE_INFO_LIST)
-                source_fill_tagstruct(c, reply, p);
+                source_put_cached(c, reply, p);
             else if (command == PA_COMMAND_GET_CLIENT_INFO_LIST)
-                client_fill_tagstruct(c, reply, p);
+                client_put_cached(c, reply, p);
             else if (command == PA_COMMAND_GET_CARD_INFO_LIST)
-                card_fill_tagstruct(c, reply, p);
+                card_put_cached(c, reply, p);
             else if (command == PA_COMMAND_GET_MODULE_INFO_LIST)
-                module_fill_tagstruct(c, reply, p);
+                module_put_cached(c, reply, p);
             else if (command == PA_COMMAND_GET_SINK_INPUT_INFO_LIST)
-                sink_input_fill_tagstruct(c, reply, p);
+                sink_input_put_cached(c, reply, p);
             else if (command == PA_COMMAND_GET_SOURCE_OUTPUT_INFO_LIST)
-                source_output_fill_tagstruct(c, reply, p);
+                source_output_put_cached(c, reply, p);
             else {
                 pa_assert(command == PA_COMMAND_GET_SAMPLE_INFO_LIST);
                 scache_fill_tagstruct(c, reply, p);
@@ -3720,28 +4552,158 @@ static void command_get_server_info(pa_pdispatch *pd, uint32_t command, uint32_t
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
+/* Events are the same object if facility and index match */
+static unsigned pending_event_hash_func(const void *p) {
+    const pending_event *e = p;
+
+    return (unsigned) (e->type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) * 31U + e->index;
+}
+
+static int pending_event_compare_func(const void *a, const void *b) {
+    const pending_event *x = a, *y = b;
+
+    if ((x->type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) != (y->type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK))
+        return (x->type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) < (y->type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) ? -1 : 1;
+
+    return x->index < y->index ? -1 : (x->index > y->index ? 1 : 0);
+}
+
+/* Called from main context */
+static void pending_events_free(pa_native_connection *c) {
+    pending_event *e;
+
+    pa_hashmap_remove_all(c->pending_events_by_object);
+
+    while ((e = c->pending_events)) {
+        PA_LLIST_REMOVE(pending_event, c->pending_events, e);
+        pa_xfree(e);
+    }
+
+    c->pending_events_tail = NULL;
+    c->n_pending_events = 0;
+}
+
+/* Called from main context */
+static void subscription_flush(pa_native_connection *c) {
+    pa_tagstruct *t = NULL;
+    pending_event *e;
+    unsigned n = 0;
+
+    pa_native_connection_assert_ref(c);
+
+    PA_LLIST_FOREACH(e, c->pending_events) {
+
+        if (c->version < 37) {
+            t = pa_tagstruct_new();
+            pa_tagstruct_putu32(t, PA_COMMAND_SUBSCRIBE_EVENT);
+            pa_tagstruct_putu32(t, (uint32_t) -1);
+            pa_tagstruct_putu32(t, e->type);
+            pa_tagstruct_putu32(t, e->index);
+            pa_pstream_send_tagstruct(c->pstream, t);
+            t = NULL;
+            continue;
+        }
+
+        if (!t) {
+            t = pa_tagstruct_new();
+            pa_tagstruct_putu32(t, PA_COMMAND_SUBSCRIBE_EVENT_BATCH);
+            pa_tagstruct_putu32(t, (uint32_t) -1);
+        }
+
+        pa_tagstruct_putu32(t, e->type);
+        pa_tagstruct_putu32(t, e->index);
+
+        if (++n >= SUBSCRIBE_BATCH_MAX) {
+            pa_pstream_send_tagstruct(c->pstream, t);
+            t = NULL;
+            n = 0;
+        }
+    }
+
+    if (t)
+        pa_pstream_send_tagstruct(c->pstream, t);
+
+    pending_events_free(c);
+    c->subscription_last_flush = pa_rtclock_now();
+}
+
+static void subscription_flush_cb(pa_mainloop_api *m, const pa_time_event *e, const struct timeval *t, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(c->subscription_flush_event == e);
+
+    subscription_flush(c);
+}
+
 static void subscription_cb(pa_core *core, pa_subscription_event_type_t e, uint32_t idx, void *userdata) {
-    pa_tagstruct *t;
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    pending_event key, *p;
+    pa_usec_t when;
 
     pa_native_connection_assert_ref(c);
 
-    t = pa_tagstruct_new();
-    pa_tagstruct_putu32(t, PA_COMMAND_SUBSCRIBE_EVENT);
-    pa_tagstruct_putu32(t, (uint32_t) -1);
-    pa_tagstruct_putu32(t, e);
-    pa_tagstruct_putu32(t, idx);
-    pa_pstream_send_tagstruct(c->pstream, t);
+    if (!pa_subscription_match_type(c->subscription_types, e))
+        return;
+
+    key.type = e;
+    key.index = idx;
+
+    if ((p = pa_hashmap_get(c->pending_events_by_object, &key))) {
+        switch (e & PA_SUBSCRIPTION_EVENT_TYPE_MASK) {
+            case PA_SUBSCRIPTION_EVENT_CHANGE:
+                /* The client will look at the object anyway */
+                if ((p->type & PA_SUBSCRIPTION_EVENT_TYPE_MASK) != PA_SUBSCRIPTION_EVENT_REMOVE)
+                    return;
+                break;
+
+            case PA_SUBSCRIPTION_EVENT_REMOVE:
+                /* Nothing else matters once the object is gone. If the
+                 * client never heard of it, it will ignore this. */
+                p->type = e;
+                return;
+
+            default:
+                break;
+        }
+
+        pa_hashmap_remove(c->pending_events_by_object, p);
+    }
+
+    p = pa_xnew(pending_event, 1);
+    p->type = e;
+    p->index = idx;
+
+    PA_LLIST_INSERT_AFTER(pending_event, c->pending_events, c->pending_events_tail, p);
+    c->pending_events_tail = p;
+    pa_assert_se(pa_hashmap_put(c->pending_events_by_object, p, p) >= 0);
+
+    if (c->n_pending_events++ > 0)
+        return;
+
+    /* Events posted in the same main loop iteration always go out
+     * together, beyond that the interval limits the rate */
+    when = PA_MAX(pa_rtclock_now(), c->subscription_last_flush + c->subscription_interval);
+
+    if (!c->subscription_flush_event)
+        c->subscription_flush_event = pa_core_rttime_new(c->protocol->core, when, subscription_flush_cb, c);
+    else
+        pa_core_rttime_restart(c->protocol->core, c->subscription_flush_event, when);
 }
 
 static void command_subscribe(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     pa_subscription_mask_t m;
+    uint32_t types = PA_SUBSCRIPTION_TYPE_MASK_ALL;
+    pa_usec_t interval = 0;
 
     pa_native_connection_assert_ref(c);
     pa_assert(t);
 
     if (pa_tagstruct_getu32(t, &m) < 0 ||
+        (c->version >= 37 &&
+         (pa_tagstruct_getu32(t, &types) < 0 ||
+          pa_tagstruct_get_usec(t, &interval) < 0)) ||
         !pa_tagstruct_eof(t)) {
         protocol_error(c);
         return;
@@ -3749,6 +4711,14 @@ static void command_subscribe(pa_pdispatch *pd, uint32_t command, uint32_t tag,
 
     CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
     CHECK_VALIDITY(c->pstream, (m & ~PA_SUBSCRIPTION_MASK_ALL) == 0, tag, PA_ERR_INVALID);
+    CHECK_VALIDITY(c->pstream, (types & ~PA_SUBSCRIPTION_TYPE_MASK_ALL) == 0, tag, PA_ERR_INVALID);
+
+    /* What was queued for the old subscription still goes out first */
+    if (c->n_pending_events > 0)
+        subscription_flush(c);
+
+    c->subscription_types = types;
+    c->subscription_interval = PA_CLAMP(interval, c->options->subscribe_interval, MAX_SUBSCRIBE_INTERVAL);
 
     if (c->subscription)
         pa_subscription_free(c->subscription);
@@ -4060,6 +5030,15 @@ static void command_flush_record_stream(pa_pdispatch *pd, uint32_t command, uint
     CHECK_VALIDITY(c->pstream, s, tag, PA_ERR_NOENTITY);
 
     pa_memblockq_flush_read(s->memblockq);
+
+    if (s->transport_queue) {
+        pa_queue_free(s->transport_queue, transport_chunk_free);
+        s->transport_queue = pa_queue_new();
+
+        /* What the encoder keeps back must not go in front of new data */
+        pa_asyncmsgq_send(s->source_output->source->asyncmsgq, PA_MSGOBJECT(s->source_output), SOURCE_OUTPUT_MESSAGE_RESET_ENCODER, NULL, 0, NULL);
+    }
+
     pa_pstream_send_simple_ack(c->pstream, tag);
 }
 
@@ -5058,9 +6037,16 @@ static void pstream_packet_callback(pa_pstream *p, pa_packet *packet, pa_cmsg_an
 
 static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
-    output_stream *stream;
 
     pa_assert(p);
+
+    handle_memblock(c, channel, offset, seek, chunk, pa_pstream_memblock_is_encoded(p));
+}
+
+/* Called from main context */
+static void handle_memblock(pa_native_connection *c, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, bool encoded) {
+    output_stream *stream;
+
     pa_assert(chunk);
     pa_native_connection_assert_ref(c);
 
@@ -5076,8 +6062,21 @@ static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t o
 
     if (playback_stream_isinstance(stream)) {
         playback_stream *ps = PLAYBACK_STREAM(stream);
+        size_t frame_size;
 
-        size_t frame_size = pa_frame_size(&ps->sink_input->sample_spec);
+        if (encoded) {
+            /* The decoder keeps data back, seeking doesn't work with it */
+            if (!ps->transport_decoder || !chunk->memblock || seek != PA_SEEK_RELATIVE || offset != 0) {
+                pa_log_warn("Client sent encoded block the stream can't take.");
+                return;
+            }
+
+            pa_atomic_inc(&ps->seek_or_post_in_queue);
+            pa_asyncmsgq_post(ps->sink_input->sink->asyncmsgq, PA_MSGOBJECT(ps->sink_input), SINK_INPUT_MESSAGE_POST_ENCODED, NULL, 0, chunk, NULL);
+            return;
+        }
+
+        frame_size = pa_frame_size(&ps->sink_input->sample_spec);
         if (chunk->length % frame_size != 0) {
             pa_log_warn("Client sent non-aligned memblock: length %d, frame size: %d",
                         (int) chunk->length, (int) frame_size);
@@ -5097,6 +6096,11 @@ static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t o
         upload_stream *u = UPLOAD_STREAM(stream);
         size_t l;
 
+        if (encoded) {
+            pa_log_warn("Client sent encoded block for upload stream.");
+            return;
+        }
+
         if (!u->memchunk.memblock) {
             if (u->length == chunk->length && chunk->memblock) {
                 u->memchunk = *chunk;
@@ -5174,6 +6178,257 @@ static void pstream_release_callback(pa_pstream *p, uint32_t block_id, void *use
         pa_asyncmsgq_post(q->outq, PA_MSGOBJECT(userdata), CONNECTION_MESSAGE_RELEASE, PA_UINT_TO_PTR(block_id), 0, NULL, NULL);
 }
 
+/*** IO thread ***/
+
+struct io_thread_attach {
+    pa_native_connection *connection;
+    int ifd, ofd;
+    pa_pstream *pstream;
+};
+
+static void packet_msg_free(void *userdata) {
+    packet_msg *m = userdata;
+
+    pa_packet_unref(m->packet);
+    pa_xfree(m);
+}
+
+static void memblock_msg_free(void *userdata) {
+    memblock_msg *m = userdata;
+
+    if (m->chunk.memblock)
+        pa_memblock_unref(m->chunk.memblock);
+
+    pa_xfree(m);
+}
+
+/* Called from IO thread context */
+static void io_thread_packet_callback(pa_pstream *p, pa_packet *packet, pa_cmsg_ancil_data *ancil_data, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    packet_msg *m;
+
+    pa_assert(p);
+    pa_assert(packet);
+
+    m = pa_xnew(packet_msg, 1);
+    m->packet = pa_packet_ref(packet);
+#ifdef HAVE_CREDS
+    /* The fds are passed on as they are, the pstream doesn't close them */
+    m->ancil_data = *ancil_data;
+#endif
+
+    pa_asyncmsgq_post(c->io_thread->thread_mq.outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_PACKET, m, 0, NULL, packet_msg_free);
+}
+
+/* Called from IO thread context */
+static void io_thread_memblock_callback(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    memblock_msg *m;
+
+    pa_assert(p);
+    pa_assert(chunk);
+
+    /* Holes come without a memblock, which the message queue can't carry on
+     * its own, hence the chunk travels in the message */
+    m = pa_xnew(memblock_msg, 1);
+    m->channel = channel;
+    m->seek = seek;
+    m->chunk = *chunk;
+    m->encoded = pa_pstream_memblock_is_encoded(p);
+    if (m->chunk.memblock)
+        pa_memblock_ref(m->chunk.memblock);
+
+    pa_asyncmsgq_post(c->io_thread->thread_mq.outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_MEMBLOCK, m, offset, NULL, memblock_msg_free);
+}
+
+/* Called from IO thread context */
+static void io_thread_die_callback(pa_pstream *p, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+
+    pa_asyncmsgq_post(c->io_thread->thread_mq.outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_DIE, NULL, 0, NULL, NULL);
+}
+
+/* Called from IO thread context */
+static void io_thread_drain_callback(pa_pstream *p, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+
+    pa_asyncmsgq_post(c->io_thread->thread_mq.outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_DRAIN, NULL, 0, NULL, NULL);
+}
+
+/* Called from IO thread context */
+static int io_thread_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
+    io_thread *t = IO_THREAD(o);
+
+    io_thread_assert_ref(t);
+
+    switch (code) {
+
+        case IO_THREAD_MESSAGE_ATTACH: {
+            struct io_thread_attach *a = userdata;
+            pa_mainloop_api *api = pa_mainloop_get_api(t->mainloop);
+            pa_iochannel *io;
+
+            io = pa_iochannel_new(api, a->ifd, a->ofd);
+
+            if (!(a->pstream = pa_pstream_new_threaded(api, io, a->connection->protocol->core->mempool))) {
+                pa_iochannel_set_noclose(io, true);
+                pa_iochannel_free(io);
+                return -1;
+            }
+
+            /* Releases and revokes aren't set up here, since the pstream
+             * can send them on its own from whatever thread they come */
+            pa_pstream_set_receive_packet_callback(a->pstream, io_thread_packet_callback, a->connection);
+            pa_pstream_set_receive_memblock_callback(a->pstream, io_thread_memblock_callback, a->connection);
+            pa_pstream_set_die_callback(a->pstream, io_thread_die_callback, a->connection);
+            pa_pstream_set_drain_callback(a->pstream, io_thread_drain_callback, a->connection);
+
+            return 0;
+        }
+
+        case IO_THREAD_MESSAGE_NEW_SRBCHANNEL: {
+            struct io_thread_srbchannel *s = userdata;
+
+            s->srb = pa_srbchannel_new(pa_mainloop_get_api(t->mainloop), s->pool);
+            return 0;
+        }
+
+        case IO_THREAD_MESSAGE_SET_SRBCHANNEL: {
+            struct io_thread_srbchannel *s = userdata;
+
+            pa_pstream_set_srbchannel(s->pstream, s->srb);
+            return 0;
+        }
+
+        case IO_THREAD_MESSAGE_FREE_SRBCHANNEL: {
+            struct io_thread_srbchannel *s = userdata;
+
+            pa_srbchannel_free(s->srb);
+            return 0;
+        }
+
+        case IO_THREAD_MESSAGE_SHUTDOWN:
+            t->shutdown = true;
+            return 0;
+    }
+
+    return 0;
+}
+
+static void io_thread_func(void *userdata) {
+    io_thread *t = userdata;
+
+    pa_assert(t);
+
+    pa_log_debug("IO thread starting up");
+
+    pa_thread_mq_install(&t->thread_mq);
+
+    while (!t->shutdown)
+        if (pa_mainloop_iterate(t->mainloop, 1, NULL) < 0)
+            break;
+
+    /* Let go of the IO of the connections that were unlinked last */
+    while (pa_mainloop_iterate(t->mainloop, 0, NULL) > 0)
+        ;
+
+    pa_log_debug("IO thread shutting down");
+}
+
+/* Called from main context */
+static io_thread *io_thread_new(pa_native_protocol *p, unsigned n) {
+    io_thread *t;
+    char name[16];
+
+    t = pa_msgobject_new(io_thread);
+    t->parent.process_msg = io_thread_process_msg;
+    t->shutdown = false;
+    t->n_connections = 0;
+    t->mainloop = pa_mainloop_new();
+
+    if (pa_thread_mq_init_thread_mainloop(&t->thread_mq, p->core->mainloop, pa_mainloop_get_api(t->mainloop)) < 0) {
+        pa_log("pa_thread_mq_init_thread_mainloop() failed.");
+        goto fail;
+    }
+
+    pa_snprintf(name, sizeof(name), "native-io-%u", n);
+
+    if (!(t->thread = pa_thread_new(name, io_thread_func, t))) {
+        pa_log("Failed to create IO thread.");
+        pa_thread_mq_done(&t->thread_mq);
+        goto fail;
+    }
+
+    return t;
+
+fail:
+    pa_mainloop_free(t->mainloop);
+    io_thread_unref(t);
+
+    return NULL;
+}
+
+/* Called from main context */
+static void io_thread_free(io_thread *t) {
+    io_thread_assert_ref(t);
+
+    pa_asyncmsgq_send(t->thread_mq.inq, PA_MSGOBJECT(t), IO_THREAD_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+    pa_thread_free(t->thread);
+
+    pa_thread_mq_done(&t->thread_mq);
+    pa_mainloop_free(t->mainloop);
+
+    io_thread_unref(t);
+}
+
+/* Called from main context. Returns the IO thread a new connection is to be
+ * served by, or NULL if the main thread serves it. */
+static io_thread *io_thread_get(pa_native_protocol *p, pa_native_options *o) {
+    io_thread *t, *best = NULL;
+    unsigned i;
+
+    if (o->io_threads <= 0)
+        return NULL;
+
+    /* Threads are only started once a connection needs them */
+    while (pa_dynarray_size(p->io_threads) < o->io_threads) {
+        if (!(t = io_thread_new(p, pa_dynarray_size(p->io_threads))))
+            break;
+
+        pa_dynarray_append(p->io_threads, t);
+    }
+
+    PA_DYNARRAY_FOREACH(t, p->io_threads, i)
+        if (!best || t->n_connections < best->n_connections)
+            best = t;
+
+    return best;
+}
+
+/* Called from main context. Hands the fds of io over to t, and frees io if
+ * that worked out. */
+static pa_pstream *io_thread_attach(io_thread *t, pa_native_connection *c, pa_iochannel *io) {
+    struct io_thread_attach a;
+
+    a.connection = c;
+    a.ifd = pa_iochannel_get_recv_fd(io);
+    a.ofd = pa_iochannel_get_send_fd(io);
+    a.pstream = NULL;
+
+    if (pa_asyncmsgq_send(t->thread_mq.inq, PA_MSGOBJECT(t), IO_THREAD_MESSAGE_ATTACH, &a, 0, NULL) < 0) {
+        pa_log_warn("Failed to hand connection over to IO thread, serving it from the main thread.");
+        return NULL;
+    }
+
+    pa_iochannel_set_noclose(io, true);
+    pa_iochannel_free(io);
+
+    c->io_thread = t;
+    t->n_connections++;
+
+    return a.pstream;
+}
+
 /*** client callbacks ***/
 
 static void client_kill_cb(pa_client *c) {
@@ -5222,13 +6477,18 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
     char pname[128];
     pa_client *client;
     pa_client_new_data data;
+    io_thread *t;
+    unsigned max_connections;
 
     pa_assert(p);
     pa_assert(io);
     pa_assert(o);
 
-    if (pa_idxset_size(p->connections)+1 > MAX_CONNECTIONS) {
-        pa_log_warn("Warning! Too many connections (%u), dropping incoming connection.", MAX_CONNECTIONS);
+    t = io_thread_get(p, o);
+
+    max_connections = MAX_CONNECTIONS + pa_dynarray_size(p->io_threads) * MAX_IO_THREAD_CONNECTIONS;
+    if (pa_idxset_size(p->connections)+1 > max_connections) {
+        pa_log_warn("Warning! Too many connections (%u), dropping incoming connection.", max_connections);
         pa_iochannel_free(io);
         return;
     }
@@ -5249,6 +6509,7 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
     c->parent.parent.free = native_connection_free;
     c->parent.process_msg = native_connection_process_msg;
     c->protocol = p;
+    c->io_thread = NULL;
     c->options = pa_native_options_ref(o);
     c->authorized = false;
     c->srbpending = NULL;
@@ -5281,13 +6542,20 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
 
     c->rw_mempool = NULL;
 
-    c->pstream = pa_pstream_new(p->core->mainloop, io, p->core->mempool);
-    pa_pstream_set_receive_packet_callback(c->pstream, pstream_packet_callback, c);
-    pa_pstream_set_receive_memblock_callback(c->pstream, pstream_memblock_callback, c);
-    pa_pstream_set_die_callback(c->pstream, pstream_die_callback, c);
-    pa_pstream_set_drain_callback(c->pstream, pstream_drain_callback, c);
-    pa_pstream_set_revoke_callback(c->pstream, pstream_revoke_callback, c);
-    pa_pstream_set_release_callback(c->pstream, pstream_release_callback, c);
+#ifdef HAVE_CREDS
+    if (pa_iochannel_creds_supported(io))
+        pa_iochannel_creds_enable(io);
+#endif
+
+    if (!t || !(c->pstream = io_thread_attach(t, c, io))) {
+        c->pstream = pa_pstream_new(p->core->mainloop, io, p->core->mempool);
+        pa_pstream_set_receive_packet_callback(c->pstream, pstream_packet_callback, c);
+        pa_pstream_set_receive_memblock_callback(c->pstream, pstream_memblock_callback, c);
+        pa_pstream_set_die_callback(c->pstream, pstream_die_callback, c);
+        pa_pstream_set_drain_callback(c->pstream, pstream_drain_callback, c);
+        pa_pstream_set_revoke_callback(c->pstream, pstream_revoke_callback, c);
+        pa_pstream_set_release_callback(c->pstream, pstream_release_callback, c);
+    }
 
     c->pdispatch = pa_pdispatch_new(p->core->mainloop, true, command_table, PA_COMMAND_MAX);
 
@@ -5297,12 +6565,16 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
     c->rrobin_index = PA_IDXSET_INVALID;
     c->subscription = NULL;
 
-    pa_idxset_put(p->connections, c, NULL);
+    PA_LLIST_HEAD_INIT(pending_event, c->pending_events);
+    c->pending_events_tail = NULL;
+    c->pending_events_by_object = pa_hashmap_new(pending_event_hash_func, pending_event_compare_func);
+    c->n_pending_events = 0;
+    c->subscription_flush_event = NULL;
+    c->subscription_interval = 0;
+    c->subscription_last_flush = 0;
+    c->subscription_types = PA_SUBSCRIPTION_TYPE_MASK_ALL;
 
-#ifdef HAVE_CREDS
-    if (pa_iochannel_creds_supported(io))
-        pa_iochannel_creds_enable(io);
-#endif
+    pa_idxset_put(p->connections, c, NULL);
 
     pa_hook_fire(&p->hooks[PA_NATIVE_HOOK_CONNECTION_PUT], c);
 }
@@ -5334,6 +6606,11 @@ static pa_native_protocol* native_protocol_new(pa_core *c) {
 
     p->extensions = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
 
+    p->io_threads = pa_dynarray_new((pa_free_cb_t) io_thread_free);
+
+    memset(p->info_cache, 0, sizeof(p->info_cache));
+    p->subscription_post_slot = pa_hook_connect(&c->hooks[PA_CORE_HOOK_SUBSCRIPTION_POST], PA_HOOK_NORMAL, (pa_hook_cb_t) subscription_post_cb, p);
+
     for (h = 0; h < PA_NATIVE_HOOK_MAX; h++)
         pa_hook_init(&p->hooks[h], p);
 
@@ -5363,6 +6640,7 @@ pa_native_protocol* pa_native_protocol_ref(pa_native_protocol *p) {
 void pa_native_protocol_unref(pa_native_protocol *p) {
     pa_native_connection *c;
     pa_native_hook_t h;
+    unsigned i;
 
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) >= 1);
@@ -5375,6 +6653,14 @@ void pa_native_protocol_unref(pa_native_protocol *p) {
 
     pa_idxset_free(p->connections, NULL);
 
+    pa_dynarray_free(p->io_threads);
+
+    pa_hook_slot_free(p->subscription_post_slot);
+
+    for (i = 0; i < PA_ELEMENTSOF(p->info_cache); i++)
+        if (p->info_cache[i])
+            pa_hashmap_free(p->info_cache[i]);
+
     pa_strlist_free(p->servers);
 
     for (h = 0; h < PA_NATIVE_HOOK_MAX; h++)
@@ -5479,6 +6765,7 @@ void pa_native_options_unref(pa_native_options *o) {
 int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
     bool enabled;
     const char *acl;
+    uint32_t interval_msec;
 
     pa_assert(o);
     pa_assert(PA_REFCNT_VALUE(o) >= 1);
@@ -5490,6 +6777,20 @@ int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
         return -1;
     }
 
+    o->io_threads = 0;
+    if (pa_modargs_get_value_u32(ma, "io-threads", &o->io_threads) < 0) {
+        pa_log("io-threads= expects a number.");
+        return -1;
+    }
+
+    interval_msec = DEFAULT_SUBSCRIBE_INTERVAL_MSEC;
+    if (pa_modargs_get_value_u32(ma, "subscribe-interval-msec", &interval_msec) < 0 ||
+        interval_msec * PA_USEC_PER_MSEC > MAX_SUBSCRIBE_INTERVAL) {
+        pa_log("subscribe-interval-msec= expects a number of milliseconds, at most %u.", (unsigned) (MAX_SUBSCRIBE_INTERVAL / PA_USEC_PER_MSEC));
+        return -1;
+    }
+    o->subscribe_interval = interval_msec * PA_USEC_PER_MSEC;
+
     if (pa_modargs_get_value_boolean(ma, "auth-anonymous", &o->auth_anonymous) < 0) {
         pa_log("auth-anonymous= expects a boolean argument.");
         return -1;
@@ -42,6 +42,13 @@ typedef struct pa_native_options {
     bool auth_anonymous;
     bool srbchannel;
 
+    /* Number of threads doing the IO of the connections, 0 to do it in the
+     * main thread */
+    uint32_t io_threads;
+
+    /* Subscription events are sent to each client at most this often */
+    pa_usec_t subscribe_interval;
+
     pa_module *module;
 
     char *auth_group;
@@ -37,6 +37,7 @@
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/idxset.h>
+#include <pulsecore/hashmap.h>
 #include <pulsecore/socket.h>
 #include <pulsecore/queue.h>
 #include <pulsecore/log.h>
@@ -44,6 +45,9 @@
 #include <pulsecore/refcnt.h>
 #include <pulsecore/flist.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/thread.h>
 
 #include "pstream.h"
 
@@ -55,6 +59,8 @@
 #define PA_FLAG_SHMMASK     0xFF000000LU
 #define PA_FLAG_SEEKMASK    0x000000FFLU
 #define PA_FLAG_SHMWRITABLE 0x00800000LU
+/* The payload was transformed by the encoder set for the channel */
+#define PA_FLAG_ENCODED     0x00400000LU
 
 /* The sequence descriptor header consists of 5 32bit integers: */
 enum {
@@ -97,7 +103,8 @@ struct item_info {
         PA_PSTREAM_ITEM_PACKET,
         PA_PSTREAM_ITEM_MEMBLOCK,
         PA_PSTREAM_ITEM_SHMRELEASE,
-        PA_PSTREAM_ITEM_SHMREVOKE
+        PA_PSTREAM_ITEM_SHMREVOKE,
+        PA_PSTREAM_ITEM_FLUSH_ENCODER /* never sent, see pa_pstream_flush_encoder() */
     } type;
 
     /* packet info */
@@ -112,6 +119,10 @@ struct item_info {
     uint32_t channel;
     int64_t offset;
     pa_seek_mode_t seek_mode;
+    bool encoded;
+
+    /* encoder flush info */
+    bool discard;
 
     /* release/revoke info */
     uint32_t block_id;
@@ -188,12 +199,38 @@ struct pa_pstream {
 
     pa_mempool *mempool;
 
+    /* channel -> pa_pstream_codec, created on first use */
+    pa_hashmap *encoders, *decoders;
+
+    /* Set while an encoded memblock is passed on undecoded */
+    bool receiving_encoded;
+
 #ifdef HAVE_CREDS
     pa_cmsg_ancil_data read_ancil_data, *write_ancil_data;
     bool send_ancil_data_now;
 #endif
+
+    /* Only used by threaded pstreams, see pa_pstream_new_threaded(). The
+     * mutex protects everything but the incoming queue. That one has a lock
+     * of its own, since items may be queued from any thread, even with other
+     * locks held. The kick semaphore wakes up the IO thread to take them. */
+    pa_thread *thread;
+    pa_mutex *mutex, *incoming_mutex;
+    pa_queue *incoming;
+    pa_fdsem *kick;
+    pa_io_event *kick_event;
 };
 
+static void pstream_lock(pa_pstream *p) {
+    if (p->mutex)
+        pa_mutex_lock(p->mutex);
+}
+
+static void pstream_unlock(pa_pstream *p) {
+    if (p->mutex)
+        pa_mutex_unlock(p->mutex);
+}
+
 #ifdef HAVE_CREDS
 /*
  * memfd-backed SHM pools blocks transfer occur without passing the pool's
@@ -246,15 +283,103 @@ void pa_cmsg_ancil_data_close_fds(struct pa_cmsg_ancil_data *ancil) {
 
 static int do_write(pa_pstream *p);
 static int do_read(pa_pstream *p, struct pstream_read *re);
+static bool item_encode(pa_pstream *p, struct item_info *i, struct item_info **before);
+static struct item_info *encoder_flush(pa_pstream *p, uint32_t channel, bool discard);
+static void item_free(void *item);
+
+/* Called from IO context, with the lock held. Returns true if the reference
+ * of the IO thread has to be dropped, which may only happen after unlocking. */
+static bool release_io(pa_pstream *p) {
+    if (p->is_srbpending) {
+        if (p->srbpending)
+            pa_srbchannel_free(p->srbpending);
+
+        p->srbpending = NULL;
+        p->is_srbpending = false;
+    }
+
+    if (p->srb) {
+        pa_srbchannel_free(p->srb);
+        p->srb = NULL;
+    }
+
+    if (p->io) {
+        pa_iochannel_free(p->io);
+        p->io = NULL;
+    }
+
+    if (p->defer_event) {
+        p->mainloop->defer_free(p->defer_event);
+        p->defer_event = NULL;
+    }
+
+    if (p->kick_event) {
+        p->mainloop->io_free(p->kick_event);
+        p->kick_event = NULL;
+        return true;
+    }
+
+    return false;
+}
+
+/* Called from IO context, with the lock held. Moves what other threads
+ * queued over to the send queue, and encodes it on the way. */
+static void take_incoming(pa_pstream *p) {
+    struct item_info *i;
+
+    for (;;) {
+        struct item_info *before = NULL;
+
+        pa_mutex_lock(p->incoming_mutex);
+        i = pa_queue_pop(p->incoming);
+        pa_mutex_unlock(p->incoming_mutex);
+
+        if (!i)
+            break;
+
+        if (i->type == PA_PSTREAM_ITEM_FLUSH_ENCODER) {
+            before = encoder_flush(p, i->channel, i->discard);
+            item_free(i);
+
+            if (before)
+                pa_queue_push(p->send_queue, before);
+
+            continue;
+        }
+
+        if (i->type == PA_PSTREAM_ITEM_MEMBLOCK && !item_encode(p, i, &before)) {
+            item_free(i);
+            continue;
+        }
+
+        if (before)
+            pa_queue_push(p->send_queue, before);
+
+        pa_queue_push(p->send_queue, i);
+    }
+}
 
 static void do_pstream_read_write(pa_pstream *p) {
+    bool unref_io = false;
+
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
     pa_pstream_ref(p);
+    pstream_lock(p);
+
+    /* A threaded pstream unlinked from the other thread still has its IO
+     * to let go of */
+    if (p->dead) {
+        unref_io = release_io(p);
+        goto finish;
+    }
 
     p->mainloop->defer_enable(p->defer_event, 0);
 
+    if (p->thread)
+        take_incoming(p);
+
     if (!p->dead && p->srb) {
         int r = 0;
 
@@ -282,8 +407,7 @@ static void do_pstream_read_write(pa_pstream *p) {
             break;
     }
 
-    pa_pstream_unref(p);
-    return;
+    goto finish;
 
 fail:
 
@@ -291,6 +415,13 @@ fail:
         p->die_callback(p, p->die_callback_userdata);
 
     pa_pstream_unlink(p);
+
+finish:
+    pstream_unlock(p);
+
+    if (unref_io)
+        pa_pstream_unref(p);
+
     pa_pstream_unref(p);
 }
 
@@ -335,6 +466,24 @@ static void defer_callback(pa_mainloop_api *m, pa_defer_event *e, void*userdata)
     do_pstream_read_write(p);
 }
 
+static void kick_callback(pa_mainloop_api *m, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    pa_pstream *p = userdata;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->kick_event == e);
+
+    pa_fdsem_after_poll(p->kick);
+
+    pa_pstream_ref(p);
+
+    do
+        do_pstream_read_write(p);
+    while (p->kick_event && pa_fdsem_before_poll(p->kick) < 0);
+
+    pa_pstream_unref(p);
+}
+
 static void memimport_release_cb(pa_memimport *i, uint32_t block_id, void *userdata);
 
 pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *pool) {
@@ -366,6 +515,34 @@ pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *poo
     return p;
 }
 
+pa_pstream *pa_pstream_new_threaded(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *pool) {
+    pa_pstream *p;
+    pa_fdsem *kick;
+
+    pa_assert(m);
+    pa_assert(io);
+    pa_assert(pa_iochannel_get_mainloop_api(io) == m);
+
+    if (!(kick = pa_fdsem_new()))
+        return NULL;
+
+    p = pa_pstream_new(m, io, pool);
+
+    p->thread = pa_thread_self();
+    p->mutex = pa_mutex_new(true, false);
+    p->incoming_mutex = pa_mutex_new(false, false);
+    p->incoming = pa_queue_new();
+
+    p->kick = kick;
+    pa_assert_se(pa_fdsem_before_poll(p->kick) >= 0);
+    p->kick_event = m->io_new(m, pa_fdsem_get(p->kick), PA_IO_EVENT_INPUT, kick_callback, p);
+
+    /* Held by the IO thread until it lets go of io */
+    pa_pstream_ref(p);
+
+    return p;
+}
+
 /* Attach memfd<->SHM_ID mapping to given pstream and its memimport.
  * Check pa_pstream_register_memfd_mempool() for further info.
  *
@@ -375,24 +552,30 @@ int pa_pstream_attach_memfd_shmid(pa_pstream *p, unsigned shm_id, int memfd_fd)
 
     pa_assert(memfd_fd != -1);
 
+    pstream_lock(p);
+
     if (!p->use_memfd) {
         pa_log_warn("Received memfd ID registration request over a pipe "
                     "that does not support memfds");
-        return err;
+        goto finish;
     }
 
     if (pa_idxset_get_by_data(p->registered_memfd_ids, PA_UINT32_TO_PTR(shm_id), NULL)) {
         pa_log_warn("previously registered memfd SHM ID = %u", shm_id);
-        return err;
+        goto finish;
     }
 
     if (pa_memimport_attach_memfd(p->import, shm_id, memfd_fd, true)) {
         pa_log("Failed to create permanent mapping for memfd region with ID = %u", shm_id);
-        return err;
+        goto finish;
     }
 
     pa_assert_se(pa_idxset_put(p->registered_memfd_ids, PA_UINT32_TO_PTR(shm_id), NULL) == 0);
-    return 0;
+    err = 0;
+
+finish:
+    pstream_unlock(p);
+    return err;
 }
 
 static void item_free(void *item) {
@@ -448,9 +631,117 @@ static void pstream_free(pa_pstream *p) {
     if (p->registered_memfd_ids)
         pa_idxset_free(p->registered_memfd_ids, NULL);
 
+    if (p->incoming)
+        pa_queue_free(p->incoming, item_free);
+
+    if (p->kick)
+        pa_fdsem_free(p->kick);
+
+    if (p->mutex)
+        pa_mutex_free(p->mutex);
+
+    if (p->incoming_mutex)
+        pa_mutex_free(p->incoming_mutex);
+
     pa_xfree(p);
 }
 
+/* Called from any context for threaded pstreams, from IO context otherwise */
+static void queue_item(pa_pstream *p, struct item_info *i) {
+    if (!p->thread) {
+        pa_queue_push(p->send_queue, i);
+        p->mainloop->defer_enable(p->defer_event, 1);
+        return;
+    }
+
+    pa_mutex_lock(p->incoming_mutex);
+    pa_queue_push(p->incoming, i);
+    pa_mutex_unlock(p->incoming_mutex);
+
+    pa_fdsem_post(p->kick);
+}
+
+/* Returns an item with what the encoder of the channel kept back, if there
+ * is anything and discard is not set */
+static struct item_info *encoder_flush(pa_pstream *p, uint32_t channel, bool discard) {
+    pa_pstream_codec *encoder;
+    pa_memchunk encoded;
+    struct item_info *i;
+
+    if (!p->encoders || !(encoder = pa_hashmap_get(p->encoders, PA_UINT32_TO_PTR(channel))))
+        return NULL;
+
+    if (discard) {
+        if (encoder->reset)
+            encoder->reset(encoder);
+
+        return NULL;
+    }
+
+    if (!encoder->flush)
+        return NULL;
+
+    if (encoder->flush(encoder, p->mempool, &encoded) < 0) {
+        if (pa_log_ratelimit(PA_LOG_WARN))
+            pa_log_warn("Failed to flush encoder for channel %u, dropping its data.", channel);
+        return NULL;
+    }
+
+    if (!encoded.memblock)
+        return NULL;
+
+    if (!(i = pa_flist_pop(PA_STATIC_FLIST_GET(items))))
+        i = pa_xnew(struct item_info, 1);
+    i->type = PA_PSTREAM_ITEM_MEMBLOCK;
+
+    i->chunk = encoded;
+    i->encoded = true;
+
+    i->channel = channel;
+    i->offset = 0;
+    i->seek_mode = PA_SEEK_RELATIVE;
+#ifdef HAVE_CREDS
+    i->with_ancil_data = false;
+#endif
+
+    return i;
+}
+
+/* Returns false if the encoder kept all of the data back for now, and
+ * there is nothing to send. Anything returned in before has to be sent
+ * first. */
+static bool item_encode(pa_pstream *p, struct item_info *i, struct item_info **before) {
+    pa_pstream_codec *encoder;
+    pa_memchunk encoded;
+
+    *before = NULL;
+
+    if (i->encoded || !p->encoders || !(encoder = pa_hashmap_get(p->encoders, PA_UINT32_TO_PTR(i->channel))))
+        return true;
+
+    /* The decoder can't seek, so this goes out as it is, after what the
+     * encoder kept back */
+    if (i->seek_mode != PA_SEEK_RELATIVE || i->offset != 0) {
+        *before = encoder_flush(p, i->channel, false);
+        return true;
+    }
+
+    if (encoder->encode(encoder, p->mempool, &i->chunk, &encoded) < 0) {
+        if (pa_log_ratelimit(PA_LOG_WARN))
+            pa_log_warn("Failed to encode memblock for channel %u, sending it unencoded.", i->channel);
+        return true;
+    }
+
+    if (!encoded.memblock)
+        return false;
+
+    pa_memblock_unref(i->chunk.memblock);
+    i->chunk = encoded;
+    i->encoded = true;
+
+    return true;
+}
+
 void pa_pstream_send_packet(pa_pstream*p, pa_packet *packet, pa_cmsg_ancil_data *ancil_data) {
     struct item_info *i;
 
@@ -481,9 +772,7 @@ void pa_pstream_send_packet(pa_pstream*p, pa_packet *packet, pa_cmsg_ancil_data
     }
 #endif
 
-    pa_queue_push(p->send_queue, i);
-
-    p->mainloop->defer_enable(p->defer_event, 1);
+    queue_item(p, i);
 }
 
 void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa_seek_mode_t seek_mode, const pa_memchunk *chunk, size_t align) {
@@ -520,6 +809,7 @@ void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa
         i->chunk.index = chunk->index + idx;
         i->chunk.length = n;
         i->chunk.memblock = pa_memblock_ref(chunk->memblock);
+        i->encoded = false;
 
         i->channel = channel;
         i->offset = offset;
@@ -528,13 +818,55 @@ void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa
         i->with_ancil_data = false;
 #endif
 
-        pa_queue_push(p->send_queue, i);
+        /* Threaded pstreams leave the encoding to the IO thread */
+        if (!p->thread) {
+            struct item_info *before;
+
+            if (!item_encode(p, i, &before))
+                item_free(i);
+            else {
+                if (before)
+                    queue_item(p, before);
+
+                queue_item(p, i);
+            }
+        } else
+            queue_item(p, i);
 
         idx += n;
         length -= n;
     }
+}
+
+void pa_pstream_send_encoded_memblock(pa_pstream *p, uint32_t channel, const pa_memchunk *chunk) {
+    struct item_info *i;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(channel != (uint32_t) -1);
+    pa_assert(chunk);
+    pa_assert(chunk->memblock);
+    pa_assert(chunk->length <= FRAME_SIZE_MAX_ALLOW);
+
+    if (p->dead)
+        return;
+
+    if (!(i = pa_flist_pop(PA_STATIC_FLIST_GET(items))))
+        i = pa_xnew(struct item_info, 1);
+    i->type = PA_PSTREAM_ITEM_MEMBLOCK;
+
+    i->chunk = *chunk;
+    pa_memblock_ref(i->chunk.memblock);
+    i->encoded = true;
 
-    p->mainloop->defer_enable(p->defer_event, 1);
+    i->channel = channel;
+    i->offset = 0;
+    i->seek_mode = PA_SEEK_RELATIVE;
+#ifdef HAVE_CREDS
+    i->with_ancil_data = false;
+#endif
+
+    queue_item(p, i);
 }
 
 void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
@@ -555,8 +887,7 @@ void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
     item->with_ancil_data = false;
 #endif
 
-    pa_queue_push(p->send_queue, item);
-    p->mainloop->defer_enable(p->defer_event, 1);
+    queue_item(p, item);
 }
 
 /* might be called from thread context */
@@ -592,8 +923,7 @@ void pa_pstream_send_revoke(pa_pstream *p, uint32_t block_id) {
     item->with_ancil_data = false;
 #endif
 
-    pa_queue_push(p->send_queue, item);
-    p->mainloop->defer_enable(p->defer_event, 1);
+    queue_item(p, item);
 }
 
 /* might be called from thread context */
@@ -664,6 +994,9 @@ static void prepare_next_write_item(pa_pstream *p) {
 
         flags = (uint32_t) (p->write.current->seek_mode & PA_FLAG_SEEKMASK);
 
+        if (p->write.current->encoded)
+            flags |= PA_FLAG_ENCODED;
+
         if (p->use_shm) {
             pa_mem_type_t type;
             uint32_t block_id, shm_id;
@@ -850,28 +1183,69 @@ fail:
     return -1;
 }
 
-static void memblock_complete(pa_pstream *p, struct pstream_read *re) {
-    pa_memchunk chunk;
+/* Hands a received memblock frame to the memblock callback, decoding it
+ * first if the sender marked it as encoded and a decoder is set for the
+ * channel */
+static void deliver_memblock(pa_pstream *p, struct pstream_read *re, const pa_memchunk *chunk) {
+    pa_pstream_codec *decoder = NULL;
+    pa_memchunk decoded;
+    uint32_t channel, flags;
     int64_t offset;
 
     if (!p->receive_memblock_callback)
         return;
 
-    chunk.memblock = re->memblock;
-    chunk.index = 0;
-    chunk.length = re->index - PA_PSTREAM_DESCRIPTOR_SIZE;
+    channel = ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL]);
+    flags = ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]);
 
     offset = (int64_t) (
              (((uint64_t) ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI])) << 32) |
              (((uint64_t) ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO]))));
 
+    if (flags & PA_FLAG_ENCODED) {
+        if (!chunk->memblock) {
+            if (pa_log_ratelimit(PA_LOG_WARN))
+                pa_log_warn("Received encoded memblock for channel %u without data, dropping it.", channel);
+            return;
+        }
+
+        if (p->decoders)
+            decoder = pa_hashmap_get(p->decoders, PA_UINT32_TO_PTR(channel));
+
+        if (decoder) {
+            if (decoder->decode(decoder, p->mempool, chunk, &decoded) < 0) {
+                if (pa_log_ratelimit(PA_LOG_WARN))
+                    pa_log_warn("Failed to decode memblock for channel %u, dropping it.", channel);
+                return;
+            }
+
+            chunk = &decoded;
+        } else
+            p->receiving_encoded = true;
+    }
+
     p->receive_memblock_callback(
         p,
-        ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL]),
+        channel,
         offset,
-        ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]) & PA_FLAG_SEEKMASK,
-        &chunk,
+        flags & PA_FLAG_SEEKMASK,
+        chunk,
         p->receive_memblock_callback_userdata);
+
+    p->receiving_encoded = false;
+
+    if (decoder)
+        pa_memblock_unref(decoded.memblock);
+}
+
+static void memblock_complete(pa_pstream *p, struct pstream_read *re) {
+    pa_memchunk chunk;
+
+    chunk.memblock = re->memblock;
+    chunk.index = 0;
+    chunk.length = re->index - PA_PSTREAM_DESCRIPTOR_SIZE;
+
+    deliver_memblock(p, re, &chunk);
 }
 
 static int do_read(pa_pstream *p, struct pstream_read *re) {
@@ -1070,25 +1444,14 @@ static int do_read(pa_pstream *p, struct pstream_read *re) {
                     pa_log_debug("Failed to import memory block.");
             }
 
-            if (p->receive_memblock_callback) {
-                int64_t offset;
+            {
                 pa_memchunk chunk;
 
                 chunk.memblock = b;
                 chunk.index = 0;
                 chunk.length = b ? pa_memblock_get_length(b) : ntohl(re->shm_info[PA_PSTREAM_SHM_LENGTH]);
 
-                offset = (int64_t) (
-                        (((uint64_t) ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI])) << 32) |
-                        (((uint64_t) ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO]))));
-
-                p->receive_memblock_callback(
-                        p,
-                        ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL]),
-                        offset,
-                        ntohl(re->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS]) & PA_FLAG_SEEKMASK,
-                        &chunk,
-                        p->receive_memblock_callback_userdata);
+                deliver_memblock(p, re, &chunk);
             }
 
             if (b)
@@ -1131,48 +1494,67 @@ void pa_pstream_set_die_callback(pa_pstream *p, pa_pstream_notify_cb_t cb, void
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->die_callback = cb;
     p->die_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 void pa_pstream_set_drain_callback(pa_pstream *p, pa_pstream_notify_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->drain_callback = cb;
     p->drain_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 void pa_pstream_set_receive_packet_callback(pa_pstream *p, pa_pstream_packet_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->receive_packet_callback = cb;
     p->receive_packet_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 void pa_pstream_set_receive_memblock_callback(pa_pstream *p, pa_pstream_memblock_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->receive_memblock_callback = cb;
     p->receive_memblock_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 void pa_pstream_set_release_callback(pa_pstream *p, pa_pstream_block_id_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->release_callback = cb;
     p->release_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 void pa_pstream_set_revoke_callback(pa_pstream *p, pa_pstream_block_id_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->revoke_callback = cb;
     p->revoke_callback_userdata = userdata;
+    pstream_unlock(p);
+}
+
+bool pa_pstream_memblock_is_encoded(pa_pstream *p) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    return p->receiving_encoded;
 }
 
 bool pa_pstream_is_pending(pa_pstream *p) {
@@ -1181,11 +1563,21 @@ bool pa_pstream_is_pending(pa_pstream *p) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
+
     if (p->dead)
         b = false;
     else
         b = p->write.current || !pa_queue_isempty(p->send_queue);
 
+    if (!b && !p->dead && p->incoming) {
+        pa_mutex_lock(p->incoming_mutex);
+        b = !pa_queue_isempty(p->incoming);
+        pa_mutex_unlock(p->incoming_mutex);
+    }
+
+    pstream_unlock(p);
+
     return b;
 }
 
@@ -1206,16 +1598,17 @@ pa_pstream* pa_pstream_ref(pa_pstream*p) {
 }
 
 void pa_pstream_unlink(pa_pstream *p) {
+    bool unref_io = false;
+
     pa_assert(p);
 
+    pstream_lock(p);
+
     if (p->dead)
-        return;
+        goto finish;
 
     p->dead = true;
 
-    while (p->srb || p->is_srbpending) /* In theory there could be one active and one pending */
-        pa_pstream_set_srbchannel(p, NULL);
-
     if (p->import) {
         pa_memimport_free(p->import);
         p->import = NULL;
@@ -1226,26 +1619,125 @@ void pa_pstream_unlink(pa_pstream *p) {
         p->export = NULL;
     }
 
-    if (p->io) {
-        pa_iochannel_free(p->io);
-        p->io = NULL;
+    /* The IO of a threaded pstream, including its srbchannel, may only be
+     * touched by its IO thread, so if this isn't it, wake it up to let go of
+     * it */
+    if (!p->thread || p->thread == pa_thread_self())
+        unref_io = release_io(p);
+    else
+        pa_fdsem_post(p->kick);
+
+    if (p->encoders) {
+        pa_hashmap_free(p->encoders);
+        p->encoders = NULL;
     }
 
-    if (p->defer_event) {
-        p->mainloop->defer_free(p->defer_event);
-        p->defer_event = NULL;
+    if (p->decoders) {
+        pa_hashmap_free(p->decoders);
+        p->decoders = NULL;
     }
 
     p->die_callback = NULL;
     p->drain_callback = NULL;
     p->receive_packet_callback = NULL;
     p->receive_memblock_callback = NULL;
+
+finish:
+    pstream_unlock(p);
+
+    if (unref_io)
+        pa_pstream_unref(p);
+}
+
+static void codec_free(pa_pstream_codec *c) {
+    pa_assert(c);
+
+    c->free(c);
+}
+
+static void set_codec(pa_hashmap **codecs, uint32_t channel, pa_pstream_codec *c) {
+    pa_assert(codecs);
+
+    if (!*codecs) {
+        if (!c)
+            return;
+
+        *codecs = pa_hashmap_new_full(NULL, NULL, NULL, (pa_free_cb_t) codec_free);
+    }
+
+    pa_hashmap_remove_and_free(*codecs, PA_UINT32_TO_PTR(channel));
+
+    if (c)
+        pa_assert_se(pa_hashmap_put(*codecs, PA_UINT32_TO_PTR(channel), c) >= 0);
+}
+
+void pa_pstream_set_encoder(pa_pstream *p, uint32_t channel, pa_pstream_codec *c) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(!c || (c->encode && c->free));
+
+    pstream_lock(p);
+
+    if (p->dead) {
+        if (c)
+            c->free(c);
+    } else
+        set_codec(&p->encoders, channel, c);
+
+    pstream_unlock(p);
+}
+
+void pa_pstream_set_decoder(pa_pstream *p, uint32_t channel, pa_pstream_codec *c) {
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(!c || (c->decode && c->free));
+
+    pstream_lock(p);
+
+    if (p->dead) {
+        if (c)
+            c->free(c);
+    } else
+        set_codec(&p->decoders, channel, c);
+
+    pstream_unlock(p);
+}
+
+void pa_pstream_flush_encoder(pa_pstream *p, uint32_t channel, bool discard) {
+    struct item_info *i;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+
+    if (p->dead)
+        return;
+
+    if (!p->thread) {
+        if ((i = encoder_flush(p, channel, discard)))
+            queue_item(p, i);
+
+        return;
+    }
+
+    /* The IO thread does the encoding, so it has to do this in order */
+    if (!(i = pa_flist_pop(PA_STATIC_FLIST_GET(items))))
+        i = pa_xnew(struct item_info, 1);
+    i->type = PA_PSTREAM_ITEM_FLUSH_ENCODER;
+    i->channel = channel;
+    i->discard = discard;
+#ifdef HAVE_CREDS
+    i->with_ancil_data = false;
+#endif
+
+    queue_item(p, i);
 }
 
 void pa_pstream_enable_shm(pa_pstream *p, bool enable) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
+
     p->use_shm = enable;
 
     if (enable) {
@@ -1260,6 +1752,8 @@ void pa_pstream_enable_shm(pa_pstream *p, bool enable) {
             p->export = NULL;
         }
     }
+
+    pstream_unlock(p);
 }
 
 void pa_pstream_enable_memfd(pa_pstream *p) {
@@ -1267,11 +1761,15 @@ void pa_pstream_enable_memfd(pa_pstream *p) {
     pa_assert(PA_REFCNT_VALUE(p) > 0);
     pa_assert(p->use_shm);
 
+    pstream_lock(p);
+
     p->use_memfd = true;
 
     if (!p->registered_memfd_ids) {
         p->registered_memfd_ids = pa_idxset_new(NULL, NULL);
     }
+
+    pstream_unlock(p);
 }
 
 bool pa_pstream_get_shm(pa_pstream *p) {
@@ -1291,9 +1789,19 @@ bool pa_pstream_get_memfd(pa_pstream *p) {
 void pa_pstream_set_srbchannel(pa_pstream *p, pa_srbchannel *srb) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0 || srb == NULL);
+    pa_assert(!p->thread || p->thread == pa_thread_self());
+
+    pstream_lock(p);
 
     if (srb == p->srb)
-        return;
+        goto finish;
+
+    /* The srbchannel of a dead pstream is gone already */
+    if (p->dead) {
+        if (srb)
+            pa_srbchannel_free(srb);
+        goto finish;
+    }
 
     /* We can't handle quick switches between srbchannels. */
     pa_assert(!p->is_srbpending);
@@ -1302,8 +1810,8 @@ void pa_pstream_set_srbchannel(pa_pstream *p, pa_srbchannel *srb) {
     p->is_srbpending = true;
 
     /* Switch immediately, if possible. */
-    if (p->dead)
-        check_srbpending(p);
-    else
-        do_write(p);
+    do_write(p);
+
+finish:
+    pstream_unlock(p);
 }
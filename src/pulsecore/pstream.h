@@ -41,8 +41,40 @@ typedef void (*pa_pstream_memblock_cb_t)(pa_pstream *p, uint32_t channel, int64_
 typedef void (*pa_pstream_notify_cb_t)(pa_pstream *p, void *userdata);
 typedef void (*pa_pstream_block_id_cb_t)(pa_pstream *p, uint32_t block_id, void *userdata);
 
+/* A codec transforms the audio data of a single channel on the wire, for
+ * example to compress it. An encoder is applied to the memblocks we send on
+ * a channel, a decoder to those we receive on it; each only needs to
+ * implement its own direction. Both callbacks return a new memchunk reference
+ * in out, allocated from pool, and 0 on success. An encoder may keep data
+ * back for a later memblock, and leaves out empty if there is nothing to send
+ * yet. flush() hands out what an encoder keeps back the same way, reset()
+ * drops it; encoders that keep nothing back may leave both NULL. Memblocks
+ * written with a seek are sent unencoded, after what the encoder kept back,
+ * since a decoder can't seek. Encoded
+ * memblocks for a channel without decoder are passed on as they are, see
+ * pa_pstream_memblock_is_encoded(). */
+typedef struct pa_pstream_codec pa_pstream_codec;
+
+struct pa_pstream_codec {
+    int (*encode)(pa_pstream_codec *c, pa_mempool *pool, const pa_memchunk *in, pa_memchunk *out);
+    int (*decode)(pa_pstream_codec *c, pa_mempool *pool, const pa_memchunk *in, pa_memchunk *out);
+    int (*flush)(pa_pstream_codec *c, pa_mempool *pool, pa_memchunk *out);
+    void (*reset)(pa_pstream_codec *c);
+    void (*free)(pa_pstream_codec *c);
+    void *userdata;
+};
+
 pa_pstream* pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *p);
 
+/* Like pa_pstream_new(), for a pstream whose IO is done by another thread
+ * than the one using it. Must be called from the thread running m, io must
+ * belong to m too. The callbacks are then called from that thread. The
+ * pa_pstream_send_xxx() functions may be called from any thread and only
+ * queue the data, the other functions from the IO thread or the one using
+ * the pstream. If pa_pstream_unlink() is called from the latter, the IO
+ * thread releases io and its events a little later. */
+pa_pstream* pa_pstream_new_threaded(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *p);
+
 pa_pstream* pa_pstream_ref(pa_pstream*p);
 void pa_pstream_unref(pa_pstream*p);
 
@@ -52,6 +84,9 @@ int pa_pstream_attach_memfd_shmid(pa_pstream *p, unsigned shm_id, int memfd_fd);
 
 void pa_pstream_send_packet(pa_pstream*p, pa_packet *packet, pa_cmsg_ancil_data *ancil_data);
 void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, size_t align);
+/* Sends a memblock that was encoded already, bypassing the encoder of the
+ * channel. It has to fit into a single frame. */
+void pa_pstream_send_encoded_memblock(pa_pstream *p, uint32_t channel, const pa_memchunk *chunk);
 void pa_pstream_send_release(pa_pstream *p, uint32_t block_id);
 void pa_pstream_send_revoke(pa_pstream *p, uint32_t block_id);
 
@@ -62,6 +97,21 @@ void pa_pstream_set_die_callback(pa_pstream *p, pa_pstream_notify_cb_t cb, void
 void pa_pstream_set_release_callback(pa_pstream *p, pa_pstream_block_id_cb_t cb, void *userdata);
 void pa_pstream_set_revoke_callback(pa_pstream *p, pa_pstream_block_id_cb_t cb, void *userdata);
 
+/* The pstream takes ownership of the codec. Passing NULL removes the codec
+ * that is currently set for the channel. */
+void pa_pstream_set_encoder(pa_pstream *p, uint32_t channel, pa_pstream_codec *c);
+void pa_pstream_set_decoder(pa_pstream *p, uint32_t channel, pa_pstream_codec *c);
+
+/* Makes the encoder of the channel send what it keeps back, or drop it if
+ * discard is set. This happens in order with the memblocks sent before, so
+ * call it before a command that has to see all of them, like a cork or a
+ * drain. */
+void pa_pstream_flush_encoder(pa_pstream *p, uint32_t channel, bool discard);
+
+/* Only valid in the memblock callback: whether the memblock is still
+ * encoded, because no decoder is set for its channel */
+bool pa_pstream_memblock_is_encoded(pa_pstream *p);
+
 bool pa_pstream_is_pending(pa_pstream *p);
 
 void pa_pstream_enable_shm(pa_pstream *p, bool enable);
@@ -70,7 +120,8 @@ bool pa_pstream_get_shm(pa_pstream *p);
 bool pa_pstream_get_memfd(pa_pstream *p);
 
 /* Enables shared ringbuffer channel. Note that the srbchannel is now owned by the pstream.
-   Setting srb to NULL will free any existing srbchannel. */
+   Setting srb to NULL will free any existing srbchannel. For threaded pstreams this has to
+   be called from the IO thread, and srb has to be created with its mainloop. */
 void pa_pstream_set_srbchannel(pa_pstream *p, pa_srbchannel *srb);
 
 #endif
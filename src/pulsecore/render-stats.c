@@ -0,0 +1,140 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/aupdate.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+#include "render-stats.h"
+
+#define PUBLISH_INTERVAL_USEC (100 * PA_USEC_PER_MSEC)
+
+struct pa_render_stats {
+    /* Only touched by the IO thread */
+    pa_render_stage_stats current[PA_RENDER_STAGE_MAX];
+    pa_usec_t last_publish;
+    bool dirty;
+
+    pa_aupdate *aupdate;
+    pa_render_stage_stats published[2][PA_RENDER_STAGE_MAX];
+};
+
+pa_render_stats *pa_render_stats_new(void) {
+    pa_render_stats *s;
+
+    s = pa_xnew0(pa_render_stats, 1);
+    s->aupdate = pa_aupdate_new();
+
+    return s;
+}
+
+void pa_render_stats_free(pa_render_stats *s) {
+    pa_assert(s);
+
+    pa_aupdate_free(s->aupdate);
+    pa_xfree(s);
+}
+
+void pa_render_stats_add(pa_render_stats *s, pa_render_stage_t stage, pa_usec_t usec) {
+    pa_render_stage_stats *st;
+    unsigned bucket;
+
+    pa_assert(s);
+    pa_assert(stage < PA_RENDER_STAGE_MAX);
+
+    st = &s->current[stage];
+
+    st->count++;
+    st->total_usec += usec;
+    if (usec > st->max_usec)
+        st->max_usec = usec;
+
+    bucket = pa_ulog2((unsigned) PA_MIN(usec, (pa_usec_t) UINT_MAX));
+    st->buckets[PA_MIN(bucket, PA_RENDER_STATS_BUCKETS - 1)]++;
+
+    s->dirty = true;
+}
+
+void pa_render_stats_publish(pa_render_stats *s, pa_usec_t now) {
+    unsigned j;
+
+    pa_assert(s);
+
+    if (!s->dirty || now < s->last_publish + PUBLISH_INTERVAL_USEC)
+        return;
+
+    /* Readers only copy the data out, so this doesn't wait long */
+    j = pa_aupdate_write_begin(s->aupdate);
+    memcpy(s->published[j], s->current, sizeof(s->current));
+    pa_aupdate_write_end(s->aupdate);
+
+    s->last_publish = now;
+    s->dirty = false;
+}
+
+void pa_render_stats_get(pa_render_stats *s, pa_render_stage_stats stats[PA_RENDER_STAGE_MAX]) {
+    unsigned j;
+
+    pa_assert(s);
+    pa_assert(stats);
+
+    j = pa_aupdate_read_begin(s->aupdate);
+    memcpy(stats, s->published[j], sizeof(s->published[j]));
+    pa_aupdate_read_end(s->aupdate);
+}
+
+pa_usec_t pa_render_stage_stats_p99(const pa_render_stage_stats *st) {
+    uint64_t threshold, n = 0;
+    unsigned i;
+
+    pa_assert(st);
+
+    if (st->count <= 0)
+        return 0;
+
+    threshold = st->count - st->count / 100;
+
+    for (i = 0; i < PA_RENDER_STATS_BUCKETS - 1; i++) {
+        n += st->buckets[i];
+
+        if (n >= threshold)
+            return PA_MIN((pa_usec_t) 2 << i, st->max_usec);
+    }
+
+    return st->max_usec;
+}
+
+const char *pa_render_stage_to_string(pa_render_stage_t stage) {
+    static const char * const table[PA_RENDER_STAGE_MAX] = {
+        [PA_RENDER_STAGE_DATA] = "data",
+        [PA_RENDER_STAGE_RESAMPLE] = "resample",
+        [PA_RENDER_STAGE_VOLUME] = "volume"
+    };
+
+    pa_assert(stage < PA_RENDER_STAGE_MAX);
+
+    return table[stage];
+}
@@ -0,0 +1,80 @@
+#ifndef foorenderstatshfoo
+#define foorenderstatshfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/sample.h>
+
+/* Per stream accounting of the time spent in the processing stages of the
+ * IO thread. The IO thread adds samples and publishes them every now and
+ * then, the main thread (or anyone else) reads the last published state
+ * without taking a lock the IO thread could block on. */
+
+typedef struct pa_render_stats pa_render_stats;
+
+/* The order matches pa_stream_stage_t of the client API */
+typedef enum pa_render_stage {
+    PA_RENDER_STAGE_DATA,     /* pop() of sink inputs, push() of source outputs */
+    PA_RENDER_STAGE_RESAMPLE,
+    PA_RENDER_STAGE_VOLUME,
+    PA_RENDER_STAGE_MAX
+} pa_render_stage_t;
+
+/* Bucket n counts the samples of [2^n, 2^(n+1)) usec, the last one all
+ * longer ones */
+#define PA_RENDER_STATS_BUCKETS 16
+
+typedef struct pa_render_stage_stats {
+    uint64_t count;
+    pa_usec_t total_usec;
+    pa_usec_t max_usec;
+    uint64_t buckets[PA_RENDER_STATS_BUCKETS];
+} pa_render_stage_stats;
+
+pa_render_stats *pa_render_stats_new(void);
+void pa_render_stats_free(pa_render_stats *s);
+
+/* Called from IO context */
+void pa_render_stats_add(pa_render_stats *s, pa_render_stage_t stage, pa_usec_t usec);
+
+/* Called from IO context. Accounts the time from since until now to stage
+ * and returns now, so that the next stage can be timed from there. */
+static inline pa_usec_t pa_render_stats_add_since(pa_render_stats *s, pa_render_stage_t stage, pa_usec_t since) {
+    pa_usec_t now = pa_rtclock_now();
+
+    pa_render_stats_add(s, stage, now - since);
+    return now;
+}
+
+/* Called from IO context. Makes the samples added so far visible to
+ * pa_render_stats_get(), at most every 100 ms. */
+void pa_render_stats_publish(pa_render_stats *s, pa_usec_t now);
+
+/* Called from any context */
+void pa_render_stats_get(pa_render_stats *s, pa_render_stage_stats stats[PA_RENDER_STAGE_MAX]);
+
+/* Upper bound of the bucket that holds the 99th percentile, 0 if there are
+ * no samples */
+pa_usec_t pa_render_stage_stats_p99(const pa_render_stage_stats *st);
+
+const char *pa_render_stage_to_string(pa_render_stage_t stage);
+
+#endif
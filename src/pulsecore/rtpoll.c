@@ -38,6 +38,7 @@
 #include <pulsecore/flist.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/ratelimit.h>
+#include <pulsecore/trace.h>
 #include <pulse/rtclock.h>
 
 #include "rtpoll.h"
@@ -308,6 +309,7 @@ int pa_rtpoll_run(pa_rtpoll *p) {
 #endif
 
     /* OK, now let's sleep */
+    PA_TRACE_BEGIN(PA_TRACE_RTPOLL_POLL, 0, p->n_pollfd_used);
 #ifdef HAVE_PPOLL
     {
         struct timespec ts;
@@ -318,6 +320,7 @@ int pa_rtpoll_run(pa_rtpoll *p) {
 #else
     r = pa_poll(p->pollfd, p->n_pollfd_used, (p->quit || p->timer_enabled) ? (int) ((timeout.tv_sec*1000) + (timeout.tv_usec / 1000)) : -1);
 #endif
+    PA_TRACE_END(PA_TRACE_RTPOLL_POLL, 0, p->n_pollfd_used);
 
     p->timer_elapsed = r == 0;
 
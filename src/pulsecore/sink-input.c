@@ -664,6 +664,8 @@ int pa_sink_input_new(
     pa_xfree(memblockq_name);
     pa_memblock_unref(silence.memblock);
 
+    i->render_stats = pa_render_stats_new();
+
     pt = pa_proplist_to_string_sep(i->proplist, "\n    ");
     pa_log_info("Created input %u \"%s\" on %s with sample spec %s and channel map %s\n    %s",
                 i->index,
@@ -853,6 +855,9 @@ static void sink_input_free(pa_object *o) {
     if (i->thread_info.resampler)
         pa_resampler_free(i->thread_info.resampler);
 
+    if (i->render_stats)
+        pa_render_stats_free(i->render_stats);
+
     if (i->format)
         pa_format_info_free(i->format);
 
@@ -957,6 +962,7 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
     size_t block_size_max_sink, block_size_max_sink_input;
     size_t ilength;
     size_t ilength_full;
+    pa_usec_t t = 0;
 
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
@@ -1007,12 +1013,18 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
 
     while (!pa_memblockq_is_readable(i->thread_info.render_memblockq)) {
         pa_memchunk tchunk;
+        int r = -1;
 
         /* There's nothing in our render queue. We need to fill it up
          * with data from the implementor. */
 
-        if (i->thread_info.state == PA_SINK_INPUT_CORKED ||
-            i->pop(i, ilength, &tchunk) < 0) {
+        if (i->thread_info.state != PA_SINK_INPUT_CORKED) {
+            t = pa_rtclock_now();
+            r = i->pop(i, ilength, &tchunk);
+            t = pa_render_stats_add_since(i->render_stats, PA_RENDER_STAGE_DATA, t);
+        }
+
+        if (r < 0) {
 
             /* OK, we're corked or the implementor didn't give us any
              * data, so let's just hand out silence */
@@ -1046,6 +1058,7 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
 
             /* It might be necessary to adjust the volume here */
             if (do_volume_adj_here && !volume_is_norm) {
+                t = pa_rtclock_now();
                 pa_memchunk_make_writable(&wchunk, 0);
 
                 if (i->thread_info.muted) {
@@ -1064,6 +1077,8 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
 
                 } else
                     pa_volume_memchunk(&wchunk, &i->thread_info.sample_spec, &i->thread_info.soft_volume);
+
+                t = pa_render_stats_add_since(i->render_stats, PA_RENDER_STAGE_VOLUME, t);
             }
 
             /* Push chunk into history queue to retain some resampler input history. */
@@ -1072,14 +1087,19 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
             if (!i->thread_info.resampler) {
 
                 if (nvfs) {
+                    t = pa_rtclock_now();
                     pa_memchunk_make_writable(&wchunk, 0);
                     pa_volume_memchunk(&wchunk, &i->sink->sample_spec, &i->volume_factor_sink);
+                    t = pa_render_stats_add_since(i->render_stats, PA_RENDER_STAGE_VOLUME, t);
                 }
 
                 pa_memblockq_push_align(i->thread_info.render_memblockq, &wchunk);
             } else {
                 pa_memchunk rchunk;
+
+                t = pa_rtclock_now();
                 pa_resampler_run(i->thread_info.resampler, &wchunk, &rchunk);
+                t = pa_render_stats_add_since(i->render_stats, PA_RENDER_STAGE_RESAMPLE, t);
 
 #ifdef SINK_INPUT_DEBUG
                 pa_log_debug("pushing %lu", (unsigned long) rchunk.length);
@@ -1090,6 +1110,7 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
                     if (nvfs) {
                         pa_memchunk_make_writable(&rchunk, 0);
                         pa_volume_memchunk(&rchunk, &i->sink->sample_spec, &i->volume_factor_sink);
+                        t = pa_render_stats_add_since(i->render_stats, PA_RENDER_STAGE_VOLUME, t);
                     }
 
                     pa_memblockq_push_align(i->thread_info.render_memblockq, &rchunk);
@@ -1106,6 +1127,10 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
         pa_memblock_unref(tchunk.memblock);
     }
 
+    /* t is the end of the last stage that was timed, if any */
+    if (t > 0)
+        pa_render_stats_publish(i->render_stats, t);
+
     pa_assert_se(pa_memblockq_peek(i->thread_info.render_memblockq, chunk) >= 0);
 
     pa_assert(chunk->length > 0);
@@ -28,6 +28,7 @@
 #include <pulse/format.h>
 #include <pulsecore/memblockq.h>
 #include <pulsecore/resampler.h>
+#include <pulsecore/render-stats.h>
 #include <pulsecore/module.h>
 #include <pulsecore/client.h>
 #include <pulsecore/sink.h>
@@ -241,6 +242,10 @@ struct pa_sink_input {
     /* Used to store the rewind amount of the origin sink during a move */
     size_t origin_rewind_bytes;    /* In sink input sample spec */
 
+    /* Time spent in pa_sink_input_peek(), written from IO context and
+     * readable from any context */
+    pa_render_stats *render_stats;
+
     struct {
         pa_sink_input_state_t state : 2;
 
@@ -51,6 +51,7 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/play-memblockq.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/trace.h>
 
 #include "sink.h"
 
@@ -1079,6 +1080,8 @@ void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
     if (!s->thread_info.rewind_requested && nbytes <= 0)
         return;
 
+    PA_TRACE_INSTANT(PA_TRACE_SINK_REWIND, s->index, nbytes);
+
     s->thread_info.rewind_nbytes = 0;
     s->thread_info.rewind_requested = false;
 
@@ -1272,6 +1275,7 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
     }
 
     pa_sink_ref(s);
+    PA_TRACE_BEGIN(PA_TRACE_SINK_RENDER, s->index, length);
 
     if (length <= 0)
         length = pa_frame_align(MIX_BUFFER_LENGTH, &s->sample_spec);
@@ -1331,6 +1335,7 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
     inputs_drop(s, info, n, result);
 
+    PA_TRACE_END(PA_TRACE_SINK_RENDER, s->index, result->length);
     pa_sink_unref(s);
 }
 
@@ -1357,6 +1362,7 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
     }
 
     pa_sink_ref(s);
+    PA_TRACE_BEGIN(PA_TRACE_SINK_RENDER, s->index, target->length);
 
     length = target->length;
     block_size_max = pa_mempool_block_size_max(s->core->mempool);
@@ -1416,6 +1422,7 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
     inputs_drop(s, info, n, target);
 
+    PA_TRACE_END(PA_TRACE_SINK_RENDER, s->index, target->length);
     pa_sink_unref(s);
 }
 
@@ -1582,9 +1589,15 @@ void pa_sink_reconfigure(pa_sink *s, pa_sample_spec *spec, bool passthrough) {
         pa_source_reconfigure(s->monitor_source, &s->sample_spec, false);
     pa_log_info("Reconfigured successfully");
 
+    /* If the sink was suspended already, the state doesn't change and
+     * nobody would be told about the new sample spec */
+    pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SINK|PA_SUBSCRIPTION_EVENT_CHANGE, s->index);
+
     PA_IDXSET_FOREACH(i, s->inputs, idx) {
-        if (i->state == PA_SINK_INPUT_CORKED)
+        if (i->state == PA_SINK_INPUT_CORKED) {
             pa_sink_input_update_resampler(i, true);
+            pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_CHANGE, i->index);
+        }
     }
 
     pa_sink_suspend(s, false, PA_SUSPEND_INTERNAL);
@@ -2465,6 +2478,20 @@ bool pa_sink_update_proplist(pa_sink *s, pa_update_mode_t mode, pa_proplist *p)
     return true;
 }
 
+/* Called from main thread */
+bool pa_sink_same_clock_domain(pa_sink *s, pa_source *source) {
+    const char *a, *b;
+
+    pa_sink_assert_ref(s);
+    pa_source_assert_ref(source);
+    pa_assert_ctl_context();
+
+    a = pa_proplist_gets(s->proplist, PA_PROP_DEVICE_CLOCK_DOMAIN);
+    b = pa_proplist_gets(source->proplist, PA_PROP_DEVICE_CLOCK_DOMAIN);
+
+    return a && b && pa_streq(a, b);
+}
+
 /* Called from main thread */
 /* FIXME -- this should be dropped and be merged into pa_sink_update_proplist() */
 void pa_sink_set_description(pa_sink *s, const char *description) {
@@ -494,6 +494,10 @@ bool pa_sink_get_mute(pa_sink *sink, bool force_refresh);
 
 bool pa_sink_update_proplist(pa_sink *s, pa_update_mode_t mode, pa_proplist *p);
 
+/* Returns true if both devices announce the same PA_PROP_DEVICE_CLOCK_DOMAIN
+ * and thus cannot drift against each other */
+bool pa_sink_same_clock_domain(pa_sink *s, pa_source *source);
+
 int pa_sink_set_port(pa_sink *s, const char *name, bool save);
 
 unsigned pa_sink_linked_by(pa_sink *s); /* Number of connected streams */
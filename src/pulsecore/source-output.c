@@ -505,6 +505,8 @@ int pa_source_output_new(
 
     pa_memblockq_set_maxrewind(o->thread_info.delay_memblockq, resampler_history + pa_source_get_max_rewind(o->source));
 
+    o->render_stats = pa_render_stats_new();
+
     pa_assert_se(pa_idxset_put(core->source_outputs, o, &o->index) == 0);
     pa_assert_se(pa_idxset_put(o->source->outputs, pa_source_output_ref(o), NULL) == 0);
 
@@ -661,6 +663,9 @@ static void source_output_free(pa_object* mo) {
     if (o->thread_info.resampler)
         pa_resampler_free(o->thread_info.resampler);
 
+    if (o->render_stats)
+        pa_render_stats_free(o->render_stats);
+
     if (o->format)
         pa_format_info_free(o->format);
 
@@ -751,6 +756,7 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
     bool volume_is_norm;
     size_t length;
     size_t limit, mbs = 0;
+    pa_usec_t t = 0;
 
     pa_source_output_assert_ref(o);
     pa_source_output_assert_io_context(o);
@@ -808,6 +814,7 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
 
         /* It might be necessary to adjust the volume here */
         if (!volume_is_norm) {
+            t = pa_rtclock_now();
             pa_memchunk_make_writable(&qchunk, 0);
 
             if (o->thread_info.muted) {
@@ -826,16 +833,22 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
 
             } else
                 pa_volume_memchunk(&qchunk, &o->source->sample_spec, &o->thread_info.soft_volume);
+
+            t = pa_render_stats_add_since(o->render_stats, PA_RENDER_STAGE_VOLUME, t);
         }
 
         if (nvfs) {
+            t = pa_rtclock_now();
             pa_memchunk_make_writable(&qchunk, 0);
             pa_volume_memchunk(&qchunk, &o->source->sample_spec, &o->volume_factor_source);
+            t = pa_render_stats_add_since(o->render_stats, PA_RENDER_STAGE_VOLUME, t);
         }
 
-        if (!o->thread_info.resampler)
+        if (!o->thread_info.resampler) {
+            t = pa_rtclock_now();
             o->push(o, &qchunk);
-        else {
+            t = pa_render_stats_add_since(o->render_stats, PA_RENDER_STAGE_DATA, t);
+        } else {
             pa_memchunk rchunk;
 
             if (mbs == 0)
@@ -844,10 +857,14 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
             if (qchunk.length > mbs)
                 qchunk.length = mbs;
 
+            t = pa_rtclock_now();
             pa_resampler_run(o->thread_info.resampler, &qchunk, &rchunk);
+            t = pa_render_stats_add_since(o->render_stats, PA_RENDER_STAGE_RESAMPLE, t);
 
-            if (rchunk.length > 0)
+            if (rchunk.length > 0) {
                 o->push(o, &rchunk);
+                t = pa_render_stats_add_since(o->render_stats, PA_RENDER_STAGE_DATA, t);
+            }
 
             if (rchunk.memblock)
                 pa_memblock_unref(rchunk.memblock);
@@ -856,6 +873,10 @@ void pa_source_output_push(pa_source_output *o, const pa_memchunk *chunk) {
         pa_memblock_unref(qchunk.memblock);
         pa_memblockq_drop(o->thread_info.delay_memblockq, qchunk.length);
     }
+
+    /* t is the end of the last stage that was timed, if any */
+    if (t > 0)
+        pa_render_stats_publish(o->render_stats, t);
 }
 
 /* Called from thread context */
@@ -27,6 +27,7 @@
 #include <pulse/format.h>
 #include <pulsecore/memblockq.h>
 #include <pulsecore/resampler.h>
+#include <pulsecore/render-stats.h>
 #include <pulsecore/module.h>
 #include <pulsecore/client.h>
 #include <pulsecore/source.h>
@@ -201,6 +202,10 @@ struct pa_source_output {
      * mute status changes. Called from main context */
     void (*mute_changed)(pa_source_output *o); /* may be NULL */
 
+    /* Time spent in pa_source_output_push(), written from IO context and
+     * readable from any context */
+    pa_render_stats *render_stats;
+
     struct {
         pa_source_output_state_t state;
 
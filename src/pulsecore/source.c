@@ -44,6 +44,7 @@
 #include <pulsecore/log.h>
 #include <pulsecore/mix.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/trace.h>
 
 #include "source.h"
 
@@ -968,6 +969,7 @@ void pa_source_process_rewind(pa_source *s, size_t nbytes) {
         return;
 
     pa_log_debug("Processing rewind...");
+    PA_TRACE_INSTANT(PA_TRACE_SOURCE_REWIND, s->index, nbytes);
 
     PA_HASHMAP_FOREACH(o, s->thread_info.outputs, state) {
         pa_source_output_assert_ref(o);
@@ -988,6 +990,8 @@ void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
     if (s->thread_info.state == PA_SOURCE_SUSPENDED)
         return;
 
+    PA_TRACE_BEGIN(PA_TRACE_SOURCE_POST, s->index, chunk->length);
+
     if (s->thread_info.soft_muted || !pa_cvolume_is_norm(&s->thread_info.soft_volume)) {
         pa_memchunk vchunk = *chunk;
 
@@ -1016,6 +1020,8 @@ void pa_source_post(pa_source*s, const pa_memchunk *chunk) {
                 pa_source_output_push(o, chunk);
         }
     }
+
+    PA_TRACE_END(PA_TRACE_SOURCE_POST, s->index, chunk->length);
 }
 
 /* Called from IO thread context */
@@ -1149,12 +1155,18 @@ void pa_source_reconfigure(pa_source *s, pa_sample_spec *spec, bool passthrough)
     }
 
     PA_IDXSET_FOREACH(o, s->outputs, idx) {
-        if (o->state == PA_SOURCE_OUTPUT_CORKED)
+        if (o->state == PA_SOURCE_OUTPUT_CORKED) {
             pa_source_output_update_resampler(o);
+            pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT|PA_SUBSCRIPTION_EVENT_CHANGE, o->index);
+        }
     }
 
     pa_log_info("Reconfigured successfully");
 
+    /* If the source was suspended already, the state doesn't change and
+     * nobody would be told about the new sample spec */
+    pa_subscription_post(s->core, PA_SUBSCRIPTION_EVENT_SOURCE|PA_SUBSCRIPTION_EVENT_CHANGE, s->index);
+
 unsuspend:
     pa_source_suspend(s, false, PA_SUSPEND_INTERNAL);
 }
@@ -36,12 +36,12 @@
 #include <pulsecore/socket.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/packet.h>
 
 #include "tagstruct.h"
 
 #define MAX_TAG_SIZE (64*1024)
 #define MAX_APPENDED_SIZE 128
-#define GROW_TAG_SIZE 100
 
 struct pa_tagstruct {
     uint8_t *data;
@@ -50,7 +50,7 @@ struct pa_tagstruct {
 
     enum {
         PA_TAGSTRUCT_FIXED, /* The tagstruct does not own the data, buffer was provided by caller. */
-        PA_TAGSTRUCT_DYNAMIC, /* Buffer owned by tagstruct, data must be freed. */
+        PA_TAGSTRUCT_DYNAMIC, /* Buffer owned by tagstruct, from pa_packet_buffer_new(). */
         PA_TAGSTRUCT_APPENDED, /* Data points to appended buffer, used for small tagstructs. Will change to dynamic if needed. */
     } type;
     union {
@@ -92,25 +92,52 @@ void pa_tagstruct_free(pa_tagstruct*t) {
     pa_assert(t);
 
     if (t->type == PA_TAGSTRUCT_DYNAMIC)
-        pa_xfree(t->data);
+        pa_packet_buffer_free(t->data, t->allocated);
     if (pa_flist_push(PA_STATIC_FLIST_GET(tagstructs), t) < 0)
         pa_xfree(t);
 }
 
+pa_packet *pa_tagstruct_free_to_packet(pa_tagstruct *t) {
+    pa_packet *packet;
+
+    pa_assert(t);
+
+    if (t->type == PA_TAGSTRUCT_DYNAMIC) {
+        packet = pa_packet_new_buffer(t->data, t->length, t->allocated);
+        t->type = PA_TAGSTRUCT_FIXED;
+    } else
+        packet = pa_packet_new_data(t->data, t->length);
+
+    pa_tagstruct_free(t);
+
+    return packet;
+}
+
+static void grow(pa_tagstruct *t, size_t l) {
+    size_t allocated;
+    uint8_t *data;
+
+    /* Double the size, so that building long replies stays linear */
+    allocated = PA_MAX(t->length + l, 2 * t->allocated);
+    data = pa_packet_buffer_new(&allocated);
+    memcpy(data, t->data, t->length);
+
+    if (t->type == PA_TAGSTRUCT_DYNAMIC)
+        pa_packet_buffer_free(t->data, t->allocated);
+
+    t->type = PA_TAGSTRUCT_DYNAMIC;
+    t->data = data;
+    t->allocated = allocated;
+}
+
 static inline void extend(pa_tagstruct*t, size_t l) {
     pa_assert(t);
     pa_assert(t->type != PA_TAGSTRUCT_FIXED);
 
-    if (t->length+l <= t->allocated)
+    if (PA_LIKELY(t->length+l <= t->allocated))
         return;
 
-    if (t->type == PA_TAGSTRUCT_DYNAMIC)
-        t->data = pa_xrealloc(t->data, t->allocated = t->length + l + GROW_TAG_SIZE);
-    else if (t->type == PA_TAGSTRUCT_APPENDED) {
-        t->type = PA_TAGSTRUCT_DYNAMIC;
-        t->data = pa_xmalloc(t->allocated = t->length + l + GROW_TAG_SIZE);
-        memcpy(t->data, t->per_type.appended, t->length);
-    }
+    grow(t, l);
 }
 
 static void write_u8(pa_tagstruct *t, uint8_t u) {
@@ -258,6 +285,13 @@ void pa_tagstruct_put_sample_spec(pa_tagstruct *t, const pa_sample_spec *ss) {
     write_u32(t, ss->rate);
 }
 
+void pa_tagstruct_append_data(pa_tagstruct *t, const uint8_t *data, size_t length) {
+    pa_assert(t);
+    pa_assert(data || length == 0);
+
+    write_arbitrary(t, data, length);
+}
+
 void pa_tagstruct_put_arbitrary(pa_tagstruct *t, const void *p, size_t length) {
     pa_assert(t);
     pa_assert(p);
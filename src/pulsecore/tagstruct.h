@@ -31,6 +31,7 @@
 #include <pulse/proplist.h>
 
 #include <pulsecore/macro.h>
+#include <pulsecore/packet.h>
 
 typedef struct pa_tagstruct pa_tagstruct;
 
@@ -65,9 +66,17 @@ pa_tagstruct *pa_tagstruct_new(void);
 pa_tagstruct *pa_tagstruct_new_fixed(const uint8_t* data, size_t length);
 void pa_tagstruct_free(pa_tagstruct*t);
 
+/* Frees the tagstruct and returns a packet with its contents. The packet
+ * takes over the buffer instead of copying it, unless the tagstruct is
+ * small enough to fit into the packet itself. */
+pa_packet *pa_tagstruct_free_to_packet(pa_tagstruct *t);
+
 int pa_tagstruct_eof(pa_tagstruct*t);
 const uint8_t* pa_tagstruct_data(pa_tagstruct*t, size_t *l);
 
+/* Appends data as returned by pa_tagstruct_data() for another tagstruct */
+void pa_tagstruct_append_data(pa_tagstruct *t, const uint8_t *data, size_t length);
+
 void pa_tagstruct_put(pa_tagstruct *t, ...);
 
 void pa_tagstruct_puts(pa_tagstruct*t, const char *s);
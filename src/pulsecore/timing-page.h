@@ -0,0 +1,81 @@
+#ifndef footimingpagehfoo
+#define footimingpagehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/macro.h>
+
+/* The timing of a playback stream, as the server would report it in reply
+ * to PA_COMMAND_GET_PLAYBACK_LATENCY. The server keeps this up to date in a
+ * memblock shared with the client, so that the client can read it without a
+ * round trip. Only the IO thread of the sink writes it. The layout is the
+ * same for 32 and 64 bit processes. */
+
+#define PA_TIMING_PAGE_VALID 0x1U   /* Cleared while the stream is not attached to a sink */
+#define PA_TIMING_PAGE_PLAYING 0x2U
+
+typedef struct pa_timing_page_data {
+    uint32_t flags;
+    uint32_t padding;
+    uint64_t timestamp;    /* pa_rtclock_now() when this was taken */
+    uint64_t sink_usec;    /* Including the render queue and the resampler */
+    int64_t read_index;
+    uint64_t underrun_for;
+    uint64_t playing_for;
+} pa_timing_page_data;
+
+typedef struct pa_timing_page {
+    /* Odd while an update is in progress */
+    pa_atomic_t seq;
+    uint32_t padding;
+    pa_timing_page_data data;
+} pa_timing_page;
+
+static inline void pa_timing_page_write(pa_timing_page *p, const pa_timing_page_data *d) {
+    pa_atomic_inc(&p->seq);
+    p->data = *d;
+    pa_atomic_inc(&p->seq);
+}
+
+/* Returns false if no consistent snapshot could be taken, because the
+ * writer kept updating it or was interrupted halfway */
+static inline bool pa_timing_page_read(const pa_timing_page *p, pa_timing_page_data *d) {
+    unsigned tries;
+
+    for (tries = 0; tries < 100; tries++) {
+        int seq;
+
+        if ((seq = pa_atomic_load(&p->seq)) & 1)
+            continue;
+
+        *d = p->data;
+
+        /* The copy must be complete before the counter is checked again */
+        __sync_synchronize();
+
+        if (pa_atomic_load(&p->seq) == seq)
+            return true;
+    }
+
+    return false;
+}
+
+#endif
@@ -0,0 +1,314 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/thread.h>
+
+#include "trace.h"
+
+/* Records per thread, must be a power of two */
+#define RING_SIZE 4096U
+#define RING_MASK (RING_SIZE - 1)
+
+typedef struct record {
+    pa_usec_t time;
+    uint64_t value;
+    uint32_t object;
+    uint8_t event;
+    uint8_t phase;
+} record;
+
+typedef struct ring ring;
+
+struct ring {
+    PA_LLIST_FIELDS(ring);
+
+    /* One reference is held by the thread, one by the list of rings */
+    pa_atomic_t ref;
+
+    unsigned id;
+    char name[17];
+
+    /* Only the thread writes, it publishes each record by incrementing the
+     * write index afterwards. The read index is only touched by the thread
+     * draining the ring, under the mutex. */
+    pa_atomic_t write_index;
+    unsigned read_index;
+
+    record records[RING_SIZE];
+};
+
+pa_atomic_t pa_trace_active = PA_ATOMIC_INIT(0);
+
+static pa_static_mutex mutex = PA_STATIC_MUTEX_INIT;
+static PA_LLIST_HEAD(ring, rings) = NULL;
+static unsigned next_id = 1;
+
+static void ring_unref(void *userdata) {
+    ring *r = userdata;
+
+    if (pa_atomic_dec(&r->ref) <= 1)
+        pa_xfree(r);
+}
+
+PA_STATIC_TLS_DECLARE(thread_ring, ring_unref);
+
+static ring *ring_new(void) {
+    pa_mutex *m;
+    const char *name;
+    ring *r;
+
+    /* This happens once per thread, on the first tracepoint hit */
+    r = pa_xnew0(ring, 1);
+    pa_atomic_store(&r->ref, 2);
+
+    if ((name = pa_thread_get_name(pa_thread_self())))
+        pa_strlcpy(r->name, name, sizeof(r->name));
+
+    m = pa_static_mutex_get(&mutex, false, false);
+    pa_mutex_lock(m);
+    r->id = next_id++;
+    PA_LLIST_PREPEND(ring, rings, r);
+    pa_mutex_unlock(m);
+
+    PA_STATIC_TLS_SET(thread_ring, r);
+
+    return r;
+}
+
+void pa_trace_emit(pa_trace_event_t event, pa_trace_phase_t phase, uint32_t object, uint64_t value) {
+    ring *r;
+    record *rec;
+    unsigned i;
+
+    pa_assert(event < PA_TRACE_EVENT_MAX);
+
+    if (!(r = PA_STATIC_TLS_GET(thread_ring)))
+        r = ring_new();
+
+    i = (unsigned) pa_atomic_load(&r->write_index);
+    rec = &r->records[i & RING_MASK];
+
+    rec->time = pa_rtclock_now();
+    rec->value = value;
+    rec->object = object;
+    rec->event = (uint8_t) event;
+    rec->phase = (uint8_t) phase;
+
+    pa_atomic_store(&r->write_index, (int) (i + 1));
+}
+
+/* Drops the rings of threads that are gone, if there is nothing left in
+ * them to drain or we don't care. Called with the mutex held. */
+static void rings_reap(bool drained_only) {
+    ring *r, *n;
+
+    for (r = rings; r; r = n) {
+        n = r->next;
+
+        if (pa_atomic_load(&r->ref) > 1)
+            continue;
+
+        if (drained_only && r->read_index != (unsigned) pa_atomic_load(&r->write_index))
+            continue;
+
+        PA_LLIST_REMOVE(ring, rings, r);
+        ring_unref(r);
+    }
+}
+
+void pa_trace_start(void) {
+    pa_mutex *m;
+    ring *r;
+
+    m = pa_static_mutex_get(&mutex, false, false);
+    pa_mutex_lock(m);
+
+    rings_reap(false);
+
+    PA_LLIST_FOREACH(r, rings)
+        r->read_index = (unsigned) pa_atomic_load(&r->write_index);
+
+    pa_mutex_unlock(m);
+
+    pa_atomic_store(&pa_trace_active, 1);
+    pa_log_info("Tracing started.");
+}
+
+void pa_trace_stop(void) {
+    pa_mutex *m;
+
+    pa_atomic_store(&pa_trace_active, 0);
+
+    /* What exited threads recorded is kept for the next dump */
+    m = pa_static_mutex_get(&mutex, false, false);
+    pa_mutex_lock(m);
+    rings_reap(true);
+    pa_mutex_unlock(m);
+
+    pa_log_info("Tracing stopped.");
+}
+
+static const char phase_char[] = {
+    [PA_TRACE_PHASE_BEGIN] = 'B',
+    [PA_TRACE_PHASE_END] = 'E',
+    [PA_TRACE_PHASE_INSTANT] = 'i'
+};
+
+/* Writes the records added since the last drain. Returns the number of
+ * records lost because the thread overwrote them first. */
+static unsigned ring_drain(ring *r, FILE *f, pid_t pid, bool *first) {
+    record *copy;
+    unsigned copy_start, start, end, valid, i, lost = 0;
+
+    end = (unsigned) pa_atomic_load(&r->write_index);
+    start = r->read_index;
+
+    if (end - start > RING_SIZE) {
+        lost = end - start - RING_SIZE;
+        start = end - RING_SIZE;
+    }
+
+    r->read_index = end;
+
+    if (start == end)
+        return lost;
+
+    copy_start = start;
+    copy = pa_xnew(record, end - start);
+    for (i = start; i != end; i++)
+        copy[i - copy_start] = r->records[i & RING_MASK];
+
+    /* Whatever the thread wrote in the meantime may have overwritten the
+     * oldest of the records we just copied */
+    valid = (unsigned) pa_atomic_load(&r->write_index) - RING_SIZE;
+    if ((int) (valid - start) > 0) {
+        if ((int) (valid - end) > 0)
+            valid = end;
+
+        lost += valid - start;
+        start = valid;
+    }
+
+    for (i = start; i != end; i++) {
+        const record *rec = &copy[i - copy_start];
+
+        fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":%lu,\"tid\":%u,",
+                *first ? "" : ",",
+                pa_trace_event_to_string(rec->event),
+                phase_char[rec->phase],
+                (unsigned long long) rec->time,
+                (unsigned long) pid,
+                r->id);
+
+        if (rec->phase == PA_TRACE_PHASE_INSTANT)
+            fputs("\"s\":\"t\",", f);
+
+        fprintf(f, "\"args\":{\"object\":%u,\"value\":%llu}}",
+                rec->object,
+                (unsigned long long) rec->value);
+
+        *first = false;
+    }
+
+    pa_xfree(copy);
+
+    return lost;
+}
+
+int pa_trace_dump(const char *fn) {
+    pa_mutex *m;
+    ring *r;
+    FILE *f;
+    pid_t pid;
+    unsigned lost = 0;
+    bool first = true;
+
+    pa_assert(fn);
+
+    if (!(f = pa_fopen_cloexec(fn, "w"))) {
+        pa_log("Failed to open trace file %s: %s", fn, pa_cstrerror(errno));
+        return -1;
+    }
+
+    pid = getpid();
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", f);
+
+    m = pa_static_mutex_get(&mutex, false, false);
+    pa_mutex_lock(m);
+
+    PA_LLIST_FOREACH(r, rings) {
+        fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                first ? "" : ",", (unsigned long) pid, r->id, r->name[0] ? r->name : "unknown");
+        first = false;
+
+        lost += ring_drain(r, f, pid, &first);
+    }
+
+    /* Drop the rings of threads that are gone once they are drained */
+    rings_reap(true);
+
+    pa_mutex_unlock(m);
+
+    fputs("\n]}\n", f);
+
+    if (fclose(f) != 0) {
+        pa_log("Failed to write trace file %s: %s", fn, pa_cstrerror(errno));
+        return -1;
+    }
+
+    if (lost > 0)
+        pa_log_warn("Trace rings overflowed, %u events lost.", lost);
+
+    pa_log_info("Trace written to %s.", fn);
+
+    return 0;
+}
+
+const char *pa_trace_event_to_string(pa_trace_event_t event) {
+    static const char * const table[PA_TRACE_EVENT_MAX] = {
+        [PA_TRACE_SINK_RENDER] = "sink-render",
+        [PA_TRACE_SINK_REWIND] = "sink-rewind",
+        [PA_TRACE_SOURCE_POST] = "source-post",
+        [PA_TRACE_SOURCE_REWIND] = "source-rewind",
+        [PA_TRACE_RTPOLL_POLL] = "rtpoll-poll",
+        [PA_TRACE_ASYNCMSGQ_DISPATCH] = "asyncmsgq-dispatch",
+        [PA_TRACE_ALSA_WRITE] = "alsa-write",
+        [PA_TRACE_UNDERRUN] = "underrun",
+        [PA_TRACE_POOL_FULL] = "pool-full"
+    };
+
+    pa_assert(event < PA_TRACE_EVENT_MAX);
+
+    return table[event];
+}
@@ -0,0 +1,91 @@
+#ifndef footracehfoo
+#define footracehfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <inttypes.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/macro.h>
+
+/* Binary event tracing for the realtime threads. Every thread that hits a
+ * tracepoint while tracing is enabled gets a ring of fixed size records of
+ * its own, which it writes without locking or formatting anything. The
+ * rings are drained by a non-realtime thread and written out in the Chrome
+ * trace event format, which chrome://tracing and the Perfetto UI can open.
+ * When a ring overflows, the oldest records are lost.
+ *
+ * When tracing is disabled, a tracepoint costs one load and a branch. */
+
+typedef enum pa_trace_event {
+    PA_TRACE_SINK_RENDER,        /* object: sink index, value: bytes */
+    PA_TRACE_SINK_REWIND,        /* object: sink index, value: bytes */
+    PA_TRACE_SOURCE_POST,        /* object: source index, value: bytes */
+    PA_TRACE_SOURCE_REWIND,      /* object: source index, value: bytes */
+    PA_TRACE_RTPOLL_POLL,        /* value: number of fds */
+    PA_TRACE_ASYNCMSGQ_DISPATCH, /* value: message code */
+    PA_TRACE_ALSA_WRITE,         /* object: sink index, value: sleep time chosen, in usec */
+    PA_TRACE_UNDERRUN,           /* object: sink index, value: bytes missing, if known */
+    PA_TRACE_POOL_FULL,          /* value: block size */
+    PA_TRACE_EVENT_MAX
+} pa_trace_event_t;
+
+typedef enum pa_trace_phase {
+    PA_TRACE_PHASE_BEGIN,
+    PA_TRACE_PHASE_END,
+    PA_TRACE_PHASE_INSTANT
+} pa_trace_phase_t;
+
+extern pa_atomic_t pa_trace_active;
+
+static inline bool pa_trace_enabled(void) {
+    return PA_UNLIKELY(pa_atomic_load(&pa_trace_active) != 0);
+}
+
+/* Called from any context, don't call directly, use the macros below */
+void pa_trace_emit(pa_trace_event_t event, pa_trace_phase_t phase, uint32_t object, uint64_t value);
+
+#define PA_TRACE_BEGIN(event, object, value)                            \
+    do {                                                                \
+        if (pa_trace_enabled())                                         \
+            pa_trace_emit(event, PA_TRACE_PHASE_BEGIN, object, value);  \
+    } while (false)
+
+#define PA_TRACE_END(event, object, value)                              \
+    do {                                                                \
+        if (pa_trace_enabled())                                         \
+            pa_trace_emit(event, PA_TRACE_PHASE_END, object, value);    \
+    } while (false)
+
+#define PA_TRACE_INSTANT(event, object, value)                          \
+    do {                                                                \
+        if (pa_trace_enabled())                                         \
+            pa_trace_emit(event, PA_TRACE_PHASE_INSTANT, object, value); \
+    } while (false)
+
+/* Called from main context. Starting drops everything recorded so far. */
+void pa_trace_start(void);
+void pa_trace_stop(void);
+
+/* Called from main context. Drains all rings into fn. Returns a negative
+ * error code on failure. */
+int pa_trace_dump(const char *fn);
+
+const char *pa_trace_event_to_string(pa_trace_event_t event);
+
+#endif
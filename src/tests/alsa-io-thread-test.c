@@ -0,0 +1,156 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/timeval.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include <modules/alsa/alsa-io-thread.h>
+
+#define RUN_MSEC 500
+
+struct fake_device {
+    pa_usec_t period;
+    bool fail_attach;
+
+    unsigned attached, detached;
+    unsigned processed, timeouts;
+};
+
+static int fake_attach(void *userdata, pa_alsa_io_device *d) {
+    struct fake_device *f = userdata;
+
+    if (f->fail_attach)
+        return -1;
+
+    f->attached++;
+    return 0;
+}
+
+static void fake_detach(void *userdata) {
+    struct fake_device *f = userdata;
+
+    f->detached++;
+}
+
+static int fake_process(void *userdata, bool on_timeout, pa_usec_t *sleep_usec) {
+    struct fake_device *f = userdata;
+
+    f->processed++;
+    if (on_timeout)
+        f->timeouts++;
+
+    *sleep_usec = f->period;
+    return 0;
+}
+
+static int fake_after_poll(void *userdata, bool on_timeout) {
+    return 0;
+}
+
+static const pa_alsa_io_device_cb fake_cb = {
+    .attach = fake_attach,
+    .detach = fake_detach,
+    .process = fake_process,
+    .after_poll = fake_after_poll,
+};
+
+START_TEST (io_thread_test) {
+    pa_mainloop *ml;
+    pa_alsa_io_thread *t;
+    pa_alsa_io_device *fast_d, *slow_d, *idle_d, *broken_d;
+    struct fake_device fast, slow, idle, broken;
+
+    pa_zero(fast);
+    fast.period = 5 * PA_USEC_PER_MSEC;
+    pa_zero(slow);
+    slow.period = 50 * PA_USEC_PER_MSEC;
+    pa_zero(idle);
+    pa_zero(broken);
+    broken.fail_attach = true;
+
+    fail_unless((ml = pa_mainloop_new()) != NULL);
+    fail_unless((t = pa_alsa_io_thread_new(pa_mainloop_get_api(ml), "test", false, 0)) != NULL);
+
+    fail_unless((fast_d = pa_alsa_io_thread_add_device(t, &fake_cb, &fast)) != NULL);
+    fail_unless((slow_d = pa_alsa_io_thread_add_device(t, &fake_cb, &slow)) != NULL);
+    fail_unless((idle_d = pa_alsa_io_thread_add_device(t, &fake_cb, &idle)) != NULL);
+    fail_unless((broken_d = pa_alsa_io_thread_add_device(t, &fake_cb, &broken)) == NULL);
+
+    pa_msleep(RUN_MSEC);
+
+    pa_alsa_io_thread_remove_device(t, fast_d);
+    pa_alsa_io_thread_remove_device(t, slow_d);
+    pa_alsa_io_thread_remove_device(t, idle_d);
+    pa_alsa_io_thread_unref(t);
+
+    pa_log_debug("fast: %u/%u, slow: %u/%u, idle: %u/%u",
+                 fast.processed, fast.timeouts, slow.processed, slow.timeouts, idle.processed, idle.timeouts);
+
+    ck_assert_uint_eq(fast.attached, 1);
+    ck_assert_uint_eq(fast.detached, 1);
+    ck_assert_uint_eq(broken.attached, 0);
+    ck_assert_uint_eq(broken.detached, 0);
+
+    /* Each device only runs when its own timer elapsed, apart from the first
+     * round after it was added. The bounds are loose to tolerate loaded
+     * machines. */
+    ck_assert_uint_eq(fast.processed, fast.timeouts + 1);
+    ck_assert_uint_eq(slow.processed, slow.timeouts + 1);
+    fail_unless(fast.processed >= RUN_MSEC / 5 / 4);
+    fail_unless(slow.processed <= RUN_MSEC / 50 + 2);
+    fail_unless(slow.processed >= 2);
+
+    /* A device without timer is not woken up by the others */
+    ck_assert_uint_eq(idle.processed, 1);
+    ck_assert_uint_eq(idle.timeouts, 0);
+
+    pa_mainloop_free(ml);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("ALSA IO thread");
+    tc = tcase_create("alsa-io-thread");
+    tcase_add_test(tc, io_thread_test);
+    tcase_set_timeout(tc, 10);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
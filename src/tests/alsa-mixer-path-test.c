@@ -6,16 +6,19 @@
 #include <dirent.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include <pulse/pulseaudio.h>
 #include <pulsecore/log.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/strlist.h>
 #include <modules/alsa/alsa-mixer.h>
+#include <modules/alsa/alsa-path-cache.h>
 
-/* This test inspects the Makefile, so this is not applicable when using
- * Meson. */
-#ifndef MESON_BUILD
+#include "runtime-test-util.h"
+
+#define TIMES 1
+#define TIMES2 20
 
 static const char *get_default_paths_dir(void) {
     if (pa_run_from_build_tree())
@@ -24,6 +27,10 @@ static const char *get_default_paths_dir(void) {
         return PA_ALSA_DATA_DIR PA_PATH_SEP "paths/";
 }
 
+/* This test inspects the Makefile, so this is not applicable when using
+ * Meson. */
+#ifndef MESON_BUILD
+
 static pa_strlist *load_makefile() {
     FILE *f;
     bool lookforfiles = false;
@@ -95,8 +102,126 @@ START_TEST (mixer_path_test) {
 }
 END_TEST
 
+static pa_strlist *list_path_files(const char *pathsdir) {
+    DIR *dir;
+    struct dirent *ent;
+    pa_strlist *files = NULL;
+
+    fail_unless((dir = opendir(pathsdir)) != NULL);
+
+    while ((ent = readdir(dir)) != NULL)
+        if (pa_endswith(ent->d_name, ".conf"))
+            files = pa_strlist_prepend(files, ent->d_name);
+
+    closedir(dir);
+
+    return files;
+}
+
+static void load_all(const char *pathsdir, pa_strlist *files) {
+    pa_strlist *n;
+
+    for (n = files; n; n = pa_strlist_next(n)) {
+        pa_alsa_path *path;
+
+        fail_unless((path = pa_alsa_path_new(pathsdir, pa_strlist_data(n), PA_ALSA_DIRECTION_ANY)) != NULL);
+        pa_alsa_path_free(path);
+    }
+}
+
+static unsigned count_elements(pa_alsa_path *p) {
+    pa_alsa_element *e;
+    unsigned n = 0;
+
+    PA_LLIST_FOREACH(e, p->elements)
+        n++;
+
+    return n;
+}
+
+static unsigned count_jacks(pa_alsa_path *p) {
+    pa_alsa_jack *j;
+    unsigned n = 0;
+
+    PA_LLIST_FOREACH(j, p->jacks)
+        n++;
+
+    return n;
+}
+
+START_TEST (mixer_path_cache_test) {
+    const char *pathsdir = get_default_paths_dir();
+    pa_strlist *files, *n;
+
+    files = list_path_files(pathsdir);
+
+    /* A path instantiated from the cache looks like the parsed one */
+    for (n = files; n; n = pa_strlist_next(n)) {
+        pa_alsa_path *parsed, *cached;
+
+        pa_alsa_path_cache_clear();
+
+        fail_unless((parsed = pa_alsa_path_new(pathsdir, pa_strlist_data(n), PA_ALSA_DIRECTION_ANY)) != NULL);
+        fail_unless((cached = pa_alsa_path_new(pathsdir, pa_strlist_data(n), PA_ALSA_DIRECTION_ANY)) != NULL);
+
+        ck_assert_str_eq(parsed->name, cached->name);
+        ck_assert_str_eq(parsed->description, cached->description);
+        ck_assert_int_eq(parsed->priority, cached->priority);
+        ck_assert_int_eq(parsed->device_port_type, cached->device_port_type);
+        ck_assert_int_eq(count_elements(parsed), count_elements(cached));
+        ck_assert_int_eq(count_jacks(parsed), count_jacks(cached));
+
+        pa_alsa_path_free(parsed);
+        pa_alsa_path_free(cached);
+    }
+
+    /* Parse time for the full shipped path set */
+    PA_RUNTIME_TEST_RUN_START("parse", TIMES, TIMES2) {
+        pa_alsa_path_cache_clear();
+        load_all(pathsdir, files);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("compiled, in memory", TIMES, TIMES2) {
+        load_all(pathsdir, files);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_alsa_path_cache_flush();
+
+    PA_RUNTIME_TEST_RUN_START("compiled, from disk", TIMES, TIMES2) {
+        pa_alsa_path_cache_clear();
+        load_all(pathsdir, files);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_alsa_path_cache_clear();
+    pa_strlist_free(files);
+}
+END_TEST
+
+static void remove_dir(const char *path) {
+    DIR *dir;
+    struct dirent *ent;
+
+    if (!(dir = opendir(path)))
+        return;
+
+    while ((ent = readdir(dir))) {
+        char *fn;
+
+        if (pa_streq(ent->d_name, ".") || pa_streq(ent->d_name, ".."))
+            continue;
+
+        fn = pa_sprintf_malloc("%s" PA_PATH_SEP "%s", path, ent->d_name);
+        unlink(fn);
+        pa_xfree(fn);
+    }
+
+    closedir(dir);
+    rmdir(path);
+}
+
 int main(int argc, char *argv[]) {
     int failed = 0;
+    char *state_dir;
     Suite *s;
     TCase *tc;
     SRunner *sr;
@@ -104,9 +229,16 @@ int main(int argc, char *argv[]) {
     if (!getenv("MAKE_CHECK"))
         pa_log_set_level(PA_LOG_DEBUG);
 
+    /* Keep the compiled paths out of the user's state directory */
+    state_dir = pa_xstrdup("/tmp/alsa-mixer-path-test-XXXXXX");
+    fail_unless(mkdtemp(state_dir) != NULL);
+    setenv("PULSE_STATE_PATH", state_dir, 1);
+
     s = suite_create("Alsa-mixer-path");
     tc = tcase_create("alsa-mixer-path");
     tcase_add_test(tc, mixer_path_test);
+    tcase_add_test(tc, mixer_path_cache_test);
+    tcase_set_timeout(tc, 120);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -114,5 +246,8 @@ int main(int argc, char *argv[]) {
     failed = srunner_ntests_failed(sr);
     srunner_free(sr);
 
+    remove_dir(state_dir);
+    pa_xfree(state_dir);
+
     return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
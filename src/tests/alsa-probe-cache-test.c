@@ -0,0 +1,270 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <alsa/asoundlib.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include <modules/alsa/alsa-util.h>
+#include <modules/alsa/alsa-probe-cache.h>
+
+#include "runtime-test-util.h"
+
+#define TIMES 1
+#define TIMES2 10
+
+/* snd-dummy, load it with "modprobe snd-dummy" to run the benchmark */
+#define DUMMY_CARD "Dummy"
+
+static char *state_dir;
+
+static pa_hashmap *mixers_new(void) {
+    return pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                               pa_xfree, (pa_free_cb_t) pa_alsa_mixer_free);
+}
+
+/* Pretends that only the first profile with output mappings was found
+ * supported */
+static pa_alsa_profile *fake_probe(pa_alsa_profile_set *ps) {
+    pa_alsa_profile *p, *supported = NULL;
+    pa_alsa_mapping *m;
+    void *state;
+    uint32_t idx;
+
+    PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+        if (!supported && p->output_mappings && pa_idxset_size(p->output_mappings) > 0 &&
+            (!p->input_mappings || pa_idxset_size(p->input_mappings) == 0)) {
+            supported = p;
+            p->supported = true;
+
+            PA_IDXSET_FOREACH(m, p->output_mappings, idx) {
+                m->supported++;
+                m->hw_device_index = 3;
+            }
+        } else
+            p->supported = false;
+    }
+
+    pa_alsa_profile_set_drop_unsupported(ps);
+    ps->probed = true;
+
+    return supported;
+}
+
+START_TEST (probe_cache_checksum_test) {
+    pa_alsa_profile_set *ps;
+    pa_sample_spec ss = { PA_SAMPLE_S16LE, 44100, 2 };
+    char *a, *b;
+
+    fail_unless((ps = pa_alsa_profile_set_new(NULL, NULL)) != NULL);
+
+    a = pa_alsa_probe_cache_checksum(ps, &ss, 4, 25);
+    b = pa_alsa_probe_cache_checksum(ps, &ss, 4, 25);
+    ck_assert_str_eq(a, b);
+    pa_xfree(b);
+
+    ss.rate = 48000;
+    b = pa_alsa_probe_cache_checksum(ps, &ss, 4, 25);
+    fail_if(pa_streq(a, b));
+    pa_xfree(b);
+
+    ss.rate = 44100;
+    b = pa_alsa_probe_cache_checksum(ps, &ss, 2, 25);
+    fail_if(pa_streq(a, b));
+    pa_xfree(b);
+
+    pa_xfree(a);
+    pa_alsa_profile_set_free(ps);
+}
+END_TEST
+
+START_TEST (probe_cache_roundtrip_test) {
+    pa_alsa_profile_set *ps;
+    pa_alsa_profile *supported, *p;
+    pa_alsa_mapping *m;
+    pa_alsa_probe_cache_entry *e;
+    pa_hashmap *mixers;
+    char *name;
+    int hw_device_index;
+    void *state;
+    uint32_t idx;
+
+    fail_unless((ps = pa_alsa_profile_set_new(NULL, NULL)) != NULL);
+    fail_unless((supported = fake_probe(ps)) != NULL);
+    name = pa_xstrdup(supported->name);
+
+    e = pa_alsa_probe_cache_entry_new(ps, "0123456789abcdef");
+    pa_alsa_probe_cache_save("test-card", e);
+    pa_alsa_probe_cache_entry_free(e);
+
+    fail_unless(pa_alsa_probe_cache_load("unknown-card") == NULL);
+    fail_unless((e = pa_alsa_probe_cache_load("test-card")) != NULL);
+    ck_assert_str_eq(pa_alsa_probe_cache_entry_get_checksum(e), "0123456789abcdef");
+    fail_unless(pa_alsa_probe_cache_entry_get_supported(e, name));
+
+    PA_IDXSET_FOREACH(m, supported->output_mappings, idx) {
+        fail_unless(pa_alsa_probe_cache_entry_get_hw_device_index(e, m->name, &hw_device_index));
+        ck_assert_int_eq(hw_device_index, 3);
+    }
+
+    pa_alsa_profile_set_free(ps);
+
+    /* Applying the entry to a fresh set gives the same profiles. There is no
+     * card behind it, so all mixer paths are dropped. */
+    fail_unless((ps = pa_alsa_profile_set_new(NULL, NULL)) != NULL);
+    mixers = mixers_new();
+
+    fail_unless(pa_alsa_profile_set_probe_from_cache(ps, mixers, 99, e));
+    fail_unless(ps->probed);
+    ck_assert_int_eq(pa_hashmap_size(ps->profiles), 1);
+
+    PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+        ck_assert_str_eq(p->name, name);
+        fail_unless(p->supported);
+
+        PA_IDXSET_FOREACH(m, p->output_mappings, idx) {
+            ck_assert_int_eq(m->hw_device_index, 3);
+            ck_assert_int_eq(m->supported, 1);
+        }
+    }
+
+    pa_hashmap_free(mixers);
+    pa_alsa_profile_set_free(ps);
+    pa_alsa_probe_cache_entry_free(e);
+    pa_xfree(name);
+}
+END_TEST
+
+START_TEST (probe_cache_benchmark_test) {
+    pa_sample_spec ss = { PA_SAMPLE_S16LE, 44100, 2 };
+    pa_alsa_probe_cache_entry *e;
+    char *checksum;
+    int card_index;
+
+    if ((card_index = snd_card_get_index(DUMMY_CARD)) < 0) {
+        pa_log_info("No snd-dummy card, skipping benchmark");
+        return;
+    }
+
+    {
+        pa_alsa_profile_set *ps;
+        pa_hashmap *mixers;
+
+        fail_unless((ps = pa_alsa_profile_set_new(NULL, NULL)) != NULL);
+        mixers = mixers_new();
+
+        pa_alsa_profile_set_probe(ps, mixers, DUMMY_CARD, &ss, 4, 25);
+        checksum = pa_alsa_probe_cache_checksum(ps, &ss, 4, 25);
+        e = pa_alsa_probe_cache_entry_new(ps, checksum);
+
+        pa_hashmap_free(mixers);
+        pa_alsa_profile_set_free(ps);
+    }
+
+    PA_RUNTIME_TEST_RUN_START("full probe", TIMES, TIMES2) {
+        pa_alsa_profile_set *ps;
+        pa_hashmap *mixers;
+
+        fail_unless((ps = pa_alsa_profile_set_new(NULL, NULL)) != NULL);
+        mixers = mixers_new();
+        pa_alsa_profile_set_probe(ps, mixers, DUMMY_CARD, &ss, 4, 25);
+        pa_hashmap_free(mixers);
+        pa_alsa_profile_set_free(ps);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    PA_RUNTIME_TEST_RUN_START("cached probe", TIMES, TIMES2) {
+        pa_alsa_profile_set *ps;
+        pa_hashmap *mixers;
+
+        fail_unless((ps = pa_alsa_profile_set_new(NULL, NULL)) != NULL);
+        mixers = mixers_new();
+        fail_unless(pa_alsa_profile_set_probe_from_cache(ps, mixers, card_index, e));
+        pa_hashmap_free(mixers);
+        pa_alsa_profile_set_free(ps);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_alsa_probe_cache_entry_free(e);
+    pa_xfree(checksum);
+}
+END_TEST
+
+static void remove_state_dir(void) {
+    DIR *dir;
+    struct dirent *ent;
+
+    if (!(dir = opendir(state_dir)))
+        return;
+
+    while ((ent = readdir(dir))) {
+        char *fn;
+
+        if (pa_streq(ent->d_name, ".") || pa_streq(ent->d_name, ".."))
+            continue;
+
+        fn = pa_sprintf_malloc("%s" PA_PATH_SEP "%s", state_dir, ent->d_name);
+        unlink(fn);
+        pa_xfree(fn);
+    }
+
+    closedir(dir);
+    rmdir(state_dir);
+}
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    /* Keep the cache out of the user's state directory */
+    state_dir = pa_xstrdup("/tmp/alsa-probe-cache-test-XXXXXX");
+    fail_unless(mkdtemp(state_dir) != NULL);
+    setenv("PULSE_STATE_PATH", state_dir, 1);
+
+    s = suite_create("ALSA probe cache");
+    tc = tcase_create("alsa-probe-cache");
+    tcase_add_test(tc, probe_cache_checksum_test);
+    tcase_add_test(tc, probe_cache_roundtrip_test);
+    tcase_add_test(tc, probe_cache_benchmark_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    remove_state_dir();
+    pa_xfree(state_dir);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,174 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/json.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include <modules/alsa/alsa-timing.h>
+
+#define PROBABILITY 0.001
+
+static void add_usage(pa_alsa_timing *t, pa_usec_t now, pa_usec_t usage, unsigned n) {
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        pa_alsa_timing_add_usage(t, now, usage);
+}
+
+START_TEST (timing_quantile_test) {
+    pa_alsa_timing t;
+    pa_usec_t wm;
+
+    pa_alsa_timing_init(&t, 0);
+
+    /* Too few samples for any estimate */
+    add_usage(&t, 0, 1000, PA_ALSA_TIMING_MIN_SAMPLES - 1);
+    fail_if(pa_alsa_timing_required_watermark(&t, PROBABILITY, &wm));
+
+    /* All samples in one bucket, the maximum is the tighter bound */
+    add_usage(&t, 0, 1000, 1);
+    fail_unless(pa_alsa_timing_required_watermark(&t, PROBABILITY, &wm));
+    ck_assert_uint_eq(wm, 1000);
+
+    /* With less than 1/PROBABILITY samples the worst case must be covered */
+    add_usage(&t, 0, 10000, 1);
+    fail_unless(pa_alsa_timing_required_watermark(&t, PROBABILITY, &wm));
+    ck_assert_uint_eq(wm, 10000);
+
+    /* Enough samples to ignore the single outlier, the result is the edge
+     * of the bucket holding the 1ms samples */
+    add_usage(&t, 0, 1000, 1000);
+    fail_unless(pa_alsa_timing_required_watermark(&t, PROBABILITY, &wm));
+    ck_assert_uint_eq(wm, 1000 + PA_ALSA_TIMING_BUCKET_USEC);
+
+    /* Beyond the histogram range there is no estimate */
+    pa_alsa_timing_init(&t, 0);
+    add_usage(&t, 0, (PA_ALSA_TIMING_BUCKETS + 1) * PA_ALSA_TIMING_BUCKET_USEC, PA_ALSA_TIMING_MIN_SAMPLES);
+    fail_if(pa_alsa_timing_required_watermark(&t, PROBABILITY, &wm));
+}
+END_TEST
+
+START_TEST (timing_window_test) {
+    pa_alsa_timing t;
+    pa_usec_t wm;
+
+    pa_alsa_timing_init(&t, 0);
+
+    add_usage(&t, 0, 20000, PA_ALSA_TIMING_MIN_SAMPLES);
+
+    /* The previous generation still counts */
+    add_usage(&t, PA_ALSA_TIMING_WINDOW_USEC, 1000, PA_ALSA_TIMING_MIN_SAMPLES);
+    fail_unless(pa_alsa_timing_required_watermark(&t, PROBABILITY, &wm));
+    ck_assert_uint_eq(wm, 20000);
+
+    /* The one before is gone */
+    add_usage(&t, 2 * PA_ALSA_TIMING_WINDOW_USEC, 1000, PA_ALSA_TIMING_MIN_SAMPLES);
+    fail_unless(pa_alsa_timing_required_watermark(&t, PROBABILITY, &wm));
+    ck_assert_uint_eq(wm, 1000);
+
+    ck_assert_uint_eq(t.n_wakeups, 3 * PA_ALSA_TIMING_MIN_SAMPLES);
+}
+END_TEST
+
+START_TEST (timing_json_test) {
+    pa_alsa_timing t;
+    pa_json_encoder *encoder;
+    pa_json_object *o;
+    const pa_json_object *history, *jitter, *render;
+    char *s;
+    unsigned i;
+
+    pa_alsa_timing_init(&t, 0);
+
+    for (i = 0; i < PA_ALSA_TIMING_HISTORY + 4; i++)
+        pa_alsa_timing_watermark_changed(&t, i * PA_USEC_PER_SEC, (i + 1) * 1000, i % 2);
+
+    pa_alsa_timing_add_jitter(&t, 200);
+    pa_alsa_timing_add_jitter(&t, 100 * PA_USEC_PER_MSEC);
+    pa_alsa_timing_add_render(&t, 300);
+    pa_alsa_timing_add_render(&t, 500);
+    pa_alsa_timing_add_underrun(&t);
+
+    encoder = pa_json_encoder_new();
+    pa_json_encoder_begin_element_object(encoder);
+    pa_alsa_timing_to_json(&t, encoder);
+    pa_json_encoder_end_object(encoder);
+    s = pa_json_encoder_to_string_free(encoder);
+
+    pa_log_debug("%s", s);
+
+    fail_unless((o = pa_json_parse(s)) != NULL);
+    pa_xfree(s);
+
+    ck_assert_int_eq(pa_json_object_get_int(pa_json_object_get_object_member(o, "underruns")), 1);
+
+    render = pa_json_object_get_object_member(o, "render");
+    ck_assert_int_eq(pa_json_object_get_int(pa_json_object_get_object_member(render, "count")), 2);
+    ck_assert_int_eq(pa_json_object_get_int(pa_json_object_get_object_member(render, "total_usec")), 800);
+    ck_assert_int_eq(pa_json_object_get_int(pa_json_object_get_object_member(render, "max_usec")), 500);
+
+    /* The second jitter sample is beyond the range and ends up in the
+     * overflow bucket */
+    jitter = pa_json_object_get_object_member(o, "wakeup_jitter");
+    ck_assert_int_eq(pa_json_object_get_int(pa_json_object_get_object_member(jitter, "count")), 2);
+    ck_assert_int_eq(pa_json_object_get_array_length(pa_json_object_get_object_member(jitter, "buckets")), PA_ALSA_TIMING_BUCKETS + 1);
+    ck_assert_int_eq(pa_json_object_get_int(pa_json_object_get_array_member(pa_json_object_get_object_member(jitter, "buckets"), 0)), 1);
+    ck_assert_int_eq(pa_json_object_get_int(pa_json_object_get_array_member(pa_json_object_get_object_member(jitter, "buckets"), PA_ALSA_TIMING_BUCKETS)), 1);
+
+    /* Only the most recent changes are kept, oldest first */
+    history = pa_json_object_get_object_member(o, "watermark_history");
+    ck_assert_int_eq(pa_json_object_get_array_length(history), PA_ALSA_TIMING_HISTORY);
+    ck_assert_int_eq(pa_json_object_get_int(pa_json_object_get_object_member(pa_json_object_get_array_member(history, 0), "watermark_usec")), 5000);
+    ck_assert_int_eq(pa_json_object_get_int(pa_json_object_get_object_member(pa_json_object_get_array_member(history, PA_ALSA_TIMING_HISTORY - 1), "watermark_usec")),
+                     (PA_ALSA_TIMING_HISTORY + 4) * 1000);
+
+    pa_json_object_free(o);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("ALSA timing");
+    tc = tcase_create("alsa-timing");
+    tcase_add_test(tc, timing_quantile_test);
+    tcase_add_test(tc, timing_window_test);
+    tcase_add_test(tc, timing_json_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
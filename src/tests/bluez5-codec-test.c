@@ -0,0 +1,559 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <math.h>
+#include <time.h>
+
+#include <pulse/proplist.h>
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-rtclock.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/resampler.h>
+#include <pulsecore/sound-file.h>
+
+#include <sbc/sbc.h>
+
+#include <modules/bluetooth/a2dp-codecs.h>
+#include <modules/bluetooth/a2dp-codec-util.h>
+#include <modules/bluetooth/rtp.h>
+
+/* Offline benchmark of the Bluetooth codecs. Each codec is configured the way
+ * transport_config() would set it up against a peer advertising all of our
+ * own capabilities, and a WAV file (set BT_CODEC_TEST_WAV) or a synthetic
+ * signal is encoded block by block, like the bluez5 IO thread does it, then
+ * decoded again where the codec has a decoder. No Bluetooth hardware is
+ * needed. */
+
+/* Typical BR/EDR A2DP write MTU, override with BT_CODEC_TEST_MTU */
+#define A2DP_MTU 895
+/* What sco_acquire_cb() reports when the MTU is not autodetected */
+#define SCO_MTU 144
+#define SYNTHETIC_SECONDS 10
+
+/* Link model for the bitrate adaptation run: the radio manages this share of
+ * the packets the codec produces at its highest bitrate */
+#define LINK_CAPACITY 0.7
+#define ADAPTATION_SECONDS 30
+
+static pa_mempool *pool;
+
+struct codec_stats {
+    unsigned blocks;
+    unsigned packets;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    size_t max_packet;
+
+    /* Time spent inside encode_buffer(), i.e. on the IO thread */
+    pa_usec_t call_usec;
+    pa_usec_t call_max_usec;
+    /* CPU time of the whole process, including codec threads */
+    pa_usec_t cpu_usec;
+    pa_usec_t wall_usec;
+
+    uint64_t bytes_decoded;
+    pa_usec_t decode_cpu_usec;
+};
+
+/* Encoded packets, kept for the decoder */
+struct packet_store {
+    uint8_t *data;
+    size_t length, allocated;
+    size_t *sizes;
+    unsigned n_sizes, allocated_sizes;
+};
+
+static pa_usec_t cpu_now(void) {
+    struct timespec ts;
+
+    pa_assert_se(clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) == 0);
+    return pa_timespec_load(&ts);
+}
+
+static size_t a2dp_mtu(void) {
+    const char *e;
+    uint32_t mtu;
+
+    if ((e = getenv("BT_CODEC_TEST_MTU")) && pa_atou(e, &mtu) >= 0 && mtu > 0)
+        return mtu;
+
+    return A2DP_MTU;
+}
+
+static void packet_store_add(struct packet_store *s, const uint8_t *d, size_t length) {
+    if (s->length + length > s->allocated) {
+        s->allocated = PA_MAX(2 * s->allocated, s->length + length);
+        s->data = pa_xrealloc(s->data, s->allocated);
+    }
+
+    if (s->n_sizes >= s->allocated_sizes) {
+        s->allocated_sizes = PA_MAX(2 * s->allocated_sizes, 64u);
+        s->sizes = pa_xrealloc(s->sizes, s->allocated_sizes * sizeof(size_t));
+    }
+
+    memcpy(s->data + s->length, d, length);
+    s->length += length;
+    s->sizes[s->n_sizes++] = length;
+}
+
+static void packet_store_done(struct packet_store *s) {
+    pa_xfree(s->data);
+    pa_xfree(s->sizes);
+    pa_zero(*s);
+}
+
+/* Returns the test signal converted to the codec's sample spec */
+static void load_input(const pa_sample_spec *ss, pa_memchunk *result) {
+    pa_sample_spec in_ss;
+    pa_channel_map in_map, map;
+    pa_memchunk in;
+    pa_resampler *r;
+    const char *fn;
+
+    if ((fn = getenv("BT_CODEC_TEST_WAV"))) {
+        fail_unless(pa_sound_file_load(pool, fn, &in_ss, &in_map, &in, NULL) == 0, "failed to load %s", fn);
+        pa_log_debug("Encoding %s", fn);
+    } else {
+        float *d;
+        unsigned i, c;
+
+        in_ss.format = PA_SAMPLE_FLOAT32NE;
+        in_ss.rate = ss->rate;
+        in_ss.channels = ss->channels;
+        pa_channel_map_init_auto(&in_map, in_ss.channels, PA_CHANNEL_MAP_DEFAULT);
+
+        in.index = 0;
+        in.length = pa_usec_to_bytes(SYNTHETIC_SECONDS * PA_USEC_PER_SEC, &in_ss);
+        in.memblock = pa_memblock_new(pool, in.length);
+
+        /* A slow sweep, so the encoders do not see a trivially stationary signal */
+        d = pa_memblock_acquire(in.memblock);
+        for (i = 0; i < in.length / pa_frame_size(&in_ss); i++) {
+            float t = (float) i / in_ss.rate;
+
+            for (c = 0; c < in_ss.channels; c++)
+                d[i * in_ss.channels + c] = 0.5f * sinf(2.0f * (float) M_PI * (220.0f + 400.0f * t) * t + c);
+        }
+        pa_memblock_release(in.memblock);
+    }
+
+    pa_channel_map_init_auto(&map, ss->channels, PA_CHANNEL_MAP_DEFAULT);
+
+    if (pa_sample_spec_equal(&in_ss, ss)) {
+        *result = in;
+        return;
+    }
+
+    pa_assert_se(r = pa_resampler_new(pool, &in_ss, &in_map, ss, &map, 0, PA_RESAMPLER_AUTO, 0));
+    pa_resampler_run(r, &in, result);
+    pa_resampler_free(r);
+    pa_memblock_unref(in.memblock);
+
+    fail_unless(result->memblock != NULL);
+}
+
+static size_t write_block_size(const pa_bt_codec *codec, void *info, const pa_sample_spec *ss, size_t mtu) {
+    size_t block_size;
+
+    /* Same rounding as transport_config_mtu() */
+    block_size = pa_frame_align(codec->get_write_block_size(info, mtu), ss);
+    fail_unless(block_size > 0, "%s: zero write block size", codec->name);
+
+    return block_size;
+}
+
+static size_t encoder_buffer_size(const pa_bt_codec *codec, void *info, size_t block_size, size_t mtu) {
+    size_t encoded_size, encoded_frames;
+
+    /* Same reservation as bt_prepare_encoder_buffer() */
+    encoded_size = codec->get_encoded_block_size ? codec->get_encoded_block_size(info, block_size) : block_size;
+    encoded_frames = PA_MAX(mtu / block_size + 1, (size_t) 2);
+
+    return encoded_frames * encoded_size;
+}
+
+static void encode_input(const pa_bt_codec *codec, void *info, const pa_sample_spec *ss, size_t mtu,
+                         const pa_memchunk *input, struct codec_stats *stats, struct packet_store *packets) {
+    size_t block_size, output_size, offset;
+    uint8_t *output;
+    const uint8_t *d;
+    pa_usec_t start_wall, start_cpu;
+
+    block_size = write_block_size(codec, info, ss, mtu);
+    output_size = encoder_buffer_size(codec, info, block_size, mtu);
+    output = pa_xmalloc(output_size);
+
+    d = pa_memblock_acquire_chunk(input);
+    start_wall = pa_rtclock_now();
+    start_cpu = cpu_now();
+
+    for (offset = 0; offset + block_size <= input->length; offset += block_size) {
+        size_t written, processed;
+        pa_usec_t t, call;
+
+        t = pa_rtclock_now();
+        written = codec->encode_buffer(info, offset / pa_frame_size(ss), d + offset, block_size, output, output_size, &processed);
+        call = pa_rtclock_now() - t;
+
+        fail_unless(processed == block_size, "%s: encoding error", codec->name);
+        fail_unless(written <= output_size);
+
+        stats->blocks++;
+        stats->bytes_in += block_size;
+        stats->call_usec += call;
+        stats->call_max_usec = PA_MAX(stats->call_max_usec, call);
+
+        if (written > 0) {
+            stats->packets++;
+            stats->bytes_out += written;
+            stats->max_packet = PA_MAX(stats->max_packet, written);
+
+            if (packets)
+                packet_store_add(packets, output, written);
+        }
+    }
+
+    stats->cpu_usec = cpu_now() - start_cpu;
+    stats->wall_usec = pa_rtclock_now() - start_wall;
+    pa_memblock_release(input->memblock);
+
+    pa_xfree(output);
+}
+
+static void decode_packets(const pa_bt_codec *codec, void *info, size_t mtu, const struct packet_store *packets, struct codec_stats *stats) {
+    size_t output_size, offset = 0;
+    uint8_t *output;
+    pa_usec_t start_cpu;
+    unsigned i;
+
+    /* The read block size is what one MTU worth of input decodes to */
+    output_size = codec->get_read_block_size(info, PA_MAX(mtu, stats->max_packet));
+    output = pa_xmalloc(output_size);
+
+    start_cpu = cpu_now();
+
+    for (i = 0; i < packets->n_sizes; i++) {
+        size_t written, processed;
+
+        written = codec->decode_buffer(info, packets->data + offset, packets->sizes[i], output, output_size, &processed);
+        fail_unless(processed == packets->sizes[i], "%s: decoding error in packet %u", codec->name, i);
+        fail_unless(written <= output_size);
+
+        stats->bytes_decoded += written;
+        offset += packets->sizes[i];
+    }
+
+    stats->decode_cpu_usec = cpu_now() - start_cpu;
+
+    pa_xfree(output);
+}
+
+/* Replays the rate control of the bluez5 IO thread in audio time against a
+ * link that can carry only LINK_CAPACITY of the packets the codec produces at
+ * its starting bitrate. Whenever more than two blocks are backlogged the
+ * bitrate is reduced, after a quiet refresh interval it is increased again. */
+static void simulate_adaptation(const pa_bt_codec *codec, void *info, const pa_sample_spec *ss, size_t mtu) {
+    size_t block_size, min_block_size, max_block_size, new_block_size;
+    pa_usec_t now = 0, link_free = 0, last_change = 0, packet_usec;
+    unsigned reductions = 0, increases = 0, skips = 0;
+
+    if (!codec->reduce_encoder_bitrate)
+        return;
+
+    block_size = min_block_size = max_block_size = write_block_size(codec, info, ss, mtu);
+
+    /* The link sends one packet per packet_usec, regardless of its size */
+    packet_usec = (pa_usec_t) (pa_bytes_to_usec(block_size, ss) / LINK_CAPACITY);
+
+    while (now < ADAPTATION_SECONDS * PA_USEC_PER_SEC) {
+        link_free = PA_MAX(link_free, now) + packet_usec;
+        now += pa_bytes_to_usec(block_size, ss);
+
+        if (link_free > now + 2 * pa_bytes_to_usec(block_size, ss)) {
+            /* The device thread drops the backlog and reduces the bitrate */
+            skips++;
+            link_free = now;
+
+            if ((new_block_size = codec->reduce_encoder_bitrate(info, mtu))) {
+                block_size = pa_frame_align(new_block_size, ss);
+                reductions++;
+            }
+            last_change = now;
+        } else if (link_free <= now && codec->increase_encoder_bitrate &&
+                   now - last_change >= DEFAULT_OUTPUT_RATE_REFRESH_INTERVAL_MS * PA_USEC_PER_MSEC) {
+            if ((new_block_size = codec->increase_encoder_bitrate(info, mtu))) {
+                block_size = pa_frame_align(new_block_size, ss);
+                increases++;
+            }
+            last_change = now;
+        }
+
+        min_block_size = PA_MIN(min_block_size, block_size);
+        max_block_size = PA_MAX(max_block_size, block_size);
+    }
+
+    pa_log_info("%-12s adaptation at %.0f%% link capacity: %u skips, %u reductions, %u increases, "
+                "block size %zu..%zu, final %zu",
+                codec->name, LINK_CAPACITY * 100, skips, reductions, increases,
+                min_block_size, max_block_size, block_size);
+
+    /* A codec that can reduce its bitrate must settle below the link rate
+     * instead of dropping audio for the whole run */
+    if (reductions > 0)
+        fail_unless(skips < ADAPTATION_SECONDS * 2, "%s: bitrate adaptation does not converge", codec->name);
+}
+
+static void report(const pa_bt_codec *codec, const pa_sample_spec *ss, size_t mtu, const struct codec_stats *stats) {
+    double audio_sec = (double) pa_bytes_to_usec(stats->bytes_in, ss) / PA_USEC_PER_SEC;
+
+    pa_log_info("%-12s MTU %zu: %u blocks -> %u packets (max %zu bytes), %.1f kbit/s, %.0f packets/s, "
+                "%.2f ms CPU per second of audio, encode_buffer() avg %llu us max %llu us",
+                codec->name, mtu, stats->blocks, stats->packets, stats->max_packet,
+                (double) stats->bytes_out * 8 / audio_sec / 1000,
+                (double) stats->packets * PA_USEC_PER_SEC / PA_MAX(stats->wall_usec, (pa_usec_t) 1),
+                (double) stats->cpu_usec / PA_USEC_PER_MSEC / audio_sec,
+                (unsigned long long) (stats->call_usec / PA_MAX(stats->blocks, 1u)),
+                (unsigned long long) stats->call_max_usec);
+
+    if (stats->bytes_decoded > 0)
+        pa_log_info("%-12s decoded %.2f s of audio, %.2f ms CPU per second of audio",
+                    codec->name, (double) pa_bytes_to_usec(stats->bytes_decoded, ss) / PA_USEC_PER_SEC,
+                    (double) stats->decode_cpu_usec / PA_USEC_PER_MSEC / audio_sec);
+}
+
+/* config and ss have to outlive the codec, which keeps pointers to both */
+static void bench_codec(const pa_bt_codec *codec, const uint8_t *config, uint8_t config_size, size_t mtu, bool a2dp, bool decode) {
+    pa_sample_spec ss, decoder_ss;
+    struct codec_stats stats;
+    struct packet_store packets;
+    pa_memchunk input;
+    void *info, *decoder_info = NULL;
+
+    pa_zero(stats);
+    pa_zero(packets);
+
+    info = codec->init(true, false, config, config_size, &ss, NULL);
+    fail_unless(info != NULL, "%s: init failed", codec->name);
+    fail_unless(codec->reset(info) >= 0);
+
+    if (decode) {
+        decoder_info = codec->init(false, false, config, config_size, &decoder_ss, NULL);
+        fail_unless(decoder_info != NULL, "%s: decoder init failed", codec->name);
+        fail_unless(pa_sample_spec_equal(&ss, &decoder_ss));
+    }
+
+    load_input(&ss, &input);
+    encode_input(codec, info, &ss, mtu, &input, &stats, decode ? &packets : NULL);
+    pa_memblock_unref(input.memblock);
+
+    /* Allow for codec delay, but every block has to turn into a packet */
+    fail_unless(stats.packets + 4 >= stats.blocks, "%s: only %u packets from %u blocks", codec->name, stats.packets, stats.blocks);
+
+    /* A2DP packets go out in one write, SCO packets are split up */
+    if (a2dp)
+        fail_unless(stats.max_packet <= mtu, "%s: %zu byte packet exceeds MTU %zu", codec->name, stats.max_packet, mtu);
+
+    if (decoder_info) {
+        size_t block_size = write_block_size(codec, info, &ss, mtu);
+
+        decode_packets(codec, decoder_info, mtu, &packets, &stats);
+        fail_unless(stats.bytes_decoded + 4 * block_size >= stats.bytes_in,
+                    "%s: decoded %llu of %llu bytes", codec->name,
+                    (unsigned long long) stats.bytes_decoded, (unsigned long long) stats.bytes_in);
+        codec->deinit(decoder_info);
+    }
+
+    packet_store_done(&packets);
+    report(codec, &ss, mtu, &stats);
+
+    fail_unless(codec->reset(info) >= 0);
+    simulate_adaptation(codec, info, &ss, mtu);
+
+    codec->deinit(info);
+}
+
+static void bench_endpoint(const pa_a2dp_endpoint_conf *conf) {
+    const pa_sample_spec default_ss = { .format = PA_SAMPLE_S16LE, .rate = 48000, .channels = 2 };
+    uint8_t capabilities[MAX_A2DP_CAPS_SIZE], config[MAX_A2DP_CAPS_SIZE];
+    uint8_t capabilities_size, config_size;
+    bool decode;
+
+    if (!conf->can_be_supported(true)) {
+        pa_log_info("%-12s not supported, skipping", conf->bt_codec.name);
+        return;
+    }
+
+    /* Negotiate against a peer that has exactly our capabilities */
+    capabilities_size = conf->fill_capabilities(capabilities);
+    config_size = conf->fill_preferred_configuration(&default_ss, capabilities, capabilities_size, config);
+    fail_unless(config_size > 0, "%s: no configuration", conf->bt_codec.name);
+    fail_unless(conf->is_configuration_valid(config, config_size));
+
+    /* With a backchannel, the decoder handles the other direction's format */
+    decode = conf->bt_codec.decode_buffer && conf->can_be_supported(false) && !conf->bt_codec.support_backchannel;
+
+    bench_codec(&conf->bt_codec, config, config_size, a2dp_mtu(), true, decode);
+}
+
+START_TEST (a2dp_codec_test) {
+    unsigned i;
+
+#if defined(HAVE_GSTAPTX) || defined(HAVE_GSTLDAC)
+    pa_bluetooth_a2dp_codec_gst_init();
+#endif
+
+    for (i = 0; i < pa_bluetooth_a2dp_endpoint_conf_count(); i++)
+        bench_endpoint(pa_bluetooth_a2dp_endpoint_conf_iter(i));
+}
+END_TEST
+
+/* The SBC codec encodes a whole packet per call. Its frames have to be the
+ * same as what libsbc produces for the same parameters one frame at a time. */
+START_TEST (sbc_bitexact_test) {
+    const size_t rtp_size = sizeof(struct rtp_header) + sizeof(struct rtp_payload);
+    const pa_a2dp_endpoint_conf *conf;
+    const pa_bt_codec *codec;
+    a2dp_sbc_t config;
+    pa_sample_spec ss;
+    pa_memchunk input;
+    size_t block_size, output_size, offset, codesize, frame_length;
+    uint8_t *output, *reference;
+    const uint8_t *d;
+    unsigned packets = 0;
+    sbc_t ref;
+    void *info;
+
+    pa_assert_se(conf = pa_bluetooth_get_a2dp_endpoint_conf("sbc"));
+    codec = &conf->bt_codec;
+
+    pa_zero(config);
+    config.frequency = SBC_SAMPLING_FREQ_48000;
+    config.channel_mode = SBC_CHANNEL_MODE_JOINT_STEREO;
+    config.allocation_method = SBC_ALLOCATION_LOUDNESS;
+    config.subbands = SBC_SUBBANDS_8;
+    config.block_length = SBC_BLOCK_LENGTH_16;
+    config.min_bitpool = SBC_MIN_BITPOOL;
+    config.max_bitpool = SBC_BITPOOL_HQ_JOINT_STEREO_48000;
+    fail_unless(conf->is_configuration_valid((const uint8_t *) &config, sizeof(config)));
+
+    info = codec->init(true, false, (const uint8_t *) &config, sizeof(config), &ss, NULL);
+    fail_unless(info != NULL);
+    fail_unless(codec->reset(info) >= 0);
+
+    fail_unless(sbc_init(&ref, 0) == 0);
+    ref.frequency = SBC_FREQ_48000;
+    ref.mode = SBC_MODE_JOINT_STEREO;
+    ref.allocation = SBC_AM_LOUDNESS;
+    ref.subbands = SBC_SB_8;
+    ref.blocks = SBC_BLK_16;
+    ref.bitpool = config.max_bitpool;
+    ref.endian = SBC_LE;
+    codesize = sbc_get_codesize(&ref);
+    frame_length = sbc_get_frame_length(&ref);
+
+    block_size = write_block_size(codec, info, &ss, a2dp_mtu());
+    output_size = encoder_buffer_size(codec, info, block_size, a2dp_mtu());
+    output = pa_xmalloc(output_size);
+    reference = pa_xmalloc(frame_length);
+
+    load_input(&ss, &input);
+    d = pa_memblock_acquire_chunk(&input);
+
+    for (offset = 0; offset + block_size <= input.length; offset += block_size) {
+        const struct rtp_payload *payload = (const struct rtp_payload *) (output + sizeof(struct rtp_header));
+        size_t written, processed;
+        unsigned i;
+
+        written = codec->encode_buffer(info, offset / pa_frame_size(&ss), d + offset, block_size, output, output_size, &processed);
+        fail_unless(processed == block_size);
+        ck_assert_int_eq(written, rtp_size + payload->frame_count * frame_length);
+        ck_assert_int_eq(payload->frame_count * codesize, block_size);
+
+        for (i = 0; i < payload->frame_count; i++) {
+            ssize_t ref_written;
+
+            fail_unless(sbc_encode(&ref, d + offset + i * codesize, codesize, reference, frame_length, &ref_written) == (ssize_t) codesize);
+            ck_assert_int_eq(ref_written, frame_length);
+            fail_unless(memcmp(output + rtp_size + i * frame_length, reference, frame_length) == 0,
+                        "frame %u of packet %u differs from libsbc", i, packets);
+        }
+
+        packets++;
+    }
+
+    pa_memblock_release(input.memblock);
+    pa_memblock_unref(input.memblock);
+
+    pa_log_info("%u packets identical to libsbc", packets);
+
+    sbc_finish(&ref);
+    pa_xfree(reference);
+    pa_xfree(output);
+    codec->deinit(info);
+}
+END_TEST
+
+START_TEST (hf_codec_test) {
+    unsigned i;
+
+    for (i = 0; i < pa_bluetooth_hf_codec_count(); i++) {
+        const pa_bt_codec *codec = pa_bluetooth_hf_codec_iter(i);
+
+        bench_codec(codec, NULL, 0, SCO_MTU, false, codec->decode_buffer != NULL);
+    }
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    pa_assert_se(pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true));
+
+    s = suite_create("Bluetooth codecs");
+    tc = tcase_create("bluez5-codec");
+    tcase_add_test(tc, a2dp_codec_test);
+    tcase_add_test(tc, sbc_bitexact_test);
+    tcase_add_test(tc, hf_codec_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    pa_mempool_unref(pool);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
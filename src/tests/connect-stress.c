@@ -31,6 +31,7 @@
 
 #include <pulse/pulseaudio.h>
 #include <pulse/mainloop.h>
+#include <pulse/rtclock.h>
 
 #include <pulsecore/sink.h>
 
@@ -50,6 +51,20 @@
 #define NTESTS 1000
 #define SAMPLE_HZ 48000
 
+/* Clients connecting at once in the storm test, can be overridden with
+ * $CONNECT_STRESS_CLIENTS. Going beyond 64 needs the daemon to run the native
+ * protocol with io-threads= set, and a high enough file descriptor limit on
+ * both sides. */
+#define NCLIENTS 32
+
+/* Storms in a row, $CONNECT_STRESS_ROUNDS, so that thousands of clients
+ * connect in total even within the default connection limit */
+#define NROUNDS 64
+
+/* Connections made in the play sample test, each one playing a sample once */
+#define NPLAYS 100
+#define SAMPLE_NAME "connect-stress"
+
 static pa_context *context = NULL;
 static pa_stream *streams[NSTREAMS];
 static pa_threaded_mainloop *mainloop = NULL;
@@ -212,6 +227,238 @@ START_TEST (connect_stress_test) {
 }
 END_TEST
 
+static unsigned storm_ready = 0;
+
+static void storm_state_callback(pa_context *c, void *userdata) {
+    fail_unless(c != NULL);
+
+    switch (pa_context_get_state(c)) {
+        case PA_CONTEXT_READY:
+            storm_ready++;
+            pa_threaded_mainloop_signal(mainloop, 0);
+            break;
+
+        case PA_CONTEXT_FAILED:
+            fprintf(stderr, "Context error: %s\n", pa_strerror(pa_context_errno(c)));
+            ck_abort();
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void server_info_callback(pa_context *c, const pa_server_info *i, void *userdata) {
+    fail_unless(i != NULL);
+
+    pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+static pa_context *storm_connect(pa_mainloop_api *api) {
+    pa_context *c;
+
+    c = pa_context_new(api, bname);
+    fail_unless(c != NULL);
+
+    pa_context_set_state_callback(c, storm_state_callback, NULL);
+    fail_unless(pa_context_connect(c, NULL, 0, NULL) >= 0);
+
+    return c;
+}
+
+/* Connects all clients at once, like at session start, and measures how long
+ * a client that is already connected has to wait for replies meanwhile.
+ * Repeated for several rounds. */
+START_TEST (connect_storm_test) {
+    pa_context **clients, *control;
+    pa_mainloop_api *api;
+    pa_usec_t start, storm_time, storm_time_max = 0, latency, latency_max = 0, latency_sum = 0;
+    unsigned n = NCLIENTS, rounds = NROUNDS, i, r, requests = 0;
+    const char *e;
+
+    if ((e = getenv("CONNECT_STRESS_CLIENTS")))
+        n = (unsigned) atoi(e);
+
+    if ((e = getenv("CONNECT_STRESS_ROUNDS")))
+        rounds = (unsigned) atoi(e);
+
+    fail_unless(n > 0);
+    fail_unless(rounds > 0);
+
+    mainloop = pa_threaded_mainloop_new();
+    fail_unless(mainloop != NULL);
+    api = pa_threaded_mainloop_get_api(mainloop);
+
+    fail_unless(pa_threaded_mainloop_start(mainloop) == 0);
+    pa_threaded_mainloop_lock(mainloop);
+
+    control = storm_connect(api);
+    while (storm_ready < 1)
+        pa_threaded_mainloop_wait(mainloop);
+
+    clients = pa_xnew(pa_context*, n);
+
+    for (r = 0; r < rounds; r++) {
+        storm_ready = 0;
+
+        start = pa_rtclock_now();
+        for (i = 0; i < n; i++)
+            clients[i] = storm_connect(api);
+
+        do {
+            pa_operation *o;
+            pa_usec_t t;
+
+            t = pa_rtclock_now();
+            o = pa_context_get_server_info(control, server_info_callback, NULL);
+            fail_unless(o != NULL);
+
+            while (pa_operation_get_state(o) == PA_OPERATION_RUNNING)
+                pa_threaded_mainloop_wait(mainloop);
+
+            pa_operation_unref(o);
+
+            latency = pa_rtclock_now() - t;
+            latency_max = PA_MAX(latency_max, latency);
+            latency_sum += latency;
+            requests++;
+        } while (storm_ready < n);
+
+        storm_time = pa_rtclock_now() - start;
+        storm_time_max = PA_MAX(storm_time_max, storm_time);
+
+        for (i = 0; i < n; i++) {
+            pa_context_set_state_callback(clients[i], NULL, NULL);
+            pa_context_disconnect(clients[i]);
+            pa_context_unref(clients[i]);
+        }
+    }
+
+    pa_xfree(clients);
+
+    fprintf(stderr, "%u rounds of %u clients, all ready after %0.1f ms at most, control requests took %0.1f ms on average, %0.1f ms at most (%u requests).\n",
+            rounds, n, (double) storm_time_max / PA_USEC_PER_MSEC,
+            (double) latency_sum / requests / PA_USEC_PER_MSEC, (double) latency_max / PA_USEC_PER_MSEC, requests);
+
+    pa_context_set_state_callback(control, NULL, NULL);
+    pa_context_disconnect(control);
+    pa_context_unref(control);
+
+    pa_threaded_mainloop_unlock(mainloop);
+    pa_threaded_mainloop_stop(mainloop);
+    pa_threaded_mainloop_free(mainloop);
+    mainloop = NULL;
+}
+END_TEST
+
+static void upload_state_callback(pa_stream *s, void *userdata) {
+    switch (pa_stream_get_state(s)) {
+        case PA_STREAM_READY:
+        case PA_STREAM_TERMINATED:
+            pa_threaded_mainloop_signal(mainloop, 0);
+            break;
+
+        case PA_STREAM_FAILED:
+            fprintf(stderr, "Stream error: %s\n", pa_strerror(pa_context_errno(pa_stream_get_context(s))));
+            ck_abort();
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void success_callback(pa_context *c, int success, void *userdata) {
+    fail_unless(success);
+
+    pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+static void wait_operation(pa_operation *o) {
+    fail_unless(o != NULL);
+
+    while (pa_operation_get_state(o) == PA_OPERATION_RUNNING)
+        pa_threaded_mainloop_wait(mainloop);
+
+    pa_operation_unref(o);
+}
+
+/* Measures what a short-lived client like an event sound player sees: the
+ * time from connecting until the server confirmed playing a sample */
+START_TEST (connect_play_sample_test) {
+    static const float silence[SAMPLE_HZ / 10];
+    pa_context *control;
+    pa_stream *s;
+    pa_mainloop_api *api;
+    pa_usec_t latency, latency_max = 0, latency_sum = 0;
+    unsigned i;
+
+    mainloop = pa_threaded_mainloop_new();
+    fail_unless(mainloop != NULL);
+    api = pa_threaded_mainloop_get_api(mainloop);
+
+    fail_unless(pa_threaded_mainloop_start(mainloop) == 0);
+    pa_threaded_mainloop_lock(mainloop);
+
+    storm_ready = 0;
+    control = storm_connect(api);
+    while (storm_ready < 1)
+        pa_threaded_mainloop_wait(mainloop);
+
+    s = pa_stream_new(control, SAMPLE_NAME, &sample_spec, NULL);
+    fail_unless(s != NULL);
+    pa_stream_set_state_callback(s, upload_state_callback, NULL);
+    fail_unless(pa_stream_connect_upload(s, sizeof(silence)) >= 0);
+
+    while (pa_stream_get_state(s) != PA_STREAM_READY)
+        pa_threaded_mainloop_wait(mainloop);
+
+    fail_unless(pa_stream_write(s, silence, sizeof(silence), NULL, 0, PA_SEEK_RELATIVE) == 0);
+    fail_unless(pa_stream_finish_upload(s) == 0);
+
+    while (pa_stream_get_state(s) != PA_STREAM_TERMINATED)
+        pa_threaded_mainloop_wait(mainloop);
+
+    pa_stream_unref(s);
+
+    for (i = 0; i < NPLAYS; i++) {
+        pa_context *c;
+        pa_usec_t t;
+
+        storm_ready = 0;
+        t = pa_rtclock_now();
+
+        c = storm_connect(api);
+        while (storm_ready < 1)
+            pa_threaded_mainloop_wait(mainloop);
+
+        wait_operation(pa_context_play_sample(c, SAMPLE_NAME, NULL, PA_VOLUME_MUTED, success_callback, NULL));
+
+        latency = pa_rtclock_now() - t;
+        latency_max = PA_MAX(latency_max, latency);
+        latency_sum += latency;
+
+        pa_context_set_state_callback(c, NULL, NULL);
+        pa_context_disconnect(c);
+        pa_context_unref(c);
+    }
+
+    fprintf(stderr, "Connecting and playing a sample took %0.2f ms on average, %0.2f ms at most (%u connections).\n",
+            (double) latency_sum / NPLAYS / PA_USEC_PER_MSEC, (double) latency_max / PA_USEC_PER_MSEC, NPLAYS);
+
+    wait_operation(pa_context_remove_sample(control, SAMPLE_NAME, success_callback, NULL));
+
+    pa_context_set_state_callback(control, NULL, NULL);
+    pa_context_disconnect(control);
+    pa_context_unref(control);
+
+    pa_threaded_mainloop_unlock(mainloop);
+    pa_threaded_mainloop_stop(mainloop);
+    pa_threaded_mainloop_free(mainloop);
+    mainloop = NULL;
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -222,6 +469,10 @@ int main(int argc, char *argv[]) {
 
     s = suite_create("Connect Stress");
     tc = tcase_create("connectstress");
+    /* Thousands of connections take a while */
+    tcase_set_timeout(tc, 120);
+    tcase_add_test(tc, connect_storm_test);
+    tcase_add_test(tc, connect_play_sample_test);
     tcase_add_test(tc, connect_stress_test);
     suite_add_tcase(s, tc);
 
@@ -20,13 +20,16 @@
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <poll.h>
 #include <assert.h>
 #include <check.h>
 
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
 
 #include <pulsecore/core-util.h>
 #include <pulsecore/core-rtclock.h>
@@ -140,6 +143,214 @@ START_TEST (mainloop_test) {
 }
 END_TEST
 
+#ifndef GLIB_MAIN_LOOP
+
+#define BENCH_PIPES 200
+#define BENCH_TIMERS 10000
+#define BENCH_ROUNDS 2000
+
+typedef struct bench {
+    int fds[BENCH_PIPES][2];
+    pa_io_event *ioe[BENCH_PIPES];
+    pa_time_event *te[BENCH_TIMERS];
+    unsigned n_io, n_time;
+} bench;
+
+static void bench_iocb(pa_mainloop_api*a, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata) {
+    bench *b = userdata;
+    char c;
+
+    pa_assert_se(read(fd, &c, sizeof(c)) == sizeof(c));
+    b->n_io++;
+}
+
+static void bench_tcb(pa_mainloop_api*a, const pa_time_event *e, const struct timeval *tv, void *userdata) {
+    bench *b = userdata;
+
+    b->n_time++;
+}
+
+/* Returns the time per iteration, with many idle fds and timers around */
+static pa_usec_t run_bench(const char *backend) {
+    pa_mainloop *m;
+    pa_mainloop_api *a;
+    bench *b;
+    struct timeval tv;
+    pa_usec_t now, start;
+    unsigned i;
+
+    setenv("PULSE_MAINLOOP_BACKEND", backend, 1);
+    m = pa_mainloop_new();
+    unsetenv("PULSE_MAINLOOP_BACKEND");
+    fail_unless(m != NULL);
+
+    a = pa_mainloop_get_api(m);
+    b = pa_xnew0(bench, 1);
+    now = pa_rtclock_now();
+
+    for (i = 0; i < BENCH_PIPES; i++) {
+        fail_unless(pipe(b->fds[i]) == 0);
+        b->ioe[i] = a->io_new(a, b->fds[i][0], PA_IO_EVENT_INPUT, bench_iocb, b);
+    }
+
+    for (i = 0; i < BENCH_TIMERS; i++)
+        b->te[i] = a->time_new(a, pa_timeval_rtstore(&tv, now + PA_USEC_PER_SEC * 3600 + i, true), bench_tcb, b);
+
+    start = pa_rtclock_now();
+
+    /* Each round one fd becomes readable and one timer elapses */
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        pa_assert_se(write(b->fds[i % BENCH_PIPES][1], "x", 1) == 1);
+        a->time_restart(b->te[i % BENCH_TIMERS], pa_timeval_rtstore(&tv, 1, true));
+
+        while (b->n_io <= i || b->n_time <= i)
+            fail_unless(pa_mainloop_iterate(m, 1, NULL) >= 0);
+    }
+
+    now = pa_rtclock_now();
+
+    ck_assert_int_eq(b->n_io, BENCH_ROUNDS);
+    ck_assert_int_eq(b->n_time, BENCH_ROUNDS);
+
+    for (i = 0; i < BENCH_TIMERS; i++)
+        a->time_free(b->te[i]);
+
+    for (i = 0; i < BENCH_PIPES; i++) {
+        a->io_free(b->ioe[i]);
+        pa_close_pipe(b->fds[i]);
+    }
+
+    pa_mainloop_free(m);
+    pa_xfree(b);
+
+    return (now - start) / BENCH_ROUNDS;
+}
+
+typedef struct shared_fd {
+    pa_io_event *in, *out;
+    unsigned n_in, n_out;
+    unsigned long nfds;
+} shared_fd;
+
+static void shared_fd_cb(pa_mainloop_api*a, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata) {
+    shared_fd *s = userdata;
+
+    if (e == s->in) {
+        ck_assert_int_eq(f, PA_IO_EVENT_INPUT);
+        s->n_in++;
+    } else {
+        ck_assert_int_eq(f, PA_IO_EVENT_OUTPUT);
+        s->n_out++;
+    }
+}
+
+/* With epoll only the epoll fd is polled */
+static int shared_fd_poll(struct pollfd *ufds, unsigned long nfds, int timeout, void *userdata) {
+    shared_fd *s = userdata;
+
+    s->nfds = nfds;
+    return poll(ufds, nfds, timeout);
+}
+
+static pa_mainloop *epoll_mainloop_new(void) {
+    pa_mainloop *m;
+
+    setenv("PULSE_MAINLOOP_BACKEND", "epoll", 1);
+    m = pa_mainloop_new();
+    unsetenv("PULSE_MAINLOOP_BACKEND");
+    fail_unless(m != NULL);
+
+    return m;
+}
+
+/* Two io events on one fd, like the read and write watches of D-Bus */
+START_TEST (mainloop_shared_fd_test) {
+    pa_mainloop *m;
+    pa_mainloop_api *a;
+    shared_fd s = { NULL, NULL, 0, 0, 0 };
+    int fds[2];
+
+    m = epoll_mainloop_new();
+    a = pa_mainloop_get_api(m);
+    pa_mainloop_set_poll_func(m, shared_fd_poll, &s);
+    fail_unless(pipe(fds) == 0);
+
+    s.in = a->io_new(a, fds[0], PA_IO_EVENT_INPUT, shared_fd_cb, &s);
+    s.out = a->io_new(a, fds[0], PA_IO_EVENT_NULL, shared_fd_cb, &s);
+    pa_assert_se(write(fds[1], "x", 1) == 1);
+
+    fail_unless(pa_mainloop_iterate(m, 0, NULL) == 1);
+    ck_assert_int_eq(s.n_in, 1);
+    ck_assert_int_eq(s.n_out, 0);
+
+    /* The read end of a pipe never becomes writable */
+    a->io_enable(s.out, PA_IO_EVENT_OUTPUT);
+    a->io_enable(s.in, PA_IO_EVENT_NULL);
+    fail_unless(pa_mainloop_iterate(m, 0, NULL) == 0);
+
+    a->io_enable(s.in, PA_IO_EVENT_INPUT);
+    a->io_free(s.out);
+    fail_unless(pa_mainloop_iterate(m, 0, NULL) == 1);
+    ck_assert_int_eq(s.n_in, 2);
+    ck_assert_int_eq(s.n_out, 0);
+
+#ifdef HAVE_SYS_EPOLL_H
+    /* Still on epoll */
+    ck_assert_int_eq(s.nfds, 1);
+#endif
+
+    a->io_free(s.in);
+    pa_close_pipe(fds);
+    pa_mainloop_free(m);
+}
+END_TEST
+
+/* An fd that is closed before its io event is freed, while a duplicate of
+ * it stays open. The kernel keeps the registration, it must not make the
+ * main loop spin. */
+START_TEST (mainloop_stale_fd_test) {
+    pa_mainloop *m;
+    pa_mainloop_api *a;
+    shared_fd s = { NULL, NULL, 0, 0, 0 };
+    pa_io_event *e;
+    int fds[2], dup_fd;
+
+    m = epoll_mainloop_new();
+    a = pa_mainloop_get_api(m);
+    fail_unless(pipe(fds) == 0);
+    fail_unless((dup_fd = dup(fds[0])) >= 0);
+
+    e = a->io_new(a, fds[0], PA_IO_EVENT_INPUT, shared_fd_cb, &s);
+    pa_assert_se(write(fds[1], "x", 1) == 1);
+    pa_close(fds[0]);
+    a->io_free(e);
+
+    pa_mainloop_iterate(m, 0, NULL);
+    pa_mainloop_iterate(m, 0, NULL);
+
+    fail_unless(pa_mainloop_prepare(m, 0) >= 0);
+    ck_assert_int_eq(pa_mainloop_poll(m), 0);
+    fail_unless(pa_mainloop_dispatch(m) >= 0);
+
+    pa_close(dup_fd);
+    pa_close(fds[1]);
+    pa_mainloop_free(m);
+}
+END_TEST
+
+START_TEST (mainloop_benchmark_test) {
+    pa_usec_t poll_usec, epoll_usec;
+
+    poll_usec = run_bench("poll");
+    epoll_usec = run_bench("epoll");
+
+    fprintf(stderr, "%u fds, %u timers: poll() %llu usec per iteration, epoll %llu usec per iteration\n",
+            BENCH_PIPES, BENCH_TIMERS, (unsigned long long) poll_usec, (unsigned long long) epoll_usec);
+}
+END_TEST
+
+#endif /* GLIB_MAIN_LOOP */
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -149,6 +360,11 @@ int main(int argc, char *argv[]) {
     s = suite_create("MainLoop");
     tc = tcase_create("mainloop");
     tcase_add_test(tc, mainloop_test);
+#ifndef GLIB_MAIN_LOOP
+    tcase_add_test(tc, mainloop_shared_fd_test);
+    tcase_add_test(tc, mainloop_stale_fd_test);
+    tcase_add_test(tc, mainloop_benchmark_test);
+#endif
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,112 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulse/timeval.h>
+
+#include <pulsecore/render-stats.h>
+
+START_TEST (render_stats_publish_test) {
+    pa_render_stats *s;
+    pa_render_stage_stats stats[PA_RENDER_STAGE_MAX];
+
+    s = pa_render_stats_new();
+
+    pa_render_stats_add(s, PA_RENDER_STAGE_RESAMPLE, 10);
+    pa_render_stats_add(s, PA_RENDER_STAGE_RESAMPLE, 30);
+
+    /* Nothing is visible before publishing */
+    pa_render_stats_get(s, stats);
+    ck_assert_int_eq(stats[PA_RENDER_STAGE_RESAMPLE].count, 0);
+
+    pa_render_stats_publish(s, 200 * PA_USEC_PER_MSEC);
+    pa_render_stats_get(s, stats);
+    ck_assert_int_eq(stats[PA_RENDER_STAGE_RESAMPLE].count, 2);
+    ck_assert_int_eq(stats[PA_RENDER_STAGE_RESAMPLE].total_usec, 40);
+    ck_assert_int_eq(stats[PA_RENDER_STAGE_RESAMPLE].max_usec, 30);
+    ck_assert_int_eq(stats[PA_RENDER_STAGE_DATA].count, 0);
+    ck_assert_int_eq(stats[PA_RENDER_STAGE_VOLUME].count, 0);
+
+    /* Publishing is rate limited */
+    pa_render_stats_add(s, PA_RENDER_STAGE_RESAMPLE, 10);
+    pa_render_stats_publish(s, 250 * PA_USEC_PER_MSEC);
+    pa_render_stats_get(s, stats);
+    ck_assert_int_eq(stats[PA_RENDER_STAGE_RESAMPLE].count, 2);
+
+    pa_render_stats_publish(s, 300 * PA_USEC_PER_MSEC);
+    pa_render_stats_get(s, stats);
+    ck_assert_int_eq(stats[PA_RENDER_STAGE_RESAMPLE].count, 3);
+
+    pa_render_stats_free(s);
+}
+END_TEST
+
+START_TEST (render_stats_p99_test) {
+    pa_render_stats *s;
+    pa_render_stage_stats stats[PA_RENDER_STAGE_MAX];
+    unsigned i;
+
+    s = pa_render_stats_new();
+
+    /* 99 short runs and a single long one */
+    for (i = 0; i < 99; i++)
+        pa_render_stats_add(s, PA_RENDER_STAGE_DATA, 5);
+    pa_render_stats_add(s, PA_RENDER_STAGE_DATA, 5000);
+
+    pa_render_stats_publish(s, PA_USEC_PER_SEC);
+    pa_render_stats_get(s, stats);
+
+    ck_assert_int_eq(stats[PA_RENDER_STAGE_DATA].max_usec, 5000);
+    ck_assert_int_eq(pa_render_stage_stats_p99(&stats[PA_RENDER_STAGE_DATA]), 8);
+    ck_assert_int_eq(pa_render_stage_stats_p99(&stats[PA_RENDER_STAGE_VOLUME]), 0);
+
+    /* Runs longer than the last bucket still give the maximum */
+    for (i = 0; i < 100; i++)
+        pa_render_stats_add(s, PA_RENDER_STAGE_VOLUME, 10 * PA_USEC_PER_SEC);
+
+    pa_render_stats_publish(s, 2 * PA_USEC_PER_SEC);
+    pa_render_stats_get(s, stats);
+    ck_assert_int_eq(pa_render_stage_stats_p99(&stats[PA_RENDER_STAGE_VOLUME]), 10 * PA_USEC_PER_SEC);
+
+    pa_render_stats_free(s);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Render stats");
+    tc = tcase_create("render-stats");
+    tcase_add_test(tc, render_stats_publish_test);
+    tcase_add_test(tc, render_stats_p99_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
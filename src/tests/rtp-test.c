@@ -0,0 +1,214 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <errno.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/arpa-inet.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblockq.h>
+#include <pulsecore/poll.h>
+#include <pulsecore/socket.h>
+
+#include <modules/rtp/rtp.h>
+
+#include "runtime-test-util.h"
+
+#define PAYLOAD 10 /* L16 stereo 44.1 kHz */
+#define MTU 1280
+#define PUSH_SIZE 1000
+#define NPACKETS 32
+#define TIMES 50
+#define TIMES2 20
+
+static const pa_sample_spec ss = {
+    .format = PA_SAMPLE_S16BE,
+    .rate = 44100,
+    .channels = 2
+};
+
+static pa_mempool *pool;
+static pa_rtp_context *send_context, *recv_context;
+static int recv_fd;
+
+/* Bytes of the stream carry their offset, so lost, duplicated or reordered
+ * payload shows up as a pattern mismatch. */
+static uint64_t push_offset, recv_offset;
+
+static void setup(void) {
+    struct sockaddr_in sa;
+    socklen_t salen = sizeof(sa);
+    int send_fd, one = 1, rcvbuf = 4 * 1024 * 1024;
+
+    pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    fail_unless(pool != NULL);
+
+    pa_zero(sa);
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sa.sin_port = 0;
+
+    fail_unless((recv_fd = socket(AF_INET, SOCK_DGRAM, 0)) >= 0);
+    fail_unless(setsockopt(recv_fd, SOL_SOCKET, SO_TIMESTAMP, &one, sizeof(one)) == 0);
+    setsockopt(recv_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    fail_unless(bind(recv_fd, (struct sockaddr *) &sa, sizeof(sa)) == 0);
+    fail_unless(getsockname(recv_fd, (struct sockaddr *) &sa, &salen) == 0);
+
+    fail_unless((send_fd = socket(AF_INET, SOCK_DGRAM, 0)) >= 0);
+    fail_unless(connect(send_fd, (struct sockaddr *) &sa, sizeof(sa)) == 0);
+    pa_make_fd_nonblock(send_fd);
+
+    send_context = pa_rtp_context_new_send(send_fd, PAYLOAD, MTU, &ss, false);
+    recv_context = pa_rtp_context_new_recv(recv_fd, PAYLOAD, &ss, false);
+
+    push_offset = recv_offset = 0;
+}
+
+static void teardown(void) {
+    pa_rtp_context_free(send_context);
+    pa_rtp_context_free(recv_context);
+    pa_mempool_unref(pool);
+}
+
+static void push_data(pa_memblockq *q, size_t length) {
+    while (length > 0) {
+        pa_memchunk chunk;
+        uint8_t *d;
+        size_t i;
+
+        chunk.length = PA_MIN(length, (size_t) PUSH_SIZE);
+        chunk.memblock = pa_memblock_new(pool, chunk.length);
+        chunk.index = 0;
+
+        d = pa_memblock_acquire(chunk.memblock);
+        for (i = 0; i < chunk.length; i++)
+            d[i] = (uint8_t) (push_offset + i);
+        pa_memblock_release(chunk.memblock);
+
+        fail_unless(pa_memblockq_push(q, &chunk) == 0);
+        pa_memblock_unref(chunk.memblock);
+
+        push_offset += chunk.length;
+        length -= chunk.length;
+    }
+}
+
+/* Receives until npackets have arrived, checking payload and timestamps */
+static void receive_packets(unsigned npackets) {
+    unsigned n = 0;
+
+    while (n < npackets) {
+        struct pollfd p;
+        pa_memchunk chunk;
+        struct timeval tv;
+        uint32_t rtp_tstamp;
+        const uint8_t *d;
+        size_t i;
+
+        p.fd = recv_fd;
+        p.events = POLLIN;
+        p.revents = 0;
+        fail_unless(pa_poll(&p, 1, 1000) == 1, "timeout after %u of %u packets", n, npackets);
+
+        while (n < npackets && pa_rtp_recv(recv_context, &chunk, pool, &rtp_tstamp, &tv) == 0) {
+            ck_assert_int_eq(chunk.length, MTU);
+            ck_assert_uint_eq(rtp_tstamp, (uint32_t) (recv_offset / pa_frame_size(&ss)));
+
+            d = pa_memblock_acquire_chunk(&chunk);
+            for (i = 0; i < chunk.length; i++)
+                fail_unless(d[i] == (uint8_t) (recv_offset + i));
+            pa_memblock_release(chunk.memblock);
+            pa_memblock_unref(chunk.memblock);
+
+            recv_offset += MTU;
+            n++;
+        }
+    }
+}
+
+START_TEST (rtp_send_recv_test) {
+    pa_memblockq *q;
+
+    setup();
+    q = pa_memblockq_new("rtp-test memblockq", 0, 4 * 1024 * 1024, 0, &ss, 0, 0, 0, NULL);
+
+    /* Leave a partial packet behind, that must stay queued */
+    push_data(q, NPACKETS * MTU + MTU / 2);
+    fail_unless(pa_rtp_send(send_context, q) == 0);
+    ck_assert_int_eq(pa_memblockq_get_length(q), MTU / 2);
+
+    receive_packets(NPACKETS);
+
+    push_data(q, MTU / 2);
+    fail_unless(pa_rtp_send(send_context, q) == 0);
+    receive_packets(1);
+
+    pa_memblockq_free(q);
+    teardown();
+}
+END_TEST
+
+START_TEST (rtp_throughput_test) {
+    pa_memblockq *q;
+
+    setup();
+    q = pa_memblockq_new("rtp-test memblockq", 0, 4 * 1024 * 1024, 0, &ss, 0, 0, 0, NULL);
+
+    pa_log_debug("Sending and receiving %u packets of %u bytes per run", NPACKETS, MTU);
+
+    PA_RUNTIME_TEST_RUN_START("rtp send+recv", TIMES, TIMES2) {
+        push_data(q, NPACKETS * MTU);
+        fail_unless(pa_rtp_send(send_context, q) == 0);
+        receive_packets(NPACKETS);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_memblockq_free(q);
+    teardown();
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("RTP");
+    tc = tcase_create("rtp");
+    tcase_add_test(tc, rtp_send_recv_test);
+    tcase_add_test(tc, rtp_throughput_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
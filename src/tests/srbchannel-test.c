@@ -121,6 +121,43 @@ START_TEST (srbchannel_test) {
 }
 END_TEST
 
+START_TEST (srbchannel_threaded_test) {
+
+    int pipefd[4];
+
+    pa_mainloop *ml = pa_mainloop_new();
+    pa_mempool *mp = pa_mempool_new(PA_MEM_TYPE_SHARED_POSIX, 0, true);
+    pa_iochannel *io1, *io2;
+    pa_pstream *p1, *p2;
+    pa_srbchannel *sr1, *sr2;
+    pa_srbchannel_template srt;
+
+    fail_unless(pipe(pipefd) == 0);
+    fail_unless(pipe(&pipefd[2]) == 0);
+    io1 = pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[2], pipefd[1]);
+    io2 = pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[0], pipefd[3]);
+
+    /* This thread is the IO thread of p1 */
+    p1 = pa_pstream_new_threaded(pa_mainloop_get_api(ml), io1, mp);
+    p2 = pa_pstream_new(pa_mainloop_get_api(ml), io2, mp);
+
+    sr1 = pa_srbchannel_new(pa_mainloop_get_api(ml), mp);
+    pa_srbchannel_export(sr1, &srt);
+    pa_pstream_set_srbchannel(p1, sr1);
+    sr2 = pa_srbchannel_new_from_template(pa_mainloop_get_api(ml), &srt);
+    pa_pstream_set_srbchannel(p2, sr2);
+
+    packet_test(250, 5, ml, p1, p2);
+    packet_test(10, 1234567, ml, p1, p2);
+    packet_test(250, 5, ml, p2, p1);
+
+    pa_pstream_unlink(p1);
+    pa_pstream_unref(p1);
+    pa_pstream_unref(p2);
+    pa_mempool_unref(mp);
+    pa_mainloop_free(ml);
+}
+END_TEST
 
 int main(int argc, char *argv[]) {
     int failed = 0;
@@ -134,6 +171,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("srbchannel");
     tc = tcase_create("srbchannel");
     tcase_add_test(tc, srbchannel_test);
+    tcase_add_test(tc, srbchannel_threaded_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,290 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+#include <pulse/rtclock.h>
+
+#include <pulsecore/macro.h>
+#include <pulsecore/thread.h>
+
+/* Every producer thread feeds a stream of its own, once through the lock and
+ * once through pa_threaded_mainloop_submit_write(), and the time it took all
+ * writes to be carried out is compared. The streams stay corked, so that the
+ * server just buffers the data. Before that, each kind of submitted
+ * operation is checked to complete on a connected context. */
+
+#define NSTREAMS 8
+#define NWRITES 2000
+#define CHUNK_SIZE 256
+#define SAMPLE_HZ 48000
+
+static pa_threaded_mainloop *mainloop = NULL;
+static pa_context *context = NULL;
+static pa_stream *streams[NSTREAMS];
+static unsigned ready = 0;
+static unsigned completed = 0;
+
+static const pa_sample_spec sample_spec = {
+    .format = PA_SAMPLE_FLOAT32,
+    .rate = SAMPLE_HZ,
+    .channels = 1
+};
+
+static const pa_buffer_attr buffer_attr = {
+    .maxlength = 2 * NWRITES * CHUNK_SIZE,
+    .tlength = (uint32_t) -1,
+    .prebuf = (uint32_t) -1,
+    .minreq = (uint32_t) -1,
+    .fragsize = 0
+};
+
+static const float silence[CHUNK_SIZE / sizeof(float)];
+
+static void nop_free_cb(void *p) {
+}
+
+static void stream_state_callback(pa_stream *s, void *userdata) {
+    switch (pa_stream_get_state(s)) {
+        case PA_STREAM_READY:
+            ready++;
+            pa_threaded_mainloop_signal(mainloop, 0);
+            break;
+
+        case PA_STREAM_FAILED:
+            fprintf(stderr, "Stream error: %s\n", pa_strerror(pa_context_errno(pa_stream_get_context(s))));
+            ck_abort();
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void context_state_callback(pa_context *c, void *userdata) {
+    switch (pa_context_get_state(c)) {
+        case PA_CONTEXT_READY:
+            pa_threaded_mainloop_signal(mainloop, 0);
+            break;
+
+        case PA_CONTEXT_FAILED:
+            fprintf(stderr, "Context error: %s\n", pa_strerror(pa_context_errno(c)));
+            ck_abort();
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void submit_cb(pa_threaded_mainloop *m, int success, void *userdata) {
+    fail_unless(success);
+
+    if (++completed == NSTREAMS * NWRITES)
+        pa_threaded_mainloop_signal(m, 0);
+}
+
+static void locked_producer(void *userdata) {
+    pa_stream *s = userdata;
+    unsigned i;
+
+    for (i = 0; i < NWRITES; i++) {
+        pa_threaded_mainloop_lock(mainloop);
+        fail_unless(pa_stream_write(s, silence, sizeof(silence), nop_free_cb, 0, PA_SEEK_RELATIVE) == 0);
+        pa_threaded_mainloop_unlock(mainloop);
+    }
+}
+
+static void submit_producer(void *userdata) {
+    pa_stream *s = userdata;
+    unsigned i;
+
+    for (i = 0; i < NWRITES; i++)
+        pa_threaded_mainloop_submit_write(mainloop, s, silence, sizeof(silence), nop_free_cb, submit_cb, NULL);
+}
+
+static void connect_context(const char *name) {
+    mainloop = pa_threaded_mainloop_new();
+    fail_unless(mainloop != NULL);
+
+    context = pa_context_new(pa_threaded_mainloop_get_api(mainloop), name);
+    fail_unless(context != NULL);
+    pa_context_set_state_callback(context, context_state_callback, NULL);
+    fail_unless(pa_context_connect(context, NULL, 0, NULL) >= 0);
+
+    fail_unless(pa_threaded_mainloop_start(mainloop) == 0);
+    pa_threaded_mainloop_lock(mainloop);
+
+    while (pa_context_get_state(context) != PA_CONTEXT_READY)
+        pa_threaded_mainloop_wait(mainloop);
+}
+
+static void connect_streams(unsigned n) {
+    unsigned i;
+
+    ready = 0;
+
+    for (i = 0; i < n; i++) {
+        char name[64];
+
+        snprintf(name, sizeof(name), "stream #%u", i);
+        streams[i] = pa_stream_new(context, name, &sample_spec, NULL);
+        fail_unless(streams[i] != NULL);
+        pa_stream_set_state_callback(streams[i], stream_state_callback, NULL);
+        fail_unless(pa_stream_connect_playback(streams[i], NULL, &buffer_attr, PA_STREAM_START_CORKED, NULL, NULL) >= 0);
+    }
+
+    while (ready < n)
+        pa_threaded_mainloop_wait(mainloop);
+}
+
+/* Called with the lock held, releases it */
+static void disconnect_context(unsigned n_streams) {
+    unsigned i;
+
+    for (i = 0; i < n_streams; i++) {
+        pa_stream_set_state_callback(streams[i], NULL, NULL);
+        pa_stream_disconnect(streams[i]);
+        pa_stream_unref(streams[i]);
+        streams[i] = NULL;
+    }
+
+    pa_context_set_state_callback(context, NULL, NULL);
+    pa_context_disconnect(context);
+    pa_context_unref(context);
+    context = NULL;
+
+    pa_threaded_mainloop_unlock(mainloop);
+    pa_threaded_mainloop_stop(mainloop);
+    pa_threaded_mainloop_free(mainloop);
+    mainloop = NULL;
+}
+
+/* Completions of the operations in submit_complete_test, which have to come
+ * in submission order */
+static void ordered_submit_cb(pa_threaded_mainloop *m, int success, void *userdata) {
+    fail_unless(m == mainloop);
+    fail_unless(pa_threaded_mainloop_in_thread(m));
+    fail_unless(success);
+    fail_unless(PA_PTR_TO_UINT(userdata) == completed);
+
+    completed++;
+    pa_threaded_mainloop_signal(m, 0);
+}
+
+START_TEST (submit_complete_test) {
+    pa_cvolume v;
+    uint32_t idx;
+
+    connect_context("submit-complete");
+    connect_streams(1);
+
+    idx = pa_stream_get_index(streams[0]);
+    completed = 0;
+
+    pa_threaded_mainloop_unlock(mainloop);
+
+    /* Submitted without the lock, from a thread other than the event loop */
+    pa_threaded_mainloop_submit_write(mainloop, streams[0], silence, sizeof(silence), NULL, ordered_submit_cb, PA_UINT_TO_PTR(0));
+    pa_threaded_mainloop_submit_cork(mainloop, streams[0], 0, ordered_submit_cb, PA_UINT_TO_PTR(1));
+    pa_threaded_mainloop_submit_flush(mainloop, streams[0], ordered_submit_cb, PA_UINT_TO_PTR(2));
+    pa_threaded_mainloop_submit_cork(mainloop, streams[0], 1, ordered_submit_cb, PA_UINT_TO_PTR(3));
+    pa_threaded_mainloop_submit_sink_input_volume(mainloop, context, idx, pa_cvolume_set(&v, 1, PA_VOLUME_NORM / 2),
+                                                  ordered_submit_cb, PA_UINT_TO_PTR(4));
+
+    pa_threaded_mainloop_lock(mainloop);
+
+    while (completed < 5)
+        pa_threaded_mainloop_wait(mainloop);
+
+    fail_unless(pa_stream_is_corked(streams[0]) == 1);
+
+    disconnect_context(1);
+}
+END_TEST
+
+static pa_usec_t run_producers(pa_thread_func_t func, bool wait_completed) {
+    pa_thread *threads[NSTREAMS];
+    pa_usec_t start;
+    unsigned i;
+
+    completed = 0;
+    start = pa_rtclock_now();
+
+    for (i = 0; i < NSTREAMS; i++)
+        threads[i] = pa_thread_new("producer", func, streams[i]);
+
+    for (i = 0; i < NSTREAMS; i++)
+        pa_thread_free(threads[i]);
+
+    if (wait_completed) {
+        pa_threaded_mainloop_lock(mainloop);
+        while (completed < NSTREAMS * NWRITES)
+            pa_threaded_mainloop_wait(mainloop);
+        pa_threaded_mainloop_unlock(mainloop);
+    }
+
+    return pa_rtclock_now() - start;
+}
+
+START_TEST (submit_stress_test) {
+    pa_usec_t locked_time, submit_time;
+
+    connect_context("submit-stress");
+    connect_streams(NSTREAMS);
+
+    pa_threaded_mainloop_unlock(mainloop);
+
+    locked_time = run_producers(locked_producer, false);
+    submit_time = run_producers(submit_producer, true);
+
+    fprintf(stderr, "%u streams, %u writes of %u bytes each: %0.1f ms with the lock, %0.1f ms submitted\n",
+            NSTREAMS, NWRITES, CHUNK_SIZE,
+            (double) locked_time / PA_USEC_PER_MSEC, (double) submit_time / PA_USEC_PER_MSEC);
+
+    pa_threaded_mainloop_lock(mainloop);
+    disconnect_context(NSTREAMS);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Submit Stress");
+    tc = tcase_create("submitstress");
+    tcase_add_test(tc, submit_complete_test);
+    tcase_add_test(tc, submit_stress_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
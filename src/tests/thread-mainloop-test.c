@@ -29,10 +29,15 @@
 #include <pulse/timeval.h>
 #include <pulse/util.h>
 #include <pulse/thread-mainloop.h>
+#include <pulse/thread-mainloop-submit.h>
 
 #include <pulsecore/core-rtclock.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/mutex.h>
+#include <pulsecore/thread.h>
+
+#define SUBMIT_THREADS 8
+#define SUBMIT_OPS 10000
 
 static void tcb(pa_mainloop_api *a, const pa_time_event *e, const struct timeval *tv, void *userdata) {
     pa_assert_se(pa_threaded_mainloop_in_thread(userdata));
@@ -93,6 +98,81 @@ START_TEST (thread_mainloop_test) {
 }
 END_TEST
 
+static pa_threaded_mainloop *submit_mainloop = NULL;
+static pa_context *submit_context = NULL;
+static unsigned next_submission[SUBMIT_THREADS];
+static unsigned completed = 0;
+
+static void submit_cb(pa_threaded_mainloop *m, int success, void *userdata) {
+    unsigned id = PA_PTR_TO_UINT(userdata) / SUBMIT_OPS;
+    unsigned i = PA_PTR_TO_UINT(userdata) % SUBMIT_OPS;
+
+    pa_assert_se(pa_threaded_mainloop_in_thread(m));
+
+    /* The context is not connected, so everything fails */
+    fail_unless(!success);
+
+    /* Each thread's submissions complete in the order they were made */
+    ck_assert_int_eq(i, next_submission[id]);
+    next_submission[id]++;
+
+    if (++completed == SUBMIT_THREADS * SUBMIT_OPS)
+        pa_threaded_mainloop_signal(m, 0);
+}
+
+static void producer_thread(void *userdata) {
+    unsigned id = PA_PTR_TO_UINT(userdata), i;
+    pa_cvolume v;
+
+    pa_cvolume_set(&v, 2, PA_VOLUME_NORM);
+
+    for (i = 0; i < SUBMIT_OPS; i++)
+        pa_threaded_mainloop_submit_sink_input_volume(submit_mainloop, submit_context, 0, &v, submit_cb, PA_UINT_TO_PTR(id * SUBMIT_OPS + i));
+}
+
+START_TEST (thread_mainloop_submit_test) {
+    pa_threaded_mainloop *m;
+    pa_thread *threads[SUBMIT_THREADS];
+    pa_usec_t start;
+    unsigned i;
+
+    m = pa_threaded_mainloop_new();
+    fail_unless(m != NULL);
+    fail_unless(pa_threaded_mainloop_start(m) >= 0);
+    submit_mainloop = m;
+
+    pa_threaded_mainloop_lock(m);
+    submit_context = pa_context_new(pa_threaded_mainloop_get_api(m), "thread-mainloop-test");
+    fail_unless(submit_context != NULL);
+    pa_threaded_mainloop_unlock(m);
+
+    /* None of the producers takes the lock */
+    start = pa_rtclock_now();
+    for (i = 0; i < SUBMIT_THREADS; i++)
+        threads[i] = pa_thread_new("producer", producer_thread, PA_UINT_TO_PTR(i));
+
+    for (i = 0; i < SUBMIT_THREADS; i++)
+        pa_thread_free(threads[i]);
+
+    pa_threaded_mainloop_lock(m);
+
+    while (completed < SUBMIT_THREADS * SUBMIT_OPS)
+        pa_threaded_mainloop_wait(m);
+
+    fprintf(stderr, "%u submissions from %u threads completed in %0.1f ms\n",
+            completed, SUBMIT_THREADS, (double) (pa_rtclock_now() - start) / PA_USEC_PER_MSEC);
+
+    pa_context_unref(submit_context);
+    submit_context = NULL;
+
+    pa_threaded_mainloop_unlock(m);
+
+    pa_threaded_mainloop_stop(m);
+    pa_threaded_mainloop_free(m);
+    submit_mainloop = NULL;
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -102,6 +182,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Thread MainLoop");
     tc = tcase_create("threadmainloop");
     tcase_add_test(tc, thread_mainloop_test);
+    tcase_add_test(tc, thread_mainloop_submit_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
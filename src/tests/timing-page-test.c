@@ -0,0 +1,101 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulsecore/thread.h>
+#include <pulsecore/timing-page.h>
+
+#define N_UPDATES 200000
+
+static pa_timing_page page;
+static pa_atomic_t done = PA_ATOMIC_INIT(0);
+
+static void writer(void *userdata) {
+    pa_timing_page_data d;
+    unsigned i;
+
+    for (i = 1; i <= N_UPDATES; i++) {
+        d.flags = PA_TIMING_PAGE_VALID;
+        d.padding = 0;
+        d.timestamp = d.sink_usec = d.underrun_for = d.playing_for = i;
+        d.read_index = (int64_t) i;
+
+        pa_timing_page_write(&page, &d);
+    }
+
+    pa_atomic_store(&done, 1);
+}
+
+START_TEST (timing_page_test) {
+    pa_timing_page_data d;
+    pa_thread *t;
+    unsigned reads = 0;
+    uint64_t last = 0;
+
+    /* A page nobody wrote to yet reads as invalid */
+    fail_unless(pa_timing_page_read(&page, &d));
+    ck_assert_int_eq(d.flags, 0);
+
+    t = pa_thread_new("writer", writer, NULL);
+
+    while (!pa_atomic_load(&done)) {
+        if (!pa_timing_page_read(&page, &d))
+            continue;
+
+        reads++;
+
+        /* Never a mix of two updates, and never going back in time */
+        ck_assert_int_eq(d.sink_usec, d.timestamp);
+        ck_assert_int_eq(d.underrun_for, d.timestamp);
+        ck_assert_int_eq(d.playing_for, d.timestamp);
+        ck_assert_int_eq(d.read_index, (int64_t) d.timestamp);
+        fail_unless(d.timestamp >= last);
+        last = d.timestamp;
+    }
+
+    pa_thread_free(t);
+
+    fail_unless(pa_timing_page_read(&page, &d));
+    ck_assert_int_eq(d.flags, PA_TIMING_PAGE_VALID);
+    ck_assert_int_eq(d.timestamp, N_UPDATES);
+    fail_unless(reads > 0);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Timing page");
+    tc = tcase_create("timing-page");
+    tcase_add_test(tc, timing_page_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
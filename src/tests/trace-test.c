@@ -0,0 +1,157 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/trace.h>
+
+static char *read_trace(void) {
+    char fn[] = "/tmp/trace-test-XXXXXX";
+    char *data;
+    FILE *f;
+    long size;
+    int fd;
+
+    fail_unless((fd = mkstemp(fn)) >= 0);
+    close(fd);
+
+    fail_unless(pa_trace_dump(fn) == 0);
+
+    fail_unless((f = fopen(fn, "r")) != NULL);
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+
+    data = pa_xmalloc0((size_t) size + 1);
+    fail_unless(fread(data, 1, (size_t) size, f) == (size_t) size);
+
+    fclose(f);
+    unlink(fn);
+
+    return data;
+}
+
+static unsigned count(const char *data, const char *needle) {
+    unsigned n = 0;
+
+    while ((data = strstr(data, needle))) {
+        data += strlen(needle);
+        n++;
+    }
+
+    return n;
+}
+
+static void render_thread(void *userdata) {
+    unsigned i;
+
+    for (i = 0; i < PA_PTR_TO_UINT(userdata); i++) {
+        PA_TRACE_BEGIN(PA_TRACE_SINK_RENDER, 7, 1024);
+        PA_TRACE_END(PA_TRACE_SINK_RENDER, 7, 1024);
+    }
+
+    PA_TRACE_INSTANT(PA_TRACE_UNDERRUN, 7, 0);
+}
+
+START_TEST (trace_dump_test) {
+    pa_thread *t;
+    char *data;
+
+    /* Nothing is recorded while tracing is off */
+    pa_trace_stop();
+    PA_TRACE_INSTANT(PA_TRACE_POOL_FULL, 0, 64);
+
+    pa_trace_start();
+    t = pa_thread_new("render", render_thread, PA_UINT_TO_PTR(10));
+    pa_thread_free(t);
+
+    data = read_trace();
+
+    fail_unless(strncmp(data, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 39) == 0);
+    fail_unless(count(data, "\"args\":{\"name\":\"render\"}") == 1);
+    ck_assert_int_eq(count(data, "\"name\":\"sink-render\",\"ph\":\"B\""), 10);
+    ck_assert_int_eq(count(data, "\"name\":\"sink-render\",\"ph\":\"E\""), 10);
+    ck_assert_int_eq(count(data, "\"name\":\"underrun\",\"ph\":\"i\""), 1);
+    ck_assert_int_eq(count(data, "\"object\":7,\"value\":1024"), 20);
+    ck_assert_int_eq(count(data, "pool-full"), 0);
+
+    pa_xfree(data);
+
+    /* Everything was drained, and the ring of the exited thread is gone */
+    data = read_trace();
+    ck_assert_int_eq(count(data, "sink-render"), 0);
+    ck_assert_int_eq(count(data, "\"name\":\"render\""), 0);
+    pa_xfree(data);
+
+    pa_trace_stop();
+}
+END_TEST
+
+START_TEST (trace_overflow_test) {
+    pa_thread *t;
+    char *data;
+
+    pa_trace_start();
+
+    /* Far more than fits into a ring, only the newest records survive */
+    t = pa_thread_new("overflow", render_thread, PA_UINT_TO_PTR(10000));
+    pa_thread_free(t);
+
+    data = read_trace();
+    ck_assert_int_eq(count(data, "\"name\":\"sink-render\"") + count(data, "\"name\":\"underrun\""), 4096);
+    ck_assert_int_eq(count(data, "\"name\":\"underrun\""), 1);
+    pa_xfree(data);
+
+    pa_trace_stop();
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Trace");
+    tc = tcase_create("trace");
+    tcase_add_test(tc, trace_dump_test);
+    tcase_add_test(tc, trace_overflow_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,264 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+
+#include <pulsecore/macro.h>
+
+/* Hands out several memory areas with pa_stream_begin_write_buffer() on a
+ * corked playback stream, writes them out of order, partly and not at all,
+ * and checks the server's write index against what was written. */
+
+#define MAX_BUFFERS 8 /* PA_MAX_WRITE_BUFFERS */
+#define CHUNK_SIZE 4096
+
+static pa_threaded_mainloop *mainloop = NULL;
+static pa_context *context = NULL;
+static pa_stream *stream = NULL;
+
+static const pa_sample_spec sample_spec = {
+    .format = PA_SAMPLE_S16LE,
+    .rate = 44100,
+    .channels = 2
+};
+
+static void stream_state_callback(pa_stream *s, void *userdata) {
+    switch (pa_stream_get_state(s)) {
+        case PA_STREAM_READY:
+            pa_threaded_mainloop_signal(mainloop, 0);
+            break;
+
+        case PA_STREAM_FAILED:
+            fprintf(stderr, "Stream error: %s\n", pa_strerror(pa_context_errno(pa_stream_get_context(s))));
+            ck_abort();
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void context_state_callback(pa_context *c, void *userdata) {
+    switch (pa_context_get_state(c)) {
+        case PA_CONTEXT_READY:
+            pa_threaded_mainloop_signal(mainloop, 0);
+            break;
+
+        case PA_CONTEXT_FAILED:
+            fprintf(stderr, "Context error: %s\n", pa_strerror(pa_context_errno(c)));
+            ck_abort();
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void success_cb(pa_stream *s, int success, void *userdata) {
+    fail_unless(success);
+
+    *(bool *) userdata = true;
+    pa_threaded_mainloop_signal(mainloop, 0);
+}
+
+/* The write index the server reports, everything written so far has
+ * reached it by the time the reply comes in */
+static int64_t server_write_index(void) {
+    const pa_timing_info *ti;
+    pa_operation *o;
+    bool done = false;
+
+    o = pa_stream_update_timing_info(stream, success_cb, &done);
+    fail_unless(o != NULL);
+
+    while (!done)
+        pa_threaded_mainloop_wait(mainloop);
+
+    pa_operation_unref(o);
+
+    ti = pa_stream_get_timing_info(stream);
+    fail_unless(ti != NULL);
+    fail_unless(!ti->write_index_corrupt);
+
+    return ti->write_index;
+}
+
+/* Fills all free slots, returns how many were handed out */
+static unsigned begin_buffers(void **data, size_t *sizes, unsigned n_outstanding) {
+    unsigned i, n = 0;
+
+    for (i = 0; i < MAX_BUFFERS; i++) {
+        if (data[i])
+            continue;
+
+        sizes[i] = CHUNK_SIZE;
+        fail_unless(pa_stream_begin_write_buffer(stream, &data[i], &sizes[i]) == 0);
+        fail_unless(data[i] != NULL);
+        fail_unless(sizes[i] > 0 && sizes[i] <= CHUNK_SIZE);
+        fail_unless(sizes[i] % pa_frame_size(&sample_spec) == 0);
+
+        memset(data[i], (int) i + 1, sizes[i]);
+        n++;
+    }
+
+    fail_unless(n_outstanding + n == MAX_BUFFERS);
+
+    return n;
+}
+
+static size_t write_buffer(void **data, size_t *sizes, unsigned i, size_t length) {
+    fail_unless(data[i] != NULL);
+    fail_unless(length <= sizes[i]);
+
+    fail_unless(pa_stream_write(stream, data[i], length, NULL, 0, PA_SEEK_RELATIVE) == 0);
+    data[i] = NULL;
+
+    return length;
+}
+
+START_TEST (write_buffer_test) {
+    void *data[MAX_BUFFERS] = { NULL };
+    size_t sizes[MAX_BUFFERS];
+    void *extra, *last;
+    size_t extra_size, last_size;
+    int64_t start, written = 0;
+    unsigned i, j;
+    char outside[CHUNK_SIZE];
+
+    mainloop = pa_threaded_mainloop_new();
+    fail_unless(mainloop != NULL);
+
+    context = pa_context_new(pa_threaded_mainloop_get_api(mainloop), "write-buffer-test");
+    fail_unless(context != NULL);
+    pa_context_set_state_callback(context, context_state_callback, NULL);
+    fail_unless(pa_context_connect(context, NULL, 0, NULL) >= 0);
+
+    fail_unless(pa_threaded_mainloop_start(mainloop) == 0);
+    pa_threaded_mainloop_lock(mainloop);
+
+    while (pa_context_get_state(context) != PA_CONTEXT_READY)
+        pa_threaded_mainloop_wait(mainloop);
+
+    stream = pa_stream_new(context, "write buffers", &sample_spec, NULL);
+    fail_unless(stream != NULL);
+    pa_stream_set_state_callback(stream, stream_state_callback, NULL);
+    fail_unless(pa_stream_connect_playback(stream, NULL, NULL, PA_STREAM_START_CORKED, NULL, NULL) >= 0);
+
+    while (pa_stream_get_state(stream) != PA_STREAM_READY)
+        pa_threaded_mainloop_wait(mainloop);
+
+    start = server_write_index();
+
+    /* All areas are distinct, one more than the limit is refused */
+    begin_buffers(data, sizes, 0);
+
+    for (i = 0; i < MAX_BUFFERS; i++)
+        for (j = i + 1; j < MAX_BUFFERS; j++)
+            fail_unless(data[i] != data[j]);
+
+    extra_size = CHUNK_SIZE;
+    fail_unless(pa_stream_begin_write_buffer(stream, &extra, &extra_size) < 0);
+    fail_unless(pa_context_errno(context) == PA_ERR_BUSY);
+
+    /* pa_stream_begin_write() returns the area handed out last */
+    last_size = (size_t) -1;
+    fail_unless(pa_stream_begin_write(stream, &last, &last_size) == 0);
+    fail_unless(last == data[MAX_BUFFERS - 1]);
+
+    /* Only data within an outstanding area is accepted */
+    memset(outside, 0, sizeof(outside));
+    fail_unless(pa_stream_write(stream, outside, sizeof(outside), NULL, 0, PA_SEEK_RELATIVE) < 0);
+    fail_unless(pa_context_errno(context) == PA_ERR_INVALID);
+
+    /* Out of order, one of them only partly */
+    written += write_buffer(data, sizes, 3, sizes[3]);
+    written += write_buffer(data, sizes, 0, sizes[0]);
+    written += write_buffer(data, sizes, 7, sizes[7] / 2 / pa_frame_size(&sample_spec) * pa_frame_size(&sample_spec));
+    written += write_buffer(data, sizes, 5, sizes[5]);
+
+    fail_unless(server_write_index() - start == written);
+
+    /* The slots written are free again */
+    fail_unless(begin_buffers(data, sizes, MAX_BUFFERS - 4) == 4);
+    extra_size = CHUNK_SIZE;
+    fail_unless(pa_stream_begin_write_buffer(stream, &extra, &extra_size) < 0);
+    fail_unless(pa_context_errno(context) == PA_ERR_BUSY);
+
+    for (i = MAX_BUFFERS; i > 0; i -= 2)
+        written += write_buffer(data, sizes, i - 1, sizes[i - 1]);
+
+    /* Cancelling drops all areas still outstanding, none of it arrives */
+    fail_unless(pa_stream_cancel_write(stream) == 0);
+    memset(data, 0, sizeof(data));
+
+    fail_unless(pa_stream_cancel_write(stream) < 0);
+    fail_unless(pa_context_errno(context) == PA_ERR_BADSTATE);
+
+    fail_unless(server_write_index() - start == written);
+
+    /* Afterwards the full set can be handed out again */
+    begin_buffers(data, sizes, 0);
+    for (i = 0; i < MAX_BUFFERS; i++)
+        written += write_buffer(data, sizes, i, sizes[i]);
+
+    fail_unless(server_write_index() - start == written);
+
+    pa_stream_set_state_callback(stream, NULL, NULL);
+    pa_stream_disconnect(stream);
+    pa_stream_unref(stream);
+    stream = NULL;
+
+    pa_context_set_state_callback(context, NULL, NULL);
+    pa_context_disconnect(context);
+    pa_context_unref(context);
+    context = NULL;
+
+    pa_threaded_mainloop_unlock(mainloop);
+    pa_threaded_mainloop_stop(mainloop);
+    pa_threaded_mainloop_free(mainloop);
+    mainloop = NULL;
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Write Buffer");
+    tc = tcase_create("writebuffer");
+    tcase_add_test(tc, write_buffer_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -525,6 +525,53 @@ const char* pa_cvolume_to_json_object(const pa_cvolume *c, const pa_channel_map
     return pa_json_encoder_to_string_free(encoder);
 }
 
+static const char *stream_stage_to_string(pa_stream_stage_t stage) {
+    switch (stage) {
+    case PA_STREAM_STAGE_DATA: return "data";
+    case PA_STREAM_STAGE_RESAMPLE: return "resample";
+    case PA_STREAM_STAGE_VOLUME: return "volume";
+    default: return "unknown";
+    }
+}
+
+static char *stream_stages_to_json_object(const pa_stream_stage_info *stages) {
+    pa_json_encoder *encoder = pa_json_encoder_new();
+
+    pa_json_encoder_begin_element_object(encoder);
+    for (unsigned j = 0; j < PA_STREAM_STAGE_MAX; j++) {
+        pa_json_encoder_begin_member_object(encoder, stream_stage_to_string(j));
+        pa_json_encoder_add_member_int(encoder, "count", (int64_t) stages[j].count);
+        pa_json_encoder_add_member_int(encoder, "total_usec", (int64_t) stages[j].total_usec);
+        pa_json_encoder_add_member_int(encoder, "max_usec", (int64_t) stages[j].max_usec);
+        pa_json_encoder_add_member_int(encoder, "p99_usec", (int64_t) stages[j].p99_usec);
+        pa_json_encoder_end_object(encoder);
+    }
+    pa_json_encoder_end_object(encoder);
+
+    return pa_json_encoder_to_string_free(encoder);
+}
+
+static void print_stream_stages(const pa_stream_stage_info *stages) {
+    unsigned j;
+
+    /* Servers that don't account the processing time leave it all zero */
+    for (j = 0; j < PA_STREAM_STAGE_MAX; j++)
+        if (stages[j].count > 0)
+            break;
+
+    if (j >= PA_STREAM_STAGE_MAX)
+        return;
+
+    printf(_("\tProcessing:\n"));
+    for (j = 0; j < PA_STREAM_STAGE_MAX; j++)
+        printf(_("\t\t%s: %llu runs, total %llu usec, max %llu usec, p99 %llu usec\n"),
+               stream_stage_to_string(j),
+               (unsigned long long) stages[j].count,
+               (unsigned long long) stages[j].total_usec,
+               (unsigned long long) stages[j].max_usec,
+               (unsigned long long) stages[j].p99_usec);
+}
+
 static void pa_json_encoder_end_array_handler(const char *name) {
     pa_assert(json_encoder != NULL);
 
@@ -1278,7 +1325,7 @@ static void get_card_info_callback(pa_context *c, const pa_card_info *i, int is_
 
 static void get_sink_input_info_callback(pa_context *c, const pa_sink_input_info *i, int is_last, void *userdata) {
     char t[32], k[32], s[PA_SAMPLE_SPEC_SNPRINT_MAX], cv[PA_CVOLUME_SNPRINT_VERBOSE_MAX], cm[PA_CHANNEL_MAP_SNPRINT_MAX], f[PA_FORMAT_INFO_SNPRINT_MAX];
-    char *pl;
+    char *pl, *stages = NULL;
 
     if (format == JSON && json_encoder == NULL) {
         json_encoder = pa_json_encoder_new();
@@ -1355,6 +1402,7 @@ static void get_sink_input_info_callback(pa_context *c, const pa_sink_input_info
         pa_json_encoder_add_member_double(encoder, "buffer_latency_usec", (double) i->buffer_usec, 2);
         pa_json_encoder_add_member_double(encoder, "sink_latency_usec", (double) i->sink_usec, 2);
         pa_json_encoder_add_member_string(encoder, "resample_method", i->resample_method);
+        pa_json_encoder_add_member_raw_json(encoder, "processing", stages = stream_stages_to_json_object(i->stages));
         pa_json_encoder_add_member_raw_json(encoder, "properties", pl = pa_proplist_to_json_object(i->proplist));
         pa_json_encoder_end_object(encoder);
 
@@ -1394,14 +1442,17 @@ static void get_sink_input_info_callback(pa_context *c, const pa_sink_input_info
            (double) i->sink_usec,
            i->resample_method ? i->resample_method : _("n/a"),
            pl = pa_proplist_to_string_sep(i->proplist, "\n\t\t"));
+
+        print_stream_stages(i->stages);
     }
 
     pa_xfree(pl);
+    pa_xfree(stages);
 }
 
 static void get_source_output_info_callback(pa_context *c, const pa_source_output_info *i, int is_last, void *userdata) {
     char t[32], k[32], s[PA_SAMPLE_SPEC_SNPRINT_MAX], cv[PA_CVOLUME_SNPRINT_VERBOSE_MAX], cm[PA_CHANNEL_MAP_SNPRINT_MAX], f[PA_FORMAT_INFO_SNPRINT_MAX];
-    char *pl;
+    char *pl, *stages = NULL;
 
     if (format == JSON && json_encoder == NULL) {
         json_encoder = pa_json_encoder_new();
@@ -1478,6 +1529,7 @@ static void get_source_output_info_callback(pa_context *c, const pa_source_outpu
         pa_json_encoder_add_member_double(encoder, "buffer_latency_usec", (double) i->buffer_usec, 2);
         pa_json_encoder_add_member_double(encoder, "source_latency_usec", (double) i->source_usec, 2);
         pa_json_encoder_add_member_string(encoder, "resample_method", i->resample_method);
+        pa_json_encoder_add_member_raw_json(encoder, "processing", stages = stream_stages_to_json_object(i->stages));
         pa_json_encoder_add_member_raw_json(encoder, "properties", pl = pa_proplist_to_json_object(i->proplist));
         pa_json_encoder_end_object(encoder);
 
@@ -1517,9 +1569,12 @@ static void get_source_output_info_callback(pa_context *c, const pa_source_outpu
            (double) i->source_usec,
            i->resample_method ? i->resample_method : _("n/a"),
            pl = pa_proplist_to_string_sep(i->proplist, "\n\t\t"));
+
+        print_stream_stages(i->stages);
     }
 
     pa_xfree(pl);
+    pa_xfree(stages);
 }
 
 static void get_sample_info_callback(pa_context *c, const pa_sample_info *i, int is_last, void *userdata) {